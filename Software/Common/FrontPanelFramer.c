@@ -0,0 +1,419 @@
+/****************************************************************************
+Streaming front panel framer, shared by the firmware and the Windows tool
+(C) 2024 Jac Goudsmit
+Licensed under the MIT license.
+See LICENSE for details.
+****************************************************************************/
+
+
+/////////////////////////////////////////////////////////////////////////////
+// INCLUDES
+/////////////////////////////////////////////////////////////////////////////
+
+
+#include <string.h>
+
+#include "FrontPanelFramer.h"
+
+
+/////////////////////////////////////////////////////////////////////////////
+// MACROS
+/////////////////////////////////////////////////////////////////////////////
+
+
+// Phases
+#define PHASE_NONE 0                    // Waiting for a command
+#define PHASE_COMMAND 1                 // Receiving a command
+#define PHASE_RESPONSE 2                // Receiving a response
+
+// Number of idle pairs that are counted one at a time before the rest of
+// the run is skipped a word at a time. The gaps between a command and its
+// response are usually shorter than this.
+#define SHORT_IDLE 8
+
+
+/////////////////////////////////////////////////////////////////////////////
+// LOCAL FUNCTIONS
+/////////////////////////////////////////////////////////////////////////////
+
+
+//---------------------------------------------------------------------------
+// Store a byte of the current command or response
+static void Store(
+  FrontPanelFramerState *pstate,        // Framer state
+  uint8_t b)                            // Byte to store
+{
+  FrontPanelFrame *pframe = &pstate->frame;
+
+  pstate->checksum += b;
+
+  if (pframe->len < FRONTPANELFRAME_MAX)
+  {
+    pframe->buf[pframe->len++] = b;
+  }
+  else
+  {
+    pframe->flags |= FRONTPANELFRAME_OVERFLOW;
+  }
+}
+
+
+//---------------------------------------------------------------------------
+// Store a run of bytes of the current command or response
+//
+// The bytes of one line are stored until that line is idle, or until the
+// other line (if given) isn't idle. The length and checksum are kept in
+// local variables, otherwise they would have to be loaded and stored for
+// each byte: as far as the compiler knows, a byte that's stored in the
+// buffer could be any variable.
+static size_t                           // Returns number of bytes stored
+StoreRun(
+  FrontPanelFramerState *pstate,        // Framer state
+  const uint8_t *src,                   // Line with the bytes to store
+  const uint8_t *other,                 // Other line; NULL=don't care
+  size_t len)                           // Number of pairs available, >0
+{
+  FrontPanelFrame *pframe = &pstate->frame;
+  uint8_t checksum = pstate->checksum;
+  unsigned stored = pframe->len;
+  size_t n = 0;
+
+  do
+  {
+    uint8_t b = src[n];
+
+    checksum += b;
+
+    if (stored < FRONTPANELFRAME_MAX)
+    {
+      pframe->buf[stored++] = b;
+    }
+    else
+    {
+      pframe->flags |= FRONTPANELFRAME_OVERFLOW;
+    }
+
+    n++;
+  } while ((n < len) && (src[n] != 0xFF) && ((!other) || (other[n] == 0xFF)));
+
+  pstate->checksum = checksum;
+  pframe->len = (uint8_t)stored;
+
+  return n;
+}
+
+
+//---------------------------------------------------------------------------
+// Find the first pair in which either line isn't idle
+static size_t                           // Returns index; len=all idle
+FindNotIdle(
+  const uint8_t *cmd,                   // Command line bytes
+  const uint8_t *rsp,                   // Response line bytes
+  size_t len)                           // Number of byte pairs
+{
+  size_t i = 0;
+
+  // The words are copied because the bytes may not be aligned
+  for (; i + sizeof(size_t) <= len; i += sizeof(size_t))
+  {
+    size_t c;
+    size_t r;
+
+    memcpy(&c, cmd + i, sizeof(c));
+    memcpy(&r, rsp + i, sizeof(r));
+
+    if ((c & r) != (size_t)-1)
+    {
+      break;
+    }
+  }
+
+  while ((i < len) && ((cmd[i] & rsp[i]) == 0xFF))
+  {
+    i++;
+  }
+
+  return i;
+}
+
+
+//---------------------------------------------------------------------------
+// Store the idle bytes that turned out to be data
+//
+// This is used when more data arrives in the same direction.
+static void StoreIdle(
+  FrontPanelFramerState *pstate)        // Framer state
+{
+  for (; pstate->idle; pstate->idle--)
+  {
+    Store(pstate, 0xFF);
+  }
+}
+
+
+//---------------------------------------------------------------------------
+// End the current command or response
+//
+// The checksum tells how many of the idle bytes at the end were data:
+// each 0xFF subtracts 1 from the sum, and the sum must end up as 0xFF.
+static void EndPart(
+  FrontPanelFramerState *pstate,        // Framer state
+  uint8_t okflag)                       // Flag to set if checksum correct
+{
+  uint8_t needed = (uint8_t)(pstate->checksum + 1);
+
+  if (needed <= pstate->idle)
+  {
+    pstate->idle = needed;
+    StoreIdle(pstate);
+
+    pstate->frame.flags |= okflag;
+  }
+
+  pstate->idle = 0;
+  pstate->checksum = 0;
+}
+
+
+//---------------------------------------------------------------------------
+// Finish the frame
+static void EndFrame(
+  FrontPanelFramerState *pstate)        // Framer state
+{
+  FrontPanelFrame *pframe = &pstate->frame;
+
+  EndPart(pstate, FRONTPANELFRAME_RSP_OK);
+
+  if (pframe->rsp)
+  {
+    uint8_t toggle = pframe->buf[0] & 0x80;
+
+    if (toggle)
+    {
+      pframe->flags |= FRONTPANELFRAME_TOGGLE;
+    }
+
+    if ((pstate->toggle != 0xFF) && (toggle != pstate->toggle))
+    {
+      pframe->flags |= FRONTPANELFRAME_TOGGLE_OK;
+    }
+
+    pstate->toggle = toggle;
+    pframe->buf[0] &= 0x7F;
+  }
+
+  if (pframe->rsp < pframe->len)
+  {
+    if (pframe->buf[pframe->rsp] & 0x80)
+    {
+      pframe->flags |= FRONTPANELFRAME_RSP_TOGGLE;
+    }
+
+    pframe->buf[pframe->rsp] &= 0x7F;
+  }
+
+  pstate->phase = PHASE_NONE;
+  pstate->complete = true;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// PUBLIC FUNCTIONS
+/////////////////////////////////////////////////////////////////////////////
+
+
+//---------------------------------------------------------------------------
+// Initialize or reset a framer
+void FrontPanelFramer_Init(
+  FrontPanelFramerState *pstate)        // Framer state
+{
+  pstate->frame.len = 0;
+  pstate->frame.rsp = 0;
+  pstate->frame.flags = 0;
+  pstate->frame.start = 0;
+  pstate->frame.rspstart = 0;
+  pstate->pos = 0;
+  pstate->idle = 0;
+  pstate->checksum = 0;
+  pstate->phase = PHASE_NONE;
+  pstate->toggle = 0xFF;
+  pstate->complete = false;
+}
+
+
+//---------------------------------------------------------------------------
+// Feed byte pairs to the framer
+size_t                                  // Returns number of pairs used
+FrontPanelFramer_Put(
+  FrontPanelFramerState *pstate,        // Framer state
+  const uint8_t *cmd,                   // Command line bytes
+  const uint8_t *rsp,                   // Response line bytes
+  size_t len,                           // Number of byte pairs
+  bool *pcomplete)                      // Output true=frame complete
+{
+  FrontPanelFrame *pframe = &pstate->frame;
+
+  if (pstate->complete)
+  {
+    // The caller is done with the previous frame
+    pframe->len = 0;
+    pframe->rsp = 0;
+    pframe->flags = 0;
+    pstate->complete = false;
+  }
+
+  *pcomplete = false;
+
+  for (size_t i = 0; i < len; i++)
+  {
+    uint8_t c = cmd[i];
+    uint8_t r = rsp[i];
+
+    if (c != 0xFF)
+    {
+      switch (pstate->phase)
+      {
+      case PHASE_RESPONSE:
+        // This is the start of the next frame; leave it for the next call
+        EndFrame(pstate);
+        pstate->pos += (uint32_t)i;
+        *pcomplete = true;
+        return i;
+
+      case PHASE_NONE:
+        // Idle bytes before the command aren't part of any frame
+        pstate->idle = 0;
+        pstate->phase = PHASE_COMMAND;
+        pframe->start = pstate->pos + (uint32_t)i;
+        break;
+
+      default:
+        StoreIdle(pstate);
+      }
+
+      // The rest of the command usually follows without idle bytes
+      i += StoreRun(pstate, cmd + i, NULL, len - i) - 1;
+    }
+    else if ((r != 0xFF) && ((r != 0xEE) || (pstate->phase == PHASE_RESPONSE)))
+    {
+      if (pstate->phase != PHASE_RESPONSE)
+      {
+        // If the command wasn't seen, the frame has only a response
+        if (pstate->phase == PHASE_COMMAND)
+        {
+          EndPart(pstate, FRONTPANELFRAME_CMD_OK);
+        }
+        else
+        {
+          pframe->start = pstate->pos + (uint32_t)i;
+        }
+
+        pstate->idle = 0;
+        pstate->phase = PHASE_RESPONSE;
+        pframe->rsp = pframe->len;
+        pframe->rspstart = pstate->pos + (uint32_t)i;
+      }
+      else
+      {
+        StoreIdle(pstate);
+      }
+
+      // Same for the rest of the response
+      i += StoreRun(pstate, rsp + i, cmd + i, len - i) - 1;
+    }
+    else if ((c & r) == 0xFF)
+    {
+      // Both lines are idle; so are the pairs that follow, up to the next
+      // byte on either line. Short gaps are counted here, the rest of a
+      // long one is skipped a word at a time.
+      size_t n = 1;
+
+      while ((n < SHORT_IDLE) && (i + n < len) && ((cmd[i + n] & rsp[i + n]) == 0xFF))
+      {
+        n++;
+      }
+
+      if ((n == SHORT_IDLE) && (i + n < len))
+      {
+        n += FindNotIdle(cmd + i + n, rsp + i + n, len - i - n);
+      }
+
+      if (pstate->phase != PHASE_NONE)
+      {
+        pstate->idle += (uint32_t)n;
+      }
+
+      i += n - 1;
+    }
+    else if (pstate->phase != PHASE_NONE)
+    {
+      // 0xEE before the response
+      pstate->idle++;
+    }
+  }
+
+  pstate->pos += (uint32_t)len;
+
+  if (pstate->phase == PHASE_NONE)
+  {
+    pframe->start = pstate->pos;
+  }
+
+  return len;
+}
+
+
+//---------------------------------------------------------------------------
+// End the current frame without waiting for the next command
+bool                                    // Returns true=frame complete
+FrontPanelFramer_Flush(
+  FrontPanelFramerState *pstate)        // Framer state
+{
+  if (pstate->complete)
+  {
+    return false;
+  }
+
+  if (pstate->phase != PHASE_RESPONSE)
+  {
+    // An incomplete command is useless without its response
+    pstate->frame.len = 0;
+    pstate->frame.flags = 0;
+    pstate->frame.start = pstate->pos;
+    pstate->idle = 0;
+    pstate->checksum = 0;
+    pstate->phase = PHASE_NONE;
+
+    return false;
+  }
+
+  EndFrame(pstate);
+
+  return true;
+}
+
+
+//---------------------------------------------------------------------------
+// Check the checksum of a command or response
+bool                                    // Returns true=checksum correct
+FrontPanelFramer_ChecksumOK(
+  const uint8_t *buf,                   // Command or response
+  size_t len)                           // Number of bytes
+{
+  uint8_t sum = 0;
+  size_t idle = 0;
+
+  for (size_t i = 0; i < len; i++)
+  {
+    sum += buf[i];
+    idle = (buf[i] == 0xFF) ? idle + 1 : 0;
+  }
+
+  // Each trailing 0xFF that's left out adds 1 to the sum
+  return (len != 0) && ((uint8_t)(0xFF - sum) <= idle);
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// END
+/////////////////////////////////////////////////////////////////////////////
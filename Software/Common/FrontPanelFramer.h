@@ -0,0 +1,239 @@
+/****************************************************************************
+Streaming front panel framer, shared by the firmware and the Windows tool
+(C) 2024 Jac Goudsmit
+Licensed under the MIT license.
+See LICENSE for details.
+****************************************************************************/
+
+/*
+  The front panel bus has two data lines: the command line (from the front
+  panel) and the response line (from the dig-mcu). They're sampled with
+  the same clock, so they're fed to the framer as pairs of bytes. A line
+  that isn't sending reads as 0xFF.
+
+  The direction is derived from which line is active:
+  - A byte that isn't 0xFF on the command line is a command byte. If a
+    response was already being received, that ends the previous frame.
+  - Otherwise, a byte that isn't 0xFF on the response line is a response
+    byte. Before a response starts, 0xEE on the response line is also
+    regarded as idle.
+  - When both lines read 0xFF, it's not known yet whether that's a data
+    byte or an idle byte. That's decided when the command or response
+    ends: all bytes of a command or response, including the checksum at
+    the end, add up to 0xFF, so the number of 0xFF bytes that belong to
+    the data follows from the checksum. If no number of them works, the
+    checksum is wrong.
+
+  The first byte of each command and response has the most significant
+  bit set in every other frame. The framer clears that bit and reports it
+  in the frame flags, along with whether it toggled as expected. See
+  FrontPanelSequence.h for what can be learned from it.
+
+  Data is accepted in spans of any length, and the framer stops at the
+  end of each frame, so the caller can process it before continuing with
+  the rest of the span. No memory is allocated, so this works the same in
+  the firmware and on the PC. The core is plain C; for C++ there's a
+  wrapper class at the end.
+
+  The framer counts the byte pairs, and each frame has the positions of
+  its command and its response, so the caller can find the time stamps of
+  the bytes, or the bytes themselves if it keeps them.
+
+  Most of the pairs are idle on both lines, and they don't change anything
+  except the number of idle bytes, so long runs of them are skipped by
+  comparing a word at a time.
+*/
+
+
+#pragma once
+
+
+/////////////////////////////////////////////////////////////////////////////
+// INCLUDES
+/////////////////////////////////////////////////////////////////////////////
+
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+
+/////////////////////////////////////////////////////////////////////////////
+// MACROS
+/////////////////////////////////////////////////////////////////////////////
+
+
+#define FRONTPANELFRAME_MAX 255         // Max bytes stored per frame
+
+// Frame flags
+#define FRONTPANELFRAME_CMD_OK     0x01  // Command checksum is correct
+#define FRONTPANELFRAME_RSP_OK     0x02  // Response checksum is correct
+#define FRONTPANELFRAME_TOGGLE     0x04  // MSB of first command byte was set
+#define FRONTPANELFRAME_TOGGLE_OK  0x08  // MSB differs from previous frame
+#define FRONTPANELFRAME_OVERFLOW   0x10  // Frame too long, end is missing
+#define FRONTPANELFRAME_RSP_TOGGLE 0x20  // MSB of first response byte was set
+
+// Frame is valid if it has all of these flags
+#define FRONTPANELFRAME_VALID (FRONTPANELFRAME_CMD_OK | FRONTPANELFRAME_RSP_OK)
+
+
+/////////////////////////////////////////////////////////////////////////////
+// TYPES
+/////////////////////////////////////////////////////////////////////////////
+
+
+//---------------------------------------------------------------------------
+// Frame: one command and its response
+//
+// The checksums are included at the end of the command and the response.
+// The positions count the byte pairs since the framer was initialized,
+// and wrap around at 2^32. The command and the response each take up as
+// many pairs as they have bytes, from their first position on (unless the
+// frame overflowed). While no frame is being received, start is the
+// position of the next pair.
+typedef struct
+{
+  uint8_t     buf[FRONTPANELFRAME_MAX]; // Command followed by response
+  uint8_t     len;                      // Total number of bytes stored
+  uint8_t     rsp;                      // Index of first response byte
+  uint8_t     flags;                    // See FRONTPANELFRAME_... above
+  uint32_t    start;                    // Position of first byte
+  uint32_t    rspstart;                 // Position of first response byte
+} FrontPanelFrame;
+
+
+//---------------------------------------------------------------------------
+// Framer state
+typedef struct
+{
+  FrontPanelFrame frame;                // Frame being received
+  uint32_t    pos;                      // Position of the next pair
+  uint32_t    idle;                     // Pairs of 0xFF not assigned yet
+  uint8_t     checksum;                 // Sum of current command/response
+  uint8_t     phase;                    // Part that's being received
+  uint8_t     toggle;                   // MSB of previous frame, 0xFF=none
+  bool        complete;                 // Frame is complete
+} FrontPanelFramerState;
+
+
+/////////////////////////////////////////////////////////////////////////////
+// PUBLIC FUNCTIONS
+/////////////////////////////////////////////////////////////////////////////
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+//---------------------------------------------------------------------------
+// Initialize or reset a framer
+void FrontPanelFramer_Init(
+  FrontPanelFramerState *pstate);       // Framer state
+
+
+//---------------------------------------------------------------------------
+// Feed byte pairs to the framer
+//
+// This stops after the last byte of a frame, which is when the first byte
+// of the next command arrives; that byte isn't used until the next call.
+// When a frame is complete, it's available in pstate->frame until the
+// next call.
+size_t                                  // Returns number of pairs used
+FrontPanelFramer_Put(
+  FrontPanelFramerState *pstate,        // Framer state
+  const uint8_t *cmd,                   // Command line bytes
+  const uint8_t *rsp,                   // Response line bytes
+  size_t len,                           // Number of byte pairs
+  bool *pcomplete);                     // Output true=frame complete
+
+
+//---------------------------------------------------------------------------
+// End the current frame without waiting for the next command
+//
+// This is used at the end of the data, or when nothing was received for
+// a while. A frame is only produced if the response has started.
+bool                                    // Returns true=frame complete
+FrontPanelFramer_Flush(
+  FrontPanelFramerState *pstate);       // Framer state
+
+
+//---------------------------------------------------------------------------
+// Check the checksum of a command or response
+//
+// Any trailing 0xFF bytes may be idle bytes instead of data; the checksum
+// is correct if leaving some of them out makes it match.
+bool                                    // Returns true=checksum correct
+FrontPanelFramer_ChecksumOK(
+  const uint8_t *buf,                   // Command or response
+  size_t len);                          // Number of bytes
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+/////////////////////////////////////////////////////////////////////////////
+// C++ WRAPPER
+/////////////////////////////////////////////////////////////////////////////
+
+
+#ifdef __cplusplus
+class FrontPanelFramer
+{
+protected:
+  FrontPanelFramerState m_state;        // Framer state
+
+public:
+  //-------------------------------------------------------------------------
+  // Constructor
+  FrontPanelFramer()
+  {
+    FrontPanelFramer_Init(&m_state);
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Reset to the initial state
+  void Reset()
+  {
+    FrontPanelFramer_Init(&m_state);
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Feed byte pairs to the framer
+  size_t                                // Returns number of pairs used
+  Put(
+    const uint8_t *cmd,                 // Command line bytes
+    const uint8_t *rsp,                 // Response line bytes
+    size_t len,                         // Number of byte pairs
+    bool *pcomplete)                    // Output true=frame complete
+  {
+    return FrontPanelFramer_Put(&m_state, cmd, rsp, len, pcomplete);
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // End the current frame without waiting for the next command
+  bool                                  // Returns true=frame complete
+  Flush()
+  {
+    return FrontPanelFramer_Flush(&m_state);
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Get the last completed frame
+  const FrontPanelFrame &Frame() const
+  {
+    return m_state.frame;
+  }
+};
+#endif
+
+
+/////////////////////////////////////////////////////////////////////////////
+// END
+/////////////////////////////////////////////////////////////////////////////
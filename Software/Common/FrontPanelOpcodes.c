@@ -0,0 +1,462 @@
+/****************************************************************************
+Front panel opcode descriptors, shared by the firmware and the Windows tool
+(C) 2024 Jac Goudsmit
+Licensed under the MIT license.
+See LICENSE for details.
+****************************************************************************/
+
+
+/////////////////////////////////////////////////////////////////////////////
+// INCLUDES
+/////////////////////////////////////////////////////////////////////////////
+
+
+#include <string.h>
+
+#include "FrontPanelOpcodes.h"
+
+
+/////////////////////////////////////////////////////////////////////////////
+// DATA
+/////////////////////////////////////////////////////////////////////////////
+
+
+//---------------------------------------------------------------------------
+// Keys and remote control (0x10)
+//
+// These numbers correspond to the numbers shown on the front panel during
+// the Key Test program of the Service Mode. The numbers in the comments of
+// the remote control codes are the codes shown in the service manual for
+// the key test program. "PAUSE" and "COUNTER RESET" and "WRITE MARK" on
+// the remote control don't show up.
+static const FrontPanelValue keys[] =
+{
+  { 0x01, "SIDE A/B" },
+  { 0x02, "OPEN/CLOSE" },
+  { 0x03, "EDIT" },
+  { 0x04, "REC/PAUSE" },
+  { 0x05, "STOP" },
+  { 0x06, "REPEAT" },
+  { 0x07, "DOLBY" },
+  { 0x08, "SCROLL" },
+  { 0x09, "RECLEVEL-" },
+  { 0x0A, "APPEND" },
+  { 0x0B, "PLAY" },
+  { 0x0C, "PRESETS" },
+  { 0x0D, "TIME" },
+  { 0x0E, "TEXT" },
+  { 0x0F, "RECLEVEL+" },
+  { 0x10, "RECORD" },
+  { 0x11, "NEXT" },
+  { 0x12, "PREV" },
+
+  { 0x1C, "RC FFWD" },                  // 052?
+  { 0x1D, "RC OPEN/CLOSE" },            // 045
+  { 0x1F, "RC REWIND" },                // 050?
+  { 0x20, "RC 0" },                     // 000
+  { 0x21, "RC 1" },                     // 001
+  { 0x22, "RC 2" },                     // 002
+  { 0x23, "RC 3" },                     // 003
+  { 0x24, "RC 4" },                     // 004
+  { 0x25, "RC 5" },                     // 005
+  { 0x26, "RC 6" },                     // 006
+  { 0x27, "RC 7" },                     // 007
+  { 0x28, "RC 8" },                     // 008
+  { 0x29, "RC 9" },                     // 009
+  { 0x2C, "RC STANDBY" },               // 012
+  // I couldn't reproduce the following codes from the service manual
+  // with my Logitech Harmony universal remote control. I may verify
+  // these later.
+  // 011 TIME
+  // 047 SIDE A/B
+  // 028 REPEAT
+  // 054 STOP
+  // 053 PLAY
+  // 040 REC SELECT/PAUSE
+  // 117 APPEND
+  // 055 RECORD
+  // 121 EDIT
+  // 103 REC LEVEL -
+  // 102 REC LEVEL +
+  // 015 SCROLL/DEMO
+  // 122 TEXT
+  // 063 DCC
+  { 0, NULL }
+};
+
+
+//---------------------------------------------------------------------------
+// Repeat modes (0x23)
+static const FrontPanelValue repeatmodes[] =
+{
+  { 1, "None" },
+  { 2, "Track" },
+  { 3, "All" },
+  { 0, NULL }
+};
+
+
+//---------------------------------------------------------------------------
+// Text kinds for setting text (0x36)
+static const FrontPanelValue settextkinds[] =
+{
+  { 0xFD, "DECKID=" },                  // Sent at init time to store deck ID
+  { 0xFA, "TITLE=" },                   // Sent when editing title of song
+  { 0, NULL }
+};
+
+
+//---------------------------------------------------------------------------
+// Time modes (0x38)
+//
+// For [super] user tapes, the display has a VU mode too: press TIME enough
+// times and it will only send TIME but no time mode command. For ACC's a
+// counter will appear in one of the modes, this also doesn't issue a time
+// mode command.
+static const FrontPanelValue timemodes[] =
+{
+  { 1, "TOTAL TIME" },                  // prerec/dcc/acc
+  { 2, "TOT REM TIME" },                // prerec
+  { 3, "TRACK TIME" },                  // prerec/sudcc
+  { 5, "REM TIME" },                    // non-prerecorded
+  { 0, NULL }
+};
+
+
+//---------------------------------------------------------------------------
+// System status (0x44)
+//
+// 0x0D is seen when pushing A/B on the remote just after pushing
+// open/close twice in quick succession; there's no text on the screen.
+// 0x1A is seen while playing a DCC175 recorded tape in service mode.
+static const FrontPanelValue systemstatus[] =
+{
+  { 0x06, "CHECK DIG IN" },
+  { 0x10, "CLEAN HEADS" },
+  { 0x1F, "POWER FAIL" },
+  { 0, NULL }
+};
+
+
+//---------------------------------------------------------------------------
+// Drawer status (0x46)
+static const FrontPanelValue drawerstatus[] =
+{
+  { 1, "Closed" },
+  { 2, "Open" },
+  { 3, "Closing" },
+  { 4, "Opening" },
+  { 5, "Blocked" },
+  { 6, "Unknown" },
+  { 0, NULL }
+};
+
+
+//---------------------------------------------------------------------------
+// Tape types (0x49)
+//
+// Meanings of bits:
+//  0x01: No cassette
+//  0x02: Chrome
+//  0x04: DCC
+//  0x08: Recording Allowed
+//  0x10: Length Hole "3" (45/75/105/Undefined)
+//  0x20: Length Hole "4" (45/60/105/120)
+//  0x40: Length Hole "5" (45/60/75/90)
+// Length can be ("5"/"4"/"3"):
+//  45  minutes  (1/1/1)
+//  60  minutes  (1/1/0)
+//  75  minutes  (1/0/1)
+//  90  minutes  (1/0/0)
+//  105 minutes  (0/1/1)
+//  120 minutes  (0/1/0)
+//  Undefined    (0/0/1) Reserved
+//  Undefined    (0/0/0) Also used for prerecorded DCC
+// The numbers in the comments correspond to the decimal numbers that are
+// shown by the "Switches Test" program in Service Mode.
+static const FrontPanelValue tapetypes[] =
+{
+  { 0x00, "ACC FERRO" },                // 000
+  { 0x02, "ACC CHROME" },               // 002
+  { 0x04, "PDCC" },                     // 004
+  { 0x14, "UDCC(PROT)" },               // 020
+  { 0x1C, "UDCC" },                     // 028
+  { 0x24, "DCC120(PROT)" },             // 036
+  { 0x2C, "DCC120" },                   // 044
+  { 0x34, "DCC105(PROT)" },             // 052
+  { 0x3C, "DCC105" },                   // 060
+  { 0x44, "DCC90(PROT)" },              // 068
+  { 0x4C, "DCC90" },                    // 076
+  { 0x54, "DCC75(PROT)" },              // 084
+  { 0x5C, "DCC75" },                    // 092
+  { 0x64, "DCC60(PROT)" },              // 100
+  { 0x6C, "DCC60" },                    // 108
+  { 0x74, "DCC45(PROT)" },              // 116
+  { 0x7B, "NO CASSETTE" },              // 123
+  { 0x7C, "DCC45" },                    // 124
+  { 0, NULL }
+};
+
+
+//---------------------------------------------------------------------------
+// Text kinds for getting long text (0x51)
+static const FrontPanelValue longtextkinds[] =
+{
+  { 0xFA, "Track" },                    // Get track name?
+  { 0xE0, "TOC track name" },           // Not sure; used when rewinding
+                                        //  sudcc to beginning, but
+                                        //  returns error
+  { 0x01, "Lyrics / Album Title" },     // Language number for lyrics?
+  { 0x03, "Artist" },                   // Album artist on PDCC
+  { 0, NULL }
+};
+
+
+//---------------------------------------------------------------------------
+// Text kinds for getting short text (0x53)
+//
+// Other codes are probably the same as for long text.
+static const FrontPanelValue shorttextkinds[] =
+{
+  { 0xFA, "Track" },                    // Get track name
+  { 0, NULL }
+};
+
+
+//---------------------------------------------------------------------------
+// Marker types (0x57)
+static const FrontPanelValue markertypes[] =
+{
+  { 0x02, "TRACK" },
+  { 0x03, "REVERSE" },                  // Switch to side B
+  { 0x07, "SKIP +1" },                  // Skip marker? Also seen at
+                                        //  beginning of 175-recorded tape
+  { 0x0B, "REUSE" },                    // End of recording, beginning of
+                                        //  reusable tape
+  { 0x0D, "INTRO SKIP" },               // Skip over begin of sector 1
+  { 0x14, "BEGIN SEC" },                // After reversing
+  { 0, NULL }
+};
+
+
+//---------------------------------------------------------------------------
+// Function states (0x58)
+//
+// Not decoded yet: 0x22, 0x23, 0x24 and 0x26 are all used when recording
+// a title; 0x19, 0x0E, 0x32 and 0x34 are seen during APPEND; 0x2B might be
+// REC/PAUSE.
+static const FrontPanelValue functionstates[] =
+{
+  { 0x01, "OFF " },                     // Stand by
+  { 0x02, "STOP" },                     // Stop
+  { 0x03, "READ" },                     // Reading
+  { 0x04, "PLAY" },                     // Play
+  { 0x0A, "FFWD" },                     // FFWD (sector)
+  { 0x0B, "REWD" },                     // Rewind (sector)
+  { 0x11, "NEXT" },                     // Search forwards
+  { 0x12, "PREV" },                     // Search backwards
+  { 0x15, "SBY<" },                     // Search arriving at track
+  { 0x16, "SBY>" },                     // Search arriving at track
+  { 0x2A, "END " },                     // End of recording marker found
+  { 0x30, "SKIP" },                     // Skipping intro
+  { 0, NULL }
+};
+
+
+//---------------------------------------------------------------------------
+// Opcode descriptors
+//
+// The designated initializers make the compiler generate the entries
+// that aren't listed (i.e. the unknown opcodes) as all zeroes.
+//
+// Opcodes that are seen but not understood yet:
+//   0x29: Rec/pause?
+//   0x35: 35 18 42 10 seen for REC/PAUSE. Configure inputs perhaps?
+//   0x5B: Set something (at search time). cmdlen=2 rsplen=4
+#define OP(opcode, name, cmdlen, rsplen, decode, flags, values) \
+  [FRONTPANEL_##opcode] = { name, cmdlen, rsplen, FRONTPANEL_DECODE_##decode, flags, values }
+
+const FrontPanelOpcode FrontPanelOpcodes[FRONTPANEL_NUM_OPCODES] =
+{
+  OP(DECK_STOP,         "DECK: STOP",              1,  1, NONE,      0, NULL),
+  OP(DECK_PLAY,         "DECK: PLAY",              1,  1, NONE,      0, NULL),
+  OP(DECK_FFWD,         "DECK: FFWD",              1,  1, NONE,      0, NULL),
+  OP(DECK_REWIND,       "DECK: REWIND",            1,  1, NONE,      0, NULL),
+  OP(DECK_CLOSE,        "DECK: CLOSE",             1,  1, NONE,      0, NULL),
+  OP(DECK_OPEN,         "DECK: OPEN",              1,  1, NONE,      0, NULL),
+
+  // Key or remote command. These are ignored by the dig MCU
+  OP(KEY,               "KEY/RC: ",                2,  1, CMDVALUE,  0, keys),
+
+  OP(REPEAT_MODE,       "REPEAT MODE: ",           2,  1, CMDVALUE,  0, repeatmodes),
+
+  // Sector. This is issued after the 10 01 (SIDE A/B) command.
+  // Presumably the sector can be 1 to 4 inclusive but without 4-sector
+  // tapes, we won't know...
+  OP(SECTOR,            "SECTOR: ",                2,  1, CMDNUMBER, 0, NULL),
+
+  // Go to track (pdcc only?)
+  OP(GO_TO_TRACK,       "GO TO TRACK: ",           3,  1, CUSTOM,    0, NULL),
+
+  OP(SET_TEXT,          "SET TEXT: ",             42,  1, CMDTEXT,   0, settextkinds),
+
+  // Search relative from current track
+  OP(SEARCH,            "DECK: SEARCH: ",          3,  1, CUSTOM,    0, NULL),
+
+  // Time mode. This is issued after the TIME command (10 0D)
+  OP(TIME_MODE,         "TIME MODE: ",             2,  1, CMDVALUE,  0, timemodes),
+
+  // Read DCC. This is issued after inserting a DCC cassette.
+  OP(READ_DCC,          "READ DCC.",               1,  1, NONE,      0, NULL),
+
+  // Write DCC. This is issued after setting the text for the current track
+  OP(WRITE_DCC,         "WRITE DCC.",              1,  1, NONE,      0, NULL),
+
+  // Poll status. This is generated often and is very chatty.
+  OP(POLL,              "POLL -> ",                1,  4, CUSTOM,
+    FRONTPANEL_ANYSTATUS | FRONTPANEL_OWNPREFIX, NULL),
+
+  OP(SYSTEM_STATUS,     "GET SYSTEM STATUS -> ",   1,  2, RSPVALUE,
+    FRONTPANEL_HEXFALLBACK, systemstatus),
+
+  OP(DRAWER_STATUS,     "GET DRAWER STATUS -> ",   1,  2, RSPVALUE,  0, drawerstatus),
+
+  // Get tape type? This is issued right after the drawer finishes closing
+  OP(TAPE_TYPE,         "TAPE TYPE -> ",           1,  2, CUSTOM,
+    FRONTPANEL_HEXFALLBACK, tapetypes),
+
+  OP(LONG_TEXT,         "GET LONG TEXT: ",         2, 41, RSPTEXT,   0, longtextkinds),
+  OP(TRACK_TITLE,       "GET TRACK TITLE: ",       2, 41, TRACKTEXT, 0, NULL),
+  OP(SHORT_TEXT,        "GET SHORT TEXT -> ",      2, 13, RSPTEXT,   0, shorttextkinds),
+  OP(SHORT_TRACK_TITLE, "GET SHORT TRACK TITLE: ", 2, 13, TRACKTEXT, 0, NULL),
+
+  // Get DDU2113 ID. Issued at startup before sending the front panel ID
+  OP(DDU_ID,            "Get DDU ID -> ",          1,  5, RSPHEX,    0, NULL),
+
+  OP(MARKER_TYPE,       "MARKER TYPE -> ",         1,  2, RSPVALUE,
+    FRONTPANEL_HEXFALLBACK, markertypes),
+
+  // Get Function State. This is apparently used to update the symbols
+  // on the front panel display
+  OP(FUNCTION_STATE,    "FUNCTION STATE -> ",      1,  2, RSPVALUE,
+    FRONTPANEL_HEXFALLBACK, functionstates),
+
+  // Get Target Track number
+  // This is the positive or negative number that's shown in the track
+  // display during search. It also gets polled when playing past a
+  // marker.
+  OP(TARGET_TRACK,      "GET TARGET TRACK -> ",    1,  2, RSPNUMBER, 0, NULL),
+
+  // VU meters, 2 bytes between 00-5F. 5F (95 decimal) is silence.
+  // Values are negative decibels for left and right.
+  OP(VU,                "VU -> ",                  1,  3, CUSTOM,
+    FRONTPANEL_OWNPREFIX, NULL),
+
+  // Service mode playback error reporting.
+  // The command parameter byte indicates the requested track (1-9)
+  // or is set to 0x10 to request a bit pattern of all the (main) heads.
+  // The bit order is: head 1=0x80, head 2=0x40, head 3=0x20 etc.
+  // The first byte of the response is always 0 (so the AUX track is
+  // not part of the result for more 0x10).
+  // The second response byte is between 0 and 20 decimal for individual
+  // heads. According to the service manual, the individual head error
+  // counts can basically be multiplied by 5 to get the percentage of
+  // errors.
+  OP(BIT_ERRORS,        "BITS ",                   2,  2, CUSTOM,    0, NULL),
+
+  // Get Time (and state?) from deck controller. All values in BCD, big
+  // endian.
+  // byte 0=error 00=ok
+  // byte 1=status, 8=play?
+  // byte 2=track
+  // byte 3/4/5=time in BCD, hh/mm/ss. Negative is indicated in hours-byte
+  // byte 6=?
+  // byte 7/8=tape counter, 0-9999
+  // byte 9=?
+  OP(DECK_STATE,        "Time -> ",                1, 10, CUSTOM,
+    FRONTPANEL_ANYSTATUS | FRONTPANEL_OWNPREFIX, NULL),
+
+  // Get tape info for prerecorded tape
+  OP(PREREC_INFO,       "PREREC TAPE INFO -> ",    1,  6, CUSTOM,    0, NULL),
+};
+
+#undef OP
+
+
+/////////////////////////////////////////////////////////////////////////////
+// PUBLIC FUNCTIONS
+/////////////////////////////////////////////////////////////////////////////
+
+
+//---------------------------------------------------------------------------
+// Get the name of an opcode for a table
+const char *                            // Returns name; "" if unknown
+FrontPanel_OpcodeName(
+  uint8_t cmd0,                         // First command byte
+  int *plen)                            // Output length without punctuation
+{
+  const char *name = FrontPanel_Opcode(cmd0)->name;
+  int len;
+
+  if (!name)
+  {
+    name = "";
+  }
+
+  len = (int)strlen(name);
+
+  // Leave the punctuation off the end of the name
+  while ((len) && (strchr(" :->", name[len - 1])))
+  {
+    len--;
+  }
+
+  *plen = len;
+
+  return name;
+}
+
+
+//---------------------------------------------------------------------------
+// Check if a message has the expected lengths and status
+bool                                    // Returns true=as expected
+FrontPanel_Check(
+  const FrontPanelOpcode *op,           // Descriptor
+  size_t cmdlen,                        // Command length without checksum
+  const uint8_t *rsp,                   // Response
+  size_t rsplen)                        // Response length without checksum
+{
+  return (op->name)
+    && (cmdlen == op->cmdlen)
+    && (rsplen == op->rsplen)
+    && ((op->flags & FRONTPANEL_ANYSTATUS) || (rsp[0] == 0));
+}
+
+
+//---------------------------------------------------------------------------
+// Get the name of a parameter value
+const char *                            // Returns name; NULL=unknown
+FrontPanel_ValueName(
+  const FrontPanelOpcode *op,           // Descriptor
+  uint8_t value)                        // Value
+{
+  const FrontPanelValue *v = op->values;
+
+  if (v)
+  {
+    for (; v->name; v++)
+    {
+      if (v->value == value)
+      {
+        return v->name;
+      }
+    }
+  }
+
+  return NULL;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// END
+/////////////////////////////////////////////////////////////////////////////
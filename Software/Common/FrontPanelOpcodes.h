@@ -0,0 +1,202 @@
+/****************************************************************************
+Front panel opcode descriptors, shared by the firmware and the Windows tool
+(C) 2024 Jac Goudsmit
+Licensed under the MIT license.
+See LICENSE for details.
+****************************************************************************/
+
+/*
+  Everything that's known about each front panel command is in one table:
+  the name, the expected lengths of the command and the response, and how
+  the parameters are decoded. The table has an entry for each of the 128
+  possible opcodes (the most significant bit of the first byte is the
+  toggle bit, not part of the opcode), so finding the descriptor of a
+  message is a single indexed lookup. Unknown opcodes have no name.
+
+  The table is constant data that's generated entirely by the compiler,
+  so in the firmware it stays in flash.
+
+  Lengths don't include the checksums. Unless the FRONTPANEL_ANYSTATUS
+  flag is set, the first byte of the response must be 0 (no error).
+*/
+
+
+#pragma once
+
+
+/////////////////////////////////////////////////////////////////////////////
+// INCLUDES
+/////////////////////////////////////////////////////////////////////////////
+
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+
+/////////////////////////////////////////////////////////////////////////////
+// MACROS
+/////////////////////////////////////////////////////////////////////////////
+
+
+#define FRONTPANEL_NUM_OPCODES 128      // Number of possible opcodes
+
+// Descriptor flags
+#define FRONTPANEL_HEXFALLBACK 0x01     // Unknown values shown as hex
+#define FRONTPANEL_ANYSTATUS   0x02     // First response byte not checked
+#define FRONTPANEL_OWNPREFIX   0x04     // Front end shows name if it wants
+
+
+/////////////////////////////////////////////////////////////////////////////
+// TYPES
+/////////////////////////////////////////////////////////////////////////////
+
+
+//---------------------------------------------------------------------------
+// Opcodes
+enum
+{
+  FRONTPANEL_DECK_STOP = 0x02,
+  FRONTPANEL_DECK_PLAY = 0x03,
+  FRONTPANEL_DECK_FFWD = 0x05,
+  FRONTPANEL_DECK_REWIND = 0x06,
+  FRONTPANEL_DECK_CLOSE = 0x0B,
+  FRONTPANEL_DECK_OPEN = 0x0C,
+  FRONTPANEL_KEY = 0x10,
+  FRONTPANEL_REPEAT_MODE = 0x23,
+  FRONTPANEL_SECTOR = 0x2A,
+  FRONTPANEL_GO_TO_TRACK = 0x2F,
+  FRONTPANEL_SET_TEXT = 0x36,
+  FRONTPANEL_SEARCH = 0x37,
+  FRONTPANEL_TIME_MODE = 0x38,
+  FRONTPANEL_READ_DCC = 0x39,
+  FRONTPANEL_WRITE_DCC = 0x3C,
+  FRONTPANEL_POLL = 0x41,
+  FRONTPANEL_SYSTEM_STATUS = 0x44,
+  FRONTPANEL_DRAWER_STATUS = 0x46,
+  FRONTPANEL_TAPE_TYPE = 0x49,
+  FRONTPANEL_LONG_TEXT = 0x51,
+  FRONTPANEL_TRACK_TITLE = 0x52,
+  FRONTPANEL_SHORT_TEXT = 0x53,
+  FRONTPANEL_SHORT_TRACK_TITLE = 0x54,
+  FRONTPANEL_DDU_ID = 0x55,
+  FRONTPANEL_MARKER_TYPE = 0x57,
+  FRONTPANEL_FUNCTION_STATE = 0x58,
+  FRONTPANEL_TARGET_TRACK = 0x5D,
+  FRONTPANEL_VU = 0x5E,
+  FRONTPANEL_BIT_ERRORS = 0x5F,
+  FRONTPANEL_DECK_STATE = 0x60,
+  FRONTPANEL_PREREC_INFO = 0x61,
+};
+
+
+//---------------------------------------------------------------------------
+// How the parameters are decoded
+enum
+{
+  FRONTPANEL_DECODE_NONE,               // No parameters
+  FRONTPANEL_DECODE_CMDVALUE,           // Name of cmd[1]
+  FRONTPANEL_DECODE_RSPVALUE,           // Name of rsp[1]
+  FRONTPANEL_DECODE_CMDNUMBER,          // cmd[1] as decimal number
+  FRONTPANEL_DECODE_RSPNUMBER,          // rsp[1] as decimal number
+  FRONTPANEL_DECODE_RSPHEX,             // Response data as hex
+  FRONTPANEL_DECODE_CMDTEXT,            // Name of cmd[1], text in cmd[2..]
+  FRONTPANEL_DECODE_RSPTEXT,            // Name of cmd[1], text in rsp[1..]
+  FRONTPANEL_DECODE_TRACKTEXT,          // Track in cmd[1], text in rsp[1..]
+  FRONTPANEL_DECODE_CUSTOM,             // Decoded by the front end
+};
+
+
+//---------------------------------------------------------------------------
+// Name of a parameter value
+//
+// Lists of these end with a NULL name.
+typedef struct
+{
+  uint8_t     value;                    // Value
+  const char *name;                     // Name
+} FrontPanelValue;
+
+
+//---------------------------------------------------------------------------
+// Opcode descriptor
+typedef struct
+{
+  const char *name;                     // Name; NULL=unknown opcode
+  uint8_t     cmdlen;                   // Expected command length
+  uint8_t     rsplen;                   // Expected response length
+  uint8_t     decode;                   // FRONTPANEL_DECODE_...
+  uint8_t     flags;                    // FRONTPANEL_... flags
+  const FrontPanelValue *values;        // Value names; NULL=none
+} FrontPanelOpcode;
+
+
+/////////////////////////////////////////////////////////////////////////////
+// DATA
+/////////////////////////////////////////////////////////////////////////////
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+// Descriptors, indexed by opcode
+extern const FrontPanelOpcode FrontPanelOpcodes[FRONTPANEL_NUM_OPCODES];
+
+
+/////////////////////////////////////////////////////////////////////////////
+// PUBLIC FUNCTIONS
+/////////////////////////////////////////////////////////////////////////////
+
+
+//---------------------------------------------------------------------------
+// Get the descriptor for the first byte of a command
+//
+// The toggle bit is ignored.
+static inline const FrontPanelOpcode *  // Returns descriptor
+FrontPanel_Opcode(
+  uint8_t cmd0)                         // First command byte
+{
+  return &FrontPanelOpcodes[cmd0 & 0x7F];
+}
+
+
+//---------------------------------------------------------------------------
+// Get the name of an opcode for a table
+//
+// The names end with punctuation for the dump (e.g. "Time -> "); the
+// returned length leaves that off. The name isn't terminated at that
+// length, so print it with "%.*s".
+const char *                            // Returns name; "" if unknown
+FrontPanel_OpcodeName(
+  uint8_t cmd0,                         // First command byte
+  int *plen);                           // Output length without punctuation
+
+
+//---------------------------------------------------------------------------
+// Check if a message has the expected lengths and status
+bool                                    // Returns true=as expected
+FrontPanel_Check(
+  const FrontPanelOpcode *op,           // Descriptor
+  size_t cmdlen,                        // Command length without checksum
+  const uint8_t *rsp,                   // Response
+  size_t rsplen);                       // Response length without checksum
+
+
+//---------------------------------------------------------------------------
+// Get the name of a parameter value
+const char *                            // Returns name; NULL=unknown
+FrontPanel_ValueName(
+  const FrontPanelOpcode *op,           // Descriptor
+  uint8_t value);                       // Value
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+/////////////////////////////////////////////////////////////////////////////
+// END
+/////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,110 @@
+/****************************************************************************
+Front panel message sequence tracking, shared by the firmware and the
+Windows tool
+(C) 2024 Jac Goudsmit
+Licensed under the MIT license.
+See LICENSE for details.
+****************************************************************************/
+
+
+/////////////////////////////////////////////////////////////////////////////
+// INCLUDES
+/////////////////////////////////////////////////////////////////////////////
+
+
+#include <string.h>
+
+#include "FrontPanelSequence.h"
+
+
+/////////////////////////////////////////////////////////////////////////////
+// PUBLIC FUNCTIONS
+/////////////////////////////////////////////////////////////////////////////
+
+
+//---------------------------------------------------------------------------
+// Initialize a sequence checker, and clear the counters
+void FrontPanelSeq_Init(
+  FrontPanelSeqState *pstate)           // Sequence state
+{
+  memset(pstate, 0, sizeof(*pstate));
+
+  FrontPanelSeq_Restart(pstate);
+}
+
+
+//---------------------------------------------------------------------------
+// Forget the previous message, but keep the counters
+void FrontPanelSeq_Restart(
+  FrontPanelSeqState *pstate)           // Sequence state
+{
+  pstate->toggle = 0xFF;
+  pstate->cmdlen = 0;
+}
+
+
+//---------------------------------------------------------------------------
+// Check the toggle bits of a message, and count what went wrong
+uint8_t                                 // Returns FRONTPANELSEQ_... flags
+FrontPanelSeq_Check(
+  FrontPanelSeqState *pstate,           // Sequence state
+  const uint8_t *cmd,                   // Command
+  size_t cmdlen,                        // Number of bytes in command
+  bool cmdtoggle,                       // Toggle bit of command
+  bool rsptoggle)                       // Toggle bit of response; same as
+                                        //  cmdtoggle if there's none
+{
+  uint8_t result = 0;
+
+  if (!cmdlen)
+  {
+    return 0;
+  }
+
+  // Leave the checksum out
+  if (cmdlen > 1)
+  {
+    cmdlen--;
+  }
+
+  if (cmdlen > FRONTPANELSEQ_MAX_CMD)
+  {
+    cmdlen = FRONTPANELSEQ_MAX_CMD;
+  }
+
+  pstate->messages++;
+
+  if (pstate->toggle == (uint8_t)cmdtoggle)
+  {
+    if ((cmdlen == pstate->cmdlen)
+      && ((cmd[0] & 0x7F) == pstate->cmd[0])
+      && (!memcmp(cmd + 1, pstate->cmd + 1, cmdlen - 1)))
+    {
+      pstate->retried++;
+      result |= FRONTPANELSEQ_RETRY;
+    }
+    else
+    {
+      pstate->missed++;
+      result |= FRONTPANELSEQ_MISSED;
+    }
+  }
+
+  if (rsptoggle != cmdtoggle)
+  {
+    pstate->mismatched++;
+    result |= FRONTPANELSEQ_MISMATCH;
+  }
+
+  pstate->toggle = (uint8_t)cmdtoggle;
+  pstate->cmdlen = (uint8_t)cmdlen;
+  memcpy(pstate->cmd, cmd, cmdlen);
+  pstate->cmd[0] &= 0x7F;
+
+  return result;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// END
+/////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,128 @@
+/****************************************************************************
+Front panel message sequence tracking, shared by the firmware and the
+Windows tool
+(C) 2024 Jac Goudsmit
+Licensed under the MIT license.
+See LICENSE for details.
+****************************************************************************/
+
+/*
+  The most significant bit of the first command byte is set in every other
+  message, and the first byte of the response has the same bit as the
+  command. The deck controller protocol does the same. This is probably
+  how each side makes sure that it's not working with stale data, but it
+  also works as a 1-bit sequence number for whoever is listening in.
+
+  - If the bit toggled since the previous message, everything is fine (or
+    an even number of messages went missing, which can't be detected).
+  - If the bit didn't toggle and the command is the same as the previous
+    one, the command was sent again; this is counted as a retry. If the
+    capture missed an odd number of identical messages (e.g. polls), it
+    looks the same.
+  - If the bit didn't toggle and the command is different, at least one
+    message was missed by the capture.
+  - If the bit of the response is different from the bit of the command,
+    the response doesn't belong to the command.
+
+  The checker only needs the toggle bits and the command bytes, so it
+  works with the raw data as well as with frames where the framer has
+  already cleared the bits (see FRONTPANELFRAME_TOGGLE and
+  FRONTPANELFRAME_RSP_TOGGLE). No memory is allocated.
+*/
+
+
+#pragma once
+
+
+/////////////////////////////////////////////////////////////////////////////
+// INCLUDES
+/////////////////////////////////////////////////////////////////////////////
+
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+
+/////////////////////////////////////////////////////////////////////////////
+// MACROS
+/////////////////////////////////////////////////////////////////////////////
+
+
+// Number of command bytes that are compared to recognize a retry
+#define FRONTPANELSEQ_MAX_CMD 16
+
+// Result flags
+#define FRONTPANELSEQ_RETRY     0x01    // Same toggle and command: sent again
+#define FRONTPANELSEQ_MISSED    0x02    // Same toggle, other command: missed
+#define FRONTPANELSEQ_MISMATCH  0x04    // Response toggle differs from command
+
+
+/////////////////////////////////////////////////////////////////////////////
+// TYPES
+/////////////////////////////////////////////////////////////////////////////
+
+
+//---------------------------------------------------------------------------
+// Sequence state of one bus
+typedef struct
+{
+  uint8_t     toggle;                   // Previous command toggle, 0xFF=none
+  uint8_t     cmdlen;                   // Bytes stored in cmd
+  uint8_t     cmd[FRONTPANELSEQ_MAX_CMD]; // Previous command, no toggle bit
+  uint32_t    messages;                 // Messages checked
+  uint32_t    retried;                  // Messages that were sent again
+  uint32_t    missed;                   // Messages missed (at least)
+  uint32_t    mismatched;               // Responses with the wrong toggle
+} FrontPanelSeqState;
+
+
+/////////////////////////////////////////////////////////////////////////////
+// PUBLIC FUNCTIONS
+/////////////////////////////////////////////////////////////////////////////
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+//---------------------------------------------------------------------------
+// Initialize a sequence checker, and clear the counters
+void FrontPanelSeq_Init(
+  FrontPanelSeqState *pstate);          // Sequence state
+
+
+//---------------------------------------------------------------------------
+// Forget the previous message, but keep the counters
+//
+// This is used when the data is known to be interrupted, e.g. when the
+// lines were realigned, so that doesn't count as a missed message.
+void FrontPanelSeq_Restart(
+  FrontPanelSeqState *pstate);          // Sequence state
+
+
+//---------------------------------------------------------------------------
+// Check the toggle bits of a message, and count what went wrong
+//
+// The command includes the checksum; the checksum isn't compared because
+// it depends on the toggle bit. The toggle bit of the first command byte
+// is ignored.
+uint8_t                                 // Returns FRONTPANELSEQ_... flags
+FrontPanelSeq_Check(
+  FrontPanelSeqState *pstate,           // Sequence state
+  const uint8_t *cmd,                   // Command
+  size_t cmdlen,                        // Number of bytes in command
+  bool cmdtoggle,                       // Toggle bit of command
+  bool rsptoggle);                      // Toggle bit of response; same as
+                                        //  cmdtoggle if there's none
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+/////////////////////////////////////////////////////////////////////////////
+// END
+/////////////////////////////////////////////////////////////////////////////
@@ -14,6 +14,10 @@
 #include <string.h>
 #include <stdio.h>
 
+#include "../../../Common/FrontPanelFramer.h"
+#include "../../../Common/FrontPanelOpcodes.h"
+#include "../../../Common/FrontPanelSequence.h"
+
 /*
   This program is intended to reverse-engineer the data that goes over the
   bus between the front panel and the digital board microcontroller of the
@@ -324,703 +328,396 @@ void hexdumpbuf(
 }
 
 //---------------------------------------------------------------------------
-// Parse a buffer
-void dumpfrontpanelmessage(
-  uint8_t *cmd,
-  uint8_t cmdlen,
-  uint8_t *rsp,
-  uint8_t rsplen)
+// Print the name of a parameter value
+//
+// Unknown values are printed in hex if the descriptor says so.
+bool printvalue(                       // Returns false=unknown value
+  const FrontPanelOpcode *op,
+  uint8_t value)
 {
-  switch(*cmd)
-  {
-// Shortcuts
-#define P(name) printf("%02X %s", cmd[0], name)
-#define QCR(name, wantedcmdlen, wantedrsplen) do { P(name); if ((cmdlen != wantedcmdlen) || (rsplen != wantedrsplen) || (rsp[0] != 0)) goto dump; } while(0)
-#define QC(name, wantedcmdlen) QCR(name, wantedcmdlen, 1) // Command with parameters, no return data
-#define QR(name, wantedrsplen) QCR(name, 1, wantedrsplen) // Command without parameters, has return data
-#define Q(name) QCR(name, 1, 1); do { fputs("\r\n", stdout); return; } while(0) // Command with no parameters, no return data
-
-  case 0x02: Q("DECK: STOP");
-  case 0x03: Q("DECK: PLAY");
-  case 0x05: Q("DECK: FFWD");
-  case 0x06: Q("DECK: REWIND");
-  case 0x0B: Q("DECK: CLOSE");
-  case 0x0C: Q("DECK: OPEN");
-    
-  case 0x10:
-    // Key or remote command. These are ignored by the dig MCU
-    QC("KEY/RC: ", 2);
-
-    switch (cmd[1])
-    {
-    // Note: These numbers correspond to the numbers shown on the front
-    // panel during the Key Test program of the Service Mode
-    case 0x01: printf("SIDE A/B\r\n");      return;
-    case 0x02: printf("OPEN/CLOSE\r\n");    return;
-    case 0x03: printf("EDIT\r\n");          return;
-    case 0x04: printf("REC/PAUSE\r\n");     return;
-    case 0x05: printf("STOP\r\n");          return;
-    case 0x06: printf("REPEAT\r\n");        return;
-    case 0x07: printf("DOLBY\r\n");         return;
-    case 0x08: printf("SCROLL\r\n");        return;
-    case 0x09: printf("RECLEVEL-\r\n");     return;
-    case 0x0A: printf("APPEND\r\n");        return;
-    case 0x0B: printf("PLAY\r\n");          return;
-    case 0x0C: printf("PRESETS\r\n");       return;
-    case 0x0D: printf("TIME\r\n");          return;
-    case 0x0E: printf("TEXT\r\n");          return;
-    case 0x0F: printf("RECLEVEL+\r\n");     return;
-    case 0x10: printf("RECORD\r\n");        return;
-    case 0x11: printf("NEXT\r\n");          return;
-    case 0x12: printf("PREV\r\n");          return;
-
-    // Remote control
-    // "PAUSE" and "COUNTER RESET" and "WRITE MARK" don't show up
-    //
-    // NOTE: Numbers in comments are the codes shown in the service manual
-    // for the key test program
-    case 0x1C: printf("RC FFWD\r\n");       return; // 052?
-    case 0x1D: printf("RC OPEN/CLOSE\r\n"); return; // 045
-    case 0x1F: printf("RC REWIND\r\n");     return; // 050?
-    case 0x20: printf("RC 0\r\n");          return; // 000
-    case 0x21: printf("RC 1\r\n");          return; // 001
-    case 0x22: printf("RC 2\r\n");          return; // 002
-    case 0x23: printf("RC 3\r\n");          return; // 003
-    case 0x24: printf("RC 4\r\n");          return; // 004
-    case 0x25: printf("RC 5\r\n");          return; // 005
-    case 0x26: printf("RC 6\r\n");          return; // 006
-    case 0x27: printf("RC 7\r\n");          return; // 007
-    case 0x28: printf("RC 8\r\n");          return; // 008
-    case 0x29: printf("RC 9\r\n");          return; // 009
-    case 0x2C: printf("RC STANDBY\r\n");    return; // 012
-    // I couldn't reproduce the following codes from the service manual
-    // with my Logitech Harmony universal remote control. I may verify
-    // these later.
-                                                  // 011 TIME
-                                                  // 047 SIDE A/B
-                                                  // 028 REPEAT
-                                                  // 054 STOP
-                                                  // 053 PLAY
-                                                  // 040 REC SELECT/PAUSE
-                                                  // 117 APPEND
-                                                  // 055 RECORD
-                                                  // 121 EDIT
-                                                  // 103 REC LEVEL -
-                                                  // 102 REC LEVEL +
-                                                  // 015 SCROLL/DEMO
-                                                  // 122 TEXT
-                                                  // 063 DCC
-    default:
-      ; // Nothing
-    }
-
-    break;
-
-  case 0x23:
-    // Set repeat mode
-    QC("REPEAT MODE: ", 2);
-
-    switch(cmd[1])
-    {
-    case 1: printf("None\r\n");    return;
-    case 2: printf("Track\r\n");   return;
-    case 3: printf("All\r\n");     return;
-    default:
-      ; // Nothing
-    }
-
-    break;
+  const char *name = FrontPanel_ValueName(op, value);
 
-  case 0x29:
-    // Rec/pause?
-    break;
-    
-  case 0x2A:
-    // Sector. This is issued after the 10 01 (SIDE A/B) command.
-    // Presumably the sector can be 1 to 4 inclusive but without 4-sector
-    // tapes, we won't know...
-    QC("SECTOR: ", 2);
-
-    printf("%u\r\n", cmd[1]);
+  if (name)
+  {
+    printf("%s\r\n", name);
+  }
+  else if (op->flags & FRONTPANEL_HEXFALLBACK)
+  {
+    printf("%02X\r\n", value);
+  }
+  else
+  {
+    return false;
+  }
 
-    return;
+  return true;
+}
 
-  case 0x2F:
-    // Go to track (pdcc only?)
-    QC("GO TO TRACK: ", 3);
 
+//---------------------------------------------------------------------------
+// Print the parameters of messages that need special treatment
+bool printcustom(                      // Returns false=not understood
+  const FrontPanelOpcode *op,
+  uint8_t *cmd,
+  uint8_t *rsp,
+  uint8_t rsplen)
+{
+  switch (cmd[0])
+  {
+  case FRONTPANEL_GO_TO_TRACK:
     printf("To=%u, [2]=%u\r\n", cmd[1], cmd[2]);
 
-    return;
-
-  case 0x35:
-    // 35 18 42 10 seen for REC/PAUSE. Configure inputs perhaps?
-    break;
-
-  case 0x36:
-    // Send text
-    QC("SET TEXT: ", 42);
-
-    switch(cmd[1])
-    {
-    case 0xFD: printf("DECKID="); break;  // Sent at initialization time to store deck ID
-    case 0xFA: printf("TITLE=");  break;  // Sent when editing title of current song
-    default:
-      printf("%02X ", cmd[1]);
-    }
-
-    printstring(cmd + 2, cmd + cmdlen);
-    fputs("\r\n", stdout);
-
-    return;
-
-  case 0x37:
-    // Search relative from current track.
-    QC("DECK: SEARCH: ", 3);
+    return true;
 
+  case FRONTPANEL_SEARCH:
     printhex(rsp + 1, rsp + 3);
     fputs("\r\n", stdout);
 
-    return;
-/*
-    // What the second parameter byte means is not clear, seems to be always 1
-    if (rsp[1] < 100)
-    {
-      // You can search forwards by 1-99 tracks
-      printf("+%u [%02X]\r\n", rsp[1], rsp[2]);
-      return;
-    }
-    else // if?...
-    {
-      // Searching backwards it uses EE=-0, ED=-1 etc. Weird.
-      printf("-%u [%02X]\r\n", 0xEE - rsp[1], rsp[2]);
-      return;
-    }
-
-    break;
-*/
-
-  case 0x38:
-    // Time mode. This is issued after the TIME command (10 0D)
-    // Note: for [super] user tapes, the display has a VU mode too:
-    // Press TIME enough times and it will only send TIME but no time mode
-    // command.
-    // For ACC's a counter will appear in one of the modes, this also
-    // doesn't issue a time mode command.
-    QC("TIME MODE: ", 2);
-
-    switch(cmd[1])
-    {
-    case 1: printf("TOTAL TIME\r\n");     return; // prerec/dcc/acc
-    case 2: printf("TOT REM TIME\r\n");   return; // prerec
-    case 3: printf("TRACK TIME\r\n");     return; // prerec/sudcc
-
-    case 5: printf("REM TIME\r\n");       return; // non-prerecorded
-    default:
-      ; // Nothing
-    }
-
-    break;
-
-  case 0x39:
-    // Read DCC. This is issued after inserting a DCC cassette.
-    Q("READ DCC.");
-
-  case 0x3C:
-    // Write DCC. This is issued after setting the text for the current track
-    Q("WRITE DCC.");
-
-  case 0x41:
-    // Poll status
-    // This is generated often and is very chatty.
-    // We cache it and only show it when it changes.
-    {
-      static uint8_t status[4] = {0};
-
-      if ((cmdlen == 1) && (rsplen == sizeof(status)))
-      {
-        if ( ( status[0] !=          rsp[0])
-          || ((status[1] & 0xF9) != (rsp[1] & 0xF9)) // Those bits change too often while running. Tachos?
-          || ( status[2] !=          rsp[2])
-          || ( status[3] !=          rsp[3]))
+    return true;
+    /*
+        // What the second parameter byte means is not clear, seems to be always 1
+        if (rsp[1] < 100)
         {
-          P("POLL -> from=");
-          printhex(status, status + sizeof(status));
-          fputs("to=", stdout);
-          printhex(rsp, rsp + rsplen);
-
-          // Interpret bits
-          if (rsp[1] & 0x01) fputs("SYSTEM ",     stdout); // System (issue Get System State)
-          //if (rsp[1] & 0x02) fputs("(A2) ",       stdout); // ignored; toggles too fast.
-          //if (rsp[1] & 0x04) fputs("(A4) ",       stdout); // ignored; toggles too fast
-          if (rsp[1] & 0x08) fputs("FUNCTION ",   stdout); // Function change? (issue Get Function State)
-          if (rsp[1] & 0x10) fputs("DRAWER ",     stdout); // Drawer change (issue Get Drawer State)
-          if (rsp[1] & 0x20) fputs("EOT ",        stdout); // End of Tape (sector)
-          if (rsp[1] & 0x40) fputs("BOT ",        stdout); // Beginning of Tape (sector)
-          if (rsp[1] & 0x80) fputs("FAST ",       stdout); // Winding/rewinding without heads applied; time is deck time?
-
-          if (rsp[2] & 0x01) fputs("LYRICS ",     stdout); // Lyrics (issue Get DCC Long Text)
-          if (rsp[2] & 0x02) fputs("MARKER ",     stdout); // Marker change (issue Get Marker)
-          if (rsp[2] & 0x04) fputs("(B4) ",       stdout);
-          if (rsp[2] & 0x08) fputs("(B8) ",       stdout);
-          if (rsp[2] & 0x10) fputs("(B10) ",      stdout);
-          if (rsp[2] & 0x20) fputs("TRACK ",      stdout); // Track info available? Seen when playing past track marker
-          if (rsp[2] & 0x40) fputs("ABSTIME ",    stdout); // Absolute time known (SUDCC/PDCC)?
-          if (rsp[2] & 0x80) fputs("TOTALTIME ",  stdout); // Total time known on PDCC? FP issues PREREC TAPE TIME
-
-          if (rsp[3] & 0x80) fputs("DECKTIME ",   stdout); // No absolute tape time, using deck time?
-          if (rsp[3] & 0x40) fputs("TAPETIME ",   stdout); // Using tape time code
-          printf("Sector=%u\r\n", rsp[3] & 3);
-
-          memcpy(status, rsp, sizeof(status));
+          // You can search forwards by 1-99 tracks
+          printf("+%u [%02X]\r\n", rsp[1], rsp[2]);
+          return;
         }
-        else
+        else // if?...
         {
-          // Nothing changed; don't print anything
+          // Searching backwards it uses EE=-0, ED=-1 etc. Weird.
+          printf("-%u [%02X]\r\n", 0xEE - rsp[1], rsp[2]);
+          return;
         }
 
-        return;
-      }
-    }
-    break;
+        break;
+    */
 
-  case 0x44:
-    QR("GET SYSTEM STATUS -> ", 2);
-
-    switch(rsp[1])
-    {
-    case 0x06: printf("CHECK DIG IN\r\n");  return;
-    case 0x10: printf("CLEAN HEADS\r\n");   return;
-    case 0x1F: printf("POWER FAIL\r\n");    return;
-
-    case 0x0D: // Seen when pushing A/B on remote just after pushing open/close twice in quick succession. No text on screen.
-    case 0x1A: // Seen while playing DCC175 recorded tape in service mode
-    default:
-      printf("%02X\r\n", rsp[1]);           return;
+  case FRONTPANEL_POLL:
+    // We cache the status and only show it when it changes.
+  {
+    static uint8_t status[4] = { 0 };
+
+    if ((status[0] != rsp[0])
+      || ((status[1] & 0xF9) != (rsp[1] & 0xF9)) // Those bits change too often while running. Tachos?
+      || (status[2] != rsp[2])
+      || (status[3] != rsp[3]))
+    {
+      printf("%02X %sfrom=", cmd[0], op->name);
+      printhex(status, status + sizeof(status));
+      fputs("to=", stdout);
+      printhex(rsp, rsp + rsplen);
+
+      // Interpret bits
+      if (rsp[1] & 0x01) fputs("SYSTEM ", stdout); // System (issue Get System State)
+      //if (rsp[1] & 0x02) fputs("(A2) ",       stdout); // ignored; toggles too fast.
+      //if (rsp[1] & 0x04) fputs("(A4) ",       stdout); // ignored; toggles too fast
+      if (rsp[1] & 0x08) fputs("FUNCTION ", stdout); // Function change? (issue Get Function State)
+      if (rsp[1] & 0x10) fputs("DRAWER ", stdout); // Drawer change (issue Get Drawer State)
+      if (rsp[1] & 0x20) fputs("EOT ", stdout); // End of Tape (sector)
+      if (rsp[1] & 0x40) fputs("BOT ", stdout); // Beginning of Tape (sector)
+      if (rsp[1] & 0x80) fputs("FAST ", stdout); // Winding/rewinding without heads applied; time is deck time?
+
+      if (rsp[2] & 0x01) fputs("LYRICS ", stdout); // Lyrics (issue Get DCC Long Text)
+      if (rsp[2] & 0x02) fputs("MARKER ", stdout); // Marker change (issue Get Marker)
+      if (rsp[2] & 0x04) fputs("(B4) ", stdout);
+      if (rsp[2] & 0x08) fputs("(B8) ", stdout);
+      if (rsp[2] & 0x10) fputs("(B10) ", stdout);
+      if (rsp[2] & 0x20) fputs("TRACK ", stdout); // Track info available? Seen when playing past track marker
+      if (rsp[2] & 0x40) fputs("ABSTIME ", stdout); // Absolute time known (SUDCC/PDCC)?
+      if (rsp[2] & 0x80) fputs("TOTALTIME ", stdout); // Total time known on PDCC? FP issues PREREC TAPE TIME
+
+      if (rsp[3] & 0x80) fputs("DECKTIME ", stdout); // No absolute tape time, using deck time?
+      if (rsp[3] & 0x40) fputs("TAPETIME ", stdout); // Using tape time code
+      printf("Sector=%u\r\n", rsp[3] & 3);
+
+      memcpy(status, rsp, sizeof(status));
     }
-
-  case 0x46:
-    // Get drawer status
-    QR("GET DRAWER STATUS -> ", 2);
-
-    switch(rsp[1])
+    else
     {
-    case 1: printf("Closed\r\n");         return;
-    case 2: printf("Open\r\n");           return;
-    case 3: printf("Closing\r\n");        return;
-    case 4: printf("Opening\r\n");        return;
-    case 5: printf("Blocked\r\n");        return;
-    case 6: printf("Unknown\r\n");        return;
-    default:
-      ; // Nothing
+      // Nothing changed; don't print anything
     }
+  }
+  return true;
 
-    break;
-
-  case 0x49:
-    // Get tape type? This is issued right after the drawer finishes closing
-    QR("TAPE TYPE -> ", 2);
-
+  case FRONTPANEL_TAPE_TYPE:
     printf("(%02X) ", rsp[0]);
 
-    switch(rsp[1])
+    return printvalue(op, rsp[1]);
+
+  case FRONTPANEL_VU:
+    if (chattymode)
     {
-    // Meanings of bits:
-    //  0x01: No cassette
-    //  0x02: Chrome
-    //  0x04: DCC
-    //  0x08: Recording Allowed
-    //  0x10: Length Hole "3" (45/75/105/Undefined)
-    //  0x20: Length Hole "4" (45/60/105/120)
-    //  0x40: Length Hole "5" (45/60/75/90)
-    // Length can be ("5"/"4"/"3"):
-    //  45  minutes  (1/1/1)
-    //  60  minutes  (1/1/0)
-    //  75  minutes  (1/0/1)
-    //  90  minutes  (1/0/0)
-    //  105 minutes  (0/1/1)
-    //  120 minutes  (0/1/0)
-    //  Undefined    (0/0/1) Reserved
-    //  Undefined    (0/0/0) Also used for prerecorded DCC
-    // These numbers correspond to the decimal numbers that are shown by
-    // the "Switches Test" program in Service Mode
-    case 0x00: printf("ACC FERRO\r\n");   return; // 000
-    case 0x02: printf("ACC CHROME\r\n");  return; // 002
-    case 0x04: printf("PDCC\r\n");        return; // 004
-    case 0x14: printf("UDCC(PROT)\r\n");  return; // 020
-    case 0x1C: printf("UDCC\r\n");        return; // 028
-    case 0x24: printf("DCC120(PROT)\r\n");return; // 036
-    case 0x2C: printf("DCC120\r\n");      return; // 044
-    case 0x34: printf("DCC105(PROT)\r\n");return; // 052
-    case 0x3C: printf("DCC105\r\n");      return; // 060
-    case 0x44: printf("DCC90(PROT)\r\n"); return; // 068
-    case 0x4C: printf("DCC90\r\n");       return; // 076
-    case 0x54: printf("DCC75(PROT)\r\n"); return; // 084
-    case 0x5C: printf("DCC75\r\n");       return; // 092
-    case 0x64: printf("DCC60(PROT)\r\n"); return; // 100
-    case 0x6C: printf("DCC60\r\n");       return; // 108
-    case 0x74: printf("DCC45(PROT)\r\n"); return; // 116
-    case 0x7B: printf("NO CASSETTE\r\n"); return; // 123
-    case 0x7C: printf("DCC45\r\n");       return; // 124
-    default:
-      printf("%02X\r\n", rsp[1]);         return;
+      // Cursor off
+      fputs("\x1B[?25l", stdout);
+      printf("%02X %s", cmd[0], op->name);
+
+      // No line feed so the text window doesn't scroll
+      printf("%16s %-16s\r", vustring(rsp[1]), vustring(rsp[2]));
+      // Cursor on
+      fputs("\x1B[?25h", stdout);
     }
 
-    break;
+    return true;
+
+  case FRONTPANEL_BIT_ERRORS:
+    printf("%02X -> %02X %02X\r\n", cmd[1], rsp[0], rsp[1]);
+
+    return true;
 
-  case 0x51:
-    // Get long text
-    QCR("GET LONG TEXT: ", 2, 41);
+  case FRONTPANEL_DECK_STATE:
+  {
+    static uint8_t track;
 
-    switch(cmd[1])
+    if ((chattymode) || (rsp[2] != track))
     {
-    case 0xFA: printf("Track -> ");                 break; // Get track name?
-    case 0xE0: printf("TOC track name -> ");        break; // Not sure; Used when rewinding sudcc to beginning, but returns error
-    case 0x01: printf("Lyrics / Album Title -> ");  break; // Possibly language number for lyrics?
-    case 0x03: printf("Artist -> ");                break; // Album artist on PDCC
-    default:   printf("%02X -> ", cmd[1]);
-    }
+      // Cursor off
+      fputs("\x1B[?25l", stdout);
+      printf("%02X %s", cmd[0], op->name);
+      // ESC [ <n> C is cursor forward by n places
+      printf("\x1B[32CT%02X %X:%02X:%02X C%02X%02X [%02X %X %02X %02X]\r",
+        rsp[2], rsp[3] & 0xF, rsp[4], rsp[5], rsp[7], rsp[8],
+        rsp[1], rsp[3] >> 4, rsp[6], rsp[9]);
+      // Cursor on
+      fputs("\x1B[?25h", stdout);
 
-    printstring(rsp + 1, rsp + rsplen);
-    fputs("\r\n", stdout);
+      track = rsp[2];
+    }
+  }
+  return true;
 
-    return;
+  case FRONTPANEL_PREREC_INFO:
+    printf("[1]=0x%02X Tracks=%02X Total time=%02X:%02X:%02X\r\n",
+      rsp[1], rsp[2], rsp[3], rsp[4], rsp[5]);
 
-  case 0x52:
-    // Get track title
-    QCR("GET TRACK TITLE: ", 2, 41);
+    return true;
 
-    printf("Track %u -> ", cmd[1]);
-    printstring(rsp + 1, rsp + rsplen);
-    fputs("\r\n", stdout);
+  default:
+    return false;
+  }
+}
 
-    return;
 
-  case 0x53:
-    // Get short text
-    QCR("GET SHORT TEXT -> ", 2, 13);
+//---------------------------------------------------------------------------
+// Print the parameters of a message, according to its descriptor
+bool printparameters(                  // Returns false=not understood
+  const FrontPanelOpcode *op,
+  uint8_t *cmd,
+  uint8_t cmdlen,
+  uint8_t *rsp,
+  uint8_t rsplen)
+{
+  const char *name;
 
-    switch(cmd[1])
-    {
-    case 0xFA: printf("Track -> ");                 break; // Get track name
-    // Other codes see 0x51?
-    default:   printf("%02X -> ", cmd[1]);
-    }
-    
-    printstring(rsp + 1, rsp + rsplen);
+  switch (op->decode)
+  {
+  case FRONTPANEL_DECODE_NONE:
     fputs("\r\n", stdout);
+    return true;
 
-    return;
-
-  case 0x54:
-    // Get short track title
-    QCR("GET SHORT TRACK TITLE: ", 2, 13);
+  case FRONTPANEL_DECODE_CMDVALUE:
+    return printvalue(op, cmd[1]);
 
-    printf("Track %u -> ", cmd[1]);
-    printstring(rsp + 1, rsp + rsplen);
-    fputs("\r\n", stdout);
+  case FRONTPANEL_DECODE_RSPVALUE:
+    return printvalue(op, rsp[1]);
 
-    return;
+  case FRONTPANEL_DECODE_CMDNUMBER:
+    printf("%u\r\n", cmd[1]);
+    return true;
 
-  case 0x55:
-    // Get DDU2113 ID. Issued at startup before sending the front panel ID
-    QR("Get DDU ID -> ", 5);
+  case FRONTPANEL_DECODE_RSPNUMBER:
+    printf("%u\r\n", rsp[1]);
+    return true;
 
+  case FRONTPANEL_DECODE_RSPHEX:
     printhex(rsp + 1, rsp + rsplen);
     fputs("\r\n", stdout);
+    return true;
 
-    return;
-
-  case 0x57:
-    // Get Marker Type?
-    QR("MARKER TYPE -> ", 2);
-
-    switch(rsp[1])
+  case FRONTPANEL_DECODE_CMDTEXT:
+    name = FrontPanel_ValueName(op, cmd[1]);
+    if (name)
     {
-    case 0x02: printf("TRACK\r\n");       return;
-    case 0x03: printf("REVERSE\r\n");     return; // Switch to side B
-    case 0x07: printf("SKIP +1\r\n");     return; // Skip marker? Also seen at beginning of 175-recorded tape
-    case 0x0B: printf("REUSE\r\n");       return; // End of recording, beginning of reusable tape
-    case 0x0D: printf("INTRO SKIP\r\n");  return; // Skip over begin of sector 1
-    case 0x14: printf("BEGIN SEC\r\n");   return; // After reversing
-    case 0x0E: 
-    default:
-      printf("%02X\r\n", rsp[1]);
+      fputs(name, stdout);
     }
-
-    return;
-
-  case 0x58:
-    // Get Function State. This is apparently used to update the symbols
-    // on the front panel display
-    QR("FUNCTION STATE -> ", 2);
-
-    switch(rsp[1])
+    else
     {
-    case 0x01: printf("OFF \r\n");        return; // Stand by
-    case 0x02: printf("STOP\r\n");        return; // Stop
-    case 0x03: printf("READ\r\n");        return; // Reading
-    case 0x04: printf("PLAY\r\n");        return; // Play
-      
-    case 0x0A: printf("FFWD\r\n");        return; // FFWD (sector)
-    case 0x0B: printf("REWD\r\n");        return; // Rewind (sector)
-      
-    case 0x11: printf("NEXT\r\n");        return; // Search forwards
-    case 0x12: printf("PREV\r\n");        return; // Search backwards
-      
-    case 0x15: printf("SBY<\r\n");        return; // Search arriving at track
-    case 0x16: printf("SBY>\r\n");        return; // Search arriving at track
-
-    case 0x2A: printf("END \r\n");        return; // End of recording marker found
-
-    case 0x30: printf("SKIP\r\n");        return; // Skipping intro
-
-    case 0x22: 
-    case 0x23:
-    case 0x24:
-    case 0x26: // All used when recording title
-    
-    case 0x19:
-    case 0x0E:
-    case 0x32:
-    case 0x34: // Seen during APPEND
-    
-    case 0x2B: // REC/PAUSE?
-    
-    default:
-      printf("%02X\r\n", rsp[1]);         return; // TODO: decode other codes
+      printf("%02X ", cmd[1]);
     }
 
-    return;
-
-  case 0x5B:
-    // Set something (at search time). cmdlen=2 rsplen=4
-    break;
-
-  case 0x5D:
-    // Get Target Track number
-    // This is the positive or negative number that's shown in the track
-    // display during search. It also gets polled when playing past a
-    // marker.
-    QR("GET TARGET TRACK -> ", 2);
-
-    printf("%d\r\n", rsp[1]);           return;
-
-    return;
+    printstring(cmd + 2, cmd + cmdlen);
+    fputs("\r\n", stdout);
+    return true;
 
-  case 0x5E:
-    // VU meters, 2 bytes between 00-5F. 5F (95 decimal) is silence.
-    // Values are negative decibels for left and right.
-    if (chattymode)
+  case FRONTPANEL_DECODE_RSPTEXT:
+    name = FrontPanel_ValueName(op, cmd[1]);
+    if (name)
     {
-      // Cursor off
-      fputs("\x1B[?25l", stdout);
-      QR("VU -> ", 3);
-
-      // No line feed so the text window doesn't scroll
-      printf("%16s %-16s\r", vustring(rsp[1]), vustring(rsp[2]));
-      // Cursor on
-      fputs("\x1B[?25h", stdout);
+      printf("%s -> ", name);
+    }
+    else
+    {
+      printf("%02X -> ", cmd[1]);
     }
-      
-    return;
-
-  case 0x5F:
-    // Service mode playback error reporting.
-    // The command parameter byte indicates the requested track (1-9)
-    // or is set to 0x10 to request a bit pattern of all the (main) heads.
-    // The bit order is: head 1=0x80, head 2=0x40, head 3=0x20 etc.
-    // The first byte of the response is always 0 (so the AUX track is
-    // not part of the result for more 0x10). 
-    // The second response byte is between 0 and 20 decimal for individual
-    // heads. According to the service manual, the individual head error
-    // counts can basically be multiplied by 5 to get the percentage of
-    // errors.
-    QCR("BITS ", 2, 2);
 
-    printf("%02X -> %02X %02X\r\n", cmd[1], rsp[0], rsp[1]);
+    printstring(rsp + 1, rsp + rsplen);
+    fputs("\r\n", stdout);
+    return true;
 
-    return;
+  case FRONTPANEL_DECODE_TRACKTEXT:
+    printf("Track %u -> ", cmd[1]);
+    printstring(rsp + 1, rsp + rsplen);
+    fputs("\r\n", stdout);
+    return true;
 
-  case 0x60:
-    // Get Time (and state?) from deck controller. All values in BCD, big endian.
-    // byte 0=error 00=ok
-    // byte 1=status, 8=play?
-    // byte 2=track
-    // byte 3/4/5=time in BCD, hh/mm/ss. Negative is indicated in hours-byte; don't remember how :)
-    // byte 6=?
-    // byte 7/8=tape counter, 0-9999 
-    // byte 9=?
-    {
-      static uint8_t track;
+  case FRONTPANEL_DECODE_CUSTOM:
+    return printcustom(op, cmd, rsp, rsplen);
 
-      if ((chattymode) || (rsp[2] != track))
-      {
-        // Cursor off
-        fputs("\x1B[?25l", stdout);
-        P("Time -> ");
-        //printf("Track %02X Time %X:%02X:%02X Counter %02X%02X [1/2=%02X%X 6=%02X 9=%02X]\r\n", 
-        //printf("                                T%02X %X:%02X:%02X C%02X%02X [%02X %X %02X %02X]\r", 
-        // ESC [ <n> C is cursor forward by n places
-        printf("\x1B[32CT%02X %X:%02X:%02X C%02X%02X [%02X %X %02X %02X]\r", 
-          rsp[2], rsp[3] & 0xF, rsp[4], rsp[5], rsp[7], rsp[8],
-          rsp[1], rsp[3] >> 4, rsp[6], rsp[9]);
-        // Cursor on
-        fputs("\x1B[?25h", stdout);
-
-        track = rsp[2];
-      }
-    }
-    return;
+  default:
+    return false;
+  }
+}
 
-  case 0x61:
-    // Get tape info for prerecorded tape
-    QR("PREREC TAPE INFO -> ", 6);
 
-    printf("[1]=0x%02X Tracks=%02X Total time=%02X:%02X:%02X\r\n",
-      rsp[1], rsp[2], rsp[3], rsp[4], rsp[5]);
+//---------------------------------------------------------------------------
+// Parse a buffer
+//
+// Everything that's known about the opcodes is in the descriptor table in
+// Common/FrontPanelOpcodes.c; only messages with unusual formats are
+// decoded by hand.
+void dumpfrontpanelmessage(
+  uint8_t *cmd,
+  uint8_t cmdlen,
+  uint8_t *rsp,
+  uint8_t rsplen)
+{
+  const FrontPanelOpcode *op = FrontPanel_Opcode(*cmd);
 
-    return;
+  if ((op->name) && (!(op->flags & FRONTPANEL_OWNPREFIX)))
+  {
+    printf("%02X %s", cmd[0], op->name);
+  }
 
-  default:
-    ;// Nothing
+  if ((!FrontPanel_Check(op, cmdlen, rsp, rsplen))
+    || (!printparameters(op, cmd, cmdlen, rsp, rsplen)))
+  {
+    // If we got here, we don't understand the command. Just dump it.
+    // Note, we don't dump the checksums.
+    fputs("?? ", stdout);
+    hexdumpmessage(cmd, cmdlen, rsp, rsplen);
   }
+}
 
-dump:
-  // If we got here, we don't understand the command. Just dump it.
-  // Note, we don't dump the checksums.
-  fputs("?? ", stdout);
-  hexdumpmessage(cmd, cmdlen, rsp, rsplen);
+
+//---------------------------------------------------------------------------
+// Show a frame from the front panel bus
+void showfrontpanelframe(
+  const FrontPanelFrame *pframe)
+{
+  // The framer already cleared the msb's of the first command and response
+  // bytes. These alternate between 1 and 0 on subsequent commands and
+  // responses, probably to ensure that the firmware always works on live
+  // data, not on stale data that happens when things stop responding
+  // because of some technical problem.
+  uint8_t *buf = (uint8_t *)pframe->buf;
+  bool valid = ((pframe->flags & FRONTPANELFRAME_VALID) == FRONTPANELFRAME_VALID)
+    && !(pframe->flags & FRONTPANELFRAME_OVERFLOW);
+
+  // The VU meter command often responds with a checksum error. There is
+  // probably a bug in the firmware; maybe the code that updates the VU
+  // values and the code that calculates the checksums aren't synchronized
+  // so that checksums don't match the data.
+  // And maybe that's why the 3rd generation decks don't have a VU meter?
+  // I guess we'll never know.
+  if ((!valid) && (pframe->rsp != 2) && (buf[0] != 0x5E)) // Ignore checksum for VU updates
+  {
+    // Don't try to interpret something that we already know is wrong
+    fputs("CHECKSUM ERROR: ", stdout);
+    hexdumpmessage(buf, pframe->rsp, buf + pframe->rsp, pframe->len - pframe->rsp);
+  }
+  else if ((pframe->len < 4) || (pframe->rsp < 2))
+  {
+    // We didn't get at least 2 bytes for command and 2 bytes for response.
+    printf("IGNORING: ");
+    hexdumpmessage(buf, pframe->rsp, buf + pframe->rsp, pframe->len - pframe->rsp);
+  }
+  else
+  {
+    // Note: Interpreting the data may be an expensive operation.
+    // That's okay, the receive callbacks will just gather up data
+    // into the ringbuffers in the background.
+    dumpfrontpanelmessage(buf, pframe->rsp - 1, buf + pframe->rsp, (pframe->len - pframe->rsp) - 1);
+  }
 }
 
 
 //---------------------------------------------------------------------------
 // Parse command and response bytes for the front panel bus
+//
+// The framing is done by the same code as in the Windows program; see
+// Common/FrontPanelFramer.h for how it works.
 void capturefrontpanel()
 {
+  static FrontPanelFramerState framer;
+  static FrontPanelSeqState sequence;
+  static bool initialized = false;
+
+  if (!initialized)
+  {
+    FrontPanelFramer_Init(&framer);
+    FrontPanelSeq_Init(&sequence);
+    initialized = true;
+  }
+
   // Data should come in on both front panel connections at the same time.
-  // Ignore the call if there is no data on one of the connections
-  if (!ringbuffer_num(&rb_cmd) || !ringbuffer_num(&rb_rsp))
+  // Take as many pairs as are available, up to the size of the local
+  // buffers.
+  uint8_t cmd[16];
+  uint8_t rsp[16];
+  size_t len = 0;
+
+  while ((len < sizeof(cmd)) && ringbuffer_num(&rb_cmd) && ringbuffer_num(&rb_rsp))
   {
-    return;
+    ringbuffer_get(&rb_cmd, &cmd[len]);
+    ringbuffer_get(&rb_rsp, &rsp[len]);
+    len++;
   }
 
-  uint8_t cmdbyte;
-  uint8_t rspbyte;
-
-  ringbuffer_get(&rb_cmd, &cmdbyte);
-  ringbuffer_get(&rb_rsp, &rspbyte);
-
-  static uint8_t checksum = 0;
-  static bool valid = true;
-  static buf_t buffer;
-  static uint8_t rxbyte;
-
-  // If one of the bytes is 0xFF but the other one isn't, we know for sure
-  // who is sending the data. Otherwise (i.e. when both incoming bytes
-  // are 0xFF) we assume that the data came from the same source as the
-  // previous byte.
-  //
-  // That means we get out of sync if the first byte from either side is
-  // 0xFF but this is very unlikely and probably easy to recognize. For
-  // one thing, the checksum will not match if we get it wrong.
-  if (cmdbyte != 0xFF)
+  for (size_t i = 0; i < len; )
   {
-    // Data came from front panel
+    bool complete;
 
-    // If we already have some response bytes, parse the buffer and clear
-    // it before we store the new byte.
-    if (buffer.rsp)
+    i += FrontPanelFramer_Put(&framer, cmd + i, rsp + i, len - i, &complete);
+
+    if (complete)
     {
-      // Check response checksum
-      if (checksum != 0xFF)
-      {
-        valid = false;
-      }
+      const FrontPanelFrame *pframe = &framer.frame;
 
-      // clear msb's. These alternate between 1 and 0 on subsequent
-      // commands and responses, probably to ensure that the firmware always
-      // works on live data, not on stale data that happens when things stop
-      // responding because of some technical problem.
-      buffer.buf[0] &= 0x7F;
-      buffer.buf[buffer.rsp] &= 0x7F;
-
-      // The VU meter command often responds with a checksum error. There is
-      // probably a bug in the firmware; maybe the code that updates the VU
-      // values and the code that calculates the checksums aren't synchronized
-      // so that checksums don't match the data.
-      // And maybe that's why the 3rd generation decks don't have a VU meter?
-      // I guess we'll never know.
-      if ((!valid) && (buffer.rsp != 2) && (buffer.buf[0] != 0x5E)) // Ignore checksum for VU updates
+      // The toggle bits show if we lost any messages, e.g. because the
+      // ring buffers overflowed while we were busy printing.
+      if ((pframe->rsp) && (pframe->len > pframe->rsp))
       {
-        // Don't try to interpret something that we already know is wrong
-        fputs("CHECKSUM ERROR: ", stdout);
-        hexdumpbuf(&buffer);
-      }
-      else if ((buffer.len < 4) || (buffer.rsp < 2))
-      {
-        // We didn't get at least 2 bytes for command and 2 bytes for response.
-        printf("IGNORING: ");
-        hexdumpbuf(&buffer);
-      }
-      else
-      {
-        // Note: Interpreting the data may be an expensive operation.
-        // That's okay, the receive callbacks will just gather up data
-        // into the ringbuffers in the background.
-        dumpfrontpanelmessage(&buffer.buf[0], buffer.rsp - 1, &buffer.buf[buffer.rsp], (buffer.len - buffer.rsp) - 1);
-      }
-      
-      buffer.len = buffer.rsp = 0;
-      checksum = 0;
-      valid = true;
-    }
+        uint8_t seq = FrontPanelSeq_Check(&sequence, pframe->buf, pframe->rsp,
+          (pframe->flags & FRONTPANELFRAME_TOGGLE) != 0,
+          (pframe->flags & FRONTPANELFRAME_RSP_TOGGLE) != 0);
 
-    rxbyte = cmdbyte;
-  }
-  else if ((rspbyte != 0xFF) && (rspbyte != 0xEE))
-  {
-    // Data came from dig-mcu
+        if (seq & FRONTPANELSEQ_MISSED)
+        {
+          printf("MISSED MESSAGES (%lu so far)\r\n", (unsigned long)sequence.missed);
+        }
 
-    // Ignore the data if we don't have a command yet.
-    // There's no point trying to catch and interpret a response without
-    // the command.
-/*
-    if (!buffer.len)
-    {
-      continue;
-    }
-*/
+        if (seq & FRONTPANELSEQ_RETRY)
+        {
+          fputs("SENT AGAIN: ", stdout);
+        }
 
-    // If this is the first response byte, mark it
-    if (!buffer.rsp)
-    {
-      // Check command checksum
-      if (checksum != 0xFF)
-      {
-        valid = false;
+        if (seq & FRONTPANELSEQ_MISMATCH)
+        {
+          fputs("WRONG TOGGLE: ", stdout);
+        }
       }
 
-      buffer.rsp = buffer.len; // Response starts here
-
-      checksum = 0;
+      showfrontpanelframe(pframe);
     }
-
-    rxbyte = rspbyte;
-  }
-  else
-  {
-    // Both bytes were 0xFF, don't change direction
-    rxbyte = 0xFF;
-  }
-
-  checksum += rxbyte;
-
-  if (buffer.len < sizeof(buffer.buf))
-  {
-    buffer.buf[buffer.len++] = rxbyte;
-//      buffer.buf[buffer.len++] = cmdbyte;
-//      buffer.buf[buffer.len++] = rspbyte;
   }
 }
 
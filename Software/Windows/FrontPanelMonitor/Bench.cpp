@@ -0,0 +1,1605 @@
+/****************************************************************************
+Built-in benchmarks
+(C) 2024 Jac Goudsmit
+Licensed under the MIT license.
+See LICENSE file for details.
+****************************************************************************/
+
+/*
+  Run with "-bench [<name>...]" on the command line. The benchmarks use
+  synthetic data that is generated in memory, so they don't need any
+  hardware or recordings, and they don't produce any other output than the
+  measurements.
+*/
+
+
+/////////////////////////////////////////////////////////////////////////////
+// INCLUDES
+/////////////////////////////////////////////////////////////////////////////
+
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <thread>
+#include <vector>
+
+#include "../../Common/FrontPanelFramer.h"
+#include "../../Common/FrontPanelOpcodes.h"
+
+#include "Bench.h"
+#include "ByteOps.h"
+#include "Cadence.h"
+#include "CapFile.h"
+#include "Compress.h"
+#include "DeckState.h"
+#include "Decode.h"
+#include "OutBuf.h"
+#include "Infer.h"
+#include "Latency.h"
+#include "Pacer.h"
+#include "SPIrx.h"
+#include "SPSCRing.h"
+
+
+/////////////////////////////////////////////////////////////////////////////
+// TYPES
+/////////////////////////////////////////////////////////////////////////////
+
+
+//---------------------------------------------------------------------------
+// Synthetic bus traffic, as it comes out of the receivers
+struct Session
+{
+  std::vector<uint8_t> cmd;             // Command stream
+  std::vector<uint8_t> rsp;             // Response stream
+  size_t      messages;                 // Number of messages
+};
+
+
+//---------------------------------------------------------------------------
+// Synthetic messages, as they come out of the merge
+//
+// The messages are stored back to back; each one is its command followed
+// by its response.
+struct Messages
+{
+  std::vector<uint8_t> data;            // Commands and responses
+  std::vector<size_t> pos;              // Offset of each message in data
+  std::vector<uint8_t> cmdlen;          // Command length incl. checksum
+  std::vector<uint8_t> rsplen;          // Response length incl. checksum
+};
+
+
+/////////////////////////////////////////////////////////////////////////////
+// DATA
+/////////////////////////////////////////////////////////////////////////////
+
+
+// Results are accumulated here so the compiler can't optimize the
+// benchmarked code away
+static volatile unsigned long long BenchSink;
+
+
+/////////////////////////////////////////////////////////////////////////////
+// LOCAL FUNCTIONS
+/////////////////////////////////////////////////////////////////////////////
+
+
+//---------------------------------------------------------------------------
+// Get the number of seconds since the given time
+static double Seconds(
+  std::chrono::steady_clock::time_point start) // Start time
+{
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+
+//---------------------------------------------------------------------------
+// Generate a session of synthetic messages
+//
+// The mix of message lengths is roughly what the recorder sends while
+// it's playing a tape: mostly polls, with an occasional text message.
+// The contents are random, except for the checksums.
+static void MakeSession(
+  Session &s,                           // Output session
+  size_t messages,                      // Number of messages
+  unsigned maxgap)                      // Max idle bytes between messages
+{
+  static const uint8_t lengths[][3] = {
+    // Opcode, command length, response length (including checksums)
+    { 0x41, 2, 6 },
+    { 0x41, 2, 6 },
+    { 0x41, 2, 6 },
+    { 0x5E, 3, 2 },
+    { 0x60, 6, 2 },
+    { 0x46, 20, 2 },
+    { 0x58, 2, 3 },
+    { 0x29, 2, 12 },
+  };
+  const size_t numlengths = sizeof(lengths) / sizeof(lengths[0]);
+
+  uint32_t seed = 12345;
+  auto random = [&seed]() { seed = seed * 1103515245 + 12345; return (seed >> 16) & 0x7FFF; };
+
+  s.cmd.clear();
+  s.rsp.clear();
+  s.messages = messages;
+
+  for (size_t m = 0; m < messages; m++)
+  {
+    const uint8_t *l = lengths[random() % numlengths];
+    uint8_t toggle = (m & 1) ? 0x80 : 0;
+
+    uint8_t sum = (uint8_t)(l[0] | toggle);
+    s.cmd.push_back(sum);
+    s.rsp.push_back(0xFF);
+    for (unsigned i = 1; i < l[1]; i++)
+    {
+      uint8_t b = (i + 1 < l[1]) ? (uint8_t)random() : (uint8_t)(0xFF - sum);
+      sum += b;
+      s.cmd.push_back(b);
+      s.rsp.push_back(0xFF);
+    }
+
+    sum = toggle;
+    s.cmd.push_back(0xFF);
+    s.rsp.push_back(sum);
+    for (unsigned i = 1; i < l[2]; i++)
+    {
+      uint8_t b = (i + 1 < l[2]) ? (uint8_t)random() : (uint8_t)(0xFF - sum);
+      sum += b;
+      s.cmd.push_back(0xFF);
+      s.rsp.push_back(b);
+    }
+
+    for (unsigned i = maxgap ? random() % (maxgap + 1) : 0; i; i--)
+    {
+      s.cmd.push_back(0xFF);
+      s.rsp.push_back(0xFF);
+    }
+  }
+}
+
+
+//---------------------------------------------------------------------------
+// Copy session data to two buffers, wrapping around at the end
+static void Refill(
+  const Session &s,                     // Session to copy from
+  size_t &pos,                          // Input/output position in session
+  uint8_t *cmd,                         // Command buffer
+  uint8_t *rsp,                         // Response buffer
+  size_t len)                           // Number of bytes to copy
+{
+  while (len)
+  {
+    size_t n = s.cmd.size() - pos;
+    if (n > len)
+    {
+      n = len;
+    }
+
+    memcpy(cmd, s.cmd.data() + pos, n);
+    memcpy(rsp, s.rsp.data() + pos, n);
+    cmd += n;
+    rsp += n;
+    len -= n;
+
+    pos += n;
+    if (pos == s.cmd.size())
+    {
+      pos = 0;
+    }
+  }
+}
+
+
+//---------------------------------------------------------------------------
+// Frame messages from linear buffers that are compacted after each message
+//
+// This is how the main loop used to work.
+static double                           // Returns seconds
+FramingLinear(
+  const Session &s,                     // Input data
+  size_t backlog,                       // Number of bytes waiting
+  size_t messages)                      // Number of messages to process
+{
+  std::vector<uint8_t> cmd(backlog);
+  std::vector<uint8_t> rsp(backlog);
+  size_t pos = 0;
+  unsigned long long sum = 0;
+  FrontPanelFramer framer;
+
+  Refill(s, pos, cmd.data(), rsp.data(), backlog);
+
+  auto start = std::chrono::steady_clock::now();
+
+  for (size_t m = 0; m < messages; m++)
+  {
+    bool complete;
+    size_t used = framer.Put(cmd.data(), rsp.data(), backlog, &complete);
+    const FrontPanelFrame &f = framer.Frame();
+
+    sum += f.buf[0] + f.buf[f.rsp];
+
+    memmove(cmd.data(), cmd.data() + used, backlog - used);
+    memmove(rsp.data(), rsp.data() + used, backlog - used);
+    Refill(s, pos, cmd.data() + backlog - used, rsp.data() + backlog - used, used);
+  }
+
+  double seconds = Seconds(start);
+  BenchSink += sum;
+
+  return seconds;
+}
+
+
+//---------------------------------------------------------------------------
+// Frame messages straight from the receive rings
+//
+// This is how the main loop works now.
+static double                           // Returns seconds
+FramingRing(
+  const Session &s,                     // Input data
+  size_t backlog,                       // Number of bytes waiting
+  size_t messages)                      // Number of messages to process
+{
+  SPSCRing<uint8_t> cmdring(backlog, SPIRX_MAX_SPAN);
+  SPSCRing<uint8_t> rspring(backlog, SPIRX_MAX_SPAN);
+  size_t pos = 0;
+  unsigned long long sum = 0;
+  FrontPanelFramer framer;
+
+  // Keep the rings full; both rings always have the same free space
+  auto fill = [&]()
+  {
+    uint8_t *c;
+    uint8_t *r;
+    size_t n;
+
+    while ((n = cmdring.WriteSpan(&c)) != 0)
+    {
+      rspring.WriteSpan(&r);
+      Refill(s, pos, c, r, n);
+      cmdring.Commit(n);
+      rspring.Commit(n);
+    }
+  };
+
+  fill();
+
+  auto start = std::chrono::steady_clock::now();
+
+  for (size_t m = 0; m < messages; m++)
+  {
+    uint8_t *cmd;
+    uint8_t *rsp;
+    size_t len = cmdring.ReadSpan(&cmd);
+    size_t rsplen = rspring.ReadSpan(&rsp);
+    bool complete;
+
+    if (len > rsplen)
+    {
+      len = rsplen;
+    }
+    if (len > SPIRX_MAX_SPAN)
+    {
+      len = SPIRX_MAX_SPAN;
+    }
+
+    size_t used = framer.Put(cmd, rsp, len, &complete);
+    const FrontPanelFrame &f = framer.Frame();
+
+    sum += f.buf[0] + f.buf[f.rsp];
+
+    cmdring.Release(used);
+    rspring.Release(used);
+    fill();
+  }
+
+  double seconds = Seconds(start);
+  BenchSink += sum;
+
+  return seconds;
+}
+
+
+//---------------------------------------------------------------------------
+// Benchmark: framing with different amounts of data waiting
+static void BenchFraming()
+{
+  Session s;
+  MakeSession(s, 65536, 4);
+
+  printf("  %10s %18s %18s\n", "Backlog", "Linear+memmove", "Ring");
+
+  for (size_t backlog = 4096; backlog <= (16 << 20); backlog <<= 2)
+  {
+    // Limit the number of bytes moved around by the old method
+    size_t messages = (1 << 30) / backlog;
+    if (messages < 100)
+    {
+      messages = 100;
+    }
+    if (messages > 1000000)
+    {
+      messages = 1000000;
+    }
+
+    double linear = FramingLinear(s, backlog, messages);
+    double ring = FramingRing(s, backlog, messages);
+
+    printf("  %7zu KB %15.1f ns %15.1f ns\n",
+      backlog >> 10,
+      linear * 1e9 / messages,
+      ring * 1e9 / messages);
+  }
+}
+
+
+//---------------------------------------------------------------------------
+// Benchmark: bit reversal of received data
+static void BenchReverse()
+{
+  const size_t size = 16 << 20;
+  const unsigned passes = 64;
+  std::vector<uint8_t> data(size);
+  std::vector<uint8_t> expected;
+  std::vector<uint8_t> buf;
+
+  uint32_t seed = 12345;
+  for (uint8_t &b : data)
+  {
+    seed = seed * 1103515245 + 12345;
+    b = (uint8_t)(seed >> 16);
+  }
+
+  printf("  %-8s %12s %10s\n", "", "GB/s", "Speedup");
+
+  double base = 0;
+  for (unsigned i = 0; i < ByteOps_NumImpl(); i++)
+  {
+    const ByteOpsImpl *impl = ByteOps_GetImpl(i);
+    if (!impl)
+    {
+      printf("  #%-7u not supported by this processor\n", i);
+      continue;
+    }
+
+    // Check the result against the plain version. Use an odd length and
+    // offset so the unaligned leftovers are checked too.
+    buf.assign(data.begin(), data.end());
+    impl->ReverseBits(buf.data() + 1, size - 8);
+    if (expected.empty())
+    {
+      expected = buf;
+    }
+    else if (buf != expected)
+    {
+      printf("  %-8s gives wrong results!\n", impl->name);
+      continue;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned pass = 0; pass < passes; pass++)
+    {
+      impl->ReverseBits(buf.data(), size);
+    }
+    double seconds = Seconds(start);
+    BenchSink += buf[0];
+
+    double rate = (double)size * passes / seconds / 1e9;
+    if (!base)
+    {
+      base = rate;
+    }
+
+    printf("  %-8s %12.2f %9.1fx%s\n", impl->name, rate, rate / base, (impl == ByteOps_Best()) ? " (selected)" : "");
+  }
+}
+
+
+//---------------------------------------------------------------------------
+// Frame a session with the framer that's shared with the firmware
+//
+// The data is fed in spans of the given size, the way it comes in from
+// the receivers.
+static double                           // Returns seconds
+FrameSession(
+  const Session &s,                     // Input data
+  size_t span,                          // Number of pairs per call
+  size_t *pframes,                      // Output number of frames
+  size_t *pvalid)                       // Output number of valid frames
+{
+  FrontPanelFramer framer;
+  size_t frames = 0;
+  size_t valid = 0;
+  unsigned long long sum = 0;
+
+  auto start = std::chrono::steady_clock::now();
+
+  for (size_t pos = 0; pos < s.cmd.size(); )
+  {
+    size_t len = std::min(span, s.cmd.size() - pos);
+
+    for (size_t i = 0; i < len; )
+    {
+      bool complete;
+
+      i += framer.Put(s.cmd.data() + pos + i, s.rsp.data() + pos + i, len - i, &complete);
+
+      if (complete)
+      {
+        const FrontPanelFrame &f = framer.Frame();
+
+        sum += f.buf[0] + f.buf[f.rsp];
+        frames++;
+        valid += ((f.flags & FRONTPANELFRAME_VALID) == FRONTPANELFRAME_VALID);
+      }
+    }
+
+    pos += len;
+  }
+
+  double seconds = Seconds(start);
+  BenchSink += sum;
+
+  *pframes = frames;
+  *pvalid = valid;
+
+  return seconds;
+}
+
+
+//---------------------------------------------------------------------------
+// Benchmark: framing with different amounts of idle time between messages
+//
+// The framer skips the pairs that are idle on both lines a word at a time.
+static void BenchIdle()
+{
+  const unsigned maxgaps[] = { 0, 64, 1024, 8192 };
+
+  printf("  %-8s %18s\n", "Max gap", "Framing");
+
+  for (unsigned maxgap : maxgaps)
+  {
+    // Keep the amount of data reasonable
+    Session s;
+    MakeSession(s, (maxgap > 1024) ? 8192 : 65536, maxgap);
+
+    size_t frames;
+    size_t valid;
+    double seconds = FrameSession(s, SPIRX_MAX_SPAN, &frames, &valid);
+
+    printf("  %-8u %10.1f ns/msg   (%.1f MB per line)\n", maxgap, seconds * 1e9 / frames, s.cmd.size() / 1e6);
+  }
+}
+
+
+//---------------------------------------------------------------------------
+// Benchmark: frames per second of the framer that's shared with the
+// firmware, versus the number of pairs per call
+//
+// The firmware gets a few bytes at a time, the PC gets large blocks from
+// the receivers.
+static void BenchFrames()
+{
+  const unsigned maxgaps[] = { 0, 64 };
+  const size_t spans[] = { 1, 16, 4096 };
+
+  printf("  %-8s", "Max gap");
+  for (size_t span : spans)
+  {
+    printf("   Stream by %-5zu", span);
+  }
+  printf("\n");
+
+  for (unsigned maxgap : maxgaps)
+  {
+    Session s;
+    MakeSession(s, 262144, maxgap);
+
+    printf("  %-8u", maxgap);
+
+    for (size_t span : spans)
+    {
+      size_t frames;
+      size_t valid;
+      double seconds = FrameSession(s, span, &frames, &valid);
+
+      printf(" %8.2f Mframe/s", frames / seconds / 1e6);
+
+      if (valid != frames)
+      {
+        printf(" (%zu bad)", frames - valid);
+      }
+    }
+
+    printf("\n");
+  }
+}
+
+
+//---------------------------------------------------------------------------
+// Generate complete commands and responses, as the merge delivers them
+//
+// The mix is what the recorder sends while it's playing a tape. The
+// contents are random.
+static void MakeMessages(
+  Messages &msgs,                       // Output messages
+  size_t messages)                      // Number of messages
+{
+  static const uint8_t lengths[][3] = {
+    // Opcode, command length, response length (including checksums)
+    { 0x41, 2, 6 },
+    { 0x41, 2, 6 },
+    { 0x41, 2, 6 },
+    { 0x5E, 2, 4 },
+    { 0x5E, 2, 4 },
+    { 0x60, 2, 12 },
+    { 0x58, 2, 3 },
+    { 0x46, 2, 3 },
+    { 0x52, 3, 43 },
+    { 0x29, 2, 12 },
+  };
+  const size_t numlengths = sizeof(lengths) / sizeof(lengths[0]);
+
+  uint32_t seed = 12345;
+  auto random = [&seed]() { seed = seed * 1103515245 + 12345; return (seed >> 16) & 0x7FFF; };
+
+  msgs.data.clear();
+  msgs.pos.resize(messages);
+  msgs.cmdlen.resize(messages);
+  msgs.rsplen.resize(messages);
+
+  for (size_t m = 0; m < messages; m++)
+  {
+    const uint8_t *l = lengths[random() % numlengths];
+
+    msgs.pos[m] = msgs.data.size();
+    msgs.cmdlen[m] = l[1];
+    msgs.rsplen[m] = l[2];
+
+    msgs.data.push_back((uint8_t)(l[0] | ((m & 1) ? 0x80 : 0)));
+    for (unsigned i = 1; i < l[1]; i++)
+    {
+      msgs.data.push_back((uint8_t)(random() & 0x7F));
+    }
+
+    msgs.data.push_back((m & 1) ? 0x80 : 0);
+    for (unsigned i = 1; i < l[2]; i++)
+    {
+      msgs.data.push_back((uint8_t)(0x20 + random() % 0x5E));
+    }
+  }
+}
+
+
+//---------------------------------------------------------------------------
+// Benchmark: messages per second of the decoder, versus batch size
+//
+// Nothing is shown; the batches are simply reset when they're full.
+static void BenchDecode()
+{
+  const size_t batchsizes[] = { 16, 256, 4096 };
+
+  Messages msgs;
+  MakeMessages(msgs, 1048576);
+
+  const size_t messages = msgs.pos.size();
+
+  printf("  %-10s %14s %10s %12s\n", "Batch", "Mmsg/s", "ns/msg", "Arena bytes");
+
+  for (size_t batchsize : batchsizes)
+  {
+    DecodeBatch batch(batchsize);
+    MsgTime time = { 0, 0, 0, 0 };
+    unsigned long long sum = 0;
+
+    auto start = std::chrono::steady_clock::now();
+
+    for (size_t m = 0; m < messages; m++)
+    {
+      const uint8_t *msg = msgs.data.data() + msgs.pos[m];
+
+      if (batch.Full())
+      {
+        sum += batch.Events()[0].type;
+        batch.Reset();
+      }
+
+      time.start += 1000;
+      Decode_Message(&batch, &time, msg, msgs.cmdlen[m], msg + msgs.cmdlen[m], msgs.rsplen[m]);
+    }
+
+    double seconds = Seconds(start);
+    BenchSink += sum;
+
+    printf("  %-10zu %14.2f %10.1f %12zu\n", batchsize,
+      messages / seconds / 1e6, seconds * 1e9 / messages, batch.ArenaCapacity());
+  }
+}
+
+
+//---------------------------------------------------------------------------
+// Show an event with a stdio call per item, the way the dump used to do it
+static void FormatStdio(
+  FILE *f,                              // Output file
+  const DecodeEvent *pev)               // Event
+{
+  const FrontPanelOpcode *op = FrontPanel_Opcode(pev->opcode);
+  auto hex = [f](const uint8_t *begin, const uint8_t *end)
+  {
+    for (const uint8_t *s = begin; s != end; s++)
+    {
+      fprintf(f, "%02X ", *s);
+    }
+  };
+
+  fprintf(f, "%02X %s", pev->opcode, op->name ? op->name : "");
+
+  switch (pev->type)
+  {
+  case DECODE_POLL:
+    hex(pev->poll.status, pev->poll.status + 4);
+    fprintf(f, "Sector=%u\r\n", pev->poll.status[3] & 3);
+    break;
+
+  case DECODE_VU:
+    fprintf(f, "%u %u\r", pev->vu.left, pev->vu.right);
+    break;
+
+  case DECODE_DECKSTATE:
+    fprintf(f, "T%02X %X:%02X:%02X C%02X%02X\r",
+      pev->deck.track, pev->deck.hours & 0xF, pev->deck.minutes, pev->deck.seconds,
+      pev->deck.counter[0], pev->deck.counter[1]);
+    break;
+
+  case DECODE_VALUE:
+    fprintf(f, "%u\r\n", pev->value);
+    break;
+
+  case DECODE_TEXT:
+    fprintf(f, "Track %u -> \"", pev->text.kind);
+    for (unsigned i = 0; i < pev->text.len; i++)
+    {
+      uint8_t c = (uint8_t)pev->text.text[i];
+      fprintf(f, (((c < 32) || (c >= 0x7E)) ? "\\x%02X" : "%c"), c);
+    }
+    fputs("\"\r\n", f);
+    break;
+
+  default:
+    fputs("?? ", f);
+    hex(pev->raw.cmd.data, pev->raw.cmd.data + pev->raw.cmd.len);
+    fputs("-- ", f);
+    hex(pev->raw.rsp.data, pev->raw.rsp.data + pev->raw.rsp.len);
+    fputs("\r\n", f);
+  }
+}
+
+
+//---------------------------------------------------------------------------
+// Show an event with the output buffer
+static void FormatOutBuf(
+  OutBuf &out,                          // Output buffer
+  const DecodeEvent *pev)               // Event
+{
+  const FrontPanelOpcode *op = FrontPanel_Opcode(pev->opcode);
+
+  out.Hex(pev->opcode);
+  out.Char(' ');
+  out.Str(op->name ? op->name : "");
+
+  switch (pev->type)
+  {
+  case DECODE_POLL:
+    out.HexBytes(pev->poll.status, pev->poll.status + 4);
+    out.Str("Sector=");
+    out.Dec(pev->poll.status[3] & 3);
+    out.Str("\r\n");
+    break;
+
+  case DECODE_VU:
+    out.Dec(pev->vu.left);
+    out.Char(' ');
+    out.Dec(pev->vu.right);
+    out.Char('\r');
+    break;
+
+  case DECODE_DECKSTATE:
+    out.Char('T');
+    out.Hex(pev->deck.track);
+    out.Char(' ');
+    out.Nibble(pev->deck.hours);
+    out.Char(':');
+    out.Hex(pev->deck.minutes);
+    out.Char(':');
+    out.Hex(pev->deck.seconds);
+    out.Str(" C");
+    out.Hex(pev->deck.counter[0]);
+    out.Hex(pev->deck.counter[1]);
+    out.Char('\r');
+    break;
+
+  case DECODE_VALUE:
+    out.Dec(pev->value);
+    out.Str("\r\n");
+    break;
+
+  case DECODE_TEXT:
+    out.Str("Track ");
+    out.Dec(pev->text.kind);
+    out.Str(" -> ");
+    out.Escaped((const uint8_t *)pev->text.text, (const uint8_t *)pev->text.text + pev->text.len);
+    out.Str("\r\n");
+    break;
+
+  default:
+    out.Str("?? ");
+    out.HexBytes(pev->raw.cmd.data, pev->raw.cmd.data + pev->raw.cmd.len);
+    out.Str("-- ");
+    out.HexBytes(pev->raw.rsp.data, pev->raw.rsp.data + pev->raw.rsp.len);
+    out.Str("\r\n");
+  }
+}
+
+
+//---------------------------------------------------------------------------
+// Benchmark: showing decoded messages with stdio calls, versus the output
+// buffer
+//
+// The session is decoded up front, and the text goes to the null device,
+// so this only measures the formatting and the calls into the C library.
+static void BenchFormat()
+{
+  Messages msgs;
+  MakeMessages(msgs, 262144);
+
+  const size_t messages = msgs.pos.size();
+
+  DecodeBatch batch(messages);
+  MsgTime time = { 0, 0, 0, 0 };
+
+  for (size_t m = 0; m < messages; m++)
+  {
+    const uint8_t *msg = msgs.data.data() + msgs.pos[m];
+
+    time.start += 1000;
+    Decode_Message(&batch, &time, msg, msgs.cmdlen[m], msg + msgs.cmdlen[m], msgs.rsplen[m]);
+  }
+
+#ifdef _WIN32
+  FILE *f = fopen("NUL", "wb");
+#else
+  FILE *f = fopen("/dev/null", "wb");
+#endif
+  if (!f)
+  {
+    printf("  Can't open the null device\n");
+    return;
+  }
+
+  printf("  %-10s %14s %10s\n", "Method", "Mmsg/s", "ns/msg");
+
+  for (int method = 0; method < 2; method++)
+  {
+    const DecodeEvent *pev = batch.Events();
+    auto start = std::chrono::steady_clock::now();
+
+    if (!method)
+    {
+      for (size_t n = batch.Size(); n; n--, pev++)
+      {
+        FormatStdio(f, pev);
+      }
+
+      fflush(f);
+    }
+    else
+    {
+      OutBuf out(f);
+
+      for (size_t n = batch.Size(); n; n--, pev++)
+      {
+        FormatOutBuf(out, pev);
+      }
+
+      out.Flush();
+    }
+
+    double seconds = Seconds(start);
+
+    printf("  %-10s %14.2f %10.1f\n", method ? "OutBuf" : "stdio",
+      messages / seconds / 1e6, seconds * 1e9 / messages);
+  }
+
+  fclose(f);
+}
+
+
+//---------------------------------------------------------------------------
+// Compress blocks of bus data
+//
+// The blocks are the command and response streams of a session, cut into
+// pieces of the size of a block in a capture file. The session has more
+// idle time between the messages for each row.
+static void BenchCompress()
+{
+  static const unsigned gaps[] = { 0, 16, 256, 4096 };
+
+  printf("  %-10s %10s %12s %12s\n", "Max idle", "Ratio", "Pack MB/s", "Unpack MB/s");
+
+  for (unsigned maxgap : gaps)
+  {
+    Session s;
+    MakeSession(s, 131072, maxgap);
+
+    std::vector<uint8_t> data(s.cmd);
+    data.insert(data.end(), s.rsp.begin(), s.rsp.end());
+
+    std::vector<uint8_t> packed(data.size());
+    std::vector<size_t> sizes;
+    std::vector<uint8_t> out(CAPFILE_BLOCK_SIZE);
+    Compressor compressor;
+    size_t total = 0;
+
+    auto start = std::chrono::steady_clock::now();
+
+    for (size_t pos = 0; pos < data.size(); pos += CAPFILE_BLOCK_SIZE)
+    {
+      size_t n = std::min((size_t)CAPFILE_BLOCK_SIZE, data.size() - pos);
+      size_t m = compressor.Pack(data.data() + pos, n, packed.data() + pos, n);
+
+      sizes.push_back(m);
+      total += m ? m : n;
+    }
+
+    double packseconds = Seconds(start);
+
+    start = std::chrono::steady_clock::now();
+
+    for (size_t pos = 0, i = 0; pos < data.size(); pos += CAPFILE_BLOCK_SIZE, i++)
+    {
+      size_t n = std::min((size_t)CAPFILE_BLOCK_SIZE, data.size() - pos);
+
+      if (sizes[i])
+      {
+        BenchSink += compressor.Unpack(packed.data() + pos, sizes[i], out.data(), n);
+      }
+    }
+
+    double unpackseconds = Seconds(start);
+
+    printf("  %-10u %10.1f %12.1f %12.1f\n", maxgap, (double)data.size() / total,
+      data.size() / packseconds / 1e6, data.size() / unpackseconds / 1e6);
+  }
+}
+
+
+//---------------------------------------------------------------------------
+// Write a session to a capture file and read it back
+//
+// The data is written in chunks of the size that the receivers usually
+// return. The writing is measured in the thread that calls Write (which
+// is what the capture threads pay) and until the file is closed (which is
+// what the writer thread needs to keep up). The reading doesn't copy
+// anything, other than to expand compressed blocks; it only visits each
+// record.
+static void BenchCapture()
+{
+  Session s;
+  MakeSession(s, 1048576, 16);
+
+  const size_t chunk = 256;
+  const size_t total = s.cmd.size() + s.rsp.size();
+
+  std::error_code ec;
+  std::filesystem::path path = std::filesystem::temp_directory_path(ec) / "fpmon-bench.fpc";
+  std::string filename = path.string();
+
+  static const char *const names[] = { "cmd", "rsp" };
+  static const unsigned bitrates[] = { SPIRX_DEFAULT_BITRATE, SPIRX_DEFAULT_BITRATE };
+
+  printf("  %-10s %-12s %10s %10s %12s\n", "Blocks", "Stage", "MB/s", "ns/chunk", "File MB");
+
+  for (int method = 0; method < 2; method++)
+  {
+    const char *methodname = method ? "Compressed" : "Stored";
+    CapWriter writer;
+
+    if (!writer.Open(filename.c_str(), 2, names, bitrates, 0, method != 0))
+    {
+      printf("  Can't create %s\n", filename.c_str());
+      return;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    uint64_t time = 0;
+    size_t chunks = 0;
+
+    for (size_t pos = 0; pos < s.cmd.size(); pos += chunk)
+    {
+      size_t n = std::min(chunk, s.cmd.size() - pos);
+
+      time += n * 8000;
+      writer.Write(0, time, time - n * 8000, s.cmd.data() + pos, n, true);
+      writer.Write(1, time, time - n * 8000, s.rsp.data() + pos, n, true);
+      chunks += 2;
+    }
+
+    double seconds = Seconds(start);
+
+    printf("  %-10s %-12s %10.1f %10.1f\n", methodname, "Write", total / seconds / 1e6, seconds * 1e9 / chunks);
+
+    writer.Close();
+    seconds = Seconds(start);
+
+    printf("  %-10s %-12s %10.1f %10.1f %12.1f\n", methodname, "File", total / seconds / 1e6, seconds * 1e9 / chunks,
+      std::filesystem::file_size(path, ec) / 1e6);
+
+    // Read with one thread to expand the blocks, and with the default
+    for (unsigned numthreads = 1; ; numthreads = 0)
+    {
+      CapReader reader;
+
+      if (!reader.Open(filename.c_str(), numthreads))
+      {
+        return;
+      }
+
+      start = std::chrono::steady_clock::now();
+      CapCursor cursor;
+      CapRecord rec;
+      size_t bytes = 0;
+      size_t records = 0;
+
+      reader.Rewind(&cursor);
+
+      while (reader.Next(&cursor, &rec))
+      {
+        bytes += rec.len;
+        records++;
+        BenchSink += rec.data[0];
+      }
+
+      seconds = Seconds(start);
+
+      char stage[32];
+      snprintf(stage, sizeof(stage), numthreads ? "Read, 1 thr" : "Read, auto");
+
+      printf("  %-10s %-12s %10.1f %10.1f\n", methodname, stage, bytes / seconds / 1e6, seconds * 1e9 / records);
+
+      if ((!numthreads) || (!method))
+      {
+        break;
+      }
+    }
+  }
+
+  std::filesystem::remove(path, ec);
+}
+
+
+//---------------------------------------------------------------------------
+// Benchmark: finding a time and a command in a capture file, with the
+// index versus going through the index entries one by one
+//
+// The file is opened with and without its index, to see what it costs
+// to go through the block headers. There's one command with opcode 0x7E
+// at the very end of the file, and none with 0x7D.
+static void BenchIndex()
+{
+  Session s;
+  MakeSession(s, 1048576, 16);
+
+  const size_t chunk = 256;
+  const unsigned repeat = 4;
+
+  std::error_code ec;
+  std::filesystem::path path = std::filesystem::temp_directory_path(ec) / "fpmon-bench.fpc";
+  std::string filename = path.string();
+
+  static const char *const names[] = { "cmd", "rsp" };
+  static const unsigned bitrates[] = { SPIRX_DEFAULT_BITRATE, SPIRX_DEFAULT_BITRATE };
+
+  uint64_t time = 0;
+
+  {
+    CapWriter writer;
+
+    if (!writer.Open(filename.c_str(), 2, names, bitrates, 0))
+    {
+      printf("  Can't create %s\n", filename.c_str());
+      return;
+    }
+
+    for (unsigned r = 0; r < repeat; r++)
+    {
+      for (size_t pos = 0; pos < s.cmd.size(); pos += chunk)
+      {
+        size_t n = std::min(chunk, s.cmd.size() - pos);
+
+        time += n * 8000;
+        writer.Write(0, time, time - n * 8000, s.cmd.data() + pos, n, true);
+        writer.Write(1, time, time - n * 8000, s.rsp.data() + pos, n, true);
+      }
+    }
+
+    static const uint8_t rare[] = { 0xFF, 0x7E, 0x81, 0xFF };
+
+    time += sizeof(rare) * 8000;
+    writer.Write(0, time, time - sizeof(rare) * 8000, rare, sizeof(rare), true);
+  }
+
+  CapReader reader;
+
+  if (!reader.Open(filename.c_str()))
+  {
+    return;
+  }
+
+  size_t blocks = reader.Blocks();
+
+  printf("  %zu blocks, %.1f MB\n", blocks, std::filesystem::file_size(path, ec) / 1e6);
+  printf("  %-24s %12s %12s\n", "Operation", "Index ns", "Linear ns");
+
+  // Searching by time; the linear search goes through the entries until
+  // it finds one that ends at or after the time
+  uint32_t seed = 12345;
+  auto random = [&seed]() { seed = seed * 1103515245 + 12345; return (seed >> 16) & 0x7FFF; };
+
+  const size_t lookups = 100000;
+  const size_t linearlookups = 1000;
+
+  auto start = std::chrono::steady_clock::now();
+
+  for (size_t i = 0; i < lookups; i++)
+  {
+    BenchSink += reader.FindTime(time / 32768 * random());
+  }
+
+  double indexseconds = Seconds(start);
+
+  start = std::chrono::steady_clock::now();
+
+  for (size_t i = 0; i < linearlookups; i++)
+  {
+    uint64_t t = time / 32768 * random();
+    size_t b = 0;
+
+    while ((b < blocks) && (reader.Entry(b)->last < t))
+    {
+      b++;
+    }
+
+    BenchSink += b;
+  }
+
+  double linearseconds = Seconds(start);
+
+  printf("  %-24s %12.1f %12.1f\n", "Find time", indexseconds * 1e9 / lookups, linearseconds * 1e9 / linearlookups);
+
+  // Searching by opcode, from the start of the file
+  for (uint8_t opcode : { (uint8_t)0x41, (uint8_t)0x7E, (uint8_t)0x7D })
+  {
+    size_t found = 0;
+
+    start = std::chrono::steady_clock::now();
+
+    for (size_t i = 0; i < lookups; i++)
+    {
+      found = reader.FindOpcode(opcode, i % 4);
+      BenchSink += found;
+    }
+
+    indexseconds = Seconds(start);
+
+    start = std::chrono::steady_clock::now();
+
+    for (size_t i = 0; i < linearlookups; i++)
+    {
+      size_t b = i % 4;
+
+      while ((b < blocks) && (!(reader.Entry(b)->opcodes[opcode >> 6] & (1ULL << (opcode & 63)))))
+      {
+        b++;
+      }
+
+      BenchSink += b;
+    }
+
+    linearseconds = Seconds(start);
+
+    char operation[40];
+    snprintf(operation, sizeof(operation), "Find 0x%02X (block %zu)", opcode, found);
+
+    printf("  %-24s %12.1f %12.1f\n", operation, indexseconds * 1e9 / lookups, linearseconds * 1e9 / linearlookups);
+  }
+
+  reader.Close();
+
+  // Opening the file, with and without the index at the end
+  for (int method = 0; method < 2; method++)
+  {
+    if (method)
+    {
+      uintmax_t indexsize = sizeof(CapFileIndex) + blocks * sizeof(CapFileIndexEntry) + sizeof(CapFileTrailer);
+
+      std::filesystem::resize_file(path, std::filesystem::file_size(path, ec) - indexsize, ec);
+    }
+
+    const unsigned opens = 20;
+
+    start = std::chrono::steady_clock::now();
+
+    for (unsigned i = 0; i < opens; i++)
+    {
+      if (!reader.Open(filename.c_str()))
+      {
+        return;
+      }
+
+      BenchSink += reader.Indexed();
+      reader.Close();
+    }
+
+    printf("  %-24s %12.1f\n", method ? "Open without index" : "Open", Seconds(start) * 1e9 / opens);
+  }
+
+  std::filesystem::remove(path, ec);
+}
+
+
+//---------------------------------------------------------------------------
+// Benchmark: how late the pacer delivers data, versus sleeping until the
+// data is due
+//
+// The data is spaced evenly; the lateness is the time between when the
+// data was due and when the wait returned.
+static void BenchPacer()
+{
+  static const uint64_t intervals[] = { 100000, 1000000, 10000000 };
+
+  printf("  %-12s %-12s %12s %12s\n", "Interval us", "Method", "Mean us", "Max us");
+
+  for (uint64_t interval : intervals)
+  {
+    const unsigned count = (unsigned)(1000000000ULL / interval < 200 ? 1000000000ULL / interval : 200) + 20;
+
+    for (int method = 0; method < 2; method++)
+    {
+      Pacer pacer;
+      double total = 0;
+      double worst = 0;
+      // The pacer starts at the first wait, right after this
+      auto start = std::chrono::steady_clock::now();
+
+      for (unsigned i = 0; i < count; i++)
+      {
+        uint64_t time = i * interval;
+        auto due = start + std::chrono::nanoseconds(time);
+
+        if (method)
+        {
+          while (!pacer.Wait(time, interval * 2))
+          {
+            // Not due yet
+          }
+        }
+        else
+        {
+          std::this_thread::sleep_until(due);
+        }
+
+        double late = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - due).count();
+
+        total += late;
+        worst = std::max(worst, late);
+      }
+
+      printf("  %-12.0f %-12s %12.1f %12.1f\n", interval / 1e3, method ? "Pacer" : "Sleep", total / count, worst);
+    }
+  }
+}
+
+
+//---------------------------------------------------------------------------
+// Benchmark: recording response latencies in histograms, versus keeping
+// all of them and sorting them to get the percentiles
+//
+// Most latencies are a few byte times, with a long tail, roughly like
+// the deck's responses.
+static void BenchLatency()
+{
+  static const uint8_t opcodes[] = { 0x41, 0x41, 0x41, 0x5E, 0x60, 0x46, 0x58, 0x51 };
+  const size_t count = 1000000;
+  const size_t repeat = 20;
+
+  std::vector<MsgTime> times(count);
+  std::vector<uint8_t> cmds(count);
+  uint32_t seed = 1;
+  auto random = [&seed]() { seed = seed * 1103515245 + 12345; return (seed >> 16) & 0x7FFF; };
+
+  for (size_t i = 0; i < count; i++)
+  {
+    uint32_t wait = 8000 + (random() % 4000);
+
+    // About 1 in 100 responses takes much longer
+    if (!(random() % 100))
+    {
+      wait += (random() << 8);
+    }
+
+    times[i].start = i * 100000;
+    times[i].command = 16000;
+    times[i].response = times[i].command + wait;
+    times[i].end = times[i].response + 8000 * (1 + random() % 8);
+    cmds[i] = opcodes[random() % sizeof(opcodes)];
+  }
+
+  // Histograms
+  Latency latency;
+
+  auto start = std::chrono::steady_clock::now();
+
+  for (size_t r = 0; r < repeat; r++)
+  {
+    for (size_t i = 0; i < count; i++)
+    {
+      latency.Add(&cmds[i], 2, 2, &times[i]);
+    }
+  }
+
+  double histseconds = Seconds(start);
+
+  start = std::chrono::steady_clock::now();
+
+  const LatencyHistogram *h = latency.Histogram(0x41, false);
+  uint32_t histp50 = 0;
+  uint32_t histp99 = 0;
+
+  for (size_t r = 0; r < repeat; r++)
+  {
+    histp50 = h->Percentile(50);
+    histp99 = h->Percentile(99);
+  }
+
+  double histquery = Seconds(start);
+
+  // All latencies in a vector per opcode
+  std::vector<std::vector<uint32_t>> samples(128);
+
+  start = std::chrono::steady_clock::now();
+
+  for (size_t r = 0; r < repeat; r++)
+  {
+    for (size_t i = 0; i < count; i++)
+    {
+      samples[cmds[i] & 0x7F].push_back(times[i].response - times[i].command);
+    }
+  }
+
+  double vectorseconds = Seconds(start);
+
+  start = std::chrono::steady_clock::now();
+
+  std::vector<uint32_t> &v = samples[0x41];
+  std::sort(v.begin(), v.end());
+  uint32_t exactp50 = v[v.size() / 2];
+  uint32_t exactp99 = v[v.size() * 99 / 100];
+
+  double vectorquery = Seconds(start);
+
+  BenchSink += histp50 + histp99 + exactp50 + exactp99;
+
+  printf("  %-24s %12s %12s\n", "", "Histogram", "Sorted");
+  printf("  %-24s %12.2f %12.2f\n", "Record ns/message", histseconds * 1e9 / (count * repeat), vectorseconds * 1e9 / (count * repeat));
+  printf("  %-24s %12.1f %12.1f\n", "Percentiles us", histquery * 1e6 / repeat, vectorquery * 1e6);
+  printf("  %-24s %12.2f %12.2f\n", "Opcode 41 p50 us", histp50 / 1e3, exactp50 / 1e3);
+  printf("  %-24s %12.2f %12.2f\n", "Opcode 41 p99 us", histp99 / 1e3, exactp99 / 1e3);
+  printf("  %-24s %12zu %12zu\n", "Opcode 41 bytes", sizeof(LatencyHistogram), v.capacity() * sizeof(uint32_t));
+}
+
+
+//---------------------------------------------------------------------------
+// Benchmark: cost per poll of the cadence monitor
+//
+// The polls are irregular. In the first case, there's a stall of 100 ms
+// every 20000 polls. In the second case, the deck is busy for a long time
+// (e.g. a long search): in the second half of the polls, every tenth
+// interval is a stall of 20 ms. All stalls should be counted in both
+// cases.
+static void BenchCadence()
+{
+  const size_t count = 1000000;
+  const size_t repeat = 20;
+
+  const struct
+  {
+    const char *name;                   // Name of the case
+    size_t    from;                     // First poll with stalls
+    size_t    every;                    // Polls from one stall to the next
+    uint64_t  ns;                       // Length of a stall
+  } cases[] =
+  {
+    { "Occasional", 0,         20000, 100000000 },
+    { "Sustained",  count / 2, 10,    20000000 },
+  };
+
+  printf("  %-12s %12s %12s %12s %12s\n", "Stalls", "ns/poll", "Made", "Counted", "Changes");
+
+  for (const auto &c : cases)
+  {
+    std::vector<uint64_t> times(count);
+    uint32_t seed = 1;
+    auto random = [&seed]() { seed = seed * 1103515245 + 12345; return (seed >> 16) & 0x7FFF; };
+    uint64_t time = 0;
+    unsigned made = 0;
+
+    for (size_t i = 0; i < count; i++)
+    {
+      time += 50000 + random() * 8;
+
+      // The first intervals set the limit, so they aren't stalls
+      if ((i >= c.from) && (i >= 1000) && (!(i % c.every)))
+      {
+        time += c.ns;
+        made++;
+      }
+
+      times[i] = time;
+    }
+
+    unsigned changes = 0;
+    uint64_t counted = 0;
+
+    auto start = std::chrono::steady_clock::now();
+
+    for (size_t r = 0; r < repeat; r++)
+    {
+      Cadence cadence(0x41);
+
+      for (size_t i = 0; i < count; i++)
+      {
+        changes += (cadence.Add(times[i]) != CADENCE_SAME);
+      }
+
+      counted += cadence.Stalls();
+    }
+
+    double seconds = Seconds(start);
+
+    BenchSink += changes;
+
+    printf("  %-12s %12.2f %12u %12llu %12u\n", c.name, seconds * 1e9 / (count * repeat),
+      made, (unsigned long long)(counted / repeat), changes / (unsigned)repeat);
+  }
+}
+
+
+//---------------------------------------------------------------------------
+// Analyze messages that aren't understood
+//
+// Every message goes through Decode_Known, like in the main loop; one in
+// 8 isn't understood and is analyzed. The function state changes every
+// 4096 messages, so the known state has to be taken from the model now
+// and then.
+static void BenchInfer()
+{
+  const size_t count = 1000000;
+  const size_t repeat = 10;
+
+  // Poll, function state, and an unknown opcode with a counter, BCD and
+  // flags
+  static const uint8_t pollcmd[] = { 0x41, 0x41 };
+  static const uint8_t pollrsp[] = { 0x00, 0x00, 0x00, 0x00, 0x00 };
+  static const uint8_t funccmd[] = { 0x58, 0x58 };
+  uint8_t funcrsp[] = { 0x00, 0x00, 0x00 };
+  uint8_t cmd[] = { 0x35, 0x00, 0x00 };
+  uint8_t rsp[] = { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 };
+  MsgTime time = {};
+
+  size_t unknown = 0;
+
+  auto start = std::chrono::steady_clock::now();
+
+  for (size_t r = 0; r < repeat; r++)
+  {
+    DeckState deck;
+    Infer infer(&deck);
+
+    for (size_t i = 0; i < count; i++)
+    {
+      if (!(i & 4095))
+      {
+        funcrsp[1] = (uint8_t)((i >> 12) & 1);
+        deck.Add(&time, funccmd, sizeof(funccmd), funcrsp, sizeof(funcrsp));
+        infer.Add(funccmd, sizeof(funccmd), funcrsp, sizeof(funcrsp),
+          Decode_Known(funccmd, sizeof(funccmd), funcrsp, sizeof(funcrsp)));
+        continue;
+      }
+
+      if (i & 7)
+      {
+        infer.Add(pollcmd, sizeof(pollcmd), pollrsp, sizeof(pollrsp),
+          Decode_Known(pollcmd, sizeof(pollcmd), pollrsp, sizeof(pollrsp)));
+        continue;
+      }
+
+      rsp[1] = (uint8_t)i;
+      rsp[2] = (uint8_t)(((i / 10) % 10) << 4 | (i % 10));
+      rsp[3] = (uint8_t)(1 << ((i >> 8) & 7));
+
+      bool known = Decode_Known(cmd, sizeof(cmd), rsp, sizeof(rsp));
+
+      unknown += !known;
+      infer.Add(cmd, sizeof(cmd), rsp, sizeof(rsp), known);
+    }
+  }
+
+  double seconds = Seconds(start);
+
+  printf("  %-24s %12.2f\n", "ns/message", seconds * 1e9 / (count * repeat));
+  printf("  %-24s %12.2f\n", "ns/unknown message", seconds * 1e9 / unknown);
+}
+
+
+//---------------------------------------------------------------------------
+// Keep the deck state model up to date, and read it
+//
+// The messages are mostly repeated polls, with a time message every 16
+// messages of which the seconds change now and then.
+static void BenchDeck()
+{
+  const size_t count = 1000000;
+  const size_t repeat = 10;
+
+  static const uint8_t pollcmd[] = { 0x41, 0x41 };
+  static const uint8_t pollrsp[] = { 0x00, 0x00, 0x00, 0x00, 0x00 };
+  static const uint8_t timecmd[] = { 0x60, 0x60 };
+  uint8_t timersp[] = { 0x00, 0x08, 0x03, 0x00, 0x01, 0x00, 0x00, 0x12, 0x34, 0x00, 0x00 };
+  MsgTime time = { 0, 0, 0, 0 };
+
+  unsigned changes = 0;
+
+  auto start = std::chrono::steady_clock::now();
+
+  for (size_t r = 0; r < repeat; r++)
+  {
+    DeckState deck;
+
+    for (size_t i = 0; i < count; i++)
+    {
+      if (i & 15)
+      {
+        changes += deck.Add(&time, pollcmd, sizeof(pollcmd), pollrsp, sizeof(pollrsp));
+      }
+      else
+      {
+        timersp[5] = (uint8_t)(i >> 10);
+        changes += deck.Add(&time, timecmd, sizeof(timecmd), timersp, sizeof(timersp));
+      }
+    }
+  }
+
+  double seconds = Seconds(start);
+
+  printf("  %-24s %12.2f\n", "ns/message", seconds * 1e9 / (count * repeat));
+  printf("  %-24s %12u\n", "Changes per run", changes / (unsigned)repeat);
+
+  // Reading the latest snapshot
+  DeckState deck;
+  DeckSnapshot s;
+
+  deck.Add(&time, timecmd, sizeof(timecmd), timersp, sizeof(timersp));
+
+  start = std::chrono::steady_clock::now();
+
+  for (size_t i = 0; i < count; i++)
+  {
+    BenchSink += deck.Load(&s) + s.seconds;
+  }
+
+  seconds = Seconds(start);
+
+  printf("  %-24s %12.2f\n", "ns/snapshot read", seconds * 1e9 / count);
+
+  // Checking for a new snapshot without reading it
+  start = std::chrono::steady_clock::now();
+
+  for (size_t i = 0; i < count; i++)
+  {
+    BenchSink += deck.Version();
+  }
+
+  seconds = Seconds(start);
+
+  printf("  %-24s %12.2f\n", "ns/version check", seconds * 1e9 / count);
+}
+
+
+//---------------------------------------------------------------------------
+// List of benchmarks
+static const struct
+{
+  const char *name;                     // Name for command line
+  const char *description;              // Description
+  void (*func)();                       // Benchmark function
+} BenchTable[] =
+{
+  { "framing", "Cost per message for framing, versus backlog", BenchFraming },
+  { "reverse", "Bit reversal of received data", BenchReverse },
+  { "idle", "Cost per message for framing, versus idle time", BenchIdle },
+  { "frames", "Frames per second, versus the number of pairs per call", BenchFrames },
+  { "decode", "Messages per second of the decoder, versus batch size", BenchDecode },
+  { "format", "Showing messages with stdio, versus the output buffer", BenchFormat },
+  { "compress", "Compression of blocks, versus idle time", BenchCompress },
+  { "capture", "Writing and reading capture files", BenchCapture },
+  { "index", "Finding times and commands in capture files", BenchIndex },
+  { "pacer", "Timing of replayed data, pacer versus sleeping", BenchPacer },
+  { "latency", "Recording response latencies, histograms versus sorting", BenchLatency },
+  { "cadence", "Measuring the cadence of polls", BenchCadence },
+  { "infer", "Analyzing messages that aren't understood", BenchInfer },
+  { "deck", "Updating and reading the deck state model", BenchDeck },
+};
+
+
+/////////////////////////////////////////////////////////////////////////////
+// PUBLIC FUNCTIONS
+/////////////////////////////////////////////////////////////////////////////
+
+
+//---------------------------------------------------------------------------
+// Run benchmarks
+int                                     // Returns exit code for main
+Bench_Run(
+  const char **argv)                    // Benchmark names, nullptr ends
+{
+  const size_t num = sizeof(BenchTable) / sizeof(BenchTable[0]);
+
+  // Check the names first, so we don't waste time if there's a typo
+  for (const char **psName = argv; *psName; psName++)
+  {
+    size_t i;
+    for (i = 0; (i < num) && (strcmp(*psName, BenchTable[i].name)); i++)
+    {
+      // Nothing
+    }
+
+    if (i == num)
+    {
+      printf("Unknown benchmark: %s\nAvailable benchmarks:\n", *psName);
+      for (i = 0; i < num; i++)
+      {
+        printf("  %-12s %s\n", BenchTable[i].name, BenchTable[i].description);
+      }
+      return 1;
+    }
+  }
+
+  for (size_t i = 0; i < num; i++)
+  {
+    bool run = !*argv;
+    for (const char **psName = argv; *psName; psName++)
+    {
+      run |= !strcmp(*psName, BenchTable[i].name);
+    }
+
+    if (run)
+    {
+      printf("%s: %s\n", BenchTable[i].name, BenchTable[i].description);
+      BenchTable[i].func();
+      printf("\n");
+    }
+  }
+
+  return 0;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// END
+/////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,29 @@
+/****************************************************************************
+Built-in benchmarks
+(C) 2024 Jac Goudsmit
+Licensed under the MIT license.
+See LICENSE for details.
+****************************************************************************/
+
+
+#pragma once
+
+
+/////////////////////////////////////////////////////////////////////////////
+// PUBLIC FUNCTIONS
+/////////////////////////////////////////////////////////////////////////////
+
+
+//---------------------------------------------------------------------------
+// Run benchmarks
+//
+// The arguments are the names of the benchmarks to run; without
+// arguments, all benchmarks are run.
+int                                     // Returns exit code for main
+Bench_Run(
+  const char **argv);                   // Benchmark names, nullptr ends
+
+
+/////////////////////////////////////////////////////////////////////////////
+// END
+/////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,381 @@
+/****************************************************************************
+Byte buffer operations
+(C) 2024 Jac Goudsmit
+Licensed under the MIT license.
+See LICENSE file for details.
+****************************************************************************/
+
+
+/////////////////////////////////////////////////////////////////////////////
+// INCLUDES
+/////////////////////////////////////////////////////////////////////////////
+
+
+#include "ByteOps.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define BYTEOPS_X86
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#include <immintrin.h>
+#endif
+
+
+/////////////////////////////////////////////////////////////////////////////
+// MACROS
+/////////////////////////////////////////////////////////////////////////////
+
+
+// MSVC lets us use any intrinsics anywhere; GCC and Clang need to be told
+// which instruction set a function is compiled for.
+#if defined(BYTEOPS_X86) && !defined(_MSC_VER)
+#define TARGET(x) __attribute__((target(x)))
+#else
+#define TARGET(x)
+#endif
+
+
+/////////////////////////////////////////////////////////////////////////////
+// DATA
+/////////////////////////////////////////////////////////////////////////////
+
+
+static const uint8_t reverse_byte[] = {
+  0x00, 0x80, 0x40, 0xc0, 0x20, 0xa0, 0x60, 0xe0, 0x10, 0x90, 0x50, 0xd0, 0x30, 0xb0, 0x70, 0xf0,
+  0x08, 0x88, 0x48, 0xc8, 0x28, 0xa8, 0x68, 0xe8, 0x18, 0x98, 0x58, 0xd8, 0x38, 0xb8, 0x78, 0xf8,
+  0x04, 0x84, 0x44, 0xc4, 0x24, 0xa4, 0x64, 0xe4, 0x14, 0x94, 0x54, 0xd4, 0x34, 0xb4, 0x74, 0xf4,
+  0x0c, 0x8c, 0x4c, 0xcc, 0x2c, 0xac, 0x6c, 0xec, 0x1c, 0x9c, 0x5c, 0xdc, 0x3c, 0xbc, 0x7c, 0xfc,
+  0x02, 0x82, 0x42, 0xc2, 0x22, 0xa2, 0x62, 0xe2, 0x12, 0x92, 0x52, 0xd2, 0x32, 0xb2, 0x72, 0xf2,
+  0x0a, 0x8a, 0x4a, 0xca, 0x2a, 0xaa, 0x6a, 0xea, 0x1a, 0x9a, 0x5a, 0xda, 0x3a, 0xba, 0x7a, 0xfa,
+  0x06, 0x86, 0x46, 0xc6, 0x26, 0xa6, 0x66, 0xe6, 0x16, 0x96, 0x56, 0xd6, 0x36, 0xb6, 0x76, 0xf6,
+  0x0e, 0x8e, 0x4e, 0xce, 0x2e, 0xae, 0x6e, 0xee, 0x1e, 0x9e, 0x5e, 0xde, 0x3e, 0xbe, 0x7e, 0xfe,
+  0x01, 0x81, 0x41, 0xc1, 0x21, 0xa1, 0x61, 0xe1, 0x11, 0x91, 0x51, 0xd1, 0x31, 0xb1, 0x71, 0xf1,
+  0x09, 0x89, 0x49, 0xc9, 0x29, 0xa9, 0x69, 0xe9, 0x19, 0x99, 0x59, 0xd9, 0x39, 0xb9, 0x79, 0xf9,
+  0x05, 0x85, 0x45, 0xc5, 0x25, 0xa5, 0x65, 0xe5, 0x15, 0x95, 0x55, 0xd5, 0x35, 0xb5, 0x75, 0xf5,
+  0x0d, 0x8d, 0x4d, 0xcd, 0x2d, 0xad, 0x6d, 0xed, 0x1d, 0x9d, 0x5d, 0xdd, 0x3d, 0xbd, 0x7d, 0xfd,
+  0x03, 0x83, 0x43, 0xc3, 0x23, 0xa3, 0x63, 0xe3, 0x13, 0x93, 0x53, 0xd3, 0x33, 0xb3, 0x73, 0xf3,
+  0x0b, 0x8b, 0x4b, 0xcb, 0x2b, 0xab, 0x6b, 0xeb, 0x1b, 0x9b, 0x5b, 0xdb, 0x3b, 0xbb, 0x7b, 0xfb,
+  0x07, 0x87, 0x47, 0xc7, 0x27, 0xa7, 0x67, 0xe7, 0x17, 0x97, 0x57, 0xd7, 0x37, 0xb7, 0x77, 0xf7,
+  0x0f, 0x8f, 0x4f, 0xcf, 0x2f, 0xaf, 0x6f, 0xef, 0x1f, 0x9f, 0x5f, 0xdf, 0x3f, 0xbf, 0x7f, 0xff,
+};
+
+// Reversed nibbles, for the vector versions: the low nibble of a byte
+// goes to the high nibble and vice versa
+static const uint8_t reverse_lo_nibble[16] = {
+  0x00, 0x80, 0x40, 0xc0, 0x20, 0xa0, 0x60, 0xe0, 0x10, 0x90, 0x50, 0xd0, 0x30, 0xb0, 0x70, 0xf0,
+};
+static const uint8_t reverse_hi_nibble[16] = {
+  0x00, 0x08, 0x04, 0x0c, 0x02, 0x0a, 0x06, 0x0e, 0x01, 0x09, 0x05, 0x0d, 0x03, 0x0b, 0x07, 0x0f,
+};
+
+
+/////////////////////////////////////////////////////////////////////////////
+// LOCAL FUNCTIONS
+/////////////////////////////////////////////////////////////////////////////
+
+
+//---------------------------------------------------------------------------
+// Reverse bits, plain version
+static void ReverseBits_Scalar(
+  uint8_t *buffer,                      // Buffer to convert
+  size_t len)                           // Number of bytes
+{
+  for (uint8_t *p = buffer; len; len--, p++)
+  {
+    *p = reverse_byte[*p];
+  }
+}
+
+
+//---------------------------------------------------------------------------
+// Find first byte that's not 0xFF, plain version
+static size_t                           // Returns index, len=all idle
+FindNotIdle_Scalar(
+  const uint8_t *buffer,                // Buffer to search
+  size_t len)                           // Number of bytes
+{
+  size_t i;
+
+  for (i = 0; (i < len) && (buffer[i] == 0xFF); i++)
+  {
+    // Nothing
+  }
+
+  return i;
+}
+
+
+#ifdef BYTEOPS_X86
+//---------------------------------------------------------------------------
+// Get the index of the lowest bit that's set; the value must not be 0
+static inline unsigned LowestBit(
+  uint32_t value)                       // Value to search
+{
+#ifdef _MSC_VER
+  unsigned long index;
+
+  _BitScanForward(&index, value);
+
+  return (unsigned)index;
+#else
+  return (unsigned)__builtin_ctz(value);
+#endif
+}
+
+
+//---------------------------------------------------------------------------
+// Reverse bits, SSSE3 version
+//
+// Each byte is split into two nibbles, which are used as indexes into
+// 16-entry tables with PSHUFB: one table gives the reversed low nibble in
+// the high half of the byte, the other gives the reversed high nibble in
+// the low half of the byte.
+TARGET("ssse3")
+static void ReverseBits_SSSE3(
+  uint8_t *buffer,                      // Buffer to convert
+  size_t len)                           // Number of bytes
+{
+  const __m128i revlo = _mm_loadu_si128((const __m128i *)reverse_lo_nibble);
+  const __m128i revhi = _mm_loadu_si128((const __m128i *)reverse_hi_nibble);
+  const __m128i mask = _mm_set1_epi8(0x0F);
+
+  for (; len >= 16; len -= 16, buffer += 16)
+  {
+    __m128i v = _mm_loadu_si128((const __m128i *)buffer);
+    __m128i lo = _mm_and_si128(v, mask);
+    __m128i hi = _mm_and_si128(_mm_srli_epi16(v, 4), mask);
+
+    v = _mm_or_si128(_mm_shuffle_epi8(revlo, lo), _mm_shuffle_epi8(revhi, hi));
+    _mm_storeu_si128((__m128i *)buffer, v);
+  }
+
+  ReverseBits_Scalar(buffer, len);
+}
+
+
+//---------------------------------------------------------------------------
+// Find first byte that's not 0xFF, SSSE3 version
+//
+// This only needs SSE2, but it's grouped with the other SSSE3 functions.
+TARGET("ssse3")
+static size_t                           // Returns index, len=all idle
+FindNotIdle_SSSE3(
+  const uint8_t *buffer,                // Buffer to search
+  size_t len)                           // Number of bytes
+{
+  const __m128i idle = _mm_set1_epi8(-1);
+  size_t i;
+
+  for (i = 0; i + 16 <= len; i += 16)
+  {
+    __m128i v = _mm_loadu_si128((const __m128i *)(buffer + i));
+    uint32_t mask = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, idle));
+
+    if (mask != 0xFFFF)
+    {
+      return i + LowestBit(~mask);
+    }
+  }
+
+  return i + FindNotIdle_Scalar(buffer + i, len - i);
+}
+
+
+//---------------------------------------------------------------------------
+// Reverse bits, AVX2 version
+//
+// Same as the SSSE3 version but 32 bytes at a time.
+TARGET("avx2")
+static void ReverseBits_AVX2(
+  uint8_t *buffer,                      // Buffer to convert
+  size_t len)                           // Number of bytes
+{
+  // PSHUFB works within each 128-bit lane, so both lanes get the table
+  const __m256i revlo = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)reverse_lo_nibble));
+  const __m256i revhi = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)reverse_hi_nibble));
+  const __m256i mask = _mm256_set1_epi8(0x0F);
+
+  for (; len >= 32; len -= 32, buffer += 32)
+  {
+    __m256i v = _mm256_loadu_si256((const __m256i *)buffer);
+    __m256i lo = _mm256_and_si256(v, mask);
+    __m256i hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), mask);
+
+    v = _mm256_or_si256(_mm256_shuffle_epi8(revlo, lo), _mm256_shuffle_epi8(revhi, hi));
+    _mm256_storeu_si256((__m256i *)buffer, v);
+  }
+
+  ReverseBits_Scalar(buffer, len);
+}
+
+
+//---------------------------------------------------------------------------
+// Find first byte that's not 0xFF, AVX2 version
+TARGET("avx2")
+static size_t                           // Returns index, len=all idle
+FindNotIdle_AVX2(
+  const uint8_t *buffer,                // Buffer to search
+  size_t len)                           // Number of bytes
+{
+  const __m256i idle = _mm256_set1_epi8(-1);
+  size_t i;
+
+  for (i = 0; i + 32 <= len; i += 32)
+  {
+    __m256i v = _mm256_loadu_si256((const __m256i *)(buffer + i));
+    uint32_t mask = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, idle));
+
+    if (mask != 0xFFFFFFFF)
+    {
+      return i + LowestBit(~mask);
+    }
+  }
+
+  return i + FindNotIdle_Scalar(buffer + i, len - i);
+}
+
+
+//---------------------------------------------------------------------------
+// Check if the processor supports SSSE3
+static bool HasSSSE3()
+{
+#ifdef _MSC_VER
+  int r[4];
+
+  __cpuid(r, 1);
+
+  return (r[2] & (1 << 9)) != 0;
+#else
+  return __builtin_cpu_supports("ssse3");
+#endif
+}
+
+
+//---------------------------------------------------------------------------
+// Check if the processor and the operating system support AVX2
+static bool HasAVX2()
+{
+#ifdef _MSC_VER
+  int r[4];
+
+  __cpuid(r, 0);
+  if (r[0] < 7)
+  {
+    return false;
+  }
+
+  // The OS must save the YMM registers (OSXSAVE and XCR0 bits 1 and 2)
+  __cpuid(r, 1);
+  if (((r[2] & (1 << 27)) == 0) || ((r[2] & (1 << 28)) == 0) || ((_xgetbv(0) & 6) != 6))
+  {
+    return false;
+  }
+
+  __cpuidex(r, 7, 0);
+
+  return (r[1] & (1 << 5)) != 0;
+#else
+  return __builtin_cpu_supports("avx2");
+#endif
+}
+#endif
+
+
+//---------------------------------------------------------------------------
+// Table of implementations, slowest first
+static const ByteOpsImpl Impl[] =
+{
+  { "C++",   ReverseBits_Scalar, FindNotIdle_Scalar },
+#ifdef BYTEOPS_X86
+  { "SSSE3", ReverseBits_SSSE3,  FindNotIdle_SSSE3 },
+  { "AVX2",  ReverseBits_AVX2,   FindNotIdle_AVX2 },
+#endif
+};
+
+
+//---------------------------------------------------------------------------
+// Check if an implementation is supported by the processor
+static bool IsSupported(
+  unsigned index)                       // Index into Impl
+{
+#ifdef BYTEOPS_X86
+  switch (index)
+  {
+  case 1: return HasSSSE3();
+  case 2: return HasAVX2();
+  }
+#endif
+
+  return index < sizeof(Impl) / sizeof(Impl[0]);
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// PUBLIC FUNCTIONS
+/////////////////////////////////////////////////////////////////////////////
+
+
+//---------------------------------------------------------------------------
+// Get the number of implementations, whether they're supported or not
+unsigned ByteOps_NumImpl()
+{
+  return sizeof(Impl) / sizeof(Impl[0]);
+}
+
+
+//---------------------------------------------------------------------------
+// Get an implementation
+const ByteOpsImpl *                     // Returns nullptr=not supported
+ByteOps_GetImpl(
+  unsigned index)                       // Index of implementation
+{
+  return IsSupported(index) ? &Impl[index] : nullptr;
+}
+
+
+//---------------------------------------------------------------------------
+// Get the implementation that's used by the functions below
+const ByteOpsImpl *ByteOps_Best()
+{
+  // Initialized on the first call only
+  static const ByteOpsImpl *best = []()
+  {
+    unsigned index = sizeof(Impl) / sizeof(Impl[0]) - 1;
+
+    while (!IsSupported(index))
+    {
+      index--;
+    }
+
+    return &Impl[index];
+  }();
+
+  return best;
+}
+
+
+//---------------------------------------------------------------------------
+// Reverse the bits in each byte, in place
+void ByteOps_ReverseBits(
+  uint8_t *buffer,                      // Buffer to convert
+  size_t len)                           // Number of bytes
+{
+  ByteOps_Best()->ReverseBits(buffer, len);
+}
+
+
+//---------------------------------------------------------------------------
+// Find the first byte that's not 0xFF
+size_t                                  // Returns index, len=all idle
+ByteOps_FindNotIdle(
+  const uint8_t *buffer,                // Buffer to search
+  size_t len)                           // Number of bytes
+{
+  return ByteOps_Best()->FindNotIdle(buffer, len);
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// END
+/////////////////////////////////////////////////////////////////////////////
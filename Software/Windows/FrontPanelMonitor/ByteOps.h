@@ -0,0 +1,94 @@
+/****************************************************************************
+Byte buffer operations
+(C) 2024 Jac Goudsmit
+Licensed under the MIT license.
+See LICENSE for details.
+****************************************************************************/
+
+/*
+  These are the operations that have to be done on every received byte,
+  so they're worth optimizing. Each operation has a plain C++ version and,
+  on x86 processors, SSSE3 and AVX2 versions. The fastest version that's
+  supported by the processor is selected at runtime, the first time that
+  one of the functions is called.
+*/
+
+
+#pragma once
+
+
+/////////////////////////////////////////////////////////////////////////////
+// INCLUDES
+/////////////////////////////////////////////////////////////////////////////
+
+
+#include <cstdint>
+#include <cstddef>
+
+
+/////////////////////////////////////////////////////////////////////////////
+// TYPES
+/////////////////////////////////////////////////////////////////////////////
+
+
+//---------------------------------------------------------------------------
+// Implementation of the operations for one instruction set
+struct ByteOpsImpl
+{
+  const char *name;                     // Name of instruction set
+
+  // Reverse the bits in each byte, in place
+  void (*ReverseBits)(uint8_t *buffer, size_t len);
+
+  // Find the first byte that's not 0xFF
+  size_t (*FindNotIdle)(const uint8_t *buffer, size_t len);
+};
+
+
+/////////////////////////////////////////////////////////////////////////////
+// PUBLIC FUNCTIONS
+/////////////////////////////////////////////////////////////////////////////
+
+
+//---------------------------------------------------------------------------
+// Get the number of implementations, whether they're supported or not
+unsigned ByteOps_NumImpl();
+
+
+//---------------------------------------------------------------------------
+// Get an implementation
+//
+// Index 0 is the plain C++ version which is always available. Higher
+// indexes are faster versions that may not be supported by the processor.
+const ByteOpsImpl *                     // Returns nullptr=not supported
+ByteOps_GetImpl(
+  unsigned index);                      // Index of implementation
+
+
+//---------------------------------------------------------------------------
+// Get the implementation that's used by the functions below
+const ByteOpsImpl *ByteOps_Best();
+
+
+//---------------------------------------------------------------------------
+// Reverse the bits in each byte, in place
+//
+// This converts bytes received LSB-first to MSB-first and vice versa.
+void ByteOps_ReverseBits(
+  uint8_t *buffer,                      // Buffer to convert
+  size_t len);                          // Number of bytes
+
+
+//---------------------------------------------------------------------------
+// Find the first byte that's not 0xFF
+//
+// An idle data line reads as 0xFF, so this skips to the next message.
+size_t                                  // Returns index, len=all idle
+ByteOps_FindNotIdle(
+  const uint8_t *buffer,                // Buffer to search
+  size_t len);                          // Number of bytes
+
+
+/////////////////////////////////////////////////////////////////////////////
+// END
+/////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,148 @@
+/****************************************************************************
+Poll cadence monitor
+(C) 2024 Jac Goudsmit
+Licensed under the MIT license.
+See LICENSE for details.
+****************************************************************************/
+
+
+/////////////////////////////////////////////////////////////////////////////
+// INCLUDES
+/////////////////////////////////////////////////////////////////////////////
+
+
+#include "../../Common/FrontPanelOpcodes.h"
+
+#include "Cadence.h"
+
+
+/////////////////////////////////////////////////////////////////////////////
+// PUBLIC FUNCTIONS
+/////////////////////////////////////////////////////////////////////////////
+
+
+//---------------------------------------------------------------------------
+// Add a message
+CadenceChange                           // Returns change of the cadence
+Cadence::Add(
+  uint64_t time)                        // Time of the message, ns
+{
+  if ((!started) || (time < last))
+  {
+    // First message, or the time started over (e.g. another file)
+    started = true;
+    last = time;
+    window.clear();
+    return CADENCE_SAME;
+  }
+
+  uint32_t ns = (time - last > UINT32_MAX) ? UINT32_MAX : (uint32_t)(time - last);
+  last = time;
+
+  intervals.Add(ns);
+
+  if ((!limit) || (ns <= limit))
+  {
+    baseline.Add(ns);
+  }
+
+  if (!--update)
+  {
+    update = CADENCE_UPDATE;
+    usual = baseline.Percentile(50);
+    limit = (uint64_t)usual * CADENCE_STALL;
+  }
+
+  // Intervals that are shorter than this one can never be the longest
+  // in the window anymore
+  while ((!window.empty()) && (window.back().ns <= ns))
+  {
+    window.pop_back();
+  }
+
+  window.push_back({ time, ns });
+
+  while (window.front().time + CADENCE_WINDOW <= time)
+  {
+    window.pop_front();
+  }
+
+  // Nothing can be judged until the limits are known
+  if (!limit)
+  {
+    return CADENCE_SAME;
+  }
+
+  jitter.Add((ns > usual) ? ns - usual : usual - ns);
+
+  if (ns > limit)
+  {
+    stalls++;
+  }
+
+  uint64_t longest = window.front().ns;
+
+  if ((!degraded) && (longest > limit))
+  {
+    degraded = true;
+    degradedsince = time - ns;
+    degradations++;
+    return CADENCE_DEGRADED;
+  }
+
+  if ((degraded) && (longest <= limit))
+  {
+    degraded = false;
+    degradedtime += time - degradedsince;
+    return CADENCE_RECOVERED;
+  }
+
+  return CADENCE_SAME;
+}
+
+
+//---------------------------------------------------------------------------
+// Print the statistics
+void Cadence::Print(
+  FILE *f) const                        // Output file
+{
+  int len;
+  const char *name = FrontPanel_OpcodeName(opcode, &len);
+
+  fprintf(f, "\nCadence of opcode %02X %.*s: %llu intervals, usually %.3f ms, stalls above %.3f ms\n",
+    opcode, len, name, (unsigned long long)intervals.Count(), usual / 1e6, limit / 1e6);
+
+  if (!intervals.Count())
+  {
+    return;
+  }
+
+  fprintf(f, "%-12s %10s", "In ms", "Min");
+  LatencyHistogram::PrintHeadings(f);
+  fprintf(f, " %10s\n", "Max");
+
+  for (unsigned which = 0; which < 2; which++)
+  {
+    const LatencyHistogram &h = which ? jitter : intervals;
+
+    fprintf(f, "%-12s %10.3f", which ? "Jitter" : "Interval", h.Min() / 1e6);
+
+    for (double p : LatencyHistogram::percentiles)
+    {
+      fprintf(f, " %10.3f", h.Percentile(p) / 1e6);
+    }
+
+    fprintf(f, " %10.3f\n", h.Max() / 1e6);
+  }
+
+  fprintf(f, "%llu stalls; degraded %llu times, for %.3f s in total%s\n",
+    (unsigned long long)stalls,
+    (unsigned long long)degradations,
+    (degradedtime + (degraded ? last - degradedsince : 0)) / 1e9,
+    degraded ? " (still degraded at the end)" : "");
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// END
+/////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,203 @@
+/****************************************************************************
+Poll cadence monitor
+(C) 2024 Jac Goudsmit
+Licensed under the MIT license.
+See LICENSE for details.
+****************************************************************************/
+
+/*
+  Some commands are sent over and over, e.g. the front panel polls the
+  deck with opcode 0x41 continuously. When the deck or the front panel is
+  busy with something else (moving the drawer, searching), the polls are
+  further apart, and the user interface gets sluggish. This measures the
+  time between the messages with one opcode, to find out when that
+  happens.
+
+  The intervals, and how much they differ from the usual interval (the
+  jitter), are counted in histograms (see Latency.h). Polls are mixed in
+  with other messages, so the intervals vary a lot even when nothing is
+  wrong. That's why the limits come from a histogram instead of from an
+  average: the usual interval is the median, and an interval is a stall
+  if it's more than CADENCE_STALL times the usual interval. The stalls
+  are left out of the histogram that the median comes from; otherwise a
+  long stretch of stalls (e.g. during a long search) would move the limit
+  up until the stalls weren't stalls anymore. The limits are updated
+  every CADENCE_UPDATE intervals, so getting the median costs next to
+  nothing per message.
+
+  The longest interval in the last CADENCE_WINDOW ns is kept up to date
+  with a queue of intervals that are longer than all intervals after
+  them, so it costs a constant time per message on average. When it's a
+  stall, the cadence is degraded, until the stall has left the window.
+  The caller gets to know about those changes, and can show them along
+  with the messages.
+*/
+
+
+#pragma once
+
+
+/////////////////////////////////////////////////////////////////////////////
+// INCLUDES
+/////////////////////////////////////////////////////////////////////////////
+
+
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+
+#include "Latency.h"
+
+
+/////////////////////////////////////////////////////////////////////////////
+// MACROS
+/////////////////////////////////////////////////////////////////////////////
+
+
+// Time over which the longest interval is tracked
+#define CADENCE_WINDOW 1000000000ULL    // ns
+
+// Factor of the usual interval above which an interval is a stall. In
+// recordings without stalls, the longest intervals are 14 to 18 times
+// the median.
+#define CADENCE_STALL 20
+
+// Number of intervals after which the limits are updated
+#define CADENCE_UPDATE 256
+
+
+/////////////////////////////////////////////////////////////////////////////
+// TYPES
+/////////////////////////////////////////////////////////////////////////////
+
+
+//---------------------------------------------------------------------------
+// Change of the cadence
+enum CadenceChange
+{
+  CADENCE_SAME,                         // Nothing changed
+  CADENCE_DEGRADED,                     // Messages got too far apart
+  CADENCE_RECOVERED,                    // Messages are regular again
+};
+
+
+//---------------------------------------------------------------------------
+// Cadence of the messages with one opcode
+class Cadence
+{
+protected:
+  //-------------------------------------------------------------------------
+  // Interval in the window
+  struct Interval
+  {
+    uint64_t  time;                     // Time of the message that ended it
+    uint32_t  ns;                       // Length of the interval
+  };
+
+  uint8_t     opcode;                   // Opcode (without toggle bit)
+  uint64_t    last = 0;                 // Time of previous message
+  bool        started = false;          // True=last is valid
+  uint32_t    usual = 0;                // Usual interval, ns
+  uint64_t    limit = 0;                // Shortest stall, ns; 0=not known
+  unsigned    update = CADENCE_UPDATE;  // Intervals until limits update
+  std::deque<Interval> window;          // Intervals, longest first
+  bool        degraded = false;         // True=cadence is degraded
+  uint64_t    degradedsince = 0;        // Time when cadence degraded
+  uint64_t    degradedtime = 0;         // Total ns spent degraded
+  uint64_t    degradations = 0;         // Number of times degraded
+  uint64_t    stalls = 0;               // Number of stalls
+  LatencyHistogram intervals;           // Intervals
+  LatencyHistogram baseline;            // Intervals that aren't stalls
+  LatencyHistogram jitter;              // Difference from usual interval
+
+public:
+  //-------------------------------------------------------------------------
+  // Constructor
+  Cadence(
+    uint8_t opcode)                     // Opcode (without toggle bit)
+    : opcode(opcode & 0x7F)
+  {
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Get the opcode
+  uint8_t Opcode() const
+  {
+    return opcode;
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Add a message
+  CadenceChange                         // Returns change of the cadence
+  Add(
+    uint64_t time);                     // Time of the message, ns
+
+public:
+  //-------------------------------------------------------------------------
+  // Check if the cadence is degraded
+  bool Degraded() const
+  {
+    return degraded;
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Get the number of stalls
+  uint64_t Stalls() const
+  {
+    return stalls;
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Get the usual interval
+  uint32_t Usual() const
+  {
+    return usual;
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Get the shortest interval that counts as a stall
+  uint64_t Limit() const
+  {
+    return limit;
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Get the longest interval in the last CADENCE_WINDOW ns
+  uint32_t WindowMax() const
+  {
+    return window.empty() ? 0 : window.front().ns;
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Get the histogram of the intervals
+  const LatencyHistogram &Intervals() const
+  {
+    return intervals;
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Get the histogram of the differences from the usual interval
+  const LatencyHistogram &Jitter() const
+  {
+    return jitter;
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Print the statistics
+  void Print(
+    FILE *f) const;                     // Output file
+};
+
+
+/////////////////////////////////////////////////////////////////////////////
+// END
+/////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,1480 @@
+/****************************************************************************
+Capture files
+(C) 2024 Jac Goudsmit
+Licensed under the MIT license.
+See LICENSE for details.
+****************************************************************************/
+
+
+/////////////////////////////////////////////////////////////////////////////
+// INCLUDES
+/////////////////////////////////////////////////////////////////////////////
+
+
+#define _CRT_SECURE_NO_WARNINGS         // Allow fopen in MSVC
+#define NOMINMAX                        // Keep windows.h from defining min/max
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+#include "../../Common/FrontPanelFramer.h"
+#include "../../Common/FrontPanelOpcodes.h"
+
+#include "ByteOps.h"
+#include "CapFile.h"
+
+
+/////////////////////////////////////////////////////////////////////////////
+// LOCAL FUNCTIONS
+/////////////////////////////////////////////////////////////////////////////
+
+
+//---------------------------------------------------------------------------
+// Copy data into a ring, wrapping around at the end
+//
+// The caller must make sure that there's enough room.
+static void Put(
+  SPSCRing<uint8_t> &ring,              // Ring
+  const void *data,                     // Data
+  size_t len)                           // Number of bytes
+{
+  const uint8_t *src = (const uint8_t *)data;
+
+  while (len)
+  {
+    uint8_t *p;
+    size_t n = ring.WriteSpan(&p);
+
+    if (n > len)
+    {
+      n = len;
+    }
+
+    memcpy(p, src, n);
+    ring.Commit(n);
+
+    src += n;
+    len -= n;
+  }
+}
+
+
+//---------------------------------------------------------------------------
+// Set the bits for the opcodes of the commands in a record, and find the
+// deck state commands
+//
+// A command starts with the first byte after idle time. A single 0xFF may
+// be a data byte, so it takes a few of them to count as idle time.
+static void NoteOpcodes(
+  uint64_t *opcodes,                    // Input/output opcode bits
+  unsigned &idle,                       // Input/output number of 0xFF bytes
+  std::vector<size_t> &deckstates,      // Output offsets of deck states
+  const uint8_t *data,                  // Data
+  size_t len)                           // Number of bytes
+{
+  size_t pos = 0;
+
+  while (pos < len)
+  {
+    size_t n = ByteOps_FindNotIdle(data + pos, len - pos);
+
+    idle = (n < CAPFILE_IDLE_MIN - idle) ? idle + (unsigned)n : CAPFILE_IDLE_MIN;
+    pos += n;
+
+    if (pos == len)
+    {
+      break;
+    }
+
+    if (idle == CAPFILE_IDLE_MIN)
+    {
+      unsigned opcode = data[pos] & 0x7F;
+
+      opcodes[opcode >> 6] |= 1ULL << (opcode & 63);
+
+      // The command has no parameters, so the checksum comes right after
+      // the opcode, unless the command continues in the next record
+      if ((opcode == FRONTPANEL_DECK_STATE)
+        && ((pos + 1 == len) || ((uint8_t)(data[pos] + data[pos + 1]) == 0xFF)))
+      {
+        deckstates.push_back(pos);
+      }
+    }
+
+    idle = 0;
+
+    const uint8_t *p = (const uint8_t *)memchr(data + pos, 0xFF, len - pos);
+    if (!p)
+    {
+      break;
+    }
+
+    pos = (size_t)(p - data);
+  }
+}
+
+
+//---------------------------------------------------------------------------
+// Get the tape time from a frame, if it's a deck state message
+//
+// The response has the hours in the low nibble of byte 3, and the minutes
+// and seconds in BCD in bytes 4 and 5.
+static bool                             // Returns true=frame has tape time
+TapeTime(
+  const FrontPanelFrame *pframe,        // Frame
+  uint32_t *ptapetime)                  // Output seconds
+{
+  const uint8_t *rsp = pframe->buf + pframe->rsp;
+
+  if (((pframe->buf[0] & 0x7F) != FRONTPANEL_DECK_STATE)
+    || ((pframe->flags & FRONTPANELFRAME_VALID) != FRONTPANELFRAME_VALID)
+    || (pframe->len - pframe->rsp < 7))
+  {
+    return false;
+  }
+
+  unsigned hours = rsp[3] & 0x0F;
+  unsigned minutes = (rsp[4] >> 4) * 10 + (rsp[4] & 0x0F);
+  unsigned seconds = (rsp[5] >> 4) * 10 + (rsp[5] & 0x0F);
+
+  if ((hours > 9) || ((rsp[4] & 0x0F) > 9) || (minutes > 59) || ((rsp[5] & 0x0F) > 9) || (seconds > 59))
+  {
+    return false;
+  }
+
+  *ptapetime = (hours * 60 + minutes) * 60 + seconds;
+  return true;
+}
+
+
+//---------------------------------------------------------------------------
+// Check if a node of a tree of tape time ranges may have a tape time
+static bool                             // Returns true=in range
+InRange(
+  const std::vector<std::vector<uint32_t>> &tree, // Ranges of 2^n blocks
+  size_t level,                         // Level in the tree, 0=blocks
+  size_t node,                          // Index of node in the level
+  uint32_t tapetime)                    // Seconds since start of tape
+{
+  return (level < tree.size())
+    && (node * 2 < tree[level].size())
+    && (tree[level][node * 2] <= tapetime)
+    && (tapetime <= tree[level][node * 2 + 1]);
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// CapWriter
+/////////////////////////////////////////////////////////////////////////////
+
+
+//---------------------------------------------------------------------------
+// Constructor
+CapWriter::CapWriter()
+  : quit(false)
+  , error(false)
+{
+}
+
+
+//---------------------------------------------------------------------------
+// Destructor
+CapWriter::~CapWriter()
+{
+  Close();
+}
+
+
+//---------------------------------------------------------------------------
+// Create the file and start the writer thread
+bool                                    // Returns true=success
+CapWriter::Open(
+  const char *filename,                 // File name
+  unsigned numchannels,                 // Number of receivers
+  const char *const *names,             // Name of each receiver
+  const unsigned *bitrates,             // Bit rate of each receiver
+  uint64_t starttime,                   // Start, ns since 1970-01-01 UTC
+  bool compress)                        // False=don't compress the blocks
+{
+  Close();
+
+  this->compress = compress;
+
+  if ((!numchannels) || (numchannels > CAPFILE_MAX_CHANNELS))
+  {
+    return false;
+  }
+
+  f = fopen(filename, "wb");
+  if (!f)
+  {
+    perror(filename);
+    return false;
+  }
+
+  header = {};
+  memcpy(header.magic, CAPFILE_MAGIC, sizeof(header.magic));
+  header.version = CAPFILE_VERSION;
+  header.size = sizeof(header);
+  header.numchannels = (uint8_t)numchannels;
+  header.starttime = starttime;
+
+  for (unsigned i = 0; i < numchannels; i++)
+  {
+    header.channel[i].bitrate = bitrates[i];
+    strncpy(header.channel[i].name, names[i], sizeof(header.channel[i].name) - 1);
+  }
+
+  if (fwrite(&header, sizeof(header), 1, f) != 1)
+  {
+    perror(filename);
+    fclose(f);
+    f = nullptr;
+    return false;
+  }
+
+  channels = new Channel[numchannels];
+
+  block.reserve(CAPFILE_BLOCK_SIZE);
+  blockheader = {};
+  blockheader.magic = CAPFILE_BLOCK_MAGIC;
+  offset = sizeof(header);
+  index.clear();
+  tapetime = CAPFILE_NO_TAPETIME;
+  tapeblock = 0;
+  ResetLines();
+  NewBlock();
+
+  quit = false;
+  error = false;
+  thread = std::thread(&CapWriter::Run, this);
+
+  return true;
+}
+
+
+//---------------------------------------------------------------------------
+// Write everything that's waiting, and close the file
+void CapWriter::Close()
+{
+  if (thread.joinable())
+  {
+    quit = true;
+    thread.join();
+  }
+
+  if ((f) && (!error))
+  {
+    // Add the index, and the trailer that points to it
+    CapFileIndex ih;
+    ih.magic = CAPFILE_INDEX_MAGIC;
+    ih.count = (uint32_t)index.size();
+
+    CapFileTrailer trailer;
+    trailer.index = offset;
+    trailer.count = ih.count;
+    trailer.magic = CAPFILE_END_MAGIC;
+
+    if ((fwrite(&ih, sizeof(ih), 1, f) != 1)
+      || ((!index.empty()) && (fwrite(index.data(), sizeof(index[0]), index.size(), f) != index.size()))
+      || (fwrite(&trailer, sizeof(trailer), 1, f) != 1))
+    {
+      error = true;
+    }
+  }
+
+  if (f)
+  {
+    if ((fclose(f)) || (error))
+    {
+      printf("Error writing capture file\n");
+    }
+
+    f = nullptr;
+  }
+
+  delete[] channels;
+  channels = nullptr;
+  index.clear();
+  ResetLines();
+}
+
+
+//---------------------------------------------------------------------------
+// Store a chunk of received data
+void CapWriter::Write(
+  unsigned channel,                     // Receiver index
+  uint64_t time,                        // Time of last byte
+  uint64_t polltime,                    // Time of previous poll
+  const uint8_t *data,                  // Data
+  size_t len,                           // Number of bytes, max 0xFFFF
+  bool wait)                            // True=wait for room, don't drop
+{
+  Channel &c = channels[channel];
+
+  while (c.ring.Free() < sizeof(Staged) + len)
+  {
+    if ((!wait) || (error))
+    {
+      c.lost = true;
+      c.lostbytes.fetch_add(len, std::memory_order_relaxed);
+      return;
+    }
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+
+  Staged s;
+  s.time = time;
+  s.polltime = polltime;
+  s.len = (uint32_t)len;
+  s.flags = c.lost ? CAPFILE_LOST : 0;
+  c.lost = false;
+
+  // The writer thread doesn't take the record until all of it is there
+  Put(c.ring, &s, sizeof(s));
+  Put(c.ring, data, len);
+}
+
+
+//---------------------------------------------------------------------------
+// Get the number of bytes of a receiver that couldn't be written
+uint64_t CapWriter::Lost(
+  unsigned channel) const               // Receiver index
+{
+  if ((!channels) || (channel >= header.numchannels))
+  {
+    return 0;
+  }
+
+  return channels[channel].lostbytes.load(std::memory_order_relaxed);
+}
+
+
+//---------------------------------------------------------------------------
+// Thread function
+void CapWriter::Run()
+{
+  auto blockstart = std::chrono::steady_clock::now();
+
+  while (!quit.load(std::memory_order_relaxed))
+  {
+    bool moved = false;
+
+    for (unsigned i = 0; i < header.numchannels; i++)
+    {
+      moved |= Collect(i);
+    }
+
+    auto now = std::chrono::steady_clock::now();
+
+    if (!blockheader.records)
+    {
+      blockstart = now;
+    }
+    else if (now - blockstart >= std::chrono::milliseconds(CAPFILE_FLUSH_TIME))
+    {
+      // Don't let records wait too long when it's quiet, so not much is
+      // lost if the program doesn't end normally
+      Flush();
+      fflush(f);
+    }
+
+    if (!moved)
+    {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+  }
+
+  // The capture threads have stopped, so this gets everything
+  for (bool moved = true; moved; )
+  {
+    moved = false;
+
+    for (unsigned i = 0; i < header.numchannels; i++)
+    {
+      moved |= Collect(i);
+    }
+  }
+
+  Flush();
+}
+
+
+//---------------------------------------------------------------------------
+// Move the records that are waiting for a receiver into the block
+bool                                    // Returns true=anything moved
+CapWriter::Collect(
+  unsigned channel)                     // Receiver index
+{
+  Channel &c = channels[channel];
+  bool moved = false;
+
+  // Take turns with the other receivers, so the lines stay together
+  for (size_t total = 0; total < CAPFILE_COLLECT_SIZE; )
+  {
+    size_t avail = c.ring.Available();
+    if (avail < sizeof(Staged))
+    {
+      break;
+    }
+
+    // The mirror area of the ring is big enough for the longest record
+    uint8_t *p;
+    c.ring.ReadSpan(&p);
+
+    Staged s;
+    memcpy(&s, p, sizeof(s));
+
+    if (avail < sizeof(s) + s.len)
+    {
+      break;
+    }
+
+    uint64_t dt = s.time - c.time;
+    uint64_t wait = (s.time > s.polltime) ? (s.time - s.polltime) / 1000 : 0;
+
+    // Split up gaps that don't fit in a record
+    CapFileRecord rec = {};
+    rec.channel = (uint8_t)channel;
+
+    while (dt > UINT32_MAX)
+    {
+      if (block.size() + sizeof(rec) > CAPFILE_BLOCK_SIZE)
+      {
+        Flush();
+      }
+
+      rec.dt = UINT32_MAX;
+      block.insert(block.end(), (const uint8_t *)&rec, (const uint8_t *)(&rec + 1));
+      blockheader.records++;
+
+      c.time += UINT32_MAX;
+      dt -= UINT32_MAX;
+
+      entry.first = std::min(entry.first, c.time);
+      entry.last = std::max(entry.last, c.time);
+    }
+
+    if (block.size() + sizeof(rec) + s.len > CAPFILE_BLOCK_SIZE)
+    {
+      Flush();
+    }
+
+    rec.dt = (uint32_t)dt;
+    rec.len = (uint16_t)s.len;
+    rec.wait = (uint16_t)((wait > 0xFFFF) ? 0xFFFF : wait);
+    rec.flags = (uint8_t)s.flags;
+
+    block.insert(block.end(), (const uint8_t *)&rec, (const uint8_t *)(&rec + 1));
+    block.insert(block.end(), p + sizeof(s), p + sizeof(s) + s.len);
+    blockheader.records++;
+
+    c.time = s.time;
+
+    entry.first = std::min(entry.first, c.time);
+    entry.last = std::max(entry.last, c.time);
+
+    // Receiver 0 has the front panel commands. If data was lost before
+    // the record, it may start with a command.
+    if (!channel)
+    {
+      if (s.flags & CAPFILE_LOST)
+      {
+        c.idle = CAPFILE_IDLE_MIN;
+      }
+
+      found.clear();
+      NoteOpcodes(entry.opcodes, c.idle, found, p + sizeof(s), s.len);
+    }
+
+    // Receivers 0 and 1 are kept together, to find the tape times
+    if ((channel < 2) && (header.numchannels >= 2))
+    {
+      if (s.flags & CAPFILE_LOST)
+      {
+        ResetLines();
+      }
+
+      uint32_t pos = linepos + (uint32_t)lines[channel].size();
+
+      marks[channel].push_back({ pos, index.size() });
+      lines[channel].insert(lines[channel].end(), p + sizeof(s), p + sizeof(s) + s.len);
+
+      if (!channel)
+      {
+        for (size_t offset : found)
+        {
+          deckstates.push_back(pos + (uint32_t)offset);
+        }
+      }
+
+      FrameDeckStates();
+    }
+
+    c.ring.Release(sizeof(s) + s.len);
+    total += s.len;
+    moved = true;
+  }
+
+  return moved;
+}
+
+
+//---------------------------------------------------------------------------
+// Frame the deck state messages on the front panel lines, and note their
+// tape times in the index
+void CapWriter::FrameDeckStates()
+{
+  size_t len = std::min(lines[0].size(), lines[1].size());
+
+  while (!deckstates.empty())
+  {
+    size_t offset = (uint32_t)(deckstates.front() - linepos);
+
+    // Wait until all of the message is there
+    if (offset + CAPFILE_FRAME_PAIRS > len)
+    {
+      break;
+    }
+
+    FrontPanelFramerState framer;
+    bool complete;
+    uint32_t time;
+
+    FrontPanelFramer_Init(&framer);
+    FrontPanelFramer_Put(&framer, lines[0].data() + offset, lines[1].data() + offset, CAPFILE_FRAME_PAIRS, &complete);
+
+    if (((complete) || (FrontPanelFramer_Flush(&framer))) && (TapeTime(&framer.frame, &time)))
+    {
+      NoteTapeTime(time, deckstates.front());
+    }
+
+    deckstates.pop_front();
+  }
+
+  // The data before the next deck state message isn't needed anymore
+  size_t done = len;
+
+  if (!deckstates.empty())
+  {
+    done = std::min(done, (size_t)(uint32_t)(deckstates.front() - linepos));
+  }
+
+  // If one line stopped, the other one can't be paired with it
+  if (std::max(lines[0].size(), lines[1].size()) - done > CAPFILE_STAGING_SIZE)
+  {
+    ResetLines();
+  }
+
+  // Remove what's done once it's at least half of the data, so that each
+  // byte is moved once at most on average, even if one line is ahead
+  else if ((done >= CAPFILE_BLOCK_SIZE) && (done * 2 >= std::max(lines[0].size(), lines[1].size())))
+  {
+    uint32_t pos = linepos + (uint32_t)done;
+
+    for (unsigned i = 0; i < 2; i++)
+    {
+      size_t n = 0;
+
+      while ((n + 1 < marks[i].size()) && ((int32_t)(marks[i][n + 1].pos - pos) <= 0))
+      {
+        n++;
+      }
+
+      marks[i].erase(marks[i].begin(), marks[i].begin() + n);
+      lines[i].erase(lines[i].begin(), lines[i].begin() + done);
+    }
+
+    linepos = pos;
+  }
+}
+
+
+//---------------------------------------------------------------------------
+// Forget the front panel data that wasn't framed yet
+void CapWriter::ResetLines()
+{
+  for (unsigned i = 0; i < 2; i++)
+  {
+    lines[i].clear();
+    marks[i].clear();
+  }
+
+  deckstates.clear();
+  linepos = 0;
+}
+
+
+//---------------------------------------------------------------------------
+// Add a tape time to the index entry of the block where the message started
+void CapWriter::NoteTapeTime(
+  uint32_t time,                        // Seconds since start of tape
+  uint32_t pos)                         // Position of the message in line
+{
+  // The lines may be in different blocks; the message starts in the
+  // first of them
+  size_t block = index.size();
+
+  for (const std::vector<LineMark> &m : marks)
+  {
+    auto it = std::upper_bound(m.begin(), m.end(), pos,
+      [](uint32_t p, const LineMark &mark) { return (int32_t)(p - mark.pos) < 0; });
+
+    if (it != m.begin())
+    {
+      block = std::min(block, (it - 1)->block);
+    }
+  }
+
+  auto extend = [this](size_t b, uint32_t t)
+  {
+    CapFileIndexEntry &e = (b < index.size()) ? index[b] : entry;
+
+    e.tapemin = std::min(e.tapemin, t);
+    e.tapemax = std::max(e.tapemax, t);
+  };
+
+  // The blocks up to this one had the previous tape time when they started
+  if (tapetime != CAPFILE_NO_TAPETIME)
+  {
+    for (size_t b = tapeblock + 1; b <= block; b++)
+    {
+      extend(b, tapetime);
+    }
+  }
+
+  extend(block, time);
+
+  tapetime = time;
+  tapeblock = std::max(tapeblock, block);
+}
+
+
+//---------------------------------------------------------------------------
+// Write the current block to the file
+void CapWriter::Flush()
+{
+  if (blockheader.records)
+  {
+    const uint8_t *data = block.data();
+    size_t len = block.size();
+
+    blockheader.size = (uint32_t)len;
+    blockheader.stored = 0;
+
+    if (compress)
+    {
+      packed.resize(len);
+
+      size_t n = compressor.Pack(block.data(), len, packed.data(), packed.size());
+      if (n)
+      {
+        blockheader.stored = (uint32_t)n;
+        data = packed.data();
+        len = n;
+      }
+    }
+
+    if ((fwrite(&blockheader, sizeof(blockheader), 1, f) != 1)
+      || (fwrite(data, len, 1, f) != 1))
+    {
+      error = true;
+    }
+
+    entry.offset = offset;
+    index.push_back(entry);
+    offset += sizeof(blockheader) + len;
+  }
+
+  NewBlock();
+}
+
+
+//---------------------------------------------------------------------------
+// Start a new block
+void CapWriter::NewBlock()
+{
+  // The next block starts where the previous one ended
+  block.clear();
+  blockheader.records = 0;
+
+  for (unsigned i = 0; i < header.numchannels; i++)
+  {
+    blockheader.time[i] = channels[i].time;
+  }
+
+  entry = {};
+  entry.first = UINT64_MAX;
+
+  entry.tapemin = CAPFILE_NO_TAPETIME;
+  entry.tapemax = 0;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// CapReader
+/////////////////////////////////////////////////////////////////////////////
+
+
+//---------------------------------------------------------------------------
+// Map a file into memory and check the header
+bool                                    // Returns true=success
+CapReader::Open(
+  const char *filename,                 // File name
+  unsigned numthreads)                  // Threads to expand, 0=automatic
+{
+  Close();
+
+#ifdef _WIN32
+  HANDLE h = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+  if (h == INVALID_HANDLE_VALUE)
+  {
+    printf("Error opening %s\n", filename);
+    return false;
+  }
+
+  hfile = h;
+
+  LARGE_INTEGER filesize;
+  if ((!GetFileSizeEx(h, &filesize)) || ((uint64_t)filesize.QuadPart > SIZE_MAX))
+  {
+    printf("Error getting size of %s\n", filename);
+    Close();
+    return false;
+  }
+
+  size = (size_t)filesize.QuadPart;
+
+  if (size)
+  {
+    hmap = CreateFileMappingA(h, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (hmap)
+    {
+      base = (const uint8_t *)MapViewOfFile(hmap, FILE_MAP_READ, 0, 0, 0);
+    }
+
+    if (!base)
+    {
+      printf("Error mapping %s\n", filename);
+      Close();
+      return false;
+    }
+  }
+#else
+  int fd = open(filename, O_RDONLY);
+  if (fd < 0)
+  {
+    perror(filename);
+    return false;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st))
+  {
+    perror(filename);
+    close(fd);
+    return false;
+  }
+
+  size = (size_t)st.st_size;
+
+  if (size)
+  {
+    void *p = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (p == MAP_FAILED)
+    {
+      perror(filename);
+      close(fd);
+      size = 0;
+      return false;
+    }
+
+    // The file is mostly read from start to end
+    madvise(p, size, MADV_SEQUENTIAL);
+
+    base = (const uint8_t *)p;
+  }
+
+  // The mapping stays valid without the file descriptor
+  close(fd);
+#endif
+
+  const CapFileHeader *ph = (const CapFileHeader *)base;
+  bool ok = (size >= sizeof(*ph))
+    && (!memcmp(ph->magic, CAPFILE_MAGIC, sizeof(ph->magic)))
+    && (ph->version >= CAPFILE_MIN_VERSION)
+    && (ph->version <= CAPFILE_VERSION)
+    && (ph->size >= sizeof(*ph))
+    && (ph->size <= size)
+    && (ph->numchannels)
+    && (ph->numchannels <= CAPFILE_MAX_CHANNELS);
+
+  for (unsigned i = 0; (ok) && (i < ph->numchannels); i++)
+  {
+    ok = (memchr(ph->channel[i].name, 0, sizeof(ph->channel[i].name)) != nullptr);
+  }
+
+  if (!ok)
+  {
+    printf("%s is not a capture file\n", filename);
+    Close();
+    return false;
+  }
+
+  pheader = ph;
+
+  // Find the blocks
+  indexed = LoadIndex();
+  if (!indexed)
+  {
+    ScanBlocks();
+  }
+
+  // Latest time up to each block, for searching by time
+  maxlast.resize(index.size());
+  for (size_t i = 0; i < index.size(); i++)
+  {
+    maxlast[i] = i ? std::max(maxlast[i - 1], index[i].last) : index[i].last;
+  }
+
+  // Opcode bits of 1, 2, 4, ... blocks; 2 words per node
+  tree.emplace_back();
+  for (const CapFileIndexEntry &e : index)
+  {
+    tree[0].push_back(e.opcodes[0]);
+    tree[0].push_back(e.opcodes[1]);
+  }
+
+  while (tree.back().size() > 2)
+  {
+    const std::vector<uint64_t> &below = tree.back();
+    std::vector<uint64_t> level((below.size() / 2 + 1) / 2 * 2);
+
+    for (size_t i = 0; i < below.size(); i++)
+    {
+      level[(i / 4) * 2 + (i & 1)] |= below[i];
+    }
+
+    tree.push_back(std::move(level));
+  }
+
+  // Tape time ranges of 1, 2, 4, ... blocks; lowest and highest per node
+  tapetree.emplace_back();
+  for (const CapFileIndexEntry &e : index)
+  {
+    tapetree[0].push_back(e.tapemin);
+    tapetree[0].push_back(e.tapemax);
+  }
+
+  while (tapetree.back().size() > 2)
+  {
+    const std::vector<uint32_t> &below = tapetree.back();
+    std::vector<uint32_t> level((below.size() / 2 + 1) / 2 * 2);
+
+    for (size_t i = 0; i < level.size(); i += 2)
+    {
+      level[i] = below[i * 2];
+      level[i + 1] = below[i * 2 + 1];
+
+      if (i * 2 + 2 < below.size())
+      {
+        level[i] = std::min(level[i], below[i * 2 + 2]);
+        level[i + 1] = std::max(level[i + 1], below[i * 2 + 3]);
+      }
+    }
+
+    tapetree.push_back(std::move(level));
+  }
+
+  // Version 1 files are never compressed
+  if (ph->version >= 2)
+  {
+    if (!numthreads)
+    {
+      numthreads = std::thread::hardware_concurrency() / 2;
+    }
+
+    numthreads = (numthreads < 1) ? 1 : (numthreads > CAPFILE_MAX_THREADS) ? CAPFILE_MAX_THREADS : numthreads;
+    readahead = numthreads * 4;
+
+    for (unsigned i = 0; i < numthreads; i++)
+    {
+      threads.emplace_back(&CapReader::Run, this);
+    }
+  }
+
+  return true;
+}
+
+
+//---------------------------------------------------------------------------
+// Unmap the file
+void CapReader::Close()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    quit = true;
+  }
+
+  cv.notify_all();
+
+  for (auto &t : threads)
+  {
+    t.join();
+  }
+
+  threads.clear();
+  cache.clear();
+  blocks.clear();
+  index.clear();
+  maxlast.clear();
+  tree.clear();
+  tapetree.clear();
+  indexed = false;
+  ahead = 0;
+  quit = false;
+
+#ifdef _WIN32
+  if (base)
+  {
+    UnmapViewOfFile(base);
+  }
+
+  if (hmap)
+  {
+    CloseHandle(hmap);
+  }
+
+  if (hfile)
+  {
+    CloseHandle(hfile);
+  }
+
+  hmap = nullptr;
+  hfile = nullptr;
+#else
+  if (base)
+  {
+    munmap((void *)base, size);
+  }
+#endif
+
+  base = nullptr;
+  size = 0;
+  pheader = nullptr;
+}
+
+
+//---------------------------------------------------------------------------
+// Get the index entry of a block
+const CapFileIndexEntry *               // Returns nullptr=no such block
+CapReader::Entry(
+  size_t index) const                   // Block index
+{
+  return (index < this->index.size()) ? &this->index[index] : nullptr;
+}
+
+
+//---------------------------------------------------------------------------
+// Find the first block that may have records at or after a time
+size_t                                  // Returns block index, Blocks()=none
+CapReader::FindTime(
+  uint64_t time) const                  // ns since start of capture
+{
+  return (size_t)(std::lower_bound(maxlast.begin(), maxlast.end(), time) - maxlast.begin());
+}
+
+
+//---------------------------------------------------------------------------
+// Find the first block at or after a block, that may have a command with
+// an opcode
+size_t                                  // Returns block index, Blocks()=none
+CapReader::FindOpcode(
+  uint8_t opcode,                       // Opcode, without toggle bit
+  size_t from) const                    // First block to check
+{
+  size_t word = (opcode >> 6) & 1;
+  uint64_t bit = 1ULL << (opcode & 63);
+  size_t level = 0;
+  size_t node = from;
+
+  // Go right and up until a node has the opcode. A node that's the left
+  // half of the one above it can be replaced by that one, because
+  // everything in it is after the starting point.
+  for (;;)
+  {
+    if ((level >= tree.size()) || (node * 2 >= tree[level].size()))
+    {
+      return blocks.size();
+    }
+
+    if (tree[level][node * 2 + word] & bit)
+    {
+      break;
+    }
+
+    node++;
+
+    while ((!(node & 1)) && (level + 1 < tree.size()))
+    {
+      node >>= 1;
+      level++;
+    }
+  }
+
+  // Go down to the first block that has it
+  while (level)
+  {
+    level--;
+    node *= 2;
+
+    if (!(tree[level][node * 2 + word] & bit))
+    {
+      node++;
+    }
+  }
+
+  return node;
+}
+
+
+//---------------------------------------------------------------------------
+// Find the first block at or after a block, that may have a tape time
+size_t                                  // Returns block index, Blocks()=none
+CapReader::FindTapeTime(
+  uint32_t tapetime,                    // Seconds since start of tape
+  size_t from) const                    // First block to check
+{
+  size_t level = 0;
+  size_t node = from;
+
+  for (;;)
+  {
+    // Go right and up until a node may have the tape time, the same way as
+    // when searching for an opcode
+    while (!InRange(tapetree, level, node, tapetime))
+    {
+      if ((level >= tapetree.size()) || (node * 2 >= tapetree[level].size()))
+      {
+        return blocks.size();
+      }
+
+      node++;
+
+      while ((!(node & 1)) && (level + 1 < tapetree.size()))
+      {
+        node >>= 1;
+        level++;
+      }
+    }
+
+    // Go down to the first block that has it. The range of a node covers
+    // the ranges of both halves, and anything in between; if neither half
+    // has the tape time, the search goes on after the node.
+    while (level)
+    {
+      level--;
+      node *= 2;
+
+      if (!InRange(tapetree, level, node, tapetime))
+      {
+        node++;
+      }
+
+      if (!InRange(tapetree, level, node, tapetime))
+      {
+        break;
+      }
+    }
+
+    if (InRange(tapetree, level, node, tapetime))
+    {
+      return node;
+    }
+  }
+}
+
+
+//---------------------------------------------------------------------------
+// Set a cursor to the first record of a block
+void CapReader::Seek(
+  CapCursor *pcursor,                   // Cursor
+  size_t index)                         // Block index
+{
+  *pcursor = {};
+  pcursor->block = index;
+}
+
+
+//---------------------------------------------------------------------------
+// Get the next record
+bool                                    // Returns false=end of file
+CapReader::Next(
+  CapCursor *pcursor,                   // Cursor
+  CapRecord *prec,                      // Output record
+  unsigned mask)                        // Bit mask of receivers
+{
+  for (;;)
+  {
+    size_t pos = pcursor->pos;
+
+    if (pos >= pcursor->end)
+    {
+      // Go to the next block
+      if ((pcursor->block >= blocks.size()) || (!Load(pcursor, pcursor->block)))
+      {
+        pcursor->block = blocks.size();
+        pcursor->pos = pcursor->end = 0;
+        pcursor->expanded.reset();
+        return false;
+      }
+
+      pcursor->block++;
+      continue;
+    }
+
+    const CapFileRecord *pr = (const CapFileRecord *)(pcursor->data + pos);
+    size_t left = pcursor->end - pos;
+
+    if ((left < sizeof(*pr))
+      || (pr->len > left - sizeof(*pr))
+      || (pr->channel >= pheader->numchannels))
+    {
+      // Damaged block; skip the rest of it
+      pcursor->pos = pcursor->end;
+      continue;
+    }
+
+    pcursor->pos = pos + sizeof(*pr) + pr->len;
+
+    uint64_t time = (pcursor->time[pr->channel] += pr->dt);
+
+    // Records without data only move the time forward
+    if ((!pr->len) || (!(mask & (1U << pr->channel))))
+    {
+      continue;
+    }
+
+    prec->channel = pr->channel;
+    prec->flags = pr->flags;
+    prec->time = time;
+    prec->polltime = time - pr->wait * 1000ULL;
+    prec->data = (const uint8_t *)(pr + 1);
+    prec->len = pr->len;
+
+    return true;
+  }
+}
+
+
+//---------------------------------------------------------------------------
+// Read the index at the end of the file
+bool                                    // Returns false=no valid index
+CapReader::LoadIndex()
+{
+  if (size - pheader->size < sizeof(CapFileIndex) + sizeof(CapFileTrailer))
+  {
+    return false;
+  }
+
+  const CapFileTrailer *pt = (const CapFileTrailer *)(base + size - sizeof(CapFileTrailer));
+
+  if ((pt->magic != CAPFILE_END_MAGIC)
+    || (pt->index < pheader->size)
+    || (pt->index > size - sizeof(*pt) - sizeof(CapFileIndex)))
+  {
+    return false;
+  }
+
+  const CapFileIndex *pi = (const CapFileIndex *)(base + pt->index);
+  size_t room = size - sizeof(*pt) - (size_t)pt->index - sizeof(*pi);
+
+  if ((pi->magic != CAPFILE_INDEX_MAGIC)
+    || (pi->count != pt->count)
+    || ((uint64_t)pi->count * sizeof(CapFileIndexEntry) != room))
+  {
+    return false;
+  }
+
+  // The entries may not be aligned, so they're copied
+  index.resize(pi->count);
+  if (pi->count)
+  {
+    memcpy(index.data(), pi + 1, pi->count * sizeof(CapFileIndexEntry));
+  }
+
+  // The blocks must be in order, between the file header and the index
+  uint64_t next = pheader->size;
+
+  for (const CapFileIndexEntry &e : index)
+  {
+    if ((e.offset < next) || (e.offset > pt->index - sizeof(CapFileBlock)))
+    {
+      index.clear();
+      return false;
+    }
+
+    blocks.push_back((size_t)e.offset);
+    next = e.offset + sizeof(CapFileBlock);
+  }
+
+  return true;
+}
+
+
+//---------------------------------------------------------------------------
+// Find the blocks by going through the file, for files without an index
+//
+// Only the block headers are read. The time of the first record of a
+// block is at or after the earliest time in its header, and the time of
+// its last record is at or before the latest time in the header of the
+// next block.
+void CapReader::ScanBlocks()
+{
+  for (size_t pos = pheader->size; size - pos >= sizeof(CapFileBlock); )
+  {
+    const CapFileBlock *pb = (const CapFileBlock *)(base + pos);
+    size_t stored = pb->stored ? pb->stored : pb->size;
+
+    if ((pb->magic != CAPFILE_BLOCK_MAGIC) || (stored > size - pos - sizeof(*pb)))
+    {
+      break;
+    }
+
+    CapFileIndexEntry e;
+    e.offset = pos;
+    e.first = UINT64_MAX;
+    e.last = UINT64_MAX;
+    e.opcodes[0] = e.opcodes[1] = UINT64_MAX;
+    e.tapemin = 0;
+    e.tapemax = UINT32_MAX;
+
+    uint64_t last = 0;
+
+    for (unsigned i = 0; i < pheader->numchannels; i++)
+    {
+      e.first = std::min(e.first, pb->time[i]);
+      last = std::max(last, pb->time[i]);
+    }
+
+    if (!index.empty())
+    {
+      index.back().last = last;
+    }
+
+    blocks.push_back(pos);
+    index.push_back(e);
+    pos += sizeof(*pb) + stored;
+  }
+}
+
+
+//---------------------------------------------------------------------------
+// Get a block header, if it's valid
+const CapFileBlock *                    // Returns nullptr=damaged
+CapReader::Block(
+  size_t index) const                   // Block index
+{
+  size_t pos = blocks[index];
+  const CapFileBlock *pb = (const CapFileBlock *)(base + pos);
+
+  if ((size - pos < sizeof(*pb)) || (pb->magic != CAPFILE_BLOCK_MAGIC))
+  {
+    return nullptr;
+  }
+
+  size_t stored = pb->stored ? pb->stored : pb->size;
+
+  return (stored <= size - pos - sizeof(*pb)) ? pb : nullptr;
+}
+
+
+//---------------------------------------------------------------------------
+// Load a block into a cursor
+bool                                    // Returns false=damaged
+CapReader::Load(
+  CapCursor *pcursor,                   // Cursor
+  size_t index)                         // Block index
+{
+  const CapFileBlock *pb = Block(index);
+
+  if (!pb)
+  {
+    return false;
+  }
+
+  memcpy(pcursor->time, pb->time, sizeof(pcursor->time));
+  pcursor->pos = 0;
+  pcursor->end = pb->size;
+
+  if (!pb->stored)
+  {
+    // Use the records where they are
+    pcursor->expanded.reset();
+    pcursor->data = (const uint8_t *)(pb + 1);
+    return true;
+  }
+
+  std::unique_lock<std::mutex> lock(mutex);
+
+  if (index > ahead)
+  {
+    // Let the threads expand the blocks after this one
+    ahead = index;
+    cv.notify_all();
+  }
+
+  std::map<size_t, Expanded>::iterator it;
+
+  // Wait if the block is being expanded
+  while (((it = cache.find(index)) != cache.end()) && (!it->second.ready))
+  {
+    cv.wait(lock);
+  }
+
+  if (it != cache.end())
+  {
+    pcursor->expanded = it->second.data;
+  }
+  else
+  {
+    // Nobody's working on it (the threads are behind, or the block was
+    // forgotten), so expand it here
+    cache[index] = Expanded();
+    lock.unlock();
+
+    Compressor compressor;
+    auto p = Expand(compressor, index);
+
+    lock.lock();
+    cache[index].ready = true;
+    cache[index].data = p;
+    cv.notify_all();
+
+    pcursor->expanded = p;
+  }
+
+  Trim();
+
+  if (!pcursor->expanded)
+  {
+    return false;
+  }
+
+  pcursor->data = pcursor->expanded->data();
+
+  return true;
+}
+
+
+//---------------------------------------------------------------------------
+// Expand a compressed block
+std::shared_ptr<const std::vector<uint8_t>> // Returns nullptr=damaged
+CapReader::Expand(
+  Compressor &compressor,               // Working memory
+  size_t index)                         // Block index
+{
+  const CapFileBlock *pb = Block(index);
+  if (!pb)
+  {
+    return nullptr;
+  }
+
+  auto p = std::make_shared<std::vector<uint8_t>>(pb->size);
+
+  if (compressor.Unpack((const uint8_t *)(pb + 1), pb->stored, p->data(), pb->size) != pb->size)
+  {
+    return nullptr;
+  }
+
+  return p;
+}
+
+
+//---------------------------------------------------------------------------
+// Forget expanded blocks that aren't used, if there are too many
+void CapReader::Trim()
+{
+  while (cache.size() > CAPFILE_CACHE_BLOCKS)
+  {
+    // Forget the oldest block that's not used by a cursor, and that was
+    // requested already (i.e. not expanded ahead)
+    auto it = cache.begin();
+
+    while ((it != cache.end())
+      && ((it->first >= ahead) || (!it->second.ready) || (it->second.data.use_count() > 1)))
+    {
+      ++it;
+    }
+
+    if (it == cache.end())
+    {
+      break;
+    }
+
+    cache.erase(it);
+  }
+}
+
+
+//---------------------------------------------------------------------------
+// Thread function
+void CapReader::Run()
+{
+  Compressor compressor;
+  std::unique_lock<std::mutex> lock(mutex);
+
+  while (!quit)
+  {
+    Trim();
+
+    // Find a block after the last one that was requested, that isn't
+    // expanded yet
+    size_t index = SIZE_MAX;
+
+    if (cache.size() < CAPFILE_CACHE_BLOCKS)
+    {
+      for (size_t i = ahead; (i < blocks.size()) && (i < ahead + readahead); i++)
+      {
+        const CapFileBlock *pb = Block(i);
+
+        if ((pb) && (pb->stored) && (!cache.count(i)))
+        {
+          index = i;
+          break;
+        }
+      }
+    }
+
+    if (index == SIZE_MAX)
+    {
+      cv.wait(lock);
+      continue;
+    }
+
+    cache[index] = Expanded();
+    lock.unlock();
+
+    auto p = Expand(compressor, index);
+
+    lock.lock();
+    cache[index].ready = true;
+    cache[index].data = p;
+    cv.notify_all();
+  }
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// END
+/////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,638 @@
+/****************************************************************************
+Capture files
+(C) 2024 Jac Goudsmit
+Licensed under the MIT license.
+See LICENSE for details.
+****************************************************************************/
+
+/*
+  A capture file holds the raw data of all receivers, with the time at
+  which each chunk of data was received, so that a session can be decoded
+  again later, with the same time stamps as when it was captured.
+
+  The file starts with a header that describes the receivers (name and
+  bit rate) and the date and time at which the capture started. The rest
+  of the file is a sequence of blocks. Each block has a header, followed
+  by records; each record is a chunk of data as it came out of one
+  receiver. The data is stored the way it's in the capture rings, i.e.
+  already converted to MSB-first.
+
+  The time of each record is stored as the difference with the previous
+  record of the same receiver. The block header has the time of the last
+  record of each receiver before the block, so each block can be read
+  without reading the blocks before it.
+
+  After the last block, there's an index with an entry for each block:
+  where it is, the times of its first and last records, the range of
+  tape times that the deck reported in it, and a bit for each opcode of
+  the front panel commands that start in it. A small trailer at the very
+  end of the file points to the index. With the index, a reader can find
+  the blocks around a time with a binary search, and the next block with
+  a certain tape time or command by going through a tree of the ranges
+  or the opcode bits, without reading the blocks. If a file has no index
+  (e.g. because the program that wrote it didn't end normally, or it was
+  written before the tape times were added), the reader goes through the
+  block headers instead; the times are less exact then, and every block
+  may have every tape time and every opcode.
+
+  The records of each block are compressed (see Compress.h), unless that
+  doesn't make them smaller. Each block is compressed on its own, so the
+  reader can expand blocks in any order: it uses a few threads to expand
+  the blocks ahead of the ones that are being read, in parallel.
+
+  All numbers are little-endian. The structures are packed, so they can be
+  used directly on the file contents.
+
+  Writing is done by a background thread. The capture threads only copy
+  each chunk into a ring buffer of their own, so recording doesn't slow
+  down the capture or the decoder.
+
+  Reading is done by mapping the file into memory, so the records of
+  blocks that aren't compressed can be processed where they are, without
+  copying them. Large files need a 64-bit build.
+*/
+
+
+#pragma once
+
+
+/////////////////////////////////////////////////////////////////////////////
+// INCLUDES
+/////////////////////////////////////////////////////////////////////////////
+
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "Compress.h"
+#include "SPIrx.h"
+#include "SPSCRing.h"
+
+
+/////////////////////////////////////////////////////////////////////////////
+// MACROS
+/////////////////////////////////////////////////////////////////////////////
+
+
+#define CAPFILE_MAGIC "FPCAP\r\n\x1A"   // File signature, 8 bytes
+#define CAPFILE_VERSION 2               // File format version
+#define CAPFILE_MIN_VERSION 1           // Oldest version that can be read
+#define CAPFILE_BLOCK_MAGIC 0x4B4C4246  // "FBLK" at start of each block
+#define CAPFILE_INDEX_MAGIC 0x32444946  // "FID2" at start of the index
+#define CAPFILE_END_MAGIC 0x444E4546    // "FEND" at end of the file
+#define CAPFILE_MAX_CHANNELS SPIRX_MAX_CHANNELS // Max receivers in a file
+#define CAPFILE_NAME_SIZE 60            // Max receiver name incl. nul
+
+// Record flags
+#define CAPFILE_LOST 0x01               // Data was lost before this record
+
+// Max number of bytes of records in a block
+#define CAPFILE_BLOCK_SIZE 65536
+
+// Max time that records wait for a block to fill up before it's written
+#define CAPFILE_FLUSH_TIME 1000         // ms
+
+// Size of the ring buffer of each receiver, between the capture thread
+// and the writer thread
+#define CAPFILE_STAGING_SIZE (1 << 22)
+
+// Number of bytes that the writer thread takes from a receiver before it
+// goes on to the next one
+#define CAPFILE_COLLECT_SIZE 4096
+
+// Max number of expanded blocks that the reader keeps
+#define CAPFILE_CACHE_BLOCKS 64
+
+// Max number of threads that expand blocks for the reader
+#define CAPFILE_MAX_THREADS 8
+
+// Number of 0xFF bytes on the command line before a byte is regarded as
+// the opcode of a command, for the index
+#define CAPFILE_IDLE_MIN 2
+
+// Max number of pairs of the front panel lines that are framed to get the
+// tape time from a deck state message
+#define CAPFILE_FRAME_PAIRS 32
+
+// Tape time in the index when the deck didn't report one
+#define CAPFILE_NO_TAPETIME UINT32_MAX
+
+
+/////////////////////////////////////////////////////////////////////////////
+// TYPES
+/////////////////////////////////////////////////////////////////////////////
+
+
+#pragma pack(push, 1)
+
+//---------------------------------------------------------------------------
+// Receiver description in the file header
+struct CapFileChannel
+{
+  uint32_t    bitrate;                  // Bit rate, to estimate byte times
+  char        name[CAPFILE_NAME_SIZE];  // Location or file name
+};
+
+
+//---------------------------------------------------------------------------
+// File header
+struct CapFileHeader
+{
+  char        magic[8];                 // CAPFILE_MAGIC
+  uint16_t    version;                  // CAPFILE_VERSION
+  uint16_t    size;                     // Size of this header
+  uint8_t     numchannels;              // Number of receivers
+  uint8_t     reserved[3];              // Zero
+  uint64_t    starttime;                // Start, ns since 1970-01-01 UTC
+  CapFileChannel channel[CAPFILE_MAX_CHANNELS]; // Receivers
+};
+
+
+//---------------------------------------------------------------------------
+// Block header
+struct CapFileBlock
+{
+  uint32_t    magic;                    // CAPFILE_BLOCK_MAGIC
+  uint32_t    size;                     // Number of bytes of records
+  uint32_t    records;                  // Number of records
+  uint32_t    stored;                   // Bytes in file; 0=not compressed
+  uint64_t    time[CAPFILE_MAX_CHANNELS]; // Time of previous record, per rx
+};
+
+
+//---------------------------------------------------------------------------
+// Index header; the entries follow
+struct CapFileIndex
+{
+  uint32_t    magic;                    // CAPFILE_INDEX_MAGIC
+  uint32_t    count;                    // Number of entries
+};
+
+
+//---------------------------------------------------------------------------
+// Index entry for one block
+//
+// The opcodes are found by looking for the first byte after idle time on
+// receiver 0 (the front panel command line). The command line is idle
+// while the response is sent, which takes at least 2 bytes, so no commands
+// are missed, but there may be some extra bits for data bytes that follow
+// 0xFF bytes.
+//
+// The tape times are in seconds, from the deck state messages (0x60) on
+// receivers 0 and 1, in the block where each message starts. The blocks
+// after a tape time also get that time, up to the block with the next
+// one, so a time that the deck skipped over (e.g. while winding) is in the
+// block where that happened. If a block has no tape time, tapemin is
+// CAPFILE_NO_TAPETIME and tapemax is 0.
+struct CapFileIndexEntry
+{
+  uint64_t    offset;                   // Offset of block header
+  uint64_t    first;                    // Time of first record
+  uint64_t    last;                     // Time of last record
+  uint64_t    opcodes[2];               // Bit per opcode of commands
+  uint32_t    tapemin;                  // Lowest tape time, seconds
+  uint32_t    tapemax;                  // Highest tape time, seconds
+};
+
+
+//---------------------------------------------------------------------------
+// End of the file
+struct CapFileTrailer
+{
+  uint64_t    index;                    // Offset of the index
+  uint32_t    count;                    // Number of index entries
+  uint32_t    magic;                    // CAPFILE_END_MAGIC
+};
+
+
+//---------------------------------------------------------------------------
+// Record header; the data follows
+struct CapFileRecord
+{
+  uint32_t    dt;                       // ns since previous record of rx
+  uint16_t    len;                      // Number of bytes of data
+  uint16_t    wait;                     // us since previous poll of rx
+  uint8_t     channel;                  // Receiver index
+  uint8_t     flags;                    // CAPFILE_LOST etc.
+};
+
+#pragma pack(pop)
+
+
+//---------------------------------------------------------------------------
+// Record as it's returned by the reader
+struct CapRecord
+{
+  unsigned    channel;                  // Receiver index
+  unsigned    flags;                    // CAPFILE_LOST etc.
+  uint64_t    time;                     // Time of last byte, ns since start
+  uint64_t    polltime;                 // Time of previous poll
+  const uint8_t *data;                  // Data, in the mapped file
+  size_t      len;                      // Number of bytes
+};
+
+
+//---------------------------------------------------------------------------
+// Position of a reader in the file
+struct CapCursor
+{
+  size_t      block;                    // Index of next block
+  const uint8_t *data;                  // Records of current block
+  size_t      pos;                      // Offset of next record in data
+  size_t      end;                      // Number of bytes in data
+  uint64_t    time[CAPFILE_MAX_CHANNELS]; // Time of previous record, per rx
+  std::shared_ptr<const std::vector<uint8_t>> expanded; // Expanded block
+};
+
+
+//---------------------------------------------------------------------------
+// Background writer for a capture file
+//
+// Write is called by the capture thread of each receiver; everything else
+// is called by the thread that created the writer.
+class CapWriter
+{
+protected:
+  //-------------------------------------------------------------------------
+  // Record in the ring of a receiver, followed by the data
+  struct Staged
+  {
+    uint64_t  time;                     // Time of last byte
+    uint64_t  polltime;                 // Time of previous poll
+    uint32_t  len;                      // Number of bytes of data
+    uint32_t  flags;                    // CAPFILE_LOST etc.
+  };
+
+  //-------------------------------------------------------------------------
+  // Start of a record of a front panel line, to find its block
+  struct LineMark
+  {
+    uint32_t  pos;                      // Position of first byte in line
+    size_t    block;                    // Index of the block
+  };
+
+  //-------------------------------------------------------------------------
+  // State for one receiver
+  struct Channel
+  {
+    SPSCRing<uint8_t> ring;             // Records for the writer thread
+    bool      lost = false;             // Producer: data was lost
+    std::atomic<uint64_t> lostbytes;    // Bytes that didn't fit
+    uint64_t  time = 0;                 // Writer: time of previous record
+    unsigned  idle = CAPFILE_IDLE_MIN;  // Writer: number of 0xFF bytes
+
+    Channel()
+      : ring(CAPFILE_STAGING_SIZE, sizeof(Staged) + 0xFFFF)
+      , lostbytes(0)
+    {
+    }
+  };
+
+  FILE       *f = nullptr;              // Output file
+  CapFileHeader header = {};            // File header
+  Channel    *channels = nullptr;       // State per receiver
+
+  std::vector<uint8_t> block;           // Records of the current block
+  CapFileBlock blockheader = {};        // Header of the current block
+  bool        compress = true;          // False=store blocks as they are
+  Compressor  compressor;               // Compressor for the blocks
+  std::vector<uint8_t> packed;          // Compressed block
+  uint64_t    offset = 0;               // Offset of the next block
+  CapFileIndexEntry entry = {};         // Index entry of current block
+  std::vector<CapFileIndexEntry> index; // Index entries of written blocks
+  std::vector<uint8_t> lines[2];        // Front panel data to be framed
+  std::vector<LineMark> marks[2];       // Start of each record in lines
+  uint32_t    linepos = 0;              // Position of lines[i][0] in line
+  std::deque<uint32_t> deckstates;      // Positions of deck state commands
+  std::vector<size_t> found;            // Deck state commands in a record
+  uint32_t    tapetime = CAPFILE_NO_TAPETIME; // Latest tape time
+  size_t      tapeblock = 0;            // Block with the latest tape time
+
+  std::thread thread;                   // Writer thread
+  std::atomic<bool> quit;               // Set to stop the writer thread
+  std::atomic<bool> error;              // Set when writing failed
+
+public:
+  //-------------------------------------------------------------------------
+  // Constructor
+  CapWriter();
+
+public:
+  //-------------------------------------------------------------------------
+  // Destructor
+  ~CapWriter();
+
+  CapWriter(const CapWriter &) = delete;
+  CapWriter &operator=(const CapWriter &) = delete;
+
+public:
+  //-------------------------------------------------------------------------
+  // Create the file and start the writer thread
+  bool                                  // Returns true=success
+  Open(
+    const char *filename,               // File name
+    unsigned numchannels,               // Number of receivers
+    const char *const *names,           // Name of each receiver
+    const unsigned *bitrates,           // Bit rate of each receiver
+    uint64_t starttime,                 // Start, ns since 1970-01-01 UTC
+    bool compress = true);              // False=don't compress the blocks
+
+public:
+  //-------------------------------------------------------------------------
+  // Write everything that's waiting, and close the file
+  void Close();
+
+public:
+  //-------------------------------------------------------------------------
+  // Store a chunk of received data
+  //
+  // The data is copied, and written to the file later. If there's no room
+  // and the caller doesn't want to wait, the data is lost; the next record
+  // of the receiver is marked with CAPFILE_LOST.
+  void Write(
+    unsigned channel,                   // Receiver index
+    uint64_t time,                      // Time of last byte
+    uint64_t polltime,                  // Time of previous poll
+    const uint8_t *data,                // Data
+    size_t len,                         // Number of bytes, max 0xFFFF
+    bool wait);                         // True=wait for room, don't drop
+
+public:
+  //-------------------------------------------------------------------------
+  // Get the number of bytes of a receiver that couldn't be written
+  uint64_t Lost(
+    unsigned channel) const;            // Receiver index
+
+protected:
+  //-------------------------------------------------------------------------
+  // Thread function
+  void Run();
+
+protected:
+  //-------------------------------------------------------------------------
+  // Move the records that are waiting for a receiver into the block
+  bool                                  // Returns true=anything moved
+  Collect(
+    unsigned channel);                  // Receiver index
+
+protected:
+  //-------------------------------------------------------------------------
+  // Frame the deck state messages on the front panel lines, and note their
+  // tape times in the index
+  //
+  // The commands are found together with the opcodes. Both lines need data
+  // before a message can be framed, so this waits for the line with the
+  // least data.
+  void FrameDeckStates();
+
+protected:
+  //-------------------------------------------------------------------------
+  // Forget the front panel data that wasn't framed yet
+  //
+  // This is done when data was lost, because the lines can't be paired
+  // anymore after that.
+  void ResetLines();
+
+protected:
+  //-------------------------------------------------------------------------
+  // Add a tape time to the index entry of the block where the message
+  // started
+  void NoteTapeTime(
+    uint32_t time,                      // Seconds since start of tape
+    uint32_t pos);                      // Position of the message in line
+
+protected:
+  //-------------------------------------------------------------------------
+  // Write the current block to the file
+  void Flush();
+
+protected:
+  //-------------------------------------------------------------------------
+  // Start a new block
+  void NewBlock();
+};
+
+
+//---------------------------------------------------------------------------
+// Reader for a capture file
+//
+// The file is mapped into memory. Any number of threads can read at the
+// same time, each with its own cursor. Expanded blocks are shared by all
+// cursors; the threads of the reader expand the blocks that come after
+// the ones that the cursors are reading, so they're ready when they're
+// needed.
+class CapReader
+{
+protected:
+  //-------------------------------------------------------------------------
+  // Expanded block, or one that's being expanded
+  struct Expanded
+  {
+    bool      ready = false;            // False=being expanded
+    std::shared_ptr<const std::vector<uint8_t>> data; // nullptr=damaged
+  };
+
+  const uint8_t *base = nullptr;        // Mapped file
+  size_t      size = 0;                 // File size
+  const CapFileHeader *pheader = nullptr; // File header
+  std::vector<size_t> blocks;           // Offset of each block header
+  std::vector<CapFileIndexEntry> index; // Index entry of each block
+  std::vector<uint64_t> maxlast;        // Latest time up to each block
+  std::vector<std::vector<uint64_t>> tree; // Opcode bits of 2^n blocks
+  std::vector<std::vector<uint32_t>> tapetree; // Tape times of 2^n blocks
+  bool        indexed = false;          // True=file has an index
+#ifdef _WIN32
+  void       *hfile = nullptr;          // File handle
+  void       *hmap = nullptr;           // File mapping handle
+#endif
+
+  std::mutex  mutex;                    // Protects the fields below
+  std::condition_variable cv;           // Signaled when anything changed
+  std::map<size_t, Expanded> cache;     // Expanded blocks by index
+  size_t      ahead = 0;                // Highest block index requested
+  size_t      readahead = 0;            // Blocks to expand after that
+  bool        quit = false;             // True=stop the threads
+  std::vector<std::thread> threads;     // Threads that expand blocks
+
+public:
+  //-------------------------------------------------------------------------
+  // Destructor
+  ~CapReader()
+  {
+    Close();
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Map a file into memory and check the header
+  //
+  // The blocks are checked too; if a block is damaged or cut off (e.g.
+  // because the program that wrote the file didn't end normally), the
+  // file ends before it.
+  bool                                  // Returns true=success
+  Open(
+    const char *filename,               // File name
+    unsigned numthreads = 0);           // Threads to expand, 0=automatic
+
+public:
+  //-------------------------------------------------------------------------
+  // Unmap the file
+  void Close();
+
+public:
+  //-------------------------------------------------------------------------
+  // Get the file header
+  const CapFileHeader *Header() const
+  {
+    return pheader;
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Get the number of blocks
+  size_t Blocks() const
+  {
+    return blocks.size();
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Check if the file has an index
+  //
+  // Without an index, the results of the searches below are less exact,
+  // but they never skip anything.
+  bool Indexed() const
+  {
+    return indexed;
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Get the index entry of a block
+  const CapFileIndexEntry *             // Returns nullptr=no such block
+  Entry(
+    size_t index) const;                // Block index
+
+public:
+  //-------------------------------------------------------------------------
+  // Find the first block that may have records at or after a time
+  //
+  // All records in the blocks before it are older. This is a binary
+  // search.
+  size_t                                // Returns block index, Blocks()=none
+  FindTime(
+    uint64_t time) const;               // ns since start of capture
+
+public:
+  //-------------------------------------------------------------------------
+  // Find the first block at or after a block, that may have a command
+  // with an opcode
+  //
+  // This goes through a tree of the opcode bits of 1, 2, 4, ... blocks,
+  // so it skips large parts of the file at once.
+  size_t                                // Returns block index, Blocks()=none
+  FindOpcode(
+    uint8_t opcode,                     // Opcode, without toggle bit
+    size_t from = 0) const;             // First block to check
+
+public:
+  //-------------------------------------------------------------------------
+  // Find the first block at or after a block, that may have a tape time
+  //
+  // This goes through a tree of the tape time ranges of 1, 2, 4, ...
+  // blocks, the same way as FindOpcode. The tape time isn't always
+  // increasing, e.g. when the tape was rewound, so later blocks may have
+  // it again.
+  size_t                                // Returns block index, Blocks()=none
+  FindTapeTime(
+    uint32_t tapetime,                  // Seconds since start of tape
+    size_t from = 0) const;             // First block to check
+
+public:
+  //-------------------------------------------------------------------------
+  // Set a cursor to the first record of a block
+  void Seek(
+    CapCursor *pcursor,                 // Cursor
+    size_t index);                      // Block index
+
+public:
+  //-------------------------------------------------------------------------
+  // Set a cursor to the first record
+  void Rewind(
+    CapCursor *pcursor)                 // Cursor
+  {
+    Seek(pcursor, 0);
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Get the next record
+  //
+  // Only the records of the receivers in the mask are returned. The data
+  // stays valid until the cursor moves to another block.
+  bool                                  // Returns false=end of file
+  Next(
+    CapCursor *pcursor,                 // Cursor
+    CapRecord *prec,                    // Output record
+    unsigned mask = ~0U);               // Bit mask of receivers
+
+protected:
+  //-------------------------------------------------------------------------
+  // Read the index at the end of the file
+  bool                                  // Returns false=no valid index
+  LoadIndex();
+
+protected:
+  //-------------------------------------------------------------------------
+  // Find the blocks by going through the file, for files without an index
+  void ScanBlocks();
+
+protected:
+  //-------------------------------------------------------------------------
+  // Get a block header, if it's valid
+  const CapFileBlock *                  // Returns nullptr=damaged
+  Block(
+    size_t index) const;                // Block index
+
+protected:
+  //-------------------------------------------------------------------------
+  // Load a block into a cursor
+  bool                                  // Returns false=damaged
+  Load(
+    CapCursor *pcursor,                 // Cursor
+    size_t index);                      // Block index
+
+protected:
+  //-------------------------------------------------------------------------
+  // Expand a compressed block
+  std::shared_ptr<const std::vector<uint8_t>> // Returns nullptr=damaged
+  Expand(
+    Compressor &compressor,             // Working memory
+    size_t index);                      // Block index
+
+protected:
+  //-------------------------------------------------------------------------
+  // Forget expanded blocks that aren't used, if there are too many
+  //
+  // The caller must hold the mutex.
+  void Trim();
+
+protected:
+  //-------------------------------------------------------------------------
+  // Thread function
+  void Run();
+};
+
+
+/////////////////////////////////////////////////////////////////////////////
+// END
+/////////////////////////////////////////////////////////////////////////////
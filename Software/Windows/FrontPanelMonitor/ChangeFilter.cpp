@@ -0,0 +1,214 @@
+/****************************************************************************
+Suppression of repeated front panel messages
+(C) 2024 Jac Goudsmit
+Licensed under the MIT license.
+See LICENSE for details.
+****************************************************************************/
+
+
+/////////////////////////////////////////////////////////////////////////////
+// INCLUDES
+/////////////////////////////////////////////////////////////////////////////
+
+
+#include <cstring>
+
+#include "../../Common/FrontPanelOpcodes.h"
+
+#include "ChangeFilter.h"
+
+
+/////////////////////////////////////////////////////////////////////////////
+// PUBLIC FUNCTIONS
+/////////////////////////////////////////////////////////////////////////////
+
+
+//---------------------------------------------------------------------------
+// Filter repeated responses for an opcode
+void ChangeFilter::SetRule(
+  uint8_t opcode,                       // Opcode (without toggle bit)
+  const uint8_t *mask,                  // Mask for response, no checksum
+  size_t masklen)                       // Number of bytes in mask
+{
+  Slot &slot = slots[opcode & 0x7F];
+
+  if (masklen > CHANGEFILTER_MAX_LEN)
+  {
+    masklen = CHANGEFILTER_MAX_LEN;
+  }
+
+  uint8_t newmask[CHANGEFILTER_MAX_LEN];
+
+  memset(newmask, 0xFF, sizeof(newmask));
+  if (mask)
+  {
+    memcpy(newmask, mask, masklen);
+  }
+
+  for (size_t i = 0; i < CHANGEFILTER_MAX_LEN; i++)
+  {
+    slot.mask[i] = slot.enabled ? (slot.mask[i] | newmask[i]) : newmask[i];
+  }
+
+  // The first response byte has the toggle bit
+  slot.mask[0] &= 0x7F;
+
+  slot.enabled = true;
+  slot.entries.clear();
+}
+
+
+//---------------------------------------------------------------------------
+// Stop filtering an opcode
+void ChangeFilter::ClearRule(
+  uint8_t opcode)                       // Opcode (without toggle bit)
+{
+  Slot &slot = slots[opcode & 0x7F];
+
+  slot.enabled = false;
+  slot.entries.clear();
+}
+
+
+//---------------------------------------------------------------------------
+// Check a message, and remember its response
+bool                                    // Returns true=show message
+ChangeFilter::Pass(
+  const uint8_t *cmd,                   // Command
+  size_t cmdlen,                        // Number of bytes in command
+  const uint8_t *rsp,                   // Response
+  size_t rsplen)                        // Number of bytes in response
+{
+  if (!cmdlen)
+  {
+    return true;
+  }
+
+  Slot &slot = slots[cmd[0] & 0x7F];
+
+  if (!slot.enabled)
+  {
+    return true;
+  }
+
+  // Leave the checksums out, and the opcode with its toggle bit
+  cmdlen = (cmdlen > 2) ? cmdlen - 2 : 0;
+  cmd++;
+  if (rsplen) rsplen--;
+
+  if (cmdlen > CHANGEFILTER_MAX_LEN) cmdlen = CHANGEFILTER_MAX_LEN;
+  if (rsplen > CHANGEFILTER_MAX_LEN) rsplen = CHANGEFILTER_MAX_LEN;
+
+  uint8_t masked[CHANGEFILTER_MAX_LEN];
+
+  for (size_t i = 0; i < rsplen; i++)
+  {
+    masked[i] = rsp[i] & slot.mask[i];
+  }
+
+  // Find the last response to the same command
+  Entry *pentry = nullptr;
+
+  for (Entry &e : slot.entries)
+  {
+    if ((e.cmdlen == cmdlen) && (!memcmp(e.cmd, cmd, cmdlen)))
+    {
+      pentry = &e;
+      break;
+    }
+  }
+
+  if (pentry)
+  {
+    if ((pentry->rsplen == rsplen) && (!memcmp(pentry->rsp, masked, rsplen)))
+    {
+      slot.suppressed++;
+      return false;
+    }
+  }
+  else if (slot.entries.size() < CHANGEFILTER_MAX_ENTRIES)
+  {
+    slot.entries.emplace_back();
+    pentry = &slot.entries.back();
+    pentry->cmdlen = (uint8_t)cmdlen;
+    memcpy(pentry->cmd, cmd, cmdlen);
+  }
+
+  if (pentry)
+  {
+    pentry->rsplen = (uint8_t)rsplen;
+    memcpy(pentry->rsp, masked, rsplen);
+  }
+
+  slot.passed++;
+  return true;
+}
+
+
+//---------------------------------------------------------------------------
+// Forget all responses, so that the next message of each kind is shown
+void ChangeFilter::Reset()
+{
+  for (Slot &slot : slots)
+  {
+    slot.entries.clear();
+  }
+}
+
+
+//---------------------------------------------------------------------------
+// Get the total number of messages that were let through
+uint64_t ChangeFilter::Passed() const
+{
+  uint64_t result = 0;
+
+  for (const Slot &slot : slots)
+  {
+    result += slot.passed;
+  }
+
+  return result;
+}
+
+
+//---------------------------------------------------------------------------
+// Get the total number of messages that were suppressed
+uint64_t ChangeFilter::Suppressed() const
+{
+  uint64_t result = 0;
+
+  for (const Slot &slot : slots)
+  {
+    result += slot.suppressed;
+  }
+
+  return result;
+}
+
+
+//---------------------------------------------------------------------------
+// Print the counters of the opcodes that have a rule
+void ChangeFilter::PrintStats(
+  FILE *f) const                        // Output file
+{
+  for (unsigned opcode = 0; opcode < 128; opcode++)
+  {
+    const Slot &slot = slots[opcode];
+
+    if ((slot.passed) || (slot.suppressed))
+    {
+      int len;
+      const char *name = FrontPanel_OpcodeName((uint8_t)opcode, &len);
+
+      fprintf(f, "Opcode %02X %-24.*s %10llu shown, %10llu repeats suppressed\n",
+        opcode, len, name,
+        (unsigned long long)slot.passed,
+        (unsigned long long)slot.suppressed);
+    }
+  }
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// END
+/////////////////////////////////////////////////////////////////////////////
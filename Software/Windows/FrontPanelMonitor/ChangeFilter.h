@@ -0,0 +1,143 @@
+/****************************************************************************
+Suppression of repeated front panel messages
+(C) 2024 Jac Goudsmit
+Licensed under the MIT license.
+See LICENSE for details.
+****************************************************************************/
+
+/*
+  The front panel polls the deck many times per second, and most of the
+  time the answers are the same as the previous time. The filter remembers
+  the last response for each opcode and command parameter combination, and
+  lets a message through only if the response is different. Messages are
+  checked before they're decoded, so repeated messages cost neither
+  decoding nor output.
+
+  What counts as "different" is up to a mask for each opcode: only the
+  response bits that are set in the mask are compared. That way, bits that
+  change all the time but aren't interesting (e.g. the bits in the poll
+  status that appear to follow the tachometers) can be ignored. The toggle
+  bit in the first byte of each response is always ignored. A change of
+  the response length always counts.
+
+  Only opcodes that have a rule are filtered; everything else (e.g. key
+  presses, where a repeat is meaningful) is always let through. The
+  processing modules decide which rules they want (see Proc.h).
+*/
+
+
+#pragma once
+
+
+/////////////////////////////////////////////////////////////////////////////
+// INCLUDES
+/////////////////////////////////////////////////////////////////////////////
+
+
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <vector>
+
+
+/////////////////////////////////////////////////////////////////////////////
+// MACROS
+/////////////////////////////////////////////////////////////////////////////
+
+
+// Maximum number of command and response bytes that are remembered;
+// bytes after this are not compared
+#define CHANGEFILTER_MAX_LEN 48
+
+// Maximum number of different command parameters per opcode; if there are
+// more, messages with new parameters are always let through
+#define CHANGEFILTER_MAX_ENTRIES 256
+
+
+/////////////////////////////////////////////////////////////////////////////
+// TYPES
+/////////////////////////////////////////////////////////////////////////////
+
+
+class ChangeFilter
+{
+protected:
+  //-------------------------------------------------------------------------
+  // Last response for one command
+  struct Entry
+  {
+    uint8_t   cmdlen;                   // Command length without checksum
+    uint8_t   rsplen;                   // Response length without checksum
+    uint8_t   cmd[CHANGEFILTER_MAX_LEN]; // Command parameters
+    uint8_t   rsp[CHANGEFILTER_MAX_LEN]; // Masked response
+  };
+
+  //-------------------------------------------------------------------------
+  // Rule and state for one opcode
+  struct Slot
+  {
+    bool      enabled = false;          // True=filter this opcode
+    uint8_t   mask[CHANGEFILTER_MAX_LEN]; // Significant response bits
+    std::vector<Entry> entries;         // Last responses
+    uint64_t  passed = 0;               // Number of messages let through
+    uint64_t  suppressed = 0;           // Number of messages suppressed
+  };
+
+  Slot        slots[128];               // Indexed by opcode
+
+public:
+  //-------------------------------------------------------------------------
+  // Filter repeated responses for an opcode
+  //
+  // Response bytes after the end of the mask are compared in full. Without
+  // a mask, every bit of the response is significant. If the opcode
+  // already has a rule, a bit is significant if it is in either mask.
+  void SetRule(
+    uint8_t opcode,                     // Opcode (without toggle bit)
+    const uint8_t *mask = nullptr,      // Mask for response, no checksum
+    size_t masklen = 0);                // Number of bytes in mask
+
+public:
+  //-------------------------------------------------------------------------
+  // Stop filtering an opcode
+  void ClearRule(
+    uint8_t opcode);                    // Opcode (without toggle bit)
+
+public:
+  //-------------------------------------------------------------------------
+  // Check a message, and remember its response
+  //
+  // The lengths include the checksums, the same as for Decode_Message.
+  bool                                  // Returns true=show message
+  Pass(
+    const uint8_t *cmd,                 // Command
+    size_t cmdlen,                      // Number of bytes in command
+    const uint8_t *rsp,                 // Response
+    size_t rsplen);                     // Number of bytes in response
+
+public:
+  //-------------------------------------------------------------------------
+  // Forget all responses, so that the next message of each kind is shown
+  void Reset();
+
+public:
+  //-------------------------------------------------------------------------
+  // Get the total number of messages that were let through
+  uint64_t Passed() const;
+
+public:
+  //-------------------------------------------------------------------------
+  // Get the total number of messages that were suppressed
+  uint64_t Suppressed() const;
+
+public:
+  //-------------------------------------------------------------------------
+  // Print the counters of the opcodes that have a rule
+  void PrintStats(
+    FILE *f) const;                     // Output file
+};
+
+
+/////////////////////////////////////////////////////////////////////////////
+// END
+/////////////////////////////////////////////////////////////////////////////
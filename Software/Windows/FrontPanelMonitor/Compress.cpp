@@ -0,0 +1,405 @@
+/****************************************************************************
+Block compression
+(C) 2024 Jac Goudsmit
+Licensed under the MIT license.
+See LICENSE for details.
+****************************************************************************/
+
+
+/////////////////////////////////////////////////////////////////////////////
+// INCLUDES
+/////////////////////////////////////////////////////////////////////////////
+
+
+#include <cstring>
+
+#include "ByteOps.h"
+#include "Compress.h"
+
+
+/////////////////////////////////////////////////////////////////////////////
+// MACROS
+/////////////////////////////////////////////////////////////////////////////
+
+
+#define MIN_MATCH 4                     // Shortest match
+
+
+/////////////////////////////////////////////////////////////////////////////
+// LOCAL FUNCTIONS
+/////////////////////////////////////////////////////////////////////////////
+
+
+//---------------------------------------------------------------------------
+// Read 4 bytes at any alignment
+static inline uint32_t Read32(
+  const uint8_t *p)                     // Data
+{
+  uint32_t v;
+
+  memcpy(&v, p, sizeof(v));
+
+  return v;
+}
+
+
+//---------------------------------------------------------------------------
+// Hash a 4-byte sequence
+static inline uint32_t Hash(
+  uint32_t v)                           // 4 bytes
+{
+  return (v * 2654435761U) >> (32 - COMPRESS_HASH_BITS);
+}
+
+
+//---------------------------------------------------------------------------
+// Read a length that's continued with bytes of 255
+static inline bool                      // Returns false=past end of data
+GetLength(
+  const uint8_t *src,                   // Data
+  size_t len,                           // Number of bytes
+  size_t &pos,                          // Input/output position
+  size_t &n)                            // Input/output length
+{
+  for (;;)
+  {
+    if (pos >= len)
+    {
+      return false;
+    }
+
+    uint8_t b = src[pos++];
+
+    n += b;
+
+    if (b != 255)
+    {
+      return true;
+    }
+  }
+}
+
+
+//---------------------------------------------------------------------------
+// Write a length that's continued with bytes of 255
+static inline uint8_t *                 // Returns end of output
+PutLength(
+  uint8_t *dst,                         // Output
+  size_t n)                             // Length
+{
+  for (; n >= 255; n -= 255)
+  {
+    *dst++ = 255;
+  }
+
+  *dst++ = (uint8_t)n;
+
+  return dst;
+}
+
+
+//---------------------------------------------------------------------------
+// Replace runs of 0xFF by their lengths
+//
+// The output can be up to twice as long as the input.
+static size_t                           // Returns output length
+RunPack(
+  const uint8_t *src,                   // Data
+  size_t len,                           // Number of bytes
+  uint8_t *dst)                         // Output
+{
+  uint8_t *d = dst;
+  size_t pos = 0;
+
+  while (pos < len)
+  {
+    // Copy up to the next run
+    const uint8_t *p = (const uint8_t *)memchr(src + pos, 0xFF, len - pos);
+    size_t n = p ? (size_t)(p - (src + pos)) : len - pos;
+
+    memcpy(d, src + pos, n);
+    d += n;
+    pos += n;
+
+    if (pos == len)
+    {
+      break;
+    }
+
+    // Skip the run
+    n = ByteOps_FindNotIdle(src + pos, len - pos);
+    pos += n;
+
+    *d++ = 0xFF;
+    d = PutLength(d, n - 1);
+  }
+
+  return (size_t)(d - dst);
+}
+
+
+//---------------------------------------------------------------------------
+// Expand runs of 0xFF
+static size_t                           // Returns output length, 0=damaged
+RunUnpack(
+  const uint8_t *src,                   // Data
+  size_t len,                           // Number of bytes
+  uint8_t *dst,                         // Output
+  size_t dstsize)                       // Size of output buffer
+{
+  size_t pos = 0;
+  size_t out = 0;
+
+  while (pos < len)
+  {
+    const uint8_t *p = (const uint8_t *)memchr(src + pos, 0xFF, len - pos);
+    size_t n = p ? (size_t)(p - (src + pos)) : len - pos;
+
+    if (n > dstsize - out)
+    {
+      return 0;
+    }
+
+    memcpy(dst + out, src + pos, n);
+    out += n;
+    pos += n;
+
+    if (pos == len)
+    {
+      break;
+    }
+
+    pos++;
+    n = 1;
+
+    if ((!GetLength(src, len, pos, n)) || (n > dstsize - out))
+    {
+      return 0;
+    }
+
+    memset(dst + out, 0xFF, n);
+    out += n;
+  }
+
+  return out;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// PUBLIC FUNCTIONS
+/////////////////////////////////////////////////////////////////////////////
+
+
+//---------------------------------------------------------------------------
+// Compress a block
+size_t                                  // Returns size, 0=not smaller
+Compressor::Pack(
+  const uint8_t *src,                   // Data to compress
+  size_t len,                           // Number of bytes
+  uint8_t *dst,                         // Output buffer
+  size_t dstsize)                       // Size of output buffer
+{
+  if (dstsize > len)
+  {
+    dstsize = len;
+  }
+
+  // Stage 1
+  tmp.resize(len * 2 + 1);
+  size_t slen = RunPack(src, len, tmp.data());
+  const uint8_t *s = tmp.data();
+
+  // Stage 2
+  table.assign((size_t)1 << COMPRESS_HASH_BITS, 0);
+
+  size_t pos = 0;                       // Position in stage 1 output
+  size_t anchor = 0;                    // Start of literals
+  uint8_t *d = dst;
+  uint8_t *dend = dst + dstsize;
+
+  // Add a command; the match length is 0 for the last one
+  auto command = [&](size_t mlen, size_t offset) -> bool
+  {
+    size_t lit = pos - anchor;
+
+    // Worst case size of the command
+    if ((size_t)(dend - d) < 1 + lit / 255 + 1 + lit + 2 + mlen / 255 + 1)
+    {
+      return false;
+    }
+
+    size_t mcode = mlen ? mlen - MIN_MATCH : 0;
+    uint8_t *token = d++;
+
+    *token = (uint8_t)(((lit < 15) ? lit : 15) << 4);
+    if (lit >= 15)
+    {
+      d = PutLength(d, lit - 15);
+    }
+
+    memcpy(d, s + anchor, lit);
+    d += lit;
+
+    if (mlen)
+    {
+      *token |= (uint8_t)((mcode < 15) ? mcode : 15);
+
+      *d++ = (uint8_t)offset;
+      *d++ = (uint8_t)(offset >> 8);
+
+      if (mcode >= 15)
+      {
+        d = PutLength(d, mcode - 15);
+      }
+    }
+
+    return true;
+  };
+
+  if (slen >= MIN_MATCH * 2)
+  {
+    size_t limit = slen - MIN_MATCH;
+
+    while (pos <= limit)
+    {
+      uint32_t v = Read32(s + pos);
+      uint32_t h = Hash(v);
+      size_t cand = table[h];
+
+      table[h] = (uint32_t)(pos + 1);
+
+      if ((cand) && (pos - (cand - 1) <= COMPRESS_MAX_OFFSET) && (Read32(s + cand - 1) == v))
+      {
+        cand--;
+
+        size_t mlen = MIN_MATCH;
+        while ((pos + mlen < slen) && (s[cand + mlen] == s[pos + mlen]))
+        {
+          mlen++;
+        }
+
+        // The match may start in the literals before it
+        while ((pos > anchor) && (cand > 0) && (s[pos - 1] == s[cand - 1]))
+        {
+          pos--;
+          cand--;
+          mlen++;
+        }
+
+        if (!command(mlen, pos - cand))
+        {
+          return 0;
+        }
+
+        pos += mlen;
+        anchor = pos;
+        continue;
+      }
+
+      // Go faster through data that doesn't compress
+      pos += 1 + ((pos - anchor) >> 6);
+    }
+  }
+
+  pos = slen;
+  if (!command(0, 0))
+  {
+    return 0;
+  }
+
+  size_t result = (size_t)(d - dst);
+
+  return (result < len) ? result : 0;
+}
+
+
+//---------------------------------------------------------------------------
+// Expand a compressed block
+size_t                                  // Returns size, 0=damaged
+Compressor::Unpack(
+  const uint8_t *src,                   // Compressed data
+  size_t len,                           // Number of bytes
+  uint8_t *dst,                         // Output buffer
+  size_t dstsize)                       // Expected size of expanded data
+{
+  // Stage 2; the output of stage 1 is never more than twice the size
+  tmp.resize(dstsize * 2 + 1);
+
+  uint8_t *t = tmp.data();
+  size_t tsize = tmp.size();
+  size_t pos = 0;
+  size_t out = 0;
+
+  while (pos < len)
+  {
+    unsigned token = src[pos++];
+    size_t lit = token >> 4;
+
+    if ((lit == 15) && (!GetLength(src, len, pos, lit)))
+    {
+      return 0;
+    }
+
+    if ((lit > len - pos) || (lit > tsize - out))
+    {
+      return 0;
+    }
+
+    memcpy(t + out, src + pos, lit);
+    pos += lit;
+    out += lit;
+
+    if (pos == len)
+    {
+      // Last command
+      break;
+    }
+
+    if (len - pos < 2)
+    {
+      return 0;
+    }
+
+    size_t offset = src[pos] | (src[pos + 1] << 8);
+    size_t mlen = (token & 15) + MIN_MATCH;
+    pos += 2;
+
+    if (((token & 15) == 15) && (!GetLength(src, len, pos, mlen)))
+    {
+      return 0;
+    }
+
+    if ((!offset) || (offset > out) || (mlen > tsize - out))
+    {
+      return 0;
+    }
+
+    uint8_t *p = t + out;
+    const uint8_t *m = p - offset;
+
+    if (offset >= mlen)
+    {
+      memcpy(p, m, mlen);
+    }
+    else
+    {
+      // Overlapping; repeats the last offset bytes
+      for (size_t i = 0; i < mlen; i++)
+      {
+        p[i] = m[i];
+      }
+    }
+
+    out += mlen;
+  }
+
+  // Stage 1
+  size_t result = RunUnpack(t, out, dst, dstsize);
+
+  return (result == dstsize) ? result : 0;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// END
+/////////////////////////////////////////////////////////////////////////////
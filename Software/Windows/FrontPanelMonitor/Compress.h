@@ -0,0 +1,112 @@
+/****************************************************************************
+Block compression
+(C) 2024 Jac Goudsmit
+Licensed under the MIT license.
+See LICENSE for details.
+****************************************************************************/
+
+/*
+  The data on the buses is mostly idle fill (0xFF) and the same few
+  messages (polls, VU meter updates) over and over, so it compresses very
+  well. Blocks are compressed in two stages:
+
+  1. Runs of 0xFF are replaced by 0xFF followed by the length of the run.
+     The runs are found with ByteOps_FindNotIdle, so this is about as fast
+     as copying the data, and it makes the input of the next stage a lot
+     smaller.
+
+  2. An LZ77 stage (similar to LZ4) replaces repeated sequences with a
+     reference to an earlier copy in the same block. It uses a hash table
+     of 4-byte sequences and takes the first match it finds, so it's fast
+     rather than thorough.
+
+  Each block is compressed on its own, so blocks can be expanded in any
+  order, and in parallel.
+
+  Stage 1 format: any byte other than 0xFF is itself. 0xFF is followed by
+  the length of the run minus one, as a sequence of bytes that's ended by
+  a byte that's not 255; the length is the sum of the bytes.
+
+  Stage 2 format: a sequence of commands. Each command starts with a byte
+  that has the number of literal bytes in the upper 4 bits and the match
+  length minus 4 in the lower 4 bits. The rest of the command is, in this
+  order:
+  - If the literal length is 15, more bytes that are added to it, until
+    a byte that's not 255.
+  - The literal bytes.
+  - The 16-bit offset of the match (little-endian, 1=previous byte).
+  - If the match length is 15, more bytes that are added to it, the same
+    way as for the literal length.
+  The last command only has literals, and ends the block.
+*/
+
+
+#pragma once
+
+
+/////////////////////////////////////////////////////////////////////////////
+// INCLUDES
+/////////////////////////////////////////////////////////////////////////////
+
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+
+/////////////////////////////////////////////////////////////////////////////
+// MACROS
+/////////////////////////////////////////////////////////////////////////////
+
+
+// Number of bits of the hash of a 4-byte sequence
+#define COMPRESS_HASH_BITS 14
+
+// Longest distance of a match
+#define COMPRESS_MAX_OFFSET 65535
+
+
+/////////////////////////////////////////////////////////////////////////////
+// TYPES
+/////////////////////////////////////////////////////////////////////////////
+
+
+//---------------------------------------------------------------------------
+// Compressor and expander for blocks
+//
+// An object only has working memory, so each thread needs one of its own,
+// but it can be used for any number of blocks.
+class Compressor
+{
+protected:
+  std::vector<uint8_t> tmp;             // Data between the stages
+  std::vector<uint32_t> table;          // Hash table, positions + 1
+
+public:
+  //-------------------------------------------------------------------------
+  // Compress a block
+  //
+  // If the compressed data isn't smaller than the original, there's no
+  // point in compressing the block, so that's reported as a failure.
+  size_t                                // Returns size, 0=not smaller
+  Pack(
+    const uint8_t *src,                 // Data to compress
+    size_t len,                         // Number of bytes
+    uint8_t *dst,                       // Output buffer
+    size_t dstsize);                    // Size of output buffer
+
+public:
+  //-------------------------------------------------------------------------
+  // Expand a compressed block
+  size_t                                // Returns size, 0=damaged
+  Unpack(
+    const uint8_t *src,                 // Compressed data
+    size_t len,                         // Number of bytes
+    uint8_t *dst,                       // Output buffer
+    size_t dstsize);                    // Expected size of expanded data
+};
+
+
+/////////////////////////////////////////////////////////////////////////////
+// END
+/////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,257 @@
+/****************************************************************************
+Model of the deck state
+(C) 2024 Jac Goudsmit
+Licensed under the MIT license.
+See LICENSE for details.
+****************************************************************************/
+
+
+/////////////////////////////////////////////////////////////////////////////
+// INCLUDES
+/////////////////////////////////////////////////////////////////////////////
+
+
+#include "DeckState.h"
+
+
+/////////////////////////////////////////////////////////////////////////////
+// LOCAL FUNCTIONS
+/////////////////////////////////////////////////////////////////////////////
+
+
+//---------------------------------------------------------------------------
+// Change a value of the state
+static inline void Set(
+  uint8_t &field,                       // Value in the state
+  uint8_t value,                        // New value
+  bool &changed)                        // Set to true if different
+{
+  changed |= (field != value);
+  field = value;
+}
+
+
+//---------------------------------------------------------------------------
+// Get the name of a value, or an empty string
+static const char *                     // Returns name
+ValueName(
+  uint8_t opcode,                       // Opcode
+  uint8_t value)                        // Value
+{
+  const char *name = FrontPanel_ValueName(FrontPanel_Opcode(opcode), value);
+
+  return name ? name : "";
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// PUBLIC FUNCTIONS
+/////////////////////////////////////////////////////////////////////////////
+
+
+//---------------------------------------------------------------------------
+// Writer: update the state with a message
+bool                                    // Returns true=state changed
+DeckState::Add(
+  const MsgTime *ptime,                 // Time stamps
+  const uint8_t *cmd,                   // Command
+  size_t cmdlen,                        // Number of bytes in command
+  const uint8_t *rsp,                   // Response
+  size_t rsplen)                        // Number of bytes in response
+{
+  if (!cmdlen)
+  {
+    return false;
+  }
+
+  uint8_t opcode = cmd[0] & 0x7F;
+
+  switch (opcode)
+  {
+  case FRONTPANEL_DRAWER_STATUS:
+  case FRONTPANEL_FUNCTION_STATE:
+  case FRONTPANEL_POLL:
+  case FRONTPANEL_TAPE_TYPE:
+  case FRONTPANEL_DECK_STATE:
+  case FRONTPANEL_SECTOR:
+  case FRONTPANEL_REPEAT_MODE:
+    break;
+
+  default:
+    return false;
+  }
+
+  scratch.Reset();
+
+  if (!Decode_Message(&scratch, ptime, cmd, cmdlen, rsp, rsplen))
+  {
+    return false;
+  }
+
+  return Apply(scratch.Events());
+}
+
+
+//---------------------------------------------------------------------------
+// Writer: update the state with a decoded event
+bool                                    // Returns true=state changed
+DeckState::Apply(
+  const DecodeEvent *pev)               // Event
+{
+  bool changed = false;
+  uint8_t part;
+
+  switch (pev->type)
+  {
+  case DECODE_VALUE:
+    switch (pev->opcode)
+    {
+    case FRONTPANEL_DRAWER_STATUS:
+      Set(state.drawer, pev->value, changed);
+      part = DECKSTATE_DRAWER;
+      break;
+
+    case FRONTPANEL_FUNCTION_STATE:
+      Set(state.function, pev->value, changed);
+      part = DECKSTATE_FUNCTION;
+      break;
+
+    case FRONTPANEL_SECTOR:
+      Set(state.sector, pev->value, changed);
+      part = DECKSTATE_SECTOR;
+      break;
+
+    case FRONTPANEL_REPEAT_MODE:
+      Set(state.repeat, pev->value, changed);
+      part = DECKSTATE_REPEAT;
+      break;
+
+    default:
+      return false;
+    }
+    break;
+
+  case DECODE_RAW:
+    // Values that have no name are still part of the state, as long as
+    // the message is otherwise as expected
+    if ((pev->opcode == FRONTPANEL_DRAWER_STATUS)
+      && (pev->raw.cmd.len == 1) && (pev->raw.rsp.len == 2) && (!pev->raw.rsp.data[0]))
+    {
+      Set(state.drawer, pev->raw.rsp.data[1], changed);
+      part = DECKSTATE_DRAWER;
+    }
+    else if ((pev->opcode == FRONTPANEL_REPEAT_MODE)
+      && (pev->raw.cmd.len == 2) && (pev->raw.rsp.len == 1) && (!pev->raw.rsp.data[0]))
+    {
+      Set(state.repeat, pev->raw.cmd.data[1], changed);
+      part = DECKSTATE_REPEAT;
+    }
+    else
+    {
+      return false;
+    }
+    break;
+
+  case DECODE_POLL:
+    for (unsigned i = 0; i < 4; i++)
+    {
+      Set(state.poll[i], pev->poll.status[i], changed);
+    }
+    part = DECKSTATE_POLL;
+    break;
+
+  case DECODE_TAPETYPE:
+    Set(state.tapetype, pev->tapetype.type, changed);
+    part = DECKSTATE_TAPETYPE;
+    break;
+
+  case DECODE_DECKSTATE:
+    Set(state.status, pev->deck.status, changed);
+    Set(state.track, pev->deck.track, changed);
+    Set(state.hours, pev->deck.hours, changed);
+    Set(state.minutes, pev->deck.minutes, changed);
+    Set(state.seconds, pev->deck.seconds, changed);
+    Set(state.counter[0], pev->deck.counter[0], changed);
+    Set(state.counter[1], pev->deck.counter[1], changed);
+    Set(state.unknown6, pev->deck.unknown6, changed);
+    Set(state.unknown9, pev->deck.unknown9, changed);
+    part = DECKSTATE_TIME;
+    break;
+
+  default:
+    return false;
+  }
+
+  // The first value counts as a change, even if it happens to be 0
+  changed |= !(state.known & part);
+  state.known |= part;
+
+  if (!changed)
+  {
+    return false;
+  }
+
+  state.time = pev->time.start;
+  state.changes++;
+  snapshot.Store(state);
+
+  return true;
+}
+
+
+//---------------------------------------------------------------------------
+// Print a snapshot
+void DeckState::Print(
+  FILE *f,                              // Output file
+  const DeckSnapshot &s)                // Snapshot
+{
+  if (!s.known)
+  {
+    fprintf(f, "\nDeck state: nothing received\n");
+    return;
+  }
+
+  fprintf(f, "\nDeck state after %lu changes, at %.3f s:\n", (unsigned long)s.changes, s.time / 1e9);
+
+  if (s.known & DECKSTATE_DRAWER)
+  {
+    fprintf(f, "  Drawer status   %02X %s\n", s.drawer, ValueName(FRONTPANEL_DRAWER_STATUS, s.drawer));
+  }
+
+  if (s.known & DECKSTATE_FUNCTION)
+  {
+    fprintf(f, "  Function state  %02X %s\n", s.function, ValueName(FRONTPANEL_FUNCTION_STATE, s.function));
+  }
+
+  if (s.known & DECKSTATE_POLL)
+  {
+    fprintf(f, "  Poll status     %02X %02X %02X %02X\n", s.poll[0], s.poll[1], s.poll[2], s.poll[3]);
+  }
+
+  if (s.known & DECKSTATE_TAPETYPE)
+  {
+    fprintf(f, "  Tape type       %02X %s\n", s.tapetype, ValueName(FRONTPANEL_TAPE_TYPE, s.tapetype));
+  }
+
+  if (s.known & DECKSTATE_TIME)
+  {
+    fprintf(f, "  Time            T%02X %X:%02X:%02X C%02X%02X [%02X %X %02X %02X]\n",
+      s.track, s.hours & 0xF, s.minutes, s.seconds, s.counter[0], s.counter[1],
+      s.status, s.hours >> 4, s.unknown6, s.unknown9);
+  }
+
+  if (s.known & DECKSTATE_SECTOR)
+  {
+    fprintf(f, "  Sector          %u\n", s.sector);
+  }
+
+  if (s.known & DECKSTATE_REPEAT)
+  {
+    fprintf(f, "  Repeat mode     %02X %s\n", s.repeat, ValueName(FRONTPANEL_REPEAT_MODE, s.repeat));
+  }
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// END
+/////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,165 @@
+/****************************************************************************
+Model of the deck state
+(C) 2024 Jac Goudsmit
+Licensed under the MIT license.
+See LICENSE for details.
+****************************************************************************/
+
+/*
+  The state of the deck is spread out over several messages: the drawer
+  status, the function state, the poll status, the tape type, the time
+  and counter, the sector and the repeat mode. The decoder turns each of
+  those into an event, and the sinks show them, but nothing remembers the
+  state as a whole. This model does.
+
+  The model is updated on the decoder thread, with every message, before
+  the repeated messages are filtered out: the filter only compares the
+  bits that the sinks are interested in (e.g. the dump only looks at the
+  track number of the time message), and the model needs all of them.
+  The messages are decoded with the same decoder as the sinks use, into a
+  batch of its own. Decoding the short messages that make up the state is
+  cheaper than comparing them with the previous ones to skip the repeats.
+
+  Each time the state changes, a copy is stored in a sequence lock (see
+  SeqLock.h). Other threads (e.g. the sinks) can get the latest copy at
+  any time without locking, and the version number tells them whether
+  anything changed since they last looked, without even copying it.
+*/
+
+
+#pragma once
+
+
+/////////////////////////////////////////////////////////////////////////////
+// INCLUDES
+/////////////////////////////////////////////////////////////////////////////
+
+
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+
+#include "../../Common/FrontPanelOpcodes.h"
+
+#include "Decode.h"
+#include "SeqLock.h"
+
+
+/////////////////////////////////////////////////////////////////////////////
+// MACROS
+/////////////////////////////////////////////////////////////////////////////
+
+
+// Bits for the parts of the state that were received
+#define DECKSTATE_DRAWER    0x01        // Drawer status (0x46)
+#define DECKSTATE_FUNCTION  0x02        // Function state (0x58)
+#define DECKSTATE_POLL      0x04        // Poll status (0x41)
+#define DECKSTATE_TAPETYPE  0x08        // Tape type (0x49)
+#define DECKSTATE_TIME      0x10        // Time and counter (0x60)
+#define DECKSTATE_SECTOR    0x20        // Sector (0x2A)
+#define DECKSTATE_REPEAT    0x40        // Repeat mode (0x23)
+
+
+/////////////////////////////////////////////////////////////////////////////
+// TYPES
+/////////////////////////////////////////////////////////////////////////////
+
+
+//---------------------------------------------------------------------------
+// Snapshot of the deck state
+//
+// The values are stored the way they come in; see Proc_Screen.cpp for what
+// is known about them.
+struct DeckSnapshot
+{
+  uint64_t    time;                     // Time of last change, ns
+  uint32_t    changes;                  // Number of changes so far
+  uint8_t     known;                    // DECKSTATE_... parts received
+  uint8_t     drawer;                   // Drawer status
+  uint8_t     function;                 // Function state
+  uint8_t     poll[4];                  // Poll status, without toggle bit
+  uint8_t     tapetype;                 // Tape type
+  uint8_t     status;                   // Status byte of time message
+  uint8_t     track;                    // Track number, BCD
+  uint8_t     hours;                    // Hours in low nibble; sign?
+  uint8_t     minutes;                  // Minutes, BCD
+  uint8_t     seconds;                  // Seconds, BCD
+  uint8_t     counter[2];               // Tape counter, BCD
+  uint8_t     unknown6;                 // Unknown byte of time message
+  uint8_t     unknown9;                 // Unknown byte of time message
+  uint8_t     sector;                   // Sector
+  uint8_t     repeat;                   // Repeat mode
+};
+
+
+//---------------------------------------------------------------------------
+// Model of the deck state
+class DeckState
+{
+protected:
+  DeckSnapshot state = {};              // State, only used by writer
+  SeqLock<DeckSnapshot> snapshot;       // Latest copy for readers
+  DecodeBatch scratch;                  // Batch to decode one message
+
+public:
+  //-------------------------------------------------------------------------
+  // Constructor
+  DeckState()
+    : scratch(1)
+  {
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Writer: update the state with a message
+  //
+  // The command and response include the checksums.
+  bool                                  // Returns true=state changed
+  Add(
+    const MsgTime *ptime,               // Time stamps
+    const uint8_t *cmd,                 // Command
+    size_t cmdlen,                      // Number of bytes in command
+    const uint8_t *rsp,                 // Response
+    size_t rsplen);                     // Number of bytes in response
+
+public:
+  //-------------------------------------------------------------------------
+  // Writer: update the state with a decoded event
+  //
+  // Events that have nothing to do with the state are ignored.
+  bool                                  // Returns true=state changed
+  Apply(
+    const DecodeEvent *pev);            // Event
+
+public:
+  //-------------------------------------------------------------------------
+  // Reader: get the version of the latest snapshot
+  //
+  // The version changes every time the state changes.
+  uint32_t Version() const
+  {
+    return snapshot.Version();
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Reader: get a copy of the latest snapshot
+  uint32_t                              // Returns version of the snapshot
+  Load(
+    DeckSnapshot *psnapshot) const      // Output snapshot
+  {
+    return snapshot.Load(psnapshot);
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Print a snapshot
+  static void Print(
+    FILE *f,                            // Output file
+    const DeckSnapshot &s);             // Snapshot
+};
+
+
+/////////////////////////////////////////////////////////////////////////////
+// END
+/////////////////////////////////////////////////////////////////////////////
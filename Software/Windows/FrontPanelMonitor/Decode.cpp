@@ -0,0 +1,480 @@
+/****************************************************************************
+Decoding of front panel messages into events
+(C) 2024 Jac Goudsmit
+Licensed under the MIT license.
+See LICENSE for details.
+****************************************************************************/
+
+
+/////////////////////////////////////////////////////////////////////////////
+// INCLUDES
+/////////////////////////////////////////////////////////////////////////////
+
+
+#include <algorithm>
+#include <cstring>
+
+#include "../../Common/FrontPanelOpcodes.h"
+
+#include "Decode.h"
+
+
+/////////////////////////////////////////////////////////////////////////////
+// LOCAL FUNCTIONS
+/////////////////////////////////////////////////////////////////////////////
+
+
+//---------------------------------------------------------------------------
+// Add an event for a message that wasn't understood
+static void DecodeRaw(
+  DecodeBatch *pbatch,                  // Batch
+  DecodeEvent *pev,                     // Event to fill in
+  const uint8_t *cmd,                   // Command without checksum
+  size_t cmdlen,                        // Command length
+  const uint8_t *rsp,                   // Response without checksum
+  size_t rsplen)                        // Response length
+{
+  pev->type = DECODE_RAW;
+  pev->raw.cmd = pbatch->Copy(cmd, cmdlen, 0x7F);
+  pev->raw.rsp = pbatch->Copy(rsp, rsplen, 0x7F);
+}
+
+
+//---------------------------------------------------------------------------
+// Decode the messages that need special treatment
+static bool                             // Returns false=not understood
+DecodeCustom(
+  DecodeBatch *pbatch,                  // Batch
+  DecodeEvent *pev,                     // Event to fill in
+  const FrontPanelOpcode *op,           // Descriptor
+  const uint8_t *cmd,                   // Command without checksum
+  const uint8_t *rsp)                   // Response without checksum
+{
+  switch (pev->opcode)
+  {
+  case FRONTPANEL_GO_TO_TRACK:
+    pev->type = DECODE_GOTOTRACK;
+    pev->gototrack.track = cmd[1];
+    pev->gototrack.param = cmd[2];
+    return true;
+
+  case FRONTPANEL_SEARCH:
+    // The parameters are the number of tracks to search (1-99 forwards,
+    // 0xEE=-0, 0xED=-1 etc. backwards) and a byte that seems to be always
+    // 1; they're kept as bytes until it's clear what they mean
+    pev->type = DECODE_BYTES;
+    pev->bytes = pbatch->Copy(cmd + 1, 2);
+    return true;
+
+  case FRONTPANEL_POLL:
+    pev->type = DECODE_POLL;
+    pev->poll.status[0] = rsp[0] & 0x7F;
+    memcpy(pev->poll.status + 1, rsp + 1, 3);
+    return true;
+
+  case FRONTPANEL_TAPE_TYPE:
+    if ((!FrontPanel_ValueName(op, rsp[1])) && (!(op->flags & FRONTPANEL_HEXFALLBACK)))
+    {
+      return false;
+    }
+
+    pev->type = DECODE_TAPETYPE;
+    pev->tapetype.status = rsp[0] & 0x7F;
+    pev->tapetype.type = rsp[1];
+    return true;
+
+  case FRONTPANEL_VU:
+    pev->type = DECODE_VU;
+    pev->vu.left = rsp[1];
+    pev->vu.right = rsp[2];
+    return true;
+
+  case FRONTPANEL_BIT_ERRORS:
+    pev->type = DECODE_BITERRORS;
+    pev->biterrors.track = cmd[1];
+    pev->biterrors.status = rsp[0] & 0x7F;
+    pev->biterrors.errors = rsp[1];
+    return true;
+
+  case FRONTPANEL_DECK_STATE:
+    pev->type = DECODE_DECKSTATE;
+    pev->deck.status = rsp[1];
+    pev->deck.track = rsp[2];
+    pev->deck.hours = rsp[3];
+    pev->deck.minutes = rsp[4];
+    pev->deck.seconds = rsp[5];
+    pev->deck.unknown6 = rsp[6];
+    pev->deck.counter[0] = rsp[7];
+    pev->deck.counter[1] = rsp[8];
+    pev->deck.unknown9 = rsp[9];
+    return true;
+
+  case FRONTPANEL_PREREC_INFO:
+    pev->type = DECODE_PRERECINFO;
+    pev->prerec.unknown1 = rsp[1];
+    pev->prerec.tracks = rsp[2];
+    pev->prerec.hours = rsp[3];
+    pev->prerec.minutes = rsp[4];
+    pev->prerec.seconds = rsp[5];
+    return true;
+
+  default:
+    // Also update Decode_Known when adding opcodes here
+    return false;
+  }
+}
+
+
+//---------------------------------------------------------------------------
+// Store a parameter value if it has a name, or if the descriptor allows
+// unknown values
+static bool                             // Returns false=unknown value
+DecodeValue(
+  DecodeEvent *pev,                     // Event to fill in
+  const FrontPanelOpcode *op,           // Descriptor
+  uint8_t value)                        // Value
+{
+  if ((!FrontPanel_ValueName(op, value)) && (!(op->flags & FRONTPANEL_HEXFALLBACK)))
+  {
+    return false;
+  }
+
+  pev->type = DECODE_VALUE;
+  pev->value = value;
+
+  return true;
+}
+
+
+//---------------------------------------------------------------------------
+// Store a text
+static void DecodeText(
+  DecodeBatch *pbatch,                  // Batch
+  DecodeEvent *pev,                     // Event to fill in
+  uint8_t kind,                         // Text kind or track number
+  const uint8_t *text,                  // Text
+  size_t len)                           // Number of characters
+{
+  DecodeBytes b = pbatch->Copy(text, len);
+
+  pev->type = DECODE_TEXT;
+  pev->text.text = (const char *)b.data;
+  pev->text.len = (uint8_t)b.len;
+  pev->text.kind = kind;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// PUBLIC FUNCTIONS
+/////////////////////////////////////////////////////////////////////////////
+
+
+//---------------------------------------------------------------------------
+// Allocate memory
+void *                                  // Returns pointer to memory
+DecodeArena::Alloc(
+  size_t len,                           // Number of bytes
+  size_t align)                         // Alignment, power of 2
+{
+  while (block < blocks.size())
+  {
+    Block &b = blocks[block];
+    size_t start = (used + align - 1) & ~(align - 1);
+
+    if (start + len <= b.size)
+    {
+      used = start + len;
+      return b.mem.get() + start;
+    }
+
+    if (!used)
+    {
+      // Even an empty block is too small; insert a bigger one here
+      break;
+    }
+
+    block++;
+    used = 0;
+  }
+
+  size_t size = std::max(blocksize, len);
+  blocks.insert(blocks.begin() + block, Block{ std::unique_ptr<uint8_t[]>(new uint8_t[size]), size });
+
+  used = len;
+  return blocks[block].mem.get();
+}
+
+
+//---------------------------------------------------------------------------
+// Copy bytes into the arena
+DecodeBytes DecodeBatch::Copy(
+  const uint8_t *data,                  // Data to copy
+  size_t len,                           // Number of bytes
+  uint8_t firstmask)                    // AND-mask for first byte
+{
+  DecodeBytes result = { nullptr, 0 };
+
+  if (len)
+  {
+    uint8_t *dst = (uint8_t *)arena.Alloc(len, 1);
+
+    memcpy(dst, data, len);
+    dst[0] &= firstmask;
+
+    result.data = dst;
+    result.len = (uint32_t)len;
+  }
+
+  return result;
+}
+
+
+//---------------------------------------------------------------------------
+// Decode a command and response into an event
+bool                                    // Returns false=batch full
+Decode_Message(
+  DecodeBatch *pbatch,                  // Batch to add event to
+  const MsgTime *ptime,                 // Time stamps
+  const uint8_t *cmd,                   // Command
+  size_t cmdlen,                        // Number of bytes in command
+  const uint8_t *rsp,                   // Response
+  size_t rsplen)                        // Number of bytes in response
+{
+  uint8_t opcode = cmdlen ? (cmd[0] & 0x7F) : 0;
+  DecodeEvent *pev = pbatch->Add(ptime, DECODE_RAW, opcode);
+
+  if (!pev)
+  {
+    return false;
+  }
+
+  // From here on, the lengths don't include the checksums. The toggle
+  // bit of the first response byte is ignored by using a copy.
+  if (cmdlen) cmdlen--;
+  if (rsplen) rsplen--;
+
+  const FrontPanelOpcode *op = FrontPanel_Opcode(opcode);
+  uint8_t status = rsplen ? (rsp[0] & 0x7F) : 0;
+  bool ok = FrontPanel_Check(op, cmdlen, &status, rsplen);
+
+  if (ok)
+  {
+    switch (op->decode)
+    {
+    case FRONTPANEL_DECODE_NONE:
+      pev->type = DECODE_VALUE;
+      pev->value = 0;
+      break;
+
+    case FRONTPANEL_DECODE_CMDVALUE:
+      ok = DecodeValue(pev, op, cmd[1]);
+      break;
+
+    case FRONTPANEL_DECODE_RSPVALUE:
+      ok = DecodeValue(pev, op, rsp[1]);
+      break;
+
+    case FRONTPANEL_DECODE_CMDNUMBER:
+      pev->type = DECODE_VALUE;
+      pev->value = cmd[1];
+      break;
+
+    case FRONTPANEL_DECODE_RSPNUMBER:
+      pev->type = DECODE_VALUE;
+      pev->value = rsp[1];
+      break;
+
+    case FRONTPANEL_DECODE_RSPHEX:
+      pev->type = DECODE_BYTES;
+      pev->bytes = pbatch->Copy(rsp + 1, rsplen - 1);
+      break;
+
+    case FRONTPANEL_DECODE_CMDTEXT:
+      DecodeText(pbatch, pev, cmd[1], cmd + 2, cmdlen - 2);
+      break;
+
+    case FRONTPANEL_DECODE_RSPTEXT:
+    case FRONTPANEL_DECODE_TRACKTEXT:
+      DecodeText(pbatch, pev, cmd[1], rsp + 1, rsplen - 1);
+      break;
+
+    case FRONTPANEL_DECODE_CUSTOM:
+      ok = DecodeCustom(pbatch, pev, op, cmd, rsp);
+      break;
+
+    default:
+      ok = false;
+    }
+  }
+
+  if (!ok)
+  {
+    DecodeRaw(pbatch, pev, cmd, cmdlen, rsp, rsplen);
+  }
+
+  return true;
+}
+
+
+//---------------------------------------------------------------------------
+// Check if the decoder understands a message
+bool                                    // Returns false=not understood
+Decode_Known(
+  const uint8_t *cmd,                   // Command
+  size_t cmdlen,                        // Number of bytes in command
+  const uint8_t *rsp,                   // Response
+  size_t rsplen)                        // Number of bytes in response
+{
+  if ((!cmdlen) || (!rsplen))
+  {
+    return false;
+  }
+
+  const FrontPanelOpcode *op = FrontPanel_Opcode(cmd[0]);
+  uint8_t status = rsp[0] & 0x7F;
+
+  if (!FrontPanel_Check(op, cmdlen - 1, &status, rsplen - 1))
+  {
+    return false;
+  }
+
+  switch (op->decode)
+  {
+  case FRONTPANEL_DECODE_NONE:
+  case FRONTPANEL_DECODE_CMDNUMBER:
+  case FRONTPANEL_DECODE_RSPNUMBER:
+  case FRONTPANEL_DECODE_RSPHEX:
+  case FRONTPANEL_DECODE_CMDTEXT:
+  case FRONTPANEL_DECODE_RSPTEXT:
+  case FRONTPANEL_DECODE_TRACKTEXT:
+    return true;
+
+  case FRONTPANEL_DECODE_CMDVALUE:
+    return FrontPanel_ValueName(op, cmd[1]) != nullptr;
+
+  case FRONTPANEL_DECODE_RSPVALUE:
+    return FrontPanel_ValueName(op, rsp[1]) != nullptr;
+
+  case FRONTPANEL_DECODE_CUSTOM:
+    // Same opcodes as DecodeCustom
+    switch (cmd[0] & 0x7F)
+    {
+    case FRONTPANEL_TAPE_TYPE:
+      return FrontPanel_ValueName(op, rsp[1]) != nullptr;
+
+    case FRONTPANEL_GO_TO_TRACK:
+    case FRONTPANEL_SEARCH:
+    case FRONTPANEL_POLL:
+    case FRONTPANEL_VU:
+    case FRONTPANEL_BIT_ERRORS:
+    case FRONTPANEL_DECK_STATE:
+    case FRONTPANEL_PREREC_INFO:
+      return true;
+
+    default:
+      return false;
+    }
+
+  default:
+    return false;
+  }
+}
+
+
+//---------------------------------------------------------------------------
+// Add data from a receiver other than the front panel lines
+bool                                    // Returns false=batch full
+Decode_ChannelData(
+  DecodeBatch *pbatch,                  // Batch to add event to
+  unsigned channel,                     // Receiver index
+  const MsgTime *ptime,                 // Time stamps
+  const uint8_t *data,                  // Data
+  size_t len)                           // Number of bytes
+{
+  DecodeEvent *pev = pbatch->Add(ptime, DECODE_CHANNEL, 0);
+
+  if (!pev)
+  {
+    return false;
+  }
+
+  pev->channel.data = pbatch->Copy(data, len);
+  pev->channel.index = channel;
+
+  return true;
+}
+
+
+//---------------------------------------------------------------------------
+// Add a realignment of the front panel lines
+bool                                    // Returns false=batch full
+Decode_Slip(
+  DecodeBatch *pbatch,                  // Batch to add event to
+  const MsgTime *ptime,                 // Time stamps
+  int slip)                             // Bytes skipped on response line,
+                                        //  negative=on command line
+{
+  DecodeEvent *pev = pbatch->Add(ptime, DECODE_SLIP, 0);
+
+  if (!pev)
+  {
+    return false;
+  }
+
+  pev->slip = slip;
+
+  return true;
+}
+
+
+//---------------------------------------------------------------------------
+// Add a change of the cadence of a polled opcode
+bool                                    // Returns false=batch full
+Decode_Cadence(
+  DecodeBatch *pbatch,                  // Batch to add event to
+  const MsgTime *ptime,                 // Time stamps
+  uint8_t opcode,                       // Opcode (without toggle bit)
+  bool degraded,                        // True=degraded, false=recovered
+  uint32_t longest,                     // Longest recent interval, ns
+  uint32_t limit)                       // Shortest stall, ns
+{
+  DecodeEvent *pev = pbatch->Add(ptime, DECODE_CADENCE, opcode & 0x7F);
+
+  if (!pev)
+  {
+    return false;
+  }
+
+  pev->cadence.degraded = degraded;
+  pev->cadence.longest = longest;
+  pev->cadence.limit = limit;
+
+  return true;
+}
+
+
+//---------------------------------------------------------------------------
+// Add a message with a toggle bit that's out of sequence
+bool                                    // Returns false=batch full
+Decode_Sequence(
+  DecodeBatch *pbatch,                  // Batch to add event to
+  const MsgTime *ptime,                 // Time stamps
+  uint8_t opcode,                       // Opcode (without toggle bit)
+  uint8_t flags)                        // FRONTPANELSEQ_... flags
+{
+  DecodeEvent *pev = pbatch->Add(ptime, DECODE_SEQUENCE, opcode & 0x7F);
+
+  if (!pev)
+  {
+    return false;
+  }
+
+  pev->sequence = flags;
+
+  return true;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// END
+/////////////////////////////////////////////////////////////////////////////
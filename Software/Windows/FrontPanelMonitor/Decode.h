@@ -0,0 +1,427 @@
+/****************************************************************************
+Decoding of front panel messages into events
+(C) 2024 Jac Goudsmit
+Licensed under the MIT license.
+See LICENSE for details.
+****************************************************************************/
+
+/*
+  Decoding and showing the messages are separate stages. The decoder turns
+  each message from the merge into a compact event record, according to
+  the descriptor table in Common/FrontPanelOpcodes.h. The renderers (see
+  Proc.h) get the events in batches, and never have to look at the bytes
+  on the bus. This makes it possible to decode without paying for console
+  output, e.g. to measure the decoder or to gather statistics.
+
+  The events don't point into the capture rings: everything they need
+  that doesn't fit in the record itself (texts and undecoded bytes) is
+  copied into the arena of the batch. The arena and the event array are
+  reused for the next batch, so once the batch has grown to its working
+  size, decoding doesn't allocate any memory.
+*/
+
+
+#pragma once
+
+
+/////////////////////////////////////////////////////////////////////////////
+// INCLUDES
+/////////////////////////////////////////////////////////////////////////////
+
+
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+#include "MsgTime.h"
+
+
+/////////////////////////////////////////////////////////////////////////////
+// MACROS
+/////////////////////////////////////////////////////////////////////////////
+
+
+// Default number of events per batch
+#define DECODE_BATCH_SIZE 256
+
+// Size of each block of the arena
+#define DECODE_ARENA_BLOCK 16384
+
+
+/////////////////////////////////////////////////////////////////////////////
+// TYPES
+/////////////////////////////////////////////////////////////////////////////
+
+
+//---------------------------------------------------------------------------
+// Event types
+enum DecodeType : uint8_t
+{
+  DECODE_RAW,                           // Not understood, see raw
+  DECODE_VALUE,                         // Simple message, see value
+  DECODE_TEXT,                          // Text, see text
+  DECODE_BYTES,                         // Data bytes, see bytes
+  DECODE_POLL,                          // Poll status, see poll
+  DECODE_VU,                            // VU meters, see vu
+  DECODE_DECKSTATE,                     // Deck state and time, see deck
+  DECODE_GOTOTRACK,                     // Go to track, see gototrack
+  DECODE_TAPETYPE,                      // Tape type, see tapetype
+  DECODE_BITERRORS,                     // Bit errors, see biterrors
+  DECODE_PRERECINFO,                    // Prerecorded tape info, see prerec
+  DECODE_CHANNEL,                       // Data from other receiver
+  DECODE_SLIP,                          // Front panel lines realigned
+  DECODE_CADENCE,                       // Poll cadence changed, see cadence
+  DECODE_SEQUENCE,                      // Toggle bit out of sequence
+};
+
+
+//---------------------------------------------------------------------------
+// Bytes stored in the arena
+struct DecodeBytes
+{
+  const uint8_t *data;                  // Data
+  uint32_t    len;                      // Number of bytes
+};
+
+
+//---------------------------------------------------------------------------
+// Decoded event
+//
+// The opcode doesn't include the toggle bit. For messages that weren't
+// understood, the raw command and response are stored without the toggle
+// bits and without the checksums.
+struct DecodeEvent
+{
+  MsgTime     time;                     // Time stamps
+  DecodeType  type;                     // Event type
+  uint8_t     opcode;                   // Opcode, FRONTPANEL_...
+
+  union
+  {
+    uint8_t   value;                    // DECODE_VALUE: parameter value
+
+    struct
+    {
+      DecodeBytes cmd;                  // Command
+      DecodeBytes rsp;                  // Response
+    } raw;                              // DECODE_RAW
+
+    struct
+    {
+      const char *text;                 // Text (not terminated)
+      uint8_t len;                      // Number of characters
+      uint8_t kind;                     // Text kind or track number
+    } text;                             // DECODE_TEXT
+
+    DecodeBytes bytes;                  // DECODE_BYTES
+
+    struct
+    {
+      uint8_t status[4];                // Status bytes from response
+    } poll;                             // DECODE_POLL
+
+    struct
+    {
+      uint8_t left;                     // Left, dB below maximum
+      uint8_t right;                    // Right, dB below maximum
+    } vu;                               // DECODE_VU
+
+    struct
+    {
+      uint8_t status;                   // Status? 8=play?
+      uint8_t track;                    // Track (BCD)
+      uint8_t hours;                    // Hours (BCD, upper nibble?)
+      uint8_t minutes;                  // Minutes (BCD)
+      uint8_t seconds;                  // Seconds (BCD)
+      uint8_t unknown6;                 // Unknown
+      uint8_t counter[2];               // Tape counter (BCD, big endian)
+      uint8_t unknown9;                 // Unknown
+    } deck;                             // DECODE_DECKSTATE
+
+    struct
+    {
+      uint8_t track;                    // Track
+      uint8_t param;                    // Second parameter, unknown
+    } gototrack;                        // DECODE_GOTOTRACK
+
+    struct
+    {
+      uint8_t status;                   // First response byte
+      uint8_t type;                     // Tape type bits
+    } tapetype;                         // DECODE_TAPETYPE
+
+    struct
+    {
+      uint8_t track;                    // Requested track or 0x10
+      uint8_t status;                   // First response byte
+      uint8_t errors;                   // Error count or head bits
+    } biterrors;                        // DECODE_BITERRORS
+
+    struct
+    {
+      uint8_t unknown1;                 // Unknown
+      uint8_t tracks;                   // Number of tracks (BCD)
+      uint8_t hours;                    // Total time (BCD)
+      uint8_t minutes;
+      uint8_t seconds;
+    } prerec;                           // DECODE_PRERECINFO
+
+    struct
+    {
+      DecodeBytes data;                 // Data
+      unsigned index;                   // Receiver index
+    } channel;                          // DECODE_CHANNEL
+
+    int       slip;                     // DECODE_SLIP: bytes skipped on
+                                        //  response line, negative=command
+
+    struct
+    {
+      bool    degraded;                 // True=degraded, false=recovered
+      uint32_t longest;                 // Longest recent interval, ns
+      uint32_t limit;                   // Shortest stall, ns
+    } cadence;                          // DECODE_CADENCE
+
+    uint8_t   sequence;                 // DECODE_SEQUENCE: FRONTPANELSEQ_...
+                                        //  flags, see FrontPanelSequence.h
+  };
+};
+
+
+//---------------------------------------------------------------------------
+// Memory for data that belongs to the events of a batch
+//
+// Memory is allocated by moving a pointer through a list of blocks. There
+// is no way to free individual allocations; everything is freed at once
+// when the arena is reset, but the blocks are kept for the next batch.
+class DecodeArena
+{
+protected:
+  struct Block
+  {
+    std::unique_ptr<uint8_t[]> mem;     // Memory
+    size_t    size;                     // Size in bytes
+  };
+
+  std::vector<Block> blocks;            // Allocated blocks
+  size_t      blocksize;                // Size of new blocks
+  size_t      block = 0;                // Index of current block
+  size_t      used = 0;                 // Bytes used in current block
+
+public:
+  //-------------------------------------------------------------------------
+  // Constructor
+  DecodeArena(
+    size_t blocksize = DECODE_ARENA_BLOCK) // Size of each block
+    : blocksize(blocksize)
+  {
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Allocate memory
+  //
+  // Allocations that are bigger than the block size get a block of their
+  // own, which is also kept for the next batch.
+  void *                                // Returns pointer to memory
+  Alloc(
+    size_t len,                         // Number of bytes
+    size_t align = alignof(void *));    // Alignment, power of 2
+
+public:
+  //-------------------------------------------------------------------------
+  // Free all allocations
+  void Reset()
+  {
+    block = 0;
+    used = 0;
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Get the number of bytes that are reserved for the arena
+  size_t Capacity() const
+  {
+    size_t result = 0;
+
+    for (const Block &b : blocks)
+    {
+      result += b.size;
+    }
+
+    return result;
+  }
+};
+
+
+//---------------------------------------------------------------------------
+// A batch of events
+class DecodeBatch
+{
+protected:
+  DecodeArena arena;                    // Data of events
+  std::vector<DecodeEvent> events;      // Events
+  size_t      num = 0;                  // Number of events in the batch
+
+public:
+  //-------------------------------------------------------------------------
+  // Constructor
+  DecodeBatch(
+    size_t capacity = DECODE_BATCH_SIZE) // Max number of events
+    : events(capacity)
+  {
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Start a new batch, discarding all events and their data
+  void Reset()
+  {
+    arena.Reset();
+    num = 0;
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Check if the batch can't take any more events
+  bool Full() const
+  {
+    return num == events.size();
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Get the number of events
+  size_t Size() const
+  {
+    return num;
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Get the events
+  const DecodeEvent *Events() const
+  {
+    return events.data();
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Add an event, if there's room
+  DecodeEvent *                         // Returns event, NULL=full
+  Add(
+    const MsgTime *ptime,               // Time stamps
+    DecodeType type,                    // Event type
+    uint8_t opcode)                     // Opcode
+  {
+    if (Full())
+    {
+      return nullptr;
+    }
+
+    DecodeEvent *pev = &events[num++];
+    pev->time = *ptime;
+    pev->type = type;
+    pev->opcode = opcode;
+
+    return pev;
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Copy bytes into the arena
+  DecodeBytes Copy(
+    const uint8_t *data,                // Data to copy
+    size_t len,                         // Number of bytes
+    uint8_t firstmask = 0xFF);          // AND-mask for first byte
+
+public:
+  //-------------------------------------------------------------------------
+  // Get the number of bytes that are reserved for the arena
+  size_t ArenaCapacity() const
+  {
+    return arena.Capacity();
+  }
+};
+
+
+/////////////////////////////////////////////////////////////////////////////
+// PUBLIC FUNCTIONS
+/////////////////////////////////////////////////////////////////////////////
+
+
+//---------------------------------------------------------------------------
+// Decode a command and response into an event
+//
+// The command and response include the checksums. They aren't modified.
+bool                                    // Returns false=batch full
+Decode_Message(
+  DecodeBatch *pbatch,                  // Batch to add event to
+  const MsgTime *ptime,                 // Time stamps
+  const uint8_t *cmd,                   // Command
+  size_t cmdlen,                        // Number of bytes in command
+  const uint8_t *rsp,                   // Response
+  size_t rsplen);                       // Number of bytes in response
+
+
+//---------------------------------------------------------------------------
+// Check if the decoder understands a message
+//
+// This is cheaper than decoding, and doesn't need a batch. Values that
+// have no name count as not understood, even when the decoder would show
+// them in hex.
+bool                                    // Returns false=not understood
+Decode_Known(
+  const uint8_t *cmd,                   // Command
+  size_t cmdlen,                        // Number of bytes in command
+  const uint8_t *rsp,                   // Response
+  size_t rsplen);                       // Number of bytes in response
+
+
+//---------------------------------------------------------------------------
+// Add data from a receiver other than the front panel lines
+bool                                    // Returns false=batch full
+Decode_ChannelData(
+  DecodeBatch *pbatch,                  // Batch to add event to
+  unsigned channel,                     // Receiver index
+  const MsgTime *ptime,                 // Time stamps
+  const uint8_t *data,                  // Data
+  size_t len);                          // Number of bytes
+
+
+//---------------------------------------------------------------------------
+// Add a realignment of the front panel lines
+bool                                    // Returns false=batch full
+Decode_Slip(
+  DecodeBatch *pbatch,                  // Batch to add event to
+  const MsgTime *ptime,                 // Time stamps
+  int slip);                            // Bytes skipped on response line,
+                                        //  negative=on command line
+
+
+//---------------------------------------------------------------------------
+// Add a change of the cadence of a polled opcode (see Cadence.h)
+bool                                    // Returns false=batch full
+Decode_Cadence(
+  DecodeBatch *pbatch,                  // Batch to add event to
+  const MsgTime *ptime,                 // Time stamps
+  uint8_t opcode,                       // Opcode (without toggle bit)
+  bool degraded,                        // True=degraded, false=recovered
+  uint32_t longest,                     // Longest recent interval, ns
+  uint32_t limit);                      // Shortest stall, ns
+
+
+//---------------------------------------------------------------------------
+// Add a message with a toggle bit that's out of sequence
+bool                                    // Returns false=batch full
+Decode_Sequence(
+  DecodeBatch *pbatch,                  // Batch to add event to
+  const MsgTime *ptime,                 // Time stamps
+  uint8_t opcode,                       // Opcode (without toggle bit)
+  uint8_t flags);                       // FRONTPANELSEQ_... flags
+
+
+/////////////////////////////////////////////////////////////////////////////
+// END
+/////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,405 @@
+/****************************************************************************
+Field inference for messages that aren't understood
+(C) 2024 Jac Goudsmit
+Licensed under the MIT license.
+See LICENSE for details.
+****************************************************************************/
+
+
+/////////////////////////////////////////////////////////////////////////////
+// INCLUDES
+/////////////////////////////////////////////////////////////////////////////
+
+
+#include <cstring>
+
+#include "../../Common/FrontPanelOpcodes.h"
+
+#include "Infer.h"
+
+
+/////////////////////////////////////////////////////////////////////////////
+// DATA
+/////////////////////////////////////////////////////////////////////////////
+
+
+// Names of the kinds of bytes, indexed by InferKind
+static const char *const kindnames[] =
+{
+  "constant",
+  "counter",
+  "BCD counter",
+  "flags",
+  "BCD",
+  "enumeration",
+  "varies",
+};
+
+// Names of the known states
+static const char *const statenames[] =
+{
+  "function state",
+  "drawer status",
+};
+
+
+/////////////////////////////////////////////////////////////////////////////
+// LOCAL FUNCTIONS
+/////////////////////////////////////////////////////////////////////////////
+
+
+//---------------------------------------------------------------------------
+// Check if a byte is valid BCD
+static inline bool IsBcd(
+  uint8_t b)                            // Byte
+{
+  return ((b & 0x0F) < 10) && (b < 0xA0);
+}
+
+
+//---------------------------------------------------------------------------
+// Convert BCD to binary
+static inline int FromBcd(
+  uint8_t b)                            // BCD byte
+{
+  return (b >> 4) * 10 + (b & 0x0F);
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// PUBLIC FUNCTIONS
+/////////////////////////////////////////////////////////////////////////////
+
+
+//---------------------------------------------------------------------------
+// Constructor
+Infer::Infer(
+  const DeckState *pdeck)               // Model of the deck state
+  : pdeck(pdeck)
+{
+  for (uint16_t &s : state)
+  {
+    s = 0xFFFF;
+  }
+}
+
+
+//---------------------------------------------------------------------------
+// Add a message
+void Infer::Add(
+  const uint8_t *cmd,                   // Command
+  size_t cmdlen,                        // Number of bytes in command
+  const uint8_t *rsp,                   // Response
+  size_t rsplen,                        // Number of bytes in response
+  bool known)                           // True=understood by decoder
+{
+  if ((!cmdlen) || (known))
+  {
+    return;
+  }
+
+  uint8_t opcode = cmd[0] & 0x7F;
+
+  // Get the known state from the model, only when it changed
+  if (pdeck->Version() != version)
+  {
+    DeckSnapshot s;
+
+    version = pdeck->Load(&s);
+    state[STATE_FUNCTION] = (s.known & DECKSTATE_FUNCTION) ? s.function : 0xFFFF;
+    state[STATE_DRAWER] = (s.known & DECKSTATE_DRAWER) ? s.drawer : 0xFFFF;
+  }
+
+  // From here on, the lengths don't include the checksums
+  cmdlen--;
+  if (rsplen) rsplen--;
+  if (cmdlen > 255) cmdlen = 255;
+  if (rsplen > 255) rsplen = 255;
+
+  // Messages with the same opcode usually come in a row, so the group of
+  // the previous message is checked before looking it up
+  size_t cmdbytes = cmdlen ? cmdlen - 1 : 0;
+  uint32_t key = ((uint32_t)opcode << 16) | ((uint32_t)cmdlen << 8) | (uint32_t)rsplen;
+
+  if ((!plast) || (key != lastkey))
+  {
+    std::unique_ptr<Group> &pgroup = groups[key];
+
+    if (!pgroup)
+    {
+      pgroup.reset(new Group());
+      pgroup->opcode = opcode;
+      pgroup->cmdlen = (uint8_t)cmdlen;
+      pgroup->rsplen = (uint8_t)rsplen;
+      pgroup->numfields = (uint8_t)((cmdbytes + rsplen > INFER_MAX_BYTES) ? INFER_MAX_BYTES : cmdbytes + rsplen);
+
+      for (uint16_t &s : pgroup->state)
+      {
+        s = 0xFFFF;
+      }
+    }
+
+    plast = pgroup.get();
+    lastkey = key;
+  }
+
+  Group &g = *plast;
+
+  // Find out which known states changed since the previous message in
+  // this group
+  bool statechanged[STATE_NUM];
+
+  for (unsigned k = 0; k < STATE_NUM; k++)
+  {
+    statechanged[k] = (g.state[k] != 0xFFFF) && (state[k] != g.state[k]);
+    g.state[k] = state[k];
+  }
+
+  // The bytes are the command parameters followed by the response. The
+  // toggle bit of the first response byte is left out.
+  for (size_t i = 0; i < g.numfields; i++)
+  {
+    uint8_t b = (i < cmdbytes) ? cmd[1 + i] : rsp[i - cmdbytes];
+    Field &f = g.fields[i];
+
+    if (i == cmdbytes)
+    {
+      b &= 0x7F;
+    }
+
+    f.values[b]++;
+    f.bcd += IsBcd(b);
+
+    if ((g.messages) && (b != f.last))
+    {
+      uint8_t diff = b ^ f.last;
+
+      f.changes++;
+      f.changed |= diff;
+      f.steps += ((uint8_t)(b - f.last) == 1) || ((uint8_t)(f.last - b) == 1);
+      f.onebit += !(diff & (diff - 1));
+
+      if ((IsBcd(b)) && (IsBcd(f.last)))
+      {
+        int step = (FromBcd(b) - FromBcd(f.last) + 100) % 100;
+
+        f.bcdsteps += (step == 1) || (step == 99);
+      }
+
+      for (unsigned k = 0; k < STATE_NUM; k++)
+      {
+        f.together[k] += statechanged[k];
+      }
+    }
+
+    f.last = b;
+  }
+
+  g.messages++;
+}
+
+
+//---------------------------------------------------------------------------
+// Check if it's time for a summary
+bool                                    // Returns true=print summary now
+Infer::Due(
+  uint64_t time)                        // Time of the message, ns
+{
+  // Start counting at the first message, or when the time started over
+  // (e.g. another file)
+  if ((!nextsummary) || (time + INFER_SUMMARY < nextsummary))
+  {
+    nextsummary = time + INFER_SUMMARY;
+    return false;
+  }
+
+  if (time < nextsummary)
+  {
+    return false;
+  }
+
+  nextsummary = time + INFER_SUMMARY;
+  return true;
+}
+
+
+//---------------------------------------------------------------------------
+// Guess what a byte is
+InferKind                               // Returns kind of byte
+Infer::Classify(
+  const Field &field)                   // Statistics of the byte
+{
+  unsigned distinct = 0;
+  uint64_t samples = 0;
+  bool tens = false;
+
+  for (unsigned v = 0; v < 256; v++)
+  {
+    if (field.values[v])
+    {
+      distinct++;
+      samples += field.values[v];
+      tens |= (v >= 0x10);
+    }
+  }
+
+  if (distinct <= 1)
+  {
+    return INFER_CONSTANT;
+  }
+
+  // Counting and flipping bits only show after a few changes
+  if (field.changes >= INFER_MIN_CHANGES)
+  {
+    if ((field.bcd == samples) && (field.bcdsteps * 10ULL >= field.changes * 8ULL))
+    {
+      return INFER_BCDCOUNTER;
+    }
+
+    if (field.steps * 10ULL >= field.changes * 8ULL)
+    {
+      return INFER_COUNTER;
+    }
+
+    if (field.onebit * 10ULL >= field.changes * 8ULL)
+    {
+      return INFER_FLAGS;
+    }
+  }
+
+  if (distinct <= INFER_MAX_ENUM)
+  {
+    return INFER_ENUM;
+  }
+
+  // Values up to 9 are the same in BCD and binary, so they don't say much
+  if ((field.bcd == samples) && (tens))
+  {
+    return INFER_BCD;
+  }
+
+  return INFER_VARIES;
+}
+
+
+//---------------------------------------------------------------------------
+// Print the summary
+void Infer::Print(
+  FILE *f,                              // Output file
+  bool onlynew)                         // True=only groups with new messages
+{
+  bool any = false;
+
+  for (auto &it : groups)
+  {
+    Group &g = *it.second;
+
+    if ((onlynew) && (g.messages == g.printed))
+    {
+      continue;
+    }
+
+    g.printed = g.messages;
+
+    if (!any)
+    {
+      fprintf(f, "\nMessages that aren't understood:\n");
+      any = true;
+    }
+
+    int len;
+    const char *name = FrontPanel_OpcodeName(g.opcode, &len);
+
+    if (!len)
+    {
+      name = "(unknown)";
+      len = (int)strlen(name);
+    }
+
+    fprintf(f, "\nOpcode %02X %.*s, command length %u, response length %u: %llu messages\n",
+      g.opcode, len, name, g.cmdlen, g.rsplen, (unsigned long long)g.messages);
+    fprintf(f, "%-8s %-12s %6s %8s %4s %4s %4s  %s\n",
+      "Byte", "Kind", "Values", "Changes", "Min", "Max", "Bits", "Most common");
+
+    for (unsigned i = 0; i < g.numfields; i++)
+    {
+      const Field &field = g.fields[i];
+      unsigned cmdbytes = g.cmdlen ? g.cmdlen - 1u : 0;
+      char label[16];
+
+      if (i < cmdbytes)
+      {
+        snprintf(label, sizeof(label), "cmd[%u]", i + 1);
+      }
+      else
+      {
+        snprintf(label, sizeof(label), "rsp[%u]", i - cmdbytes);
+      }
+
+      // Find the range and the most common values
+      unsigned distinct = 0;
+      unsigned lo = 0;
+      unsigned hi = 0;
+      unsigned top[3] = { 256, 256, 256 };
+
+      for (unsigned v = 0; v < 256; v++)
+      {
+        uint32_t n = field.values[v];
+
+        if (!n)
+        {
+          continue;
+        }
+
+        if (!distinct++)
+        {
+          lo = v;
+        }
+
+        hi = v;
+
+        for (unsigned t = 0; t < 3; t++)
+        {
+          if ((top[t] == 256) || (n > field.values[top[t]]))
+          {
+            memmove(top + t + 1, top + t, (2 - t) * sizeof(top[0]));
+            top[t] = v;
+            break;
+          }
+        }
+      }
+
+      fprintf(f, "%-8s %-12s %6u %7.1f%%   %02X   %02X   %02X ",
+        label, kindnames[Classify(field)], distinct,
+        (g.messages > 1) ? field.changes * 100.0 / (g.messages - 1) : 0.0,
+        lo, hi, field.changed);
+
+      for (unsigned t = 0; (t < 3) && (top[t] < 256); t++)
+      {
+        fprintf(f, " %02X %.0f%%", top[t], field.values[top[t]] * 100.0 / g.messages);
+      }
+
+      // Most changes happening at the same time as a change of a known
+      // state suggests that the byte has something to do with it
+      for (unsigned k = 0; k < STATE_NUM; k++)
+      {
+        if ((field.changes >= INFER_MIN_CHANGES) && (field.together[k] * 10ULL >= field.changes * 8ULL))
+        {
+          fprintf(f, ", changes with %s", statenames[k]);
+        }
+      }
+
+      fprintf(f, "\n");
+    }
+  }
+
+  if ((!any) && (!onlynew))
+  {
+    fprintf(f, "\nAll messages were understood\n");
+  }
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// END
+/////////////////////////////////////////////////////////////////////////////
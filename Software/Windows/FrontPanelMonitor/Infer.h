@@ -0,0 +1,189 @@
+/****************************************************************************
+Field inference for messages that aren't understood
+(C) 2024 Jac Goudsmit
+Licensed under the MIT license.
+See LICENSE for details.
+****************************************************************************/
+
+/*
+  Messages that the decoder doesn't understand are only dumped in hex, so
+  finding out what the bytes mean takes a lot of reading through logs.
+  This collects statistics about those messages while they go by, and
+  makes an educated guess about each byte.
+
+  The messages are grouped by opcode and by the lengths of the command
+  and the response, because a different length usually means a different
+  layout. For each byte (other than the opcode and the checksums), the
+  following is counted:
+  - How often each value occurs.
+  - How often the byte changes from one message to the next one in the
+    same group, and which bits change.
+  - How many of the changes are steps of 1 up or down, in binary or in
+    BCD, and how many changes flip exactly one bit.
+  - How many of the changes happen at the same time as a change of the
+    function state or the drawer status. Those are taken from the model of
+    the deck state (see DeckState.h), which must be updated with each
+    message before it's passed to this.
+
+  From that, each byte is classified as a constant, a counter, flags, BCD,
+  an enumeration of a few values, or something that just varies. That's
+  only a guess of course, but it shows where to look.
+
+  The counting costs a few operations per byte, so it can run all the
+  time. The summaries are printed every INFER_SUMMARY ns (as measured by
+  the time stamps of the messages), and only for groups that got new
+  messages since the previous summary. When the screen is shown, the
+  summaries would mess it up, so they're only printed with the U key.
+*/
+
+
+#pragma once
+
+
+/////////////////////////////////////////////////////////////////////////////
+// INCLUDES
+/////////////////////////////////////////////////////////////////////////////
+
+
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <map>
+#include <memory>
+
+#include "DeckState.h"
+
+
+/////////////////////////////////////////////////////////////////////////////
+// MACROS
+/////////////////////////////////////////////////////////////////////////////
+
+
+// Number of bytes per message that are analyzed
+#define INFER_MAX_BYTES 32
+
+// Time between summaries
+#define INFER_SUMMARY 30000000000ULL    // ns
+
+// Number of changes needed before a byte can be called a counter or flags
+#define INFER_MIN_CHANGES 8
+
+// Maximum number of values of an enumeration
+#define INFER_MAX_ENUM 8
+
+
+/////////////////////////////////////////////////////////////////////////////
+// TYPES
+/////////////////////////////////////////////////////////////////////////////
+
+
+//---------------------------------------------------------------------------
+// Guess what a byte is
+enum InferKind
+{
+  INFER_CONSTANT,                       // Never changes
+  INFER_COUNTER,                        // Counts up or down in binary
+  INFER_BCDCOUNTER,                     // Counts up or down in BCD
+  INFER_FLAGS,                          // Bits change one at a time
+  INFER_BCD,                            // All values are BCD
+  INFER_ENUM,                           // A few different values
+  INFER_VARIES,                         // None of the above
+};
+
+
+//---------------------------------------------------------------------------
+// Statistics of messages that aren't understood
+class Infer
+{
+protected:
+  //-------------------------------------------------------------------------
+  // Known state that the bytes are compared with
+  enum
+  {
+    STATE_FUNCTION,                     // Function state (0x58)
+    STATE_DRAWER,                       // Drawer status
+    STATE_NUM
+  };
+
+  //-------------------------------------------------------------------------
+  // Statistics of one byte
+  struct Field
+  {
+    uint32_t  values[256];              // Number of times each value seen
+    uint32_t  bcd;                      // Number of valid BCD values
+    uint32_t  changes;                  // Number of changes
+    uint32_t  steps;                    // Changes of +1 or -1
+    uint32_t  bcdsteps;                 // Changes of +1 or -1 in BCD
+    uint32_t  onebit;                   // Changes of a single bit
+    uint32_t  together[STATE_NUM];      // Changes along with known state
+    uint8_t   changed;                  // Bits that ever changed
+    uint8_t   last;                     // Previous value
+  };
+
+  //-------------------------------------------------------------------------
+  // Statistics of messages with one opcode and length
+  struct Group
+  {
+    uint8_t   opcode;                   // Opcode (without toggle bit)
+    uint8_t   cmdlen;                   // Command length without checksum
+    uint8_t   rsplen;                   // Response length without checksum
+    uint8_t   numfields;                // Number of bytes analyzed
+    uint64_t  messages = 0;             // Number of messages
+    uint64_t  printed = 0;              // Messages at previous summary
+    uint16_t  state[STATE_NUM];         // Known state at previous message
+    Field     fields[INFER_MAX_BYTES];  // Statistics per byte
+  };
+
+  std::map<uint32_t, std::unique_ptr<Group>> groups; // Groups by key
+  Group      *plast = nullptr;          // Group of the previous message
+  uint32_t    lastkey = 0;              // Key of plast
+  const DeckState *pdeck;               // Model of the deck state
+  uint32_t    version = 0;              // Version of the model in state
+  uint16_t    state[STATE_NUM];         // Known state, 0xFFFF=not known
+  uint64_t    nextsummary = 0;          // Time of next summary; 0=not set
+
+protected:
+  //-------------------------------------------------------------------------
+  // Guess what a byte is
+  static InferKind                      // Returns kind of byte
+  Classify(
+    const Field &field);                // Statistics of the byte
+
+public:
+  //-------------------------------------------------------------------------
+  // Constructor
+  Infer(
+    const DeckState *pdeck);            // Model of the deck state
+
+public:
+  //-------------------------------------------------------------------------
+  // Add a message
+  //
+  // Messages that are understood are ignored. The command and response
+  // include the checksums.
+  void Add(
+    const uint8_t *cmd,                 // Command
+    size_t cmdlen,                      // Number of bytes in command
+    const uint8_t *rsp,                 // Response
+    size_t rsplen,                      // Number of bytes in response
+    bool known);                        // True=understood by decoder
+
+public:
+  //-------------------------------------------------------------------------
+  // Check if it's time for a summary
+  bool                                  // Returns true=print summary now
+  Due(
+    uint64_t time);                     // Time of the message, ns
+
+public:
+  //-------------------------------------------------------------------------
+  // Print the summary
+  void Print(
+    FILE *f,                            // Output file
+    bool onlynew);                      // True=only groups with new messages
+};
+
+
+/////////////////////////////////////////////////////////////////////////////
+// END
+/////////////////////////////////////////////////////////////////////////////
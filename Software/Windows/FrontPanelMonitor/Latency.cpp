@@ -0,0 +1,200 @@
+/****************************************************************************
+Command to response latency histograms
+(C) 2024 Jac Goudsmit
+Licensed under the MIT license.
+See LICENSE for details.
+****************************************************************************/
+
+
+/////////////////////////////////////////////////////////////////////////////
+// INCLUDES
+/////////////////////////////////////////////////////////////////////////////
+
+
+#include <cstring>
+
+#include "../../Common/FrontPanelOpcodes.h"
+
+#include "Latency.h"
+
+
+/////////////////////////////////////////////////////////////////////////////
+// DATA
+/////////////////////////////////////////////////////////////////////////////
+
+
+// Percentiles that are printed in the tables
+const double LatencyHistogram::percentiles[LATENCY_PERCENTILES] = { 50, 90, 99, 99.9 };
+
+
+/////////////////////////////////////////////////////////////////////////////
+// PUBLIC FUNCTIONS
+/////////////////////////////////////////////////////////////////////////////
+
+
+//---------------------------------------------------------------------------
+// Get the lowest latency that goes into a bucket
+uint32_t                                // Returns latency in ns
+LatencyHistogram::BucketLow(
+  unsigned bucket)                      // Bucket index
+{
+  if (bucket < (1U << LATENCY_SUB_BITS))
+  {
+    return bucket;
+  }
+
+  unsigned shift = (bucket >> LATENCY_SUB_BITS) - 1;
+
+  return ((1U << LATENCY_SUB_BITS) | (bucket & ((1U << LATENCY_SUB_BITS) - 1))) << shift;
+}
+
+
+//---------------------------------------------------------------------------
+// Forget all latencies
+void LatencyHistogram::Reset()
+{
+  memset(counts, 0, sizeof(counts));
+  total = 0;
+  sum = 0;
+  min = UINT32_MAX;
+  max = 0;
+}
+
+
+//---------------------------------------------------------------------------
+// Get a percentile
+uint32_t                                // Returns latency in ns, 0=none
+LatencyHistogram::Percentile(
+  double percent) const                 // Percentile, 0..100
+{
+  if (!total)
+  {
+    return 0;
+  }
+
+  // Number of latencies that are at or below the percentile
+  uint64_t rank = (uint64_t)(percent / 100 * total + 0.5);
+
+  if (rank < 1)
+  {
+    rank = 1;
+  }
+
+  uint64_t seen = 0;
+
+  for (unsigned bucket = 0; bucket < LATENCY_BUCKETS; bucket++)
+  {
+    seen += counts[bucket];
+
+    if (seen >= rank)
+    {
+      uint32_t high = (bucket + 1 < LATENCY_BUCKETS) ? BucketLow(bucket + 1) - 1 : UINT32_MAX;
+
+      return (high < max) ? high : max;
+    }
+  }
+
+  return max;
+}
+
+
+//---------------------------------------------------------------------------
+// Print the headings of the percentile columns of a table
+void LatencyHistogram::PrintHeadings(
+  FILE *f)                              // Output file
+{
+  for (double p : percentiles)
+  {
+    char heading[16];
+
+    snprintf(heading, sizeof(heading), "p%g", p);
+    fprintf(f, " %10s", heading);
+  }
+}
+
+
+//---------------------------------------------------------------------------
+// Get the histogram for an opcode
+const LatencyHistogram *                // Returns histogram, nullptr=none
+Latency::Histogram(
+  uint8_t opcode,                       // Opcode (without toggle bit)
+  bool end) const                       // False=response start, true=end
+{
+  const Slot *slot = slots[opcode & 0x7F].get();
+
+  if (!slot)
+  {
+    return nullptr;
+  }
+
+  return end ? &slot->end : &slot->response;
+}
+
+
+//---------------------------------------------------------------------------
+// Forget all latencies
+void Latency::Reset()
+{
+  for (auto &slot : slots)
+  {
+    if (slot)
+    {
+      slot->response.Reset();
+      slot->end.Reset();
+    }
+  }
+}
+
+
+//---------------------------------------------------------------------------
+// Print percentiles for each opcode that was seen
+void Latency::Print(
+  FILE *f) const                        // Output file
+{
+  fprintf(f, "\nLatency from end of command, in us:\n%52s %10s", "", "Count");
+
+  LatencyHistogram::PrintHeadings(f);
+  fprintf(f, " %10s\n", "Max");
+
+  for (unsigned opcode = 0; opcode < 128; opcode++)
+  {
+    const Slot *slot = slots[opcode].get();
+
+    if ((!slot) || (!slot->response.Count()))
+    {
+      continue;
+    }
+
+    int len;
+    const char *name = FrontPanel_OpcodeName((uint8_t)opcode, &len);
+
+    for (unsigned which = 0; which < 2; which++)
+    {
+      const LatencyHistogram &h = which ? slot->end : slot->response;
+
+      if (!which)
+      {
+        fprintf(f, "Opcode %02X %-24.*s", opcode, len, name);
+      }
+      else
+      {
+        fprintf(f, "%34s", "");
+      }
+
+      fprintf(f, " %-17s %10llu", which ? "to response end" : "to response start",
+        (unsigned long long)h.Count());
+
+      for (double p : LatencyHistogram::percentiles)
+      {
+        fprintf(f, " %10.1f", h.Percentile(p) / 1e3);
+      }
+
+      fprintf(f, " %10.1f\n", h.Max() / 1e3);
+    }
+  }
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// END
+/////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,263 @@
+/****************************************************************************
+Command to response latency histograms
+(C) 2024 Jac Goudsmit
+Licensed under the MIT license.
+See LICENSE for details.
+****************************************************************************/
+
+/*
+  This measures how long the deck takes to answer each kind of front
+  panel command: from the end of the command to the start of the
+  response, and to the end of the response. Every message is counted,
+  including the repeats that are filtered out before decoding.
+
+  The latencies are counted in histograms with buckets that get wider as
+  the latency gets longer: each power of 2 is split into 16 buckets, so a
+  bucket is never wider than 1/16 of its lower bound. Recording a latency
+  is a bit scan and an increment, and the size of a histogram doesn't
+  depend on how many latencies were recorded. Percentiles are accurate to
+  the width of a bucket.
+
+  The histograms aren't protected against access from multiple threads;
+  percentiles should be retrieved by the thread that records them.
+*/
+
+
+#pragma once
+
+
+/////////////////////////////////////////////////////////////////////////////
+// INCLUDES
+/////////////////////////////////////////////////////////////////////////////
+
+
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <memory>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#include "MsgTime.h"
+
+
+/////////////////////////////////////////////////////////////////////////////
+// MACROS
+/////////////////////////////////////////////////////////////////////////////
+
+
+// Number of bits below the highest bit that select a bucket; each power
+// of 2 is split into 2^LATENCY_SUB_BITS buckets
+#define LATENCY_SUB_BITS 4
+
+// Number of buckets per histogram, for 32-bit latencies in ns
+#define LATENCY_BUCKETS ((32 - LATENCY_SUB_BITS + 1) << LATENCY_SUB_BITS)
+
+// Number of percentiles in the tables
+#define LATENCY_PERCENTILES 4
+
+
+/////////////////////////////////////////////////////////////////////////////
+// TYPES
+/////////////////////////////////////////////////////////////////////////////
+
+
+//---------------------------------------------------------------------------
+// Histogram of latencies with logarithmic buckets
+class LatencyHistogram
+{
+protected:
+  uint64_t    counts[LATENCY_BUCKETS] = {}; // Latencies per bucket
+  uint64_t    total = 0;                // Number of latencies
+  uint64_t    sum = 0;                  // Sum of latencies in ns
+  uint32_t    min = UINT32_MAX;         // Shortest latency in ns
+  uint32_t    max = 0;                  // Longest latency in ns
+
+public:
+  //-------------------------------------------------------------------------
+  // Get the bucket for a latency
+  //
+  // Latencies below 2^LATENCY_SUB_BITS ns have a bucket each. Above that,
+  // the position of the highest bit selects a group of buckets, and the
+  // bits below it select the bucket in the group.
+  static unsigned                       // Returns bucket index
+  Bucket(
+    uint32_t ns)                        // Latency in ns
+  {
+    if (ns < (1U << LATENCY_SUB_BITS))
+    {
+      return ns;
+    }
+
+#ifdef _MSC_VER
+    unsigned long high;
+
+    _BitScanReverse(&high, ns);
+#else
+    unsigned high = 31 - (unsigned)__builtin_clz(ns);
+#endif
+
+    unsigned shift = (unsigned)high - LATENCY_SUB_BITS;
+
+    return ((shift + 1) << LATENCY_SUB_BITS) + ((ns >> shift) & ((1U << LATENCY_SUB_BITS) - 1));
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Get the lowest latency that goes into a bucket
+  static uint32_t                       // Returns latency in ns
+  BucketLow(
+    unsigned bucket);                   // Bucket index
+
+public:
+  //-------------------------------------------------------------------------
+  // Add a latency
+  void Add(
+    uint32_t ns)                        // Latency in ns
+  {
+    counts[Bucket(ns)]++;
+    total++;
+    sum += ns;
+
+    if (ns < min) min = ns;
+    if (ns > max) max = ns;
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Forget all latencies
+  void Reset();
+
+public:
+  //-------------------------------------------------------------------------
+  // Get the number of latencies
+  uint64_t Count() const
+  {
+    return total;
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Get the shortest latency
+  uint32_t Min() const
+  {
+    return total ? min : 0;
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Get the longest latency
+  uint32_t Max() const
+  {
+    return max;
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Get the average latency
+  double Mean() const
+  {
+    return total ? (double)sum / total : 0;
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Get a percentile
+  //
+  // The result is the highest latency of the bucket that the percentile
+  // falls in, but never more than the longest latency that was recorded.
+  // So it's an upper bound that's at most one bucket width too high.
+  uint32_t                              // Returns latency in ns, 0=none
+  Percentile(
+    double percent) const;              // Percentile, 0..100
+
+public:
+  //-------------------------------------------------------------------------
+  // Percentiles that are printed in the tables
+  static const double percentiles[LATENCY_PERCENTILES];
+
+public:
+  //-------------------------------------------------------------------------
+  // Print the headings of the percentile columns of a table
+  //
+  // Each column is 10 characters wide, with a space in front of it.
+  static void PrintHeadings(
+    FILE *f);                           // Output file
+};
+
+
+//---------------------------------------------------------------------------
+// Latency histograms for each opcode
+class Latency
+{
+protected:
+  //-------------------------------------------------------------------------
+  // Histograms for one opcode
+  struct Slot
+  {
+    LatencyHistogram response;          // Command end to response start
+    LatencyHistogram end;               // Command end to response end
+  };
+
+  // The histograms are allocated when an opcode is first seen, so only
+  // the opcodes that the deck actually uses take up memory
+  std::unique_ptr<Slot> slots[128];     // Indexed by opcode
+
+public:
+  //-------------------------------------------------------------------------
+  // Record the latencies of a message
+  //
+  // Messages without a response (e.g. with only one front panel line)
+  // are ignored.
+  void Add(
+    const uint8_t *cmd,                 // Command
+    size_t cmdlen,                      // Number of bytes in command
+    size_t rsplen,                      // Number of bytes in response
+    const MsgTime *ptime)               // Time stamps
+  {
+    if ((!cmdlen) || (!rsplen))
+    {
+      return;
+    }
+
+    std::unique_ptr<Slot> &slot = slots[cmd[0] & 0x7F];
+
+    if (!slot)
+    {
+      slot.reset(new Slot);
+    }
+
+    // Byte times are estimates, so the response may seem to start before
+    // the command ends; that's counted as 0
+    uint32_t command = ptime->command;
+
+    slot->response.Add((ptime->response > command) ? ptime->response - command : 0);
+    slot->end.Add((ptime->end > command) ? ptime->end - command : 0);
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Get the histogram for an opcode
+  const LatencyHistogram *              // Returns histogram, nullptr=none
+  Histogram(
+    uint8_t opcode,                     // Opcode (without toggle bit)
+    bool end) const;                    // False=response start, true=end
+
+public:
+  //-------------------------------------------------------------------------
+  // Forget all latencies
+  void Reset();
+
+public:
+  //-------------------------------------------------------------------------
+  // Print percentiles for each opcode that was seen
+  void Print(
+    FILE *f) const;                     // Output file
+};
+
+
+/////////////////////////////////////////////////////////////////////////////
+// END
+/////////////////////////////////////////////////////////////////////////////
@@ -11,13 +11,160 @@ See LICENSE for details.
 /////////////////////////////////////////////////////////////////////////////
 
 
+#ifdef _WIN32
 #include <windows.h>
+#else
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+#endif
 #include <cstdio>
-
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "../../Common/FrontPanelSequence.h"
+
+#include "Bench.h"
+#include "Cadence.h"
+#include "DeckState.h"
+#include "Decode.h"
+#include "Infer.h"
+#include "Latency.h"
 #include "SPIrx.h"
+#include "Merge.h"
+#include "Pacer.h"
 #include "Proc.h"
 
 
+/////////////////////////////////////////////////////////////////////////////
+// DATA
+/////////////////////////////////////////////////////////////////////////////
+
+
+#ifndef _WIN32
+static struct termios OldTerm;          // Terminal settings to restore
+#endif
+
+static bool MeasureLatency = false;     // True=measure response latency
+static Latency Latencies;               // Latency histograms per opcode
+static std::vector<Cadence> Cadences;   // Cadence monitors of polled opcodes
+static DeckState Deck;                  // Model of the deck state
+static bool InferFields = false;        // True=analyze unknown messages
+static Infer Inferences(&Deck);         // Statistics of unknown messages
+static ProcCounts Counts;               // Messages per opcode for -stats
+
+
+/////////////////////////////////////////////////////////////////////////////
+// LOCAL FUNCTIONS
+/////////////////////////////////////////////////////////////////////////////
+
+
+#ifndef _WIN32
+//---------------------------------------------------------------------------
+// Restore the terminal settings at exit
+static void RestoreTerminal()
+{
+  tcsetattr(STDIN_FILENO, TCSANOW, &OldTerm);
+}
+#endif
+
+
+//---------------------------------------------------------------------------
+// Handle a key
+//
+// Q quits. When a capture file is replayed with its timing, space pauses
+// and continues, N steps to the next data, + and - double and halve the
+// speed, and 1 goes back to the original speed. When latency is measured,
+// L shows the percentiles so far; shift-L also starts over, so that e.g.
+// a search can be measured on its own. C shows the cadence statistics, and
+// U shows what's known about the messages that aren't understood, and D
+// shows the state of the deck.
+static bool                             // Returns false=quit
+HandleKey(
+  int key)                              // Key
+{
+  Pacer *ppacer = SPIrx_GetPacer();
+
+  switch (key)
+  {
+  case 'q':
+  case 'Q':
+    return false;
+
+  case 'l':
+  case 'L':
+    if (MeasureLatency)
+    {
+      Latencies.Print(stderr);
+
+      if (key == 'L')
+      {
+        Latencies.Reset();
+      }
+    }
+    break;
+
+  case 'c':
+  case 'C':
+    for (const Cadence &c : Cadences)
+    {
+      c.Print(stderr);
+    }
+    break;
+
+  case 'u':
+  case 'U':
+    if (InferFields)
+    {
+      Inferences.Print(stderr, false);
+    }
+    break;
+
+  case 'd':
+  case 'D':
+    {
+      DeckSnapshot s;
+
+      Deck.Load(&s);
+      DeckState::Print(stderr, s);
+    }
+    break;
+  }
+
+  if (ppacer)
+  {
+    switch (key)
+    {
+    case ' ':
+      ppacer->Pause(!ppacer->Paused());
+      break;
+
+    case 'n':
+    case 'N':
+      ppacer->Step();
+      break;
+
+    case '+':
+      ppacer->SetSpeed(ppacer->Speed() * 2);
+      break;
+
+    case '-':
+      ppacer->SetSpeed(ppacer->Speed() / 2);
+      break;
+
+    case '1':
+      ppacer->SetSpeed(1);
+      break;
+    }
+  }
+
+  return true;
+}
+
+
 /////////////////////////////////////////////////////////////////////////////
 // PUBLIC FUNCTIONS
 /////////////////////////////////////////////////////////////////////////////
@@ -25,8 +172,15 @@ See LICENSE for details.
 
 //---------------------------------------------------------------------------
 // Main program
-int main(int argc, char const **argv)
+int main(int, char const **argv)
 {
+  // The arguments are scanned up to the null pointer at the end of argv
+  if ((argv[1]) && (!strcmp(argv[1], "-bench")))
+  {
+    return Bench_Run(argv + 2);
+  }
+
+#ifdef _WIN32
   // Get the standard input handle so we can wait for it to handle keys
   HANDLE hStdIn = GetStdHandle(STD_INPUT_HANDLE);
   if (hStdIn == INVALID_HANDLE_VALUE)
@@ -55,18 +209,116 @@ int main(int argc, char const **argv)
     fprintf(stderr, "Error setting console output mode\n");
     exit(1);
   }
+#endif
+
+  // Options for the processing come before the receiver options; the
+  // receivers get the rest of the command line
+  unsigned refresh = PROC_DEFAULT_REFRESH;
+  size_t depth = PROC_DEFAULT_QUEUE;
+  bool showscreen = false;
+  bool showstats = false;
+  const char *dumpfile = nullptr;
+
+  for (;;)
+  {
+    unsigned used;
+
+    if (!argv[1])
+    {
+      break;
+    }
+    else if ((!strcmp(argv[1], "-hz")) && (argv[2]))
+    {
+      refresh = (unsigned)strtoul(argv[2], nullptr, 0);
+      used = 2;
+    }
+    else if ((!strcmp(argv[1], "-queue")) && (argv[2]))
+    {
+      depth = (size_t)strtoul(argv[2], nullptr, 0);
+      used = 2;
+    }
+    else if ((!strcmp(argv[1], "-dump")) && (argv[2]))
+    {
+      dumpfile = argv[2];
+      used = 2;
+    }
+    else if (!strcmp(argv[1], "-screen"))
+    {
+      showscreen = true;
+      used = 1;
+    }
+    else if (!strcmp(argv[1], "-stats"))
+    {
+      showstats = true;
+      used = 1;
+    }
+    else if (!strcmp(argv[1], "-latency"))
+    {
+      MeasureLatency = true;
+      used = 1;
+    }
+    else if ((!strcmp(argv[1], "-cadence")) && (argv[2]))
+    {
+      Cadences.emplace_back((uint8_t)strtoul(argv[2], nullptr, 16));
+      used = 2;
+    }
+    else if (!strcmp(argv[1], "-infer"))
+    {
+      InferFields = true;
+      used = 1;
+    }
+    else
+    {
+      break;
+    }
+
+    argv[used] = argv[0];
+    argv += used;
+  }
+
+  // Without a dump, show the screen
+  if (!dumpfile)
+  {
+    showscreen = true;
+  }
 
   // Initialize receivers
   unsigned numReceivers = SPIrx_init(argv);
   if (!numReceivers)
   {
     fprintf(stderr, "No receivers initialized.\n");
+    fprintf(stderr, "Options before the receiver options:\n");
+    fprintf(stderr, "  -screen         Show the state on the screen (default without -dump)\n");
+    fprintf(stderr, "  -dump <file>    Dump the messages as text; \"-\" is standard output\n");
+    fprintf(stderr, "  -stats          Count the messages by opcode\n");
+    fprintf(stderr, "  -latency        Measure how fast the deck responds to each opcode\n");
+    fprintf(stderr, "  -cadence <op>   Measure how regularly a hex opcode is sent, e.g. 41 for polls\n");
+    fprintf(stderr, "  -infer          Guess what the bytes mean in messages that aren't understood\n");
+    fprintf(stderr, "  -hz <rate>      Screen refreshes per second (default %u)\n", PROC_DEFAULT_REFRESH);
+    fprintf(stderr, "  -queue <n>      Batches that can wait for each of the above (default %u)\n", PROC_DEFAULT_QUEUE);
     exit(1);
   }
 
-  // Main loop
-  BYTE rxbuf[2][4096]; // Input buffers
-  unsigned len[2] = { 0 }; // Number of bytes in each buffer
+  // Messages that are repeated with the same response are dropped before
+  // they're decoded, as far as all the sinks allow it
+  static ChangeFilter filter;
+
+  if (((showscreen) && (!Proc_AddSink(Proc_CreateScreen(refresh), &filter, depth)))
+    || ((dumpfile) && (!Proc_AddSink(Proc_CreateDump(dumpfile), &filter, depth)))
+    || ((showstats) && (!Proc_AddSink(Proc_CreateStats(&Counts, &Deck), &filter, depth))))
+  {
+    fprintf(stderr, "Error starting processing\n");
+    SPIrx_exit();
+    exit(1);
+  }
+
+  Merge_Init(numReceivers);
+
+  // Statistics, to measure throughput
+  auto starttime = std::chrono::steady_clock::now();
+  unsigned long long totalbytes = 0;
+  unsigned long long totalmessages = 0;
+  unsigned long long totalslips = 0;
 
   const char *fmtCommand = (numReceivers > 1) ? "\x1B[31;1m" : "";
   const char *fmtResponse = (numReceivers > 1) ? "\x1B[32;1m" : "";
@@ -74,8 +326,56 @@ int main(int argc, char const **argv)
 
   bool screencleared = false;
 
+  // Decoded events are collected in a batch, which is passed to the
+  // sinks when it's full, or when there's nothing else to do. If none of
+  // the receivers are live, nothing needs to be dropped when the sinks
+  // are slow.
+  DecodeBatch *pbatch = Proc_GetBatch();
+  bool live = false;
+
+  // A receiver error ends the main loop, but everything is still cleaned
+  // up normally
+  bool failed = false;
+
+  // The toggle bits show how many messages the capture missed
+  FrontPanelSeqState sequence;
+  FrontPanelSeq_Init(&sequence);
+
+  for (unsigned rxindex = 0; rxindex < numReceivers; rxindex++)
+  {
+    SPIrxStats stats;
+
+    if ((SPIrx_GetStats(rxindex, &stats)) && (stats.live))
+    {
+      live = true;
+    }
+  }
+
+#ifndef _WIN32
+  // The keys control a replay and show the statistics and the deck state.
+  // The terminal has to pass them on right away, without echoing them.
+  bool keys = (isatty(STDIN_FILENO)) && (!tcgetattr(STDIN_FILENO, &OldTerm));
+
+  if (keys)
+  {
+    struct termios term = OldTerm;
+
+    term.c_lflag &= ~(ICANON | ECHO);
+    term.c_cc[VMIN] = 0;
+    term.c_cc[VTIME] = 0;
+    tcsetattr(STDIN_FILENO, TCSANOW, &term);
+    atexit(RestoreTerminal);
+  }
+#endif
+
+  // Main loop
+  // The events point to the data where it is in the capture rings; the
+  // data is released when the next event is requested. This takes the
+  // same amount of time regardless of how much data is waiting. The
+  // decoder copies what it needs into the batch.
   for (;;)
   {
+#ifdef _WIN32
     // Check for keyboard input in the console window
     if (WaitForSingleObject(hStdIn, 0) == WAIT_OBJECT_0)
     {
@@ -83,130 +383,266 @@ int main(int argc, char const **argv)
       DWORD n;
       if (ReadConsoleInput(hStdIn, &ir, 1, &n) && n && ir.EventType == KEY_EVENT && ir.Event.KeyEvent.bKeyDown)
       {
-        switch (ir.Event.KeyEvent.uChar.AsciiChar)
+        if (!HandleKey(ir.Event.KeyEvent.uChar.AsciiChar))
         {
-        case 'q':
-        case 'Q':
           goto Quit;
         }
       }
     }
-
-    // Read data from all receivers
-    WORD readLen[2] = { 0 };
-    for (unsigned rxindex = 0; rxindex < numReceivers; rxindex++)
+#else
+    // Check for keys, only when the input is a terminal
+    if (keys)
     {
-      // Allow remaining buffer size for reading
-      readLen[rxindex] = (WORD)(sizeof(rxbuf[rxindex]) - len[rxindex]);
+      struct pollfd pfd = { STDIN_FILENO, POLLIN, 0 };
+      char c;
 
-      if (readLen[rxindex])
+      if ((poll(&pfd, 1, 0) > 0) && (read(STDIN_FILENO, &c, 1) == 1) && (!HandleKey(c)))
       {
-        if (!SPIrx_Receive(rxindex, rxbuf[rxindex] + len[rxindex], &readLen[rxindex]))
-        {
-          printf("Error reading from device %u\n", rxindex);
-          exit(1);
-        }
-
-        len[rxindex] += (unsigned)readLen[rxindex];
+        goto Quit;
       }
     }
+#endif
+
+    // Get the next event from the receivers, in order of time
+    MergeEvent ev;
+    MergeResult result = Merge_Next(&ev);
+
+    if (result == MERGE_ERROR)
+    {
+      failed = true;
+      goto Quit;
+    }
 
-    // Find how many bytes are in all buffers
-    unsigned bufLen = len[0];
-    for (unsigned rxindex = 1; rxindex < numReceivers; rxindex++)
+    if ((result != MERGE_EVENT) && (result != MERGE_SLIP))
     {
-      if (bufLen > len[rxindex])
+      // Show what we have while we wait
+      if (pbatch->Size())
+      {
+        Proc_Publish(pbatch, !live);
+        pbatch = Proc_GetBatch();
+      }
+
+      if (result == MERGE_END)
       {
-        bufLen = len[rxindex];
+        // Recorded data ran out
+        break;
       }
+
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      continue;
+    }
+
+    if (pbatch->Full())
+    {
+      Proc_Publish(pbatch, !live);
+      pbatch = Proc_GetBatch();
+    }
+
+    if (result == MERGE_SLIP)
+    {
+      Decode_Slip(pbatch, &ev.time, ev.slip);
+      totalslips++;
+
+      // The messages around a realignment are garbage; don't count them
+      FrontPanelSeq_Restart(&sequence);
+      continue;
+    }
+
+    if (ev.channel)
+    {
+      Decode_ChannelData(pbatch, ev.channel, &ev.time, ev.cmd, ev.cmdlen);
+      continue;
+    }
+
+    totalmessages++;
+
+    // Repeated messages count too
+    if (MeasureLatency)
+    {
+      Latencies.Add(ev.cmd, ev.cmdlen, ev.rsplen, &ev.time);
     }
 
-    // Analyze the buffers
-    // We assume that the buffers start with a command of 0 or more bytes,
-    // followed by a response of 1 or more bytes,
-    // followed by the next command of 1 or more bytes.
-    // Assuming that the first command can be zero bytes is to deal with the
-    // possibility that at startup, we may be receiving bytes of an
-    // incomplete response to a command that we missed.
+    if (showstats)
+    {
+      Counts.Add(&ev.time, ev.cmd, ev.cmdlen, ev.rsp, ev.rsplen);
+    }
 
-    // Search for the end of the command
-    unsigned resStart = bufLen;
-    if (bufLen)
+    if ((ev.cmdlen) && (ev.rsplen))
     {
-      for (unsigned byteindex = 0; byteindex < resStart; byteindex++)
+      bool cmdtoggle = (ev.cmd[0] & 0x80) != 0;
+      bool rsptoggle = (ev.rsp[0] & 0x80) != 0;
+      uint8_t flags = FrontPanelSeq_Check(&sequence, ev.cmd, ev.cmdlen, cmdtoggle, rsptoggle);
+
+      if (flags)
       {
-        // Search for any significant bytes in the buffers other than 0
-        for (unsigned rxindex = 1; rxindex < numReceivers; rxindex++)
+        Decode_Sequence(pbatch, &ev.time, ev.cmd[0] & 0x7F, flags);
+
+        if (pbatch->Full())
         {
-          if (rxbuf[rxindex][byteindex] != 0xFF)
-          {
-            resStart = byteindex;
-            break;
-          }
+          Proc_Publish(pbatch, !live);
+          pbatch = Proc_GetBatch();
         }
       }
     }
 
-    // Search for the end of the response
-    unsigned nextCmdStart = bufLen;
-    if (bufLen)
+    for (Cadence &c : Cadences)
     {
-      for (unsigned byteindex = resStart; byteindex < bufLen; byteindex++)
+      if ((ev.cmdlen) && (c.Opcode() == (ev.cmd[0] & 0x7F)))
       {
-        if (rxbuf[0][byteindex] != 0xFF)
+        CadenceChange change = c.Add(ev.time.start);
+
+        if (change != CADENCE_SAME)
         {
-          nextCmdStart = byteindex;
-          break;
+          // Show the change among the messages, so it can be matched
+          // with what the deck was doing
+          uint32_t limit = (c.Limit() > UINT32_MAX) ? UINT32_MAX : (uint32_t)c.Limit();
+
+          Decode_Cadence(pbatch, &ev.time, c.Opcode(), change == CADENCE_DEGRADED, c.WindowMax(), limit);
+
+          if (pbatch->Full())
+          {
+            Proc_Publish(pbatch, !live);
+            pbatch = Proc_GetBatch();
+          }
         }
       }
     }
 
-    // If we have an entire command and response, process the buffer
-    if (bufLen && ((numReceivers == 1) || (nextCmdStart < bufLen)))
+    // The model needs the bits that the filter ignores
+    Deck.Add(&ev.time, ev.cmd, ev.cmdlen, ev.rsp, ev.rsplen);
+
+    // Repeats are needed to see how often the bytes change. The known
+    // state comes from the model, which is up to date with this message.
+    if (InferFields)
     {
+      Inferences.Add(ev.cmd, ev.cmdlen, ev.rsp, ev.rsplen, Decode_Known(ev.cmd, ev.cmdlen, ev.rsp, ev.rsplen));
 
-      // Dump the buffer
-      if (nextCmdStart)
+      // The screen would be messed up by the summaries; the U key still
+      // shows them
+      if ((!showscreen) && (Inferences.Due(ev.time.start)))
       {
-        ProcessCommandResponse(rxbuf[0], resStart, rxbuf[1] + resStart, nextCmdStart - resStart);
-/*
-        unsigned byteindex;
+        Inferences.Print(stderr, true);
+      }
+    }
+
+    if (!filter.Pass(ev.cmd, ev.cmdlen, ev.rsp, ev.rsplen))
+    {
+      continue;
+    }
 
-        printf("%s%s", (screencleared ? "" : "\x1B[2J\x1B[0;0f"), fmtCommand);
-        screencleared = true;
+    // Decode the message
+    Decode_Message(pbatch, &ev.time, ev.cmd, ev.cmdlen, ev.rsp, ev.rsplen);
+/*
+    printf("%s%s", (screencleared ? "" : "\x1B[2J\x1B[0;0f"), fmtCommand);
+    screencleared = true;
 
-        for (byteindex = 0; byteindex < resStart; byteindex++)
-        {
-          printf("%02X ", rxbuf[0][byteindex]);
-        }
+    for (size_t byteindex = 0; byteindex < ev.cmdlen; byteindex++)
+    {
+      printf("%02X ", ev.cmd[byteindex]);
+    }
 
-        printf("%s", fmtResponse);
-        for (; byteindex < nextCmdStart; byteindex++)
-        {
-          printf("%02X ", rxbuf[1][byteindex]);
-        }
+    printf("%s", fmtResponse);
+    for (size_t byteindex = 0; byteindex < ev.rsplen; byteindex++)
+    {
+      printf("%02X ", ev.rsp[byteindex]);
+    }
 
-        printf("%s\n", fmtDefault);
+    printf("%s\n", fmtDefault);
 */
-      }
+  }
+Quit:
+
+  // Let the sinks finish what was decoded
+  Proc_Publish(pbatch, !live);
+  Proc_Exit();
 
-      // Remove all processed data from the buffers
-      for (unsigned rxindex = 0; rxindex < numReceivers; rxindex++)
+  // Show capture statistics
+  for (unsigned rxindex = 0; rxindex < numReceivers; rxindex++)
+  {
+    SPIrxStats stats;
+
+    if (SPIrx_GetStats(rxindex, &stats))
+    {
+      fprintf(stderr, "Receiver %u: %llu bytes, ring high-water %llu of %llu, %llu bytes lost to overruns\n",
+        rxindex,
+        (unsigned long long)stats.received,
+        (unsigned long long)stats.highwater,
+        (unsigned long long)stats.ringsize,
+        (unsigned long long)stats.overruns);
+
+      if (stats.unrecorded)
       {
-        memmove(rxbuf[rxindex], rxbuf[rxindex] + nextCmdStart, len[rxindex] - nextCmdStart);
-        len[rxindex] -= nextCmdStart;
+        fprintf(stderr, "Receiver %u: %llu bytes weren't written to the capture file\n",
+          rxindex, (unsigned long long)stats.unrecorded);
       }
-    }
-    else
-    {
-      Sleep(10);
+
+      totalbytes += stats.received;
     }
   }
-Quit:
 
   SPIrx_exit();
 
-  return 0;
+  // Show statistics
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - starttime).count();
+  if (seconds > 0)
+  {
+    fprintf(stderr, "\n%llu bytes, %llu messages in %.3f s (%.2f MB/s, %.0f messages/s)\n",
+      totalbytes, totalmessages, seconds,
+      totalbytes / seconds / 1e6, totalmessages / seconds);
+  }
+
+  // Show processing statistics
+  ProcSinkStats sinkstats;
+
+  for (unsigned sinkindex = 0; Proc_GetStats(sinkindex, &sinkstats); sinkindex++)
+  {
+    fprintf(stderr, "Sink %s: %llu events in %llu batches, queue high-water %zu of %zu, %llu events in %llu batches dropped\n",
+      sinkstats.name,
+      (unsigned long long)sinkstats.events,
+      (unsigned long long)sinkstats.batches,
+      sinkstats.highwater,
+      sinkstats.depth,
+      (unsigned long long)sinkstats.droppedevents,
+      (unsigned long long)sinkstats.droppedbatches);
+  }
+
+  if (filter.Suppressed())
+  {
+    fprintf(stderr, "%llu of %llu messages were repeats and weren't shown\n",
+      (unsigned long long)filter.Suppressed(), totalmessages);
+    filter.PrintStats(stderr);
+  }
+
+  if (totalslips)
+  {
+    fprintf(stderr, "Front panel lines were realigned %llu times\n", totalslips);
+  }
+
+  if (sequence.messages)
+  {
+    fprintf(stderr, "Toggle bits of %lu messages: %lu missed, %lu sent again, %lu responses didn't match\n",
+      (unsigned long)sequence.messages,
+      (unsigned long)sequence.missed,
+      (unsigned long)sequence.retried,
+      (unsigned long)sequence.mismatched);
+  }
+
+  if (MeasureLatency)
+  {
+    Latencies.Print(stderr);
+  }
+
+  for (const Cadence &c : Cadences)
+  {
+    c.Print(stderr);
+  }
+
+  if (InferFields)
+  {
+    Inferences.Print(stderr, false);
+  }
+
+  return failed ? 1 : 0;
 }
 
 
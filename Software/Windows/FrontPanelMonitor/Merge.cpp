@@ -0,0 +1,552 @@
+/****************************************************************************
+Time-ordered merge of all receivers
+(C) 2024 Jac Goudsmit
+Licensed under the MIT license.
+See LICENSE file for details.
+****************************************************************************/
+
+
+/////////////////////////////////////////////////////////////////////////////
+// INCLUDES
+/////////////////////////////////////////////////////////////////////////////
+
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+
+#include "../../Common/FrontPanelFramer.h"
+
+#include "Merge.h"
+#include "SPIrx.h"
+
+
+/////////////////////////////////////////////////////////////////////////////
+// TYPES
+/////////////////////////////////////////////////////////////////////////////
+
+
+//---------------------------------------------------------------------------
+// Source of events
+//
+// A source has at most one pending event at a time; that event is in the
+// heap. When a source doesn't have a pending event, its watermark tells
+// how old the next event from that source can be.
+struct Source
+{
+  unsigned    channel;                  // First receiver
+  unsigned    numchannels;              // 2=front panel pair, 1=raw data
+  bool        pending;                  // True=event is waiting
+  MergeEvent  event;                    // Pending event
+  size_t      release;                  // Bytes to release after event
+  uint64_t    watermark;                // No future events before this time
+  unsigned    errors;                   // Bad messages in a row
+  FrontPanelFramerState framer;         // Framer for the front panel pair
+  size_t      fed;                      // Pairs at the start of the span
+                                        //  that the framer has seen
+};
+
+
+/////////////////////////////////////////////////////////////////////////////
+// DATA
+/////////////////////////////////////////////////////////////////////////////
+
+
+static Source Sources[SPIRX_MAX_CHANNELS];
+static unsigned numSources;
+
+// Heap of sources with pending events, oldest event first
+static Source *Heap[SPIRX_MAX_CHANNELS];
+static unsigned numHeap;
+
+// Source of the event that was delivered last
+static Source *Current;
+
+
+/////////////////////////////////////////////////////////////////////////////
+// LOCAL FUNCTIONS
+/////////////////////////////////////////////////////////////////////////////
+
+
+//---------------------------------------------------------------------------
+// Compare sources for the heap
+//
+// The standard heap functions put the largest item first, so this
+// compares in reverse to get the oldest event first.
+static bool IsNewer(
+  const Source *a,                      // First source
+  const Source *b)                      // Second source
+{
+  return a->event.time.start > b->event.time.start;
+}
+
+
+//---------------------------------------------------------------------------
+// Release the data of a source's event
+static void Release(
+  Source *s)                            // Source
+{
+  for (unsigned i = 0; i < s->numchannels; i++)
+  {
+    SPIrx_Release(s->channel + i, s->release);
+  }
+
+  s->release = 0;
+  s->pending = false;
+}
+
+
+//---------------------------------------------------------------------------
+// Get the index in the span of a position of the front panel framer
+//
+// Positions of data that was already released are clamped to 0.
+static size_t                           // Returns index
+Index(
+  const Source *s,                      // Source
+  uint32_t position)                    // Position from the framer
+{
+  uint32_t back = s->framer.pos - position;
+
+  return (back > s->fed) ? 0 : s->fed - back;
+}
+
+
+//---------------------------------------------------------------------------
+// Check if a front panel message is valid
+static bool                             // Returns true=valid
+IsValid(
+  const FrontPanelFrame *pframe)        // Frame
+{
+  // Both must at least have an opcode or status, and a checksum
+  if ((pframe->rsp < 2) || (pframe->len - pframe->rsp < 2)
+    || (!(pframe->flags & FRONTPANELFRAME_CMD_OK)) || (pframe->flags & FRONTPANELFRAME_OVERFLOW))
+  {
+    return false;
+  }
+
+  // The deck often gets the checksum of the VU meter response wrong, so
+  // that one isn't checked
+  return ((pframe->buf[0] & 0x7F) == 0x5E) || (pframe->flags & FRONTPANELFRAME_RSP_OK);
+}
+
+
+//---------------------------------------------------------------------------
+// Find the offset at which the front panel lines are aligned
+//
+// Offsets are tried from small to large, and the first one at which a
+// number of messages in a row are valid is used. The first message isn't
+// counted because the data may start in the middle of a message.
+//
+// Messages can have correct checksums by accident when the lines are
+// misaligned, so the most significant bit of the first byte of the
+// commands and responses must also alternate as usual.
+static bool                             // Returns true=found
+FindSlip(
+  const uint8_t *cmd,                   // Command stream
+  const uint8_t *rsp,                   // Response stream
+  size_t len,                           // Number of bytes in both streams
+  int *pslip)                           // Output bytes to skip on response
+                                        //  line; negative=command line
+{
+  const uint8_t toggles = FRONTPANELFRAME_TOGGLE | FRONTPANELFRAME_RSP_TOGGLE;
+  FrontPanelFramerState framer;
+
+  for (int i = 0; i <= 2 * MERGE_MAX_SLIP; i++)
+  {
+    // Try 0, 1, -1, 2, -2 etc.
+    int slip = (i & 1) ? (i + 1) / 2 : -(i / 2);
+    size_t skip = (size_t)abs(slip);
+
+    if (skip >= len)
+    {
+      break;
+    }
+
+    const uint8_t *c = cmd + ((slip < 0) ? skip : 0);
+    const uint8_t *r = rsp + ((slip > 0) ? skip : 0);
+    size_t n = len - skip;
+    size_t pos = 0;
+    int good = -1;
+    uint8_t prevflags = 0;
+
+    FrontPanelFramer_Init(&framer);
+
+    while (good < MERGE_SLIP_CONFIRM)
+    {
+      bool complete;
+
+      pos += FrontPanelFramer_Put(&framer, c + pos, r + pos, n - pos, &complete);
+
+      if (!complete)
+      {
+        break;
+      }
+
+      const FrontPanelFrame *pframe = &framer.frame;
+
+      if (good >= 0)
+      {
+        if (!IsValid(pframe))
+        {
+          break;
+        }
+
+        if ((good >= 1) && (((pframe->flags ^ prevflags) & toggles) != toggles))
+        {
+          break;
+        }
+      }
+
+      prevflags = pframe->flags;
+      good++;
+    }
+
+    if (good == MERGE_SLIP_CONFIRM)
+    {
+      *pslip = slip;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+
+//---------------------------------------------------------------------------
+// Try to get the next event from the front panel lines
+static bool                             // Returns false=receiver error
+FillFrontPanel(
+  Source *s)                            // Source
+{
+  // This has to be done before getting the data, otherwise we might
+  // miss data that arrives in between.
+  uint64_t watermark = SPIRX_TIME_END;
+  uint64_t marks[2] = { 0, 0 };
+  for (unsigned i = 0; i < 2; i++)
+  {
+    marks[i] = SPIrx_Watermark(s->channel + i);
+    watermark = std::min(watermark, marks[i]);
+  }
+
+  for (;;)
+  {
+    uint8_t *rxbuf[2] = { nullptr, nullptr };
+    size_t lens[2] = { 0, 0 };
+    size_t bufLen = SPIRX_MAX_SPAN;
+
+    for (unsigned i = 0; i < 2; i++)
+    {
+      if (!SPIrx_ReadSpan(s->channel + i, &rxbuf[i], &lens[i]))
+      {
+        printf("Error reading from device %u\n", s->channel + i);
+        return false;
+      }
+
+      bufLen = std::min(bufLen, lens[i]);
+    }
+
+    // If the line with the least data has ended, nothing more can be
+    // paired with the other line (see Merge.h)
+    bool ended = false;
+    for (unsigned i = 0; i < 2; i++)
+    {
+      ended |= (marks[i] == SPIRX_TIME_END) && (lens[i] == bufLen);
+    }
+
+    if ((ended) && (!bufLen) && (lens[0] + lens[1]))
+    {
+      // Throw the rest of the other line away, so its receiver doesn't
+      // wait for room in its ring forever
+      unsigned i = lens[0] ? 0 : 1;
+
+      SPIrx_Release(s->channel + i, lens[i]);
+      continue;
+    }
+
+    // Give the framer the pairs that it hasn't seen yet. It stops at the
+    // end of a frame, when the next command starts.
+    bool complete = false;
+
+    if (s->fed < bufLen)
+    {
+      s->fed += FrontPanelFramer_Put(&s->framer, rxbuf[0] + s->fed, rxbuf[1] + s->fed, bufLen - s->fed, &complete);
+    }
+
+    // If the next command didn't start, the frame is ended anyway when
+    // nothing arrived for a while, when the data ended, or when there's
+    // no room for more data. If the response didn't start, the frame is
+    // thrown away.
+    if ((!complete) && (bufLen)
+      && ((ended) || (bufLen == SPIRX_MAX_SPAN)
+        || (watermark >= SPIrx_Time(s->channel, bufLen - 1) + MERGE_HOLD_TIME)))
+    {
+      complete = FrontPanelFramer_Flush(&s->framer);
+    }
+
+    FrontPanelFrame *pframe = &s->framer.frame;
+
+    // Keep track of bad messages and realign the lines if necessary
+    if (complete)
+    {
+      if (IsValid(pframe))
+      {
+        s->errors = 0;
+      }
+      else if (++s->errors >= MERGE_SLIP_ERRORS)
+      {
+        int slip;
+
+        if (FindSlip(rxbuf[0], rxbuf[1], bufLen, &slip))
+        {
+          s->errors = 0;
+
+          if (slip)
+          {
+            // The framer saw the misaligned data, so it starts over
+            FrontPanelFramer_Init(&s->framer);
+            s->fed = 0;
+
+            SPIrx_Release(s->channel + ((slip > 0) ? 1 : 0), (size_t)abs(slip));
+
+            uint64_t start = SPIrx_Time(s->channel, 0);
+
+            s->event.time.start = start;
+            s->event.time.command = 0;
+            s->event.time.response = 0;
+            s->event.time.end = 0;
+            s->event.channel = s->channel;
+            s->event.cmd = nullptr;
+            s->event.cmdlen = 0;
+            s->event.rsp = nullptr;
+            s->event.rsplen = 0;
+            s->event.slip = slip;
+            s->release = 0;
+            s->pending = true;
+            s->watermark = start;
+
+            return true;
+          }
+        }
+        else if ((bufLen == SPIRX_MAX_SPAN) || (ended))
+        {
+          // No offset works, even with all the data that can be seen at
+          // once. Don't search again until there are more bad messages.
+          // If there wasn't enough data, the search is done again with
+          // the next message.
+          s->errors = 0;
+        }
+      }
+    }
+
+    if (complete)
+    {
+      size_t cmdlen = pframe->rsp;
+      size_t rsplen = pframe->len - pframe->rsp;
+      size_t cmdStart = Index(s, pframe->start);
+      size_t resStart = Index(s, pframe->rspstart);
+      size_t cmdEnd = std::min(cmdStart + std::max(cmdlen, (size_t)1), s->fed) - 1;
+      size_t resEnd = std::min(resStart + std::max(rsplen, (size_t)1), s->fed) - 1;
+      uint64_t start = SPIrx_Time(s->channel, cmdStart);
+
+      // The framer reports the toggle bits in the flags, but the rest of
+      // the program expects the bytes the way they were received
+      if ((cmdlen) && (pframe->flags & FRONTPANELFRAME_TOGGLE))
+      {
+        pframe->buf[0] |= 0x80;
+      }
+
+      if ((rsplen) && (pframe->flags & FRONTPANELFRAME_RSP_TOGGLE))
+      {
+        pframe->buf[pframe->rsp] |= 0x80;
+      }
+
+      s->event.time.start = start;
+      s->event.time.command = MsgTime_Offset(start, SPIrx_Time(s->channel, cmdEnd));
+      s->event.time.response = MsgTime_Offset(start, SPIrx_Time(s->channel + 1, resStart));
+      s->event.time.end = MsgTime_Offset(start, SPIrx_Time(s->channel + 1, resEnd));
+      s->event.slip = 0;
+      s->event.channel = s->channel;
+      s->event.cmd = pframe->buf;
+      s->event.cmdlen = cmdlen;
+      s->event.rsp = pframe->buf + pframe->rsp;
+      s->event.rsplen = rsplen;
+      s->release = s->fed;
+      s->fed = 0;
+      s->pending = true;
+      s->watermark = start;
+
+      return true;
+    }
+
+    // The pairs before the frame that's being received aren't part of
+    // any message
+    size_t unused = Index(s, pframe->start);
+
+    if (!unused)
+    {
+      // The next message can't be older than what's in the buffer now
+      s->watermark = bufLen ? SPIrx_Time(s->channel, 0) : watermark;
+
+      return true;
+    }
+
+    s->release = unused;
+    s->fed -= unused;
+    Release(s);
+  }
+}
+
+
+//---------------------------------------------------------------------------
+// Try to get the next event from a raw data receiver
+static bool                             // Returns false=receiver error
+FillRaw(
+  Source *s)                            // Source
+{
+  // This has to be done before getting the data, otherwise we might
+  // miss data that arrives in between.
+  uint64_t watermark = SPIrx_Watermark(s->channel);
+
+  uint8_t *p;
+  size_t len;
+  if (!SPIrx_ReadSpan(s->channel, &p, &len))
+  {
+    printf("Error reading from device %u\n", s->channel);
+    return false;
+  }
+
+  size_t chunklen = len ? SPIrx_ChunkLen(s->channel) : 0;
+  if (!chunklen)
+  {
+    s->watermark = watermark;
+
+    return true;
+  }
+
+  // Deliver the bytes that were received at the same time
+  if (len > chunklen)
+  {
+    len = chunklen;
+  }
+
+  uint64_t start = SPIrx_Time(s->channel, 0);
+
+  s->event.time.start = start;
+  s->event.time.command = MsgTime_Offset(start, SPIrx_Time(s->channel, len - 1));
+  s->event.time.response = 0;
+  s->event.time.end = s->event.time.command;
+  s->event.channel = s->channel;
+  s->event.cmd = p;
+  s->event.cmdlen = len;
+  s->event.rsp = nullptr;
+  s->event.rsplen = 0;
+  s->event.slip = 0;
+  s->release = len;
+  s->pending = true;
+  s->watermark = start;
+
+  return true;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// PUBLIC FUNCTIONS
+/////////////////////////////////////////////////////////////////////////////
+
+
+//---------------------------------------------------------------------------
+// Initialize the merge
+void Merge_Init(
+  unsigned numReceivers)                // Number of receivers
+{
+  numSources = 0;
+  numHeap = 0;
+  Current = nullptr;
+
+  for (unsigned channel = 0; channel < numReceivers; )
+  {
+    Source *s = &Sources[numSources++];
+
+    s->channel = channel;
+    s->numchannels = (channel == 0) ? std::min(numReceivers, 2u) : 1;
+    s->pending = false;
+    s->release = 0;
+    s->watermark = 0;
+    s->errors = 0;
+    s->fed = 0;
+    FrontPanelFramer_Init(&s->framer);
+
+    channel += s->numchannels;
+  }
+}
+
+
+//---------------------------------------------------------------------------
+// Get the next event
+MergeResult                             // Returns result
+Merge_Next(
+  MergeEvent *pevent)                   // Output event
+{
+  if (Current)
+  {
+    Release(Current);
+    Current = nullptr;
+  }
+
+  // Get new events from the sources that don't have one
+  for (unsigned i = 0; i < numSources; i++)
+  {
+    Source *s = &Sources[i];
+
+    if (!s->pending)
+    {
+      if (!((s->numchannels == 2) ? FillFrontPanel(s) : FillRaw(s)))
+      {
+        return MERGE_ERROR;
+      }
+
+      if (s->pending)
+      {
+        Heap[numHeap++] = s;
+        std::push_heap(Heap, Heap + numHeap, IsNewer);
+      }
+    }
+  }
+
+  if (!numHeap)
+  {
+    for (unsigned i = 0; i < numSources; i++)
+    {
+      if (Sources[i].watermark != SPIRX_TIME_END)
+      {
+        return MERGE_WAIT;
+      }
+    }
+
+    return MERGE_END;
+  }
+
+  // The oldest event can only be delivered if none of the sources that
+  // don't have an event, can still come up with an older one
+  Source *s = Heap[0];
+  for (unsigned i = 0; i < numSources; i++)
+  {
+    if ((!Sources[i].pending) && (Sources[i].watermark < s->event.time.start))
+    {
+      return MERGE_WAIT;
+    }
+  }
+
+  std::pop_heap(Heap, Heap + numHeap, IsNewer);
+  numHeap--;
+
+  Current = s;
+  *pevent = s->event;
+
+  return s->event.slip ? MERGE_SLIP : MERGE_EVENT;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// END
+/////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,139 @@
+/****************************************************************************
+Time-ordered merge of all receivers
+(C) 2024 Jac Goudsmit
+Licensed under the MIT license.
+See LICENSE for details.
+****************************************************************************/
+
+/*
+  Each receiver delivers its data with time stamps. The merge turns the
+  data of all receivers into one stream of events, in order of time:
+
+  - Receivers 0 and 1 (the front panel command and response lines) are
+    framed together; each event is one command and its response. The
+    framing is done by the same code as in the firmware (see
+    Common/FrontPanelFramer.h), so both always agree on the messages.
+  - Every other receiver is a source of raw data; each event is the data
+    that was received at one time. If there's only one receiver, nothing
+    can be framed, so receiver 0 is a source of raw data too.
+
+  The sources are merged with a heap (a k-way merge). An event is only
+  delivered when every other source is known not to have anything older
+  (according to its watermark), so the order is correct even when some
+  receivers are slower than others.
+
+  The command and response lines are received by separate devices, so if
+  one of them loses data (e.g. a dropped USB packet), the lines are no
+  longer aligned and every message after that is garbage. The checksums
+  are used to detect this: after a number of bad messages in a row, the
+  merge searches for the offset at which the checksums are correct again,
+  skips the extra bytes on one of the lines, and reports a slip event.
+
+  The front panel lines don't always end at the same time, e.g. with
+  replay files of different lengths. Once the line with the least data has
+  ended, nothing more can be paired, so the rest of the other line is
+  thrown away; otherwise its receiver would wait for room in its ring
+  forever, and the merge would never end.
+
+  The framer is fed directly from the capture rings. It copies each front
+  panel message into its frame, because it decides by the checksums which
+  idle bytes are part of the message; the data of the other receivers
+  isn't copied. The bytes in the ring stay until the event is released,
+  so the time stamps of the message can be looked up. Apart from the
+  rings, the only memory that's used is one pending event per source.
+*/
+
+
+#pragma once
+
+
+/////////////////////////////////////////////////////////////////////////////
+// INCLUDES
+/////////////////////////////////////////////////////////////////////////////
+
+
+#include <cstdint>
+#include <cstddef>
+
+#include "MsgTime.h"
+
+
+/////////////////////////////////////////////////////////////////////////////
+// MACROS
+/////////////////////////////////////////////////////////////////////////////
+
+
+// If no more data arrives on the front panel lines for this long, the
+// response is assumed to be complete, even though the next command
+// hasn't started yet
+#define MERGE_HOLD_TIME 50000000ULL     // ns
+
+// Number of messages in a row with bad checksums that trigger a search
+// for a slip between the front panel lines
+#define MERGE_SLIP_ERRORS 3
+
+// Max number of bytes that the front panel lines can slip
+#define MERGE_MAX_SLIP 1024
+
+// Number of messages in a row that must have correct checksums to accept
+// a slip
+#define MERGE_SLIP_CONFIRM 8
+
+
+/////////////////////////////////////////////////////////////////////////////
+// TYPES
+/////////////////////////////////////////////////////////////////////////////
+
+
+//---------------------------------------------------------------------------
+// Event
+struct MergeEvent
+{
+  MsgTime     time;                     // Time stamps
+  unsigned    channel;                  // Receiver index; 0=front panel
+  uint8_t    *cmd;                      // Command or raw data
+  size_t      cmdlen;                   // Number of bytes in cmd
+  uint8_t    *rsp;                      // Response; nullptr for raw data
+  size_t      rsplen;                   // Number of bytes in rsp
+  int         slip;                     // Bytes skipped on response line,
+                                        //  negative=on command line
+};
+
+
+//---------------------------------------------------------------------------
+// Result of getting an event
+enum MergeResult
+{
+  MERGE_EVENT,                          // Event was stored
+  MERGE_SLIP,                           // Front panel lines were realigned
+  MERGE_WAIT,                           // No event can be delivered yet
+  MERGE_END,                            // All receivers ended
+  MERGE_ERROR,                          // Receiver error
+};
+
+
+/////////////////////////////////////////////////////////////////////////////
+// PUBLIC FUNCTIONS
+/////////////////////////////////////////////////////////////////////////////
+
+
+//---------------------------------------------------------------------------
+// Initialize the merge
+//
+// This must be called after SPIrx_init.
+void Merge_Init(
+  unsigned numReceivers);               // Number of receivers
+
+
+//---------------------------------------------------------------------------
+// Get the next event
+//
+// The data of the previous event is released, so it's no longer valid.
+MergeResult                             // Returns result
+Merge_Next(
+  MergeEvent *pevent);                  // Output event
+
+
+/////////////////////////////////////////////////////////////////////////////
+// END
+/////////////////////////////////////////////////////////////////////////////
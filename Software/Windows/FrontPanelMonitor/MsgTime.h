@@ -0,0 +1,69 @@
+/****************************************************************************
+Message time stamps
+(C) 2024 Jac Goudsmit
+Licensed under the MIT license.
+See LICENSE for details.
+****************************************************************************/
+
+/*
+  Times are in nanoseconds since the receivers were started. Only the
+  start of a message is stored as a full 64-bit time; the other times are
+  32-bit offsets from the start, which is plenty for a message and keeps
+  the time stamps small enough to pass along with every message.
+*/
+
+
+#pragma once
+
+
+/////////////////////////////////////////////////////////////////////////////
+// INCLUDES
+/////////////////////////////////////////////////////////////////////////////
+
+
+#include <cstdint>
+
+
+/////////////////////////////////////////////////////////////////////////////
+// TYPES
+/////////////////////////////////////////////////////////////////////////////
+
+
+//---------------------------------------------------------------------------
+// Time stamps of a message
+struct MsgTime
+{
+  uint64_t    start;                    // First command byte, ns
+  uint32_t    command;                  // Last command byte, ns after start
+  uint32_t    response;                 // First response byte, ns after start
+  uint32_t    end;                      // Last byte, ns after start
+};
+
+
+/////////////////////////////////////////////////////////////////////////////
+// PUBLIC FUNCTIONS
+/////////////////////////////////////////////////////////////////////////////
+
+
+//---------------------------------------------------------------------------
+// Get the offset of a time from the start of a message
+//
+// Byte times are estimates, so a byte may appear to be slightly earlier
+// than the start; that's reported as 0.
+inline uint32_t                         // Returns ns after start
+MsgTime_Offset(
+  uint64_t start,                       // Start of message
+  uint64_t time)                        // Time to convert
+{
+  if (time <= start)
+  {
+    return 0;
+  }
+
+  return (time - start > UINT32_MAX) ? UINT32_MAX : (uint32_t)(time - start);
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// END
+/////////////////////////////////////////////////////////////////////////////
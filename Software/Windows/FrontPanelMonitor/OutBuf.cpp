@@ -0,0 +1,242 @@
+/****************************************************************************
+Buffered text output
+(C) 2024 Jac Goudsmit
+Licensed under the MIT license.
+See LICENSE for details.
+****************************************************************************/
+
+
+/////////////////////////////////////////////////////////////////////////////
+// INCLUDES
+/////////////////////////////////////////////////////////////////////////////
+
+
+#include "OutBuf.h"
+
+
+/////////////////////////////////////////////////////////////////////////////
+// DATA
+/////////////////////////////////////////////////////////////////////////////
+
+
+const char OutBuf::hexdigits[17] = "0123456789ABCDEF";
+
+const char OutBuf::decpairs[201] =
+  "00010203040506070809"
+  "10111213141516171819"
+  "20212223242526272829"
+  "30313233343536373839"
+  "40414243444546474849"
+  "50515253545556575859"
+  "60616263646566676869"
+  "70717273747576777879"
+  "80818283848586878889"
+  "90919293949596979899";
+
+
+/////////////////////////////////////////////////////////////////////////////
+// PUBLIC FUNCTIONS
+/////////////////////////////////////////////////////////////////////////////
+
+
+//---------------------------------------------------------------------------
+// Constructor
+OutBuf::OutBuf(
+  FILE *f,                              // Output file
+  size_t size)                          // Buffer size
+  : buf(new char[size < OUTBUF_MAX_ITEM ? OUTBUF_MAX_ITEM : size])
+  , size(size < OUTBUF_MAX_ITEM ? OUTBUF_MAX_ITEM : size)
+  , f(f)
+{
+}
+
+
+//---------------------------------------------------------------------------
+// Destructor
+OutBuf::~OutBuf()
+{
+  Flush();
+
+  delete[] buf;
+}
+
+
+//---------------------------------------------------------------------------
+// Write the buffer to the file
+void OutBuf::Flush()
+{
+  if (len)
+  {
+    fwrite(buf, 1, len, f);
+    fflush(f);
+    len = 0;
+  }
+}
+
+
+//---------------------------------------------------------------------------
+// Add characters
+void OutBuf::Write(
+  const char *s,                        // Characters
+  size_t n)                             // Number of characters
+{
+  while (n)
+  {
+    Reserve(n);
+
+    size_t chunk = (n < size - len) ? n : size - len;
+
+    memcpy(buf + len, s, chunk);
+    len += chunk;
+    s += chunk;
+    n -= chunk;
+  }
+}
+
+
+//---------------------------------------------------------------------------
+// Add a string, padded with spaces to a field width
+void OutBuf::Str(
+  const char *s,                        // Nul-terminated string
+  int width)                            // Field width
+{
+  size_t n = strlen(s);
+  size_t pad = 0;
+
+  if ((width >= 0) && ((size_t)width > n))
+  {
+    pad = width - n;
+
+    while (pad--)
+    {
+      Char(' ');
+    }
+
+    pad = 0;
+  }
+  else if ((width < 0) && ((size_t)-width > n))
+  {
+    pad = (size_t)-width - n;
+  }
+
+  Write(s, n);
+
+  while (pad--)
+  {
+    Char(' ');
+  }
+}
+
+
+//---------------------------------------------------------------------------
+// Add bytes as hex digits, each followed by a space
+void OutBuf::HexBytes(
+  const uint8_t *begin,                 // First byte
+  const uint8_t *end)                   // End of data
+{
+  while (begin != end)
+  {
+    // Do as many bytes as possible without checking for room each time
+    Reserve(3);
+
+    size_t n = (size - len) / 3;
+    if (n > (size_t)(end - begin))
+    {
+      n = end - begin;
+    }
+
+    for (char *d = buf + len; n; n--, begin++)
+    {
+      *d++ = hexdigits[*begin >> 4];
+      *d++ = hexdigits[*begin & 0xF];
+      *d++ = ' ';
+      len += 3;
+    }
+  }
+}
+
+
+//---------------------------------------------------------------------------
+// Add an unsigned decimal number
+void OutBuf::Dec(
+  unsigned long long v)                 // Value
+{
+  Dec(v, 1);
+}
+
+
+//---------------------------------------------------------------------------
+// Add an unsigned decimal number, padded with zeroes to a fixed width
+void OutBuf::Dec(
+  unsigned long long v,                 // Value
+  unsigned width)                       // Minimum number of digits
+{
+  // Generate the digits backwards, two at a time
+  char tmp[24];
+  char *p = tmp + sizeof(tmp);
+
+  while (v >= 100)
+  {
+    unsigned pair = (unsigned)(v % 100) * 2;
+    v /= 100;
+
+    *--p = decpairs[pair + 1];
+    *--p = decpairs[pair];
+  }
+
+  if (v >= 10)
+  {
+    *--p = decpairs[v * 2 + 1];
+    *--p = decpairs[v * 2];
+  }
+  else
+  {
+    *--p = (char)('0' + v);
+  }
+
+  if (width > sizeof(tmp))
+  {
+    width = sizeof(tmp);
+  }
+
+  while (p > tmp + sizeof(tmp) - width)
+  {
+    *--p = '0';
+  }
+
+  Write(p, tmp + sizeof(tmp) - p);
+}
+
+
+//---------------------------------------------------------------------------
+// Add a string in quotes, with unprintable characters in hex
+void OutBuf::Escaped(
+  const uint8_t *begin,                 // First character
+  const uint8_t *end)                   // End of string
+{
+  Char('\"');
+
+  for (const uint8_t *s = begin; s != end; s++)
+  {
+    Reserve(4);
+
+    if ((*s < 32) || (*s >= 0x7E))
+    {
+      buf[len++] = '\\';
+      buf[len++] = 'x';
+      buf[len++] = hexdigits[*s >> 4];
+      buf[len++] = hexdigits[*s & 0xF];
+    }
+    else
+    {
+      buf[len++] = (char)*s;
+    }
+  }
+
+  Char('\"');
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// END
+/////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,181 @@
+/****************************************************************************
+Buffered text output
+(C) 2024 Jac Goudsmit
+Licensed under the MIT license.
+See LICENSE for details.
+****************************************************************************/
+
+/*
+  Formatting output with printf and fputc costs a function call per
+  character (and a format string that has to be parsed every time), which
+  adds up when the bus is busy and most of the output is hex bytes. This
+  buffer formats the usual things (hex bytes, BCD, decimal numbers,
+  escaped strings) with lookup tables, directly into a preallocated
+  buffer, and writes the whole buffer with a single call when it's
+  flushed.
+
+  The buffer is flushed automatically when it's full, so the amount of
+  text between flushes isn't limited.
+*/
+
+
+#pragma once
+
+
+/////////////////////////////////////////////////////////////////////////////
+// INCLUDES
+/////////////////////////////////////////////////////////////////////////////
+
+
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+
+
+/////////////////////////////////////////////////////////////////////////////
+// MACROS
+/////////////////////////////////////////////////////////////////////////////
+
+
+// Default buffer size
+#define OUTBUF_SIZE 65536
+
+// Longest text that a single formatting call may add, other than strings
+#define OUTBUF_MAX_ITEM 32
+
+
+/////////////////////////////////////////////////////////////////////////////
+// TYPES
+/////////////////////////////////////////////////////////////////////////////
+
+
+class OutBuf
+{
+protected:
+  char       *buf;                      // Buffer
+  size_t      size;                     // Size of the buffer
+  size_t      len = 0;                  // Number of characters in buffer
+  FILE       *f;                        // Output file
+
+  static const char hexdigits[17];      // Hex digits
+  static const char decpairs[201];      // "00" to "99"
+
+public:
+  //-------------------------------------------------------------------------
+  // Constructor
+  OutBuf(
+    FILE *f = stdout,                   // Output file
+    size_t size = OUTBUF_SIZE);         // Buffer size
+
+public:
+  //-------------------------------------------------------------------------
+  // Destructor
+  ~OutBuf();
+
+public:
+  //-------------------------------------------------------------------------
+  // Write the buffer to the file
+  void Flush();
+
+public:
+  //-------------------------------------------------------------------------
+  // Make sure there's room for a number of characters
+  void Reserve(
+    size_t n)                           // Number of characters
+  {
+    if (len + n > size)
+    {
+      Flush();
+    }
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Add characters
+  void Write(
+    const char *s,                      // Characters
+    size_t n);                          // Number of characters
+
+public:
+  //-------------------------------------------------------------------------
+  // Add a character
+  void Char(
+    char c)                             // Character
+  {
+    Reserve(1);
+    buf[len++] = c;
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Add a string
+  void Str(
+    const char *s)                      // Nul-terminated string
+  {
+    Write(s, strlen(s));
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Add a string, padded with spaces to a field width
+  //
+  // Like printf, a negative width pads at the right (left-aligned).
+  void Str(
+    const char *s,                      // Nul-terminated string
+    int width);                         // Field width
+
+public:
+  //-------------------------------------------------------------------------
+  // Add one hex digit
+  void Nibble(
+    unsigned n)                         // Value, 0-15
+  {
+    Char(hexdigits[n & 0xF]);
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Add a byte as two hex digits
+  //
+  // BCD values are shown the same way.
+  void Hex(
+    uint8_t b)                          // Value
+  {
+    Reserve(2);
+    buf[len++] = hexdigits[b >> 4];
+    buf[len++] = hexdigits[b & 0xF];
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Add bytes as hex digits, each followed by a space
+  void HexBytes(
+    const uint8_t *begin,               // First byte
+    const uint8_t *end);                // End of data
+
+public:
+  //-------------------------------------------------------------------------
+  // Add an unsigned decimal number
+  void Dec(
+    unsigned long long v);              // Value
+
+public:
+  //-------------------------------------------------------------------------
+  // Add an unsigned decimal number, padded with zeroes to a fixed width
+  void Dec(
+    unsigned long long v,               // Value
+    unsigned width);                    // Minimum number of digits
+
+public:
+  //-------------------------------------------------------------------------
+  // Add a string in quotes, with unprintable characters in hex
+  void Escaped(
+    const uint8_t *begin,               // First character
+    const uint8_t *end);                // End of string
+};
+
+
+/////////////////////////////////////////////////////////////////////////////
+// END
+/////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,261 @@
+/****************************************************************************
+Replay scheduler
+(C) 2024 Jac Goudsmit
+Licensed under the MIT license.
+See LICENSE for details.
+****************************************************************************/
+
+
+/////////////////////////////////////////////////////////////////////////////
+// INCLUDES
+/////////////////////////////////////////////////////////////////////////////
+
+
+#define NOMINMAX                        // Keep windows.h from defining min/max
+
+#ifdef _WIN32
+#include <windows.h>
+
+#pragma comment(lib, "winmm.lib")
+#endif
+#include <algorithm>
+#include <thread>
+
+#include "Pacer.h"
+
+
+/////////////////////////////////////////////////////////////////////////////
+// PUBLIC FUNCTIONS
+/////////////////////////////////////////////////////////////////////////////
+
+
+//---------------------------------------------------------------------------
+// Constructor
+Pacer::Pacer(
+  double speed,                         // Speed, 1=original timing
+  bool paused)                          // True=start paused
+  : speed(std::min(std::max(speed, PACER_MIN_SPEED), PACER_MAX_SPEED))
+  , paused(paused)
+{
+#ifdef _WIN32
+  // Sleep with 1 ms resolution instead of the default 15.6 ms
+  timeBeginPeriod(1);
+#endif
+}
+
+
+//---------------------------------------------------------------------------
+// Destructor
+Pacer::~Pacer()
+{
+#ifdef _WIN32
+  timeEndPeriod(1);
+#endif
+}
+
+
+//---------------------------------------------------------------------------
+// Get the speed
+double Pacer::Speed()
+{
+  std::lock_guard<std::mutex> lock(mutex);
+
+  return speed;
+}
+
+
+//---------------------------------------------------------------------------
+// Change the speed
+void Pacer::SetSpeed(
+  double speed)                         // Speed, 1=original timing
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  auto now = std::chrono::steady_clock::now();
+
+  // Continue from where the replay is now
+  anchor = PositionAt(now);
+  walltime = now;
+
+  this->speed = std::min(std::max(speed, PACER_MIN_SPEED), PACER_MAX_SPEED);
+}
+
+
+//---------------------------------------------------------------------------
+// Check if replaying is paused
+bool Pacer::Paused()
+{
+  std::lock_guard<std::mutex> lock(mutex);
+
+  return paused;
+}
+
+
+//---------------------------------------------------------------------------
+// Pause or continue
+void Pacer::Pause(
+  bool pause)                           // True=pause, false=continue
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  auto now = std::chrono::steady_clock::now();
+
+  if (pause == paused)
+  {
+    return;
+  }
+
+  anchor = PositionAt(now);
+  walltime = now;
+  paused = pause;
+  waiting = UINT64_MAX;
+}
+
+
+//---------------------------------------------------------------------------
+// Let the next data through, and pause
+void Pacer::Step()
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  auto now = std::chrono::steady_clock::now();
+
+  if (!paused)
+  {
+    anchor = PositionAt(now);
+    walltime = now;
+    paused = true;
+    waiting = UINT64_MAX;
+  }
+
+  if (waiting == UINT64_MAX)
+  {
+    // Nobody has asked yet; the first one that does, gets through
+    step = true;
+    return;
+  }
+
+  anchor = started ? std::max(anchor, waiting) : waiting;
+  started = true;
+  waiting = UINT64_MAX;
+}
+
+
+//---------------------------------------------------------------------------
+// Get the recorded time that's being replayed now
+uint64_t Pacer::Position()
+{
+  std::lock_guard<std::mutex> lock(mutex);
+
+  return PositionAt(std::chrono::steady_clock::now());
+}
+
+
+//---------------------------------------------------------------------------
+// Wait until data with a recorded time is due
+bool                                    // Returns true=due, false=not yet
+Pacer::Wait(
+  uint64_t time,                        // Recorded time of the data
+  uint64_t maxwait)                     // Max ns to wait
+{
+  std::unique_lock<std::mutex> lock(mutex);
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::nanoseconds(maxwait);
+
+  for (;;)
+  {
+    auto now = std::chrono::steady_clock::now();
+
+    if ((!started) && (!paused))
+    {
+      // The first data sets the starting point
+      started = true;
+      anchor = time;
+      walltime = now;
+    }
+
+    if (paused)
+    {
+      if ((started) && (time <= anchor))
+      {
+        return true;
+      }
+
+      if (step)
+      {
+        step = false;
+        anchor = started ? std::max(anchor, time) : time;
+        started = true;
+        return true;
+      }
+
+      // Remember what's waiting, for when the next step is taken
+      waiting = std::min(waiting, time);
+
+      if (now >= deadline)
+      {
+        return false;
+      }
+
+      lock.unlock();
+      std::this_thread::sleep_for(std::min<std::chrono::steady_clock::duration>(deadline - now, std::chrono::milliseconds(1)));
+      lock.lock();
+      continue;
+    }
+
+    if (time <= anchor)
+    {
+      return true;
+    }
+
+    auto due = walltime + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+      std::chrono::duration<double, std::nano>((time - anchor) / speed));
+
+    if (due <= now)
+    {
+      return true;
+    }
+
+    if (now >= deadline)
+    {
+      return false;
+    }
+
+    if (due - now > std::chrono::nanoseconds(PACER_SPIN_TIME))
+    {
+      // Sleep until it's almost time; the speed may change meanwhile, so
+      // the due time is calculated again afterwards
+      auto until = std::min<std::chrono::steady_clock::time_point>(due - std::chrono::nanoseconds(PACER_SPIN_TIME), deadline);
+
+      lock.unlock();
+      std::this_thread::sleep_until(until);
+      lock.lock();
+      continue;
+    }
+
+    // Spin for the last bit, which is too short to sleep accurately
+    lock.unlock();
+
+    while (std::chrono::steady_clock::now() < due)
+    {
+      std::this_thread::yield();
+    }
+
+    return true;
+  }
+}
+
+
+//---------------------------------------------------------------------------
+// Get the recorded time that's being replayed at a clock time
+uint64_t Pacer::PositionAt(
+  std::chrono::steady_clock::time_point now) // Clock time
+{
+  if ((!started) || (paused))
+  {
+    return anchor;
+  }
+
+  return anchor + (uint64_t)(std::chrono::duration<double, std::nano>(now - walltime).count() * speed);
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// END
+/////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,148 @@
+/****************************************************************************
+Replay scheduler
+(C) 2024 Jac Goudsmit
+Licensed under the MIT license.
+See LICENSE for details.
+****************************************************************************/
+
+/*
+  When a capture file is replayed to reproduce something on the screen,
+  the data should arrive with the same timing as when it was captured, or
+  at a multiple of that speed, so that the decoder and the sinks get the
+  same load as with a real deck.
+
+  The pacer maps the recorded times onto the clock: the first data that
+  asks for it is delivered right away, and everything after that is
+  delivered when the same amount of time (divided by the speed) has
+  passed. All receivers of a replay share a pacer, so they stay in step
+  with each other.
+
+  Waiting is done by sleeping until shortly before the data is due, and
+  spinning for the rest, so the timing is accurate to a few microseconds
+  instead of the resolution of the sleep function. On Windows, the timer
+  resolution is set to 1 ms while a pacer exists.
+
+  Replaying can be paused. While it's paused, it can be stepped to the
+  next data that any of the receivers is waiting for. Changing the speed,
+  pausing and stepping can be done from any thread.
+*/
+
+
+#pragma once
+
+
+/////////////////////////////////////////////////////////////////////////////
+// INCLUDES
+/////////////////////////////////////////////////////////////////////////////
+
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+
+
+/////////////////////////////////////////////////////////////////////////////
+// MACROS
+/////////////////////////////////////////////////////////////////////////////
+
+
+// Time before data is due, at which waiting stops sleeping and spins
+#define PACER_SPIN_TIME 2000000ULL      // ns
+
+// Slowest and fastest speed
+#define PACER_MIN_SPEED (1.0 / 64)
+#define PACER_MAX_SPEED 1024.0
+
+
+/////////////////////////////////////////////////////////////////////////////
+// TYPES
+/////////////////////////////////////////////////////////////////////////////
+
+
+class Pacer
+{
+protected:
+  std::mutex  mutex;                    // Protects everything below
+  double      speed;                    // Recorded ns per ns of the clock
+  bool        paused = false;           // True=paused
+  bool        started = false;          // True=anchor is set
+  uint64_t    anchor = 0;               // Recorded time at walltime
+  std::chrono::steady_clock::time_point walltime; // Clock time of anchor
+  uint64_t    waiting = UINT64_MAX;     // Earliest time waited for, paused
+  bool        step = false;             // True=let the next data through
+
+public:
+  //-------------------------------------------------------------------------
+  // Constructor
+  Pacer(
+    double speed = 1.0,                 // Speed, 1=original timing
+    bool paused = false);               // True=start paused
+
+public:
+  //-------------------------------------------------------------------------
+  // Destructor
+  ~Pacer();
+
+public:
+  //-------------------------------------------------------------------------
+  // Get the speed
+  double Speed();
+
+public:
+  //-------------------------------------------------------------------------
+  // Change the speed
+  //
+  // The speed is limited to PACER_MIN_SPEED..PACER_MAX_SPEED.
+  void SetSpeed(
+    double speed);                      // Speed, 1=original timing
+
+public:
+  //-------------------------------------------------------------------------
+  // Check if replaying is paused
+  bool Paused();
+
+public:
+  //-------------------------------------------------------------------------
+  // Pause or continue
+  void Pause(
+    bool pause);                        // True=pause, false=continue
+
+public:
+  //-------------------------------------------------------------------------
+  // Let the next data through, and pause
+  //
+  // All data that has the same time as the earliest data that's waiting
+  // is delivered. If nothing is waiting yet, the data that asks first is
+  // delivered.
+  void Step();
+
+public:
+  //-------------------------------------------------------------------------
+  // Get the recorded time that's being replayed now
+  uint64_t Position();
+
+public:
+  //-------------------------------------------------------------------------
+  // Wait until data with a recorded time is due
+  //
+  // This doesn't wait longer than the given time, so the caller can do
+  // other things (e.g. check if it should stop) while replaying is paused
+  // or when the data isn't due for a while.
+  bool                                  // Returns true=due, false=not yet
+  Wait(
+    uint64_t time,                      // Recorded time of the data
+    uint64_t maxwait);                  // Max ns to wait
+
+protected:
+  //-------------------------------------------------------------------------
+  // Get the recorded time that's being replayed at a clock time
+  //
+  // The mutex must be locked.
+  uint64_t PositionAt(
+    std::chrono::steady_clock::time_point now); // Clock time
+};
+
+
+/////////////////////////////////////////////////////////////////////////////
+// END
+/////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,332 @@
+/****************************************************************************
+Processing pipeline
+(C) 2024 Jac Goudsmit
+Licensed under the MIT license.
+See LICENSE for details.
+****************************************************************************/
+
+
+/////////////////////////////////////////////////////////////////////////////
+// INCLUDES
+/////////////////////////////////////////////////////////////////////////////
+
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "Proc.h"
+
+
+/////////////////////////////////////////////////////////////////////////////
+// TYPES
+/////////////////////////////////////////////////////////////////////////////
+
+
+// Batches are shared by all sinks; the last one to let go of a batch
+// returns it to the pool
+typedef std::shared_ptr<const DecodeBatch> SharedBatch;
+
+
+//---------------------------------------------------------------------------
+// Worker thread and queue for one sink
+class Worker
+{
+protected:
+  ProcSink   *psink;                    // Sink
+  size_t      depth;                    // Max batches in queue
+
+  std::mutex  mutex;                    // Protects the fields below
+  std::condition_variable cv;           // Signaled when batch added
+  std::condition_variable room;         // Signaled when batch removed
+  std::deque<SharedBatch> queue;        // Batches waiting for the sink
+  bool        stop = false;             // True=stop when queue is empty
+  ProcSinkStats stats = {};             // Statistics
+
+  std::thread thread;                   // Worker thread
+
+public:
+  //-------------------------------------------------------------------------
+  // Constructor
+  Worker(
+    ProcSink *psink,                    // Sink
+    size_t depth)                       // Max batches in queue
+    : psink(psink)
+    , depth(depth ? depth : 1)
+  {
+    stats.name = psink->Name();
+    stats.depth = this->depth;
+
+    thread = std::thread(&Worker::Run, this);
+  }
+
+
+public:
+  //-------------------------------------------------------------------------
+  // Destructor
+  ~Worker()
+  {
+    Stop();
+    delete psink;
+  }
+
+
+  Worker(const Worker &) = delete;
+  Worker &operator=(const Worker &) = delete;
+
+
+public:
+  //-------------------------------------------------------------------------
+  // Add a batch to the queue
+  //
+  // If the queue is full, the batch is dropped for this sink, unless the
+  // caller wants to wait.
+  void Push(
+    const SharedBatch &batch,           // Batch
+    bool wait)                          // True=wait for room
+  {
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+
+      if (wait)
+      {
+        room.wait(lock, [this] { return queue.size() < depth; });
+      }
+
+      if (queue.size() >= depth)
+      {
+        stats.droppedbatches++;
+        stats.droppedevents += batch->Size();
+        return;
+      }
+
+      queue.push_back(batch);
+
+      if (queue.size() > stats.highwater)
+      {
+        stats.highwater = queue.size();
+      }
+    }
+
+    cv.notify_one();
+  }
+
+
+public:
+  //-------------------------------------------------------------------------
+  // Tell the thread to stop when the queue is empty
+  void Signal()
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stop = true;
+    }
+
+    cv.notify_one();
+  }
+
+
+public:
+  //-------------------------------------------------------------------------
+  // Process what's in the queue, then stop the thread and the sink
+  //
+  // The sink is stopped on the calling thread, so that the sinks that
+  // print something when they stop don't do it at the same time.
+  void Stop()
+  {
+    if (thread.joinable())
+    {
+      Signal();
+      thread.join();
+      psink->Exit();
+    }
+  }
+
+
+public:
+  //-------------------------------------------------------------------------
+  // Get a copy of the statistics
+  ProcSinkStats GetStats()
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    return stats;
+  }
+
+
+protected:
+  //-------------------------------------------------------------------------
+  // Thread function
+  void Run()
+  {
+    for (;;)
+    {
+      SharedBatch batch;
+
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+
+        cv.wait(lock, [this] { return stop || !queue.empty(); });
+
+        if (queue.empty())
+        {
+          break;
+        }
+
+        batch = std::move(queue.front());
+        queue.pop_front();
+      }
+
+      room.notify_one();
+
+      psink->Batch(batch.get());
+
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        stats.batches++;
+        stats.events += batch->Size();
+      }
+    }
+  }
+};
+
+
+/////////////////////////////////////////////////////////////////////////////
+// DATA
+/////////////////////////////////////////////////////////////////////////////
+
+
+static std::vector<std::unique_ptr<Worker>> workers;
+
+// Batches that aren't in use
+static std::mutex poolmutex;
+static std::vector<DecodeBatch *> pool;
+
+
+/////////////////////////////////////////////////////////////////////////////
+// LOCAL FUNCTIONS
+/////////////////////////////////////////////////////////////////////////////
+
+
+//---------------------------------------------------------------------------
+// Return a batch to the pool
+void static recycle(
+  const DecodeBatch *pbatch)
+{
+  DecodeBatch *p = const_cast<DecodeBatch *>(pbatch);
+
+  p->Reset();
+
+  std::lock_guard<std::mutex> lock(poolmutex);
+
+  pool.push_back(p);
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// PUBLIC FUNCTIONS
+/////////////////////////////////////////////////////////////////////////////
+
+
+//---------------------------------------------------------------------------
+// Add a sink and start its worker thread
+bool                                    // Returns true=success
+Proc_AddSink(
+  ProcSink *psink,                      // Sink; deleted at program end
+  ChangeFilter *pfilter,                // Filter for repeated messages
+  size_t depth)                         // Max batches waiting in the queue
+{
+  if ((!psink) || (workers.size() >= PROC_MAX_SINKS))
+  {
+    delete psink;
+    return false;
+  }
+
+  psink->SetFilter(pfilter);
+
+  workers.emplace_back(new Worker(psink, depth));
+
+  return true;
+}
+
+
+//---------------------------------------------------------------------------
+// Get an empty batch to decode into
+//
+// The number of batches is limited by the queue depths, so the pool only
+// grows until the sinks are as far behind as they're allowed to get.
+DecodeBatch *Proc_GetBatch()
+{
+  {
+    std::lock_guard<std::mutex> lock(poolmutex);
+
+    if (!pool.empty())
+    {
+      DecodeBatch *p = pool.back();
+      pool.pop_back();
+      return p;
+    }
+  }
+
+  return new DecodeBatch;
+}
+
+
+//---------------------------------------------------------------------------
+// Pass a batch to all sinks
+void Proc_Publish(
+  DecodeBatch *pbatch,                  // Decoded events
+  bool wait)                            // True=wait for room, don't drop
+{
+  SharedBatch batch(pbatch, recycle);
+
+  for (auto &w : workers)
+  {
+    w->Push(batch, wait);
+  }
+}
+
+
+//---------------------------------------------------------------------------
+// Get statistics for a sink
+bool                                    // Returns false=no such sink
+Proc_GetStats(
+  unsigned index,                       // Sink index
+  ProcSinkStats *pstats)                // Output statistics
+{
+  if ((index >= workers.size()) || (!pstats))
+  {
+    return false;
+  }
+
+  *pstats = workers[index]->GetStats();
+
+  return true;
+}
+
+
+//---------------------------------------------------------------------------
+// Stop processing
+void Proc_Exit()
+{
+  // Signal all sinks first, so that they work through their queues at
+  // the same time
+  for (auto &w : workers)
+  {
+    w->Signal();
+  }
+
+  for (auto &w : workers)
+  {
+    w->Stop();
+  }
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// END
+/////////////////////////////////////////////////////////////////////////////
@@ -1,26 +1,243 @@
 /****************************************************************************
-SPI receiver API
+Processing API
 (C) 2024 Jac Goudsmit
 Licensed under the MIT license.
 See LICENSE for details.
 ****************************************************************************/
 
+/*
+  The decoded events go to any number of sinks: the screen view, a dump of
+  the messages as text, statistics, etc. The sinks are chosen on the
+  command line.
+
+  Each sink runs on a worker thread of its own, and gets the batches of
+  events through a queue with a limited depth. A batch is shared by all
+  sinks; it goes back to the pool when the last sink is done with it. If
+  a sink can't keep up and its queue is full, the batches that don't fit
+  are dropped for that sink only, and counted. That way, a slow sink (e.g.
+  a console that's being scrolled back) never holds up the decoder or the
+  capture, or the other sinks. When the data comes from a recording, it
+  doesn't get lost if it's not read in time, so then the decoder waits
+  for the sinks instead.
+*/
+
 
 #pragma once
 
 
+/////////////////////////////////////////////////////////////////////////////
+// INCLUDES
+/////////////////////////////////////////////////////////////////////////////
+
+
+#include <cstdio>
+
+#include "ChangeFilter.h"
+#include "DeckState.h"
+#include "Decode.h"
+
+
+/////////////////////////////////////////////////////////////////////////////
+// MACROS
+/////////////////////////////////////////////////////////////////////////////
+
+
+// Default number of screen refreshes per second
+#define PROC_DEFAULT_REFRESH 30
+
+// Default number of batches that can wait in the queue of each sink
+#define PROC_DEFAULT_QUEUE 64
+
+// Maximum number of sinks
+#define PROC_MAX_SINKS 8
+
+
+/////////////////////////////////////////////////////////////////////////////
+// TYPES
+/////////////////////////////////////////////////////////////////////////////
+
+
+//---------------------------------------------------------------------------
+// Consumer of decoded events
+//
+// Each kind of sink implements this interface. All functions are called
+// from the worker thread of the sink, except SetFilter.
+class ProcSink
+{
+public:
+  virtual ~ProcSink() {}
+
+public:
+  //-------------------------------------------------------------------------
+  // Get the name of the sink, for the statistics
+  virtual const char *Name() = 0;
+
+public:
+  //-------------------------------------------------------------------------
+  // Set up the filter for messages that the sink doesn't need to see
+  // again if their responses don't change
+  //
+  // This is called before the decoder starts. The caller checks each
+  // message with the filter before it's decoded, and all sinks get the
+  // same batches, so a repeat is only dropped if none of the sinks need
+  // it. Masks of the same opcode are combined, so each sink gets at least
+  // the changes it asked for. Sinks that need to see every message can't
+  // rely on the batches; the messages are counted before the filter (see
+  // ProcCounts).
+  virtual void SetFilter(
+    ChangeFilter *)                     // Filter for repeated messages
+  {
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Process a batch of decoded events
+  //
+  // The batch may be reused as soon as this returns.
+  virtual void Batch(
+    const DecodeBatch *pbatch) = 0;     // Events
+
+public:
+  //-------------------------------------------------------------------------
+  // Stop processing
+  //
+  // Everything that was passed to Batch is shown or stored before this
+  // returns. This is called by Proc_Exit, after the worker thread of the
+  // sink has ended.
+  virtual void Exit()
+  {
+  }
+};
+
+
+//---------------------------------------------------------------------------
+// Statistics for one sink
+struct ProcSinkStats
+{
+  const char *name;                     // Name of the sink
+  uint64_t    batches;                  // Batches processed
+  uint64_t    events;                   // Events processed
+  uint64_t    droppedbatches;           // Batches dropped, queue was full
+  uint64_t    droppedevents;            // Events in dropped batches
+  size_t      highwater;                // Max batches in queue at once
+  size_t      depth;                    // Queue capacity
+};
+
+
+//---------------------------------------------------------------------------
+// Messages per opcode
+//
+// The decoder counts every message here before the filter, so repeats and
+// batches that a sink had to drop are counted too. The stats sink reads
+// the counts when it stops, after the decoder is done.
+struct ProcCounts
+{
+  uint64_t    messages[128] = {};       // Messages per opcode
+  uint64_t    unknown[128] = {};        // Messages not understood
+  uint64_t    first = 0;                // Time of first message in ns
+  uint64_t    last = 0;                 // Time of last message in ns
+
+public:
+  //-------------------------------------------------------------------------
+  // Count a message
+  //
+  // The command and response include the checksums.
+  void Add(
+    const MsgTime *ptime,               // Time stamps
+    const uint8_t *cmd,                 // Command
+    size_t cmdlen,                      // Number of bytes in command
+    const uint8_t *rsp,                 // Response
+    size_t rsplen)                      // Number of bytes in response
+  {
+    if (!cmdlen)
+    {
+      return;
+    }
+
+    uint8_t opcode = cmd[0] & 0x7F;
+
+    messages[opcode]++;
+    unknown[opcode] += !Decode_Known(cmd, cmdlen, rsp, rsplen);
+
+    if (!first)
+    {
+      first = ptime->start;
+    }
+
+    last = ptime->start;
+  }
+};
+
+
 /////////////////////////////////////////////////////////////////////////////
 // PUBLIC FUNCTIONS
 /////////////////////////////////////////////////////////////////////////////
 
 
 //---------------------------------------------------------------------------
-// Process a command and response
-void ProcessCommandResponse(
-  BYTE *cmd,                            // Command
-  size_t cmdlen,                        // Number of bytes in command
-  BYTE *rsp,                            // Response
-  size_t rsplen);                       // Number of bytes in response
+// Create a sink that shows the state of the recorder on the screen
+//
+// The screen is updated by a render thread at the given rate.
+ProcSink *Proc_CreateScreen(
+  unsigned refresh);                    // Screen refreshes per second
+
+
+//---------------------------------------------------------------------------
+// Create a sink that dumps the messages as text
+ProcSink *                              // Returns nullptr=can't open file
+Proc_CreateDump(
+  const char *filename);                // File name, "-"=standard output
+
+
+//---------------------------------------------------------------------------
+// Create a sink that shows the message counts by opcode
+//
+// The counts are printed to the standard error output at the end, along
+// with the events that aren't messages, and the last state of the deck,
+// if there's a model.
+ProcSink *Proc_CreateStats(
+  const ProcCounts *pcounts,            // Messages counted by the decoder
+  const DeckState *pdeck = nullptr);    // Model of the deck state
+
+
+//---------------------------------------------------------------------------
+// Add a sink and start its worker thread
+bool                                    // Returns true=success
+Proc_AddSink(
+  ProcSink *psink,                      // Sink; deleted at program end
+  ChangeFilter *pfilter,                // Filter for repeated messages
+  size_t depth = PROC_DEFAULT_QUEUE);   // Max batches waiting in the queue
+
+
+//---------------------------------------------------------------------------
+// Get an empty batch to decode into
+DecodeBatch *Proc_GetBatch();
+
+
+//---------------------------------------------------------------------------
+// Pass a batch to all sinks
+//
+// The batch may not be used by the caller anymore after this; it's
+// reused when all sinks are done with it.
+void Proc_Publish(
+  DecodeBatch *pbatch,                  // Decoded events
+  bool wait = false);                   // True=wait for room, don't drop
+
+
+//---------------------------------------------------------------------------
+// Get statistics for a sink
+bool                                    // Returns false=no such sink
+Proc_GetStats(
+  unsigned index,                       // Sink index
+  ProcSinkStats *pstats);               // Output statistics
+
+
+//---------------------------------------------------------------------------
+// Stop processing
+//
+// The sinks process everything that's in their queues, then they stop.
+// The statistics are still available afterwards.
+void Proc_Exit();
 
 
 /////////////////////////////////////////////////////////////////////////////
@@ -11,13 +11,19 @@ See LICENSE for details.
 /////////////////////////////////////////////////////////////////////////////
 
 
-#include <iostream>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
 #include <cstdint>
-#include <windows.h>
+#include <cstring>
+#include <thread>
 
-#include "Proc.h"
+#include "../../Common/FrontPanelOpcodes.h"
 
-using namespace std;
+#include "OutBuf.h"
+#include "Proc.h"
+#include "SeqLock.h"
+#include "VScreen.h"
 
 
 /////////////////////////////////////////////////////////////////////////////
@@ -25,42 +31,110 @@ using namespace std;
 /////////////////////////////////////////////////////////////////////////////
 
 
-// Virtual Terminal Sequences
-#define CSI "\x1B["                     // Control Sequence Introducer
-#define CUPY(y) CSI << y << "H"         // Cursor Position (Y only)(1=top)
-#define CUP(y, x) CSI << y << ";" << x << "H"
-                                        // Cursor Position (X/Y)(1=top/left)
+// Screen size
+#define SCREEN_ROWS 14
+#define SCREEN_COLS 80
 
-
-#define PRE_VU(ch) CUPY(1 + ch)
-#define PRE_DECKSTATE CUPY(3)
-#define PRE_DECKFUNCTION CUPY(4)
-#define PRE_POLLSTATUS CUPY(5) // 3 lines
-#define PRE_DRAWERSTATUS CUPY(8)
-#define PRE_TRACKTITLE CUPY(9)
-#define PRE_LONGTEXT(y) CUPY(10 + y) // 5 lines
+// Screen lines (0=top)
+#define ROW_VU(ch) (0 + ch)
+#define ROW_DECKSTATE 2
+#define ROW_DECKFUNCTION 3
+#define ROW_POLLSTATUS 4 // 3 lines
+#define ROW_DRAWERSTATUS 7
+#define ROW_TRACKTITLE 8
+#define ROW_LONGTEXT(y) (9 + y) // 5 lines
 
 
 /////////////////////////////////////////////////////////////////////////////
-// LOCAL FUNCTIONS
+// TYPES
 /////////////////////////////////////////////////////////////////////////////
 
 
+// Copy of the virtual screen, handed from the worker to the renderer
+struct ScreenImage
+{
+  char        cells[SCREEN_ROWS * SCREEN_COLS]; // Text, line by line
+};
+
+
 //---------------------------------------------------------------------------
-// Print a string
-void static printstring(
-  const uint8_t *begin,
-  const uint8_t *end)
+// Screen sink
+//
+// The events update the virtual screen; a copy of it is published after
+// each batch. The render thread picks up the latest copy at the refresh
+// rate, so the worker never waits for the terminal, and any number of
+// updates between two refreshes cost only one repaint.
+class ScreenSink : public ProcSink
 {
-  putc('\"', stdout);
+protected:
+  VScreen     screen;                   // Virtual screen
+  ScreenImage image;                    // Copy to publish
+  SeqLock<ScreenImage> snapshot;        // Latest copy for render thread
+
+  unsigned    refreshrate;              // Refreshes per second
+  std::atomic<bool> stoprender;         // True=render last copy and stop
+  std::thread renderthread;             // Render thread
+
+public:
+  //-------------------------------------------------------------------------
+  // Constructor
+  ScreenSink(
+    unsigned refresh)                   // Refreshes per second
+    : screen(SCREEN_ROWS, SCREEN_COLS)
+    , refreshrate(refresh ? ((refresh < 1000) ? refresh : 1000) : PROC_DEFAULT_REFRESH)
+    , stoprender(false)
+  {
+    renderthread = std::thread(&ScreenSink::RenderLoop, this);
+  }
 
-  for (const uint8_t *s = begin; s != end; s++)
+public:
+  //-------------------------------------------------------------------------
+  // Destructor
+  ~ScreenSink()
   {
-    printf((((*s < 32) || (*s >= 0x7E)) ? "\\x%02X" : "%c"), *s);
+    Exit();
   }
 
-  putc('\"', stdout);
-}
+public:
+  //-------------------------------------------------------------------------
+  // Get the name of the sink, for the statistics
+  const char *Name() override
+  {
+    return "screen";
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Set up the filter
+  void SetFilter(
+    ChangeFilter *pfilter) override;    // Filter for repeated messages
+
+public:
+  //-------------------------------------------------------------------------
+  // Show a batch of decoded events
+  void Batch(
+    const DecodeBatch *pbatch) override; // Events
+
+public:
+  //-------------------------------------------------------------------------
+  // Stop processing
+  void Exit() override;
+
+protected:
+  void ShowVU(const DecodeEvent *pev);
+  void ShowDeckState(const DecodeEvent *pev);
+  void ShowDeckFunction(const FrontPanelOpcode *op, uint8_t function);
+  void ShowPollStatus(const uint8_t *rsp);
+  void ShowDrawerStatus(const FrontPanelOpcode *op, uint8_t status);
+  void ShowLongText(const FrontPanelOpcode *op, const DecodeEvent *pev);
+  void ShowTrackTitle(const DecodeEvent *pev);
+  void RenderLoop();
+};
+
+
+/////////////////////////////////////////////////////////////////////////////
+// LOCAL FUNCTIONS
+/////////////////////////////////////////////////////////////////////////////
 
 
 //---------------------------------------------------------------------------
@@ -72,8 +146,8 @@ void static printstring(
 // [2] = right channel VU meter value
 //
 // Values are absolute dB values, i.e. 0=loudest, 95=silence
-void ShowVU(
-  uint8_t *rsp)                         // Response data
+void ScreenSink::ShowVU(
+  const DecodeEvent *pev)               // Event
 {
   // Lookup table to generate the number of segments to light up on a
   // 40-segment dBFS scale meter based on the absolute segment value
@@ -182,9 +256,10 @@ void ShowVU(
 
   for (int i = 0; i < 2; i++)
   {
-    unsigned level = rsp[i + 1];
+    unsigned level = i ? pev->vu.right : pev->vu.left;
     unsigned u = level < 95 ? dblut40[level] : 0;
-    cout << PRE_VU(i) << &vu[40 - u] << &bl[u];
+    screen.Str(ROW_VU(i), 0, &vu[40 - u]);
+    screen.Str(ROW_VU(i), u, &bl[u]);
   }
 }
 
@@ -205,13 +280,15 @@ void ShowVU(
 // [9] unknown
 //
 // All values are in big-endian BCD, e.g. 0x59 should be displayed as "59".
-void ShowDeckState(
-  BYTE *rsp)                            // Response data
+void ScreenSink::ShowDeckState(
+  const DecodeEvent *pev)               // Event
 {
-  cout << PRE_DECKSTATE;
-  printf("T%02X %X:%02X:%02X C%02X%02X [%02X %X %02X %02X]",
-    rsp[2], rsp[3] & 0xF, rsp[4], rsp[5], rsp[7], rsp[8],
-    rsp[1], rsp[3] >> 4, rsp[6], rsp[9]);
+  unsigned x = screen.Printf(ROW_DECKSTATE, 0, "T%02X %X:%02X:%02X C%02X%02X [%02X %X %02X %02X]",
+    pev->deck.track, pev->deck.hours & 0xF, pev->deck.minutes, pev->deck.seconds,
+    pev->deck.counter[0], pev->deck.counter[1],
+    pev->deck.status, pev->deck.hours >> 4, pev->deck.unknown6, pev->deck.unknown9);
+
+  screen.ClearEol(ROW_DECKSTATE, x);
 }
 
 
@@ -254,589 +331,276 @@ void ShowDeckState(
 // 0x32=Unknown (seen during Append)
 // 
 // 0x34=Unknown (seen during Append)
-void ShowDeckFunction(
-  BYTE *rsp)                            // Response data
+void ScreenSink::ShowDeckFunction(
+  const FrontPanelOpcode *op,           // Descriptor
+  uint8_t function)                     // Deck function
 {
-  cout << PRE_DECKFUNCTION;
+  const char *name = FrontPanel_ValueName(op, function);
+  unsigned x;
 
-  switch (rsp[1])
+  if (name)
   {
-  case 0x01: printf("OFF ");        return; // Stand by
-  case 0x02: printf("STOP");        return; // Stop
-  case 0x03: printf("READ");        return; // Reading
-  case 0x04: printf("PLAY");        return; // Play
-
-  case 0x0A: printf("FFWD");        return; // FFWD (sector)
-  case 0x0B: printf("REWD");        return; // Rewind (sector)
-
-  case 0x11: printf("NEXT");        return; // Search forwards
-  case 0x12: printf("PREV");        return; // Search backwards
-
-  case 0x15: printf("SBY<");        return; // Search arriving at track
-  case 0x16: printf("SBY>");        return; // Search arriving at track
-
-  case 0x2A: printf("END ");        return; // End of recording marker found
-
-  case 0x30: printf("SKIP");        return; // Skipping intro
-
-  case 0x22:
-  case 0x23:
-  case 0x24:
-  case 0x26: // All used when recording title
-
-  case 0x19:
-  case 0x0E:
-  case 0x32:
-  case 0x34: // Seen during APPEND
-
-  case 0x2B: // REC/PAUSE?
-
-  default:
-    printf("%02X\r\n", rsp[1]);         return; // TODO: decode other codes
+    x = screen.Str(ROW_DECKFUNCTION, 0, name);
+  }
+  else
+  {
+    x = screen.Printf(ROW_DECKFUNCTION, 0, "%02X", function); // TODO: decode other codes
   }
 
-  return;
+  screen.ClearEol(ROW_DECKFUNCTION, x);
 }
 
 
 //---------------------------------------------------------------------------
 // Command 0x41: Show poll status
-void ShowPollStatus(
-  uint8_t *rsp)                         // Response data
+void ScreenSink::ShowPollStatus(
+  const uint8_t *rsp)                   // Status bytes from response
 {
-  cout << PRE_POLLSTATUS;
+  const unsigned y = ROW_POLLSTATUS;
+  unsigned x = 0;
 
   // Interpret bits
   uint8_t a = rsp[1];
-  cout << ((a & 0x01) ? "SYSTEM " : "       "); // System (issue Get System State)
-  cout << ((a & 0x02) ? "COUNTER " : "        "); // Counter update (issue Get Deck State)
-  cout << ((a & 0x04) ? "TIME ": "     "); // Time update (issue Get Deck State)
-  cout << ((a & 0x08) ? "FUNCTION ": "         "); // Function change? (issue Get Function State)
-  cout << ((a & 0x10) ? "DRAWER ": "       "); // Drawer change (issue Get Drawer State)
-  cout << ((a & 0x20) ? "EOT ": "    "); // End of Tape (sector)
-  cout << ((a & 0x40) ? "BOT ": "    "); // Beginning of Tape (sector)
-  cout << ((a & 0x80) ? "FAST ": "     "); // Winding/rewinding without heads applied; time is deck time?
-
-  cout << endl;
+  x = screen.Str(y, x, (a & 0x01) ? "SYSTEM " : "       "); // System (issue Get System State)
+  x = screen.Str(y, x, (a & 0x02) ? "COUNTER " : "        "); // Counter update (issue Get Deck State)
+  x = screen.Str(y, x, (a & 0x04) ? "TIME ": "     "); // Time update (issue Get Deck State)
+  x = screen.Str(y, x, (a & 0x08) ? "FUNCTION ": "         "); // Function change? (issue Get Function State)
+  x = screen.Str(y, x, (a & 0x10) ? "DRAWER ": "       "); // Drawer change (issue Get Drawer State)
+  x = screen.Str(y, x, (a & 0x20) ? "EOT ": "    "); // End of Tape (sector)
+  x = screen.Str(y, x, (a & 0x40) ? "BOT ": "    "); // Beginning of Tape (sector)
+  x = screen.Str(y, x, (a & 0x80) ? "FAST ": "     "); // Winding/rewinding without heads applied; time is deck time?
+  screen.ClearEol(y, x);
+
   a = rsp[2];
-  cout << ((a & 0x01) ? "LYRICS ": "       "); // Lyrics (issue Get DCC Long Text)
-  cout << ((a & 0x02) ? "MARKER ": "       "); // Marker change (issue Get Marker)
-  cout << ((a & 0x04) ? "(B4) ": "     "); // unknown
-  cout << ((a & 0x08) ? "(B8) ": "     "); // unknown
-  cout << ((a & 0x10) ? "(B10) ": "      "); // unknown
-  cout << ((a & 0x20) ? "TRACK ": "      "); // Track info available? Seen when playing past track marker
-  cout << ((a & 0x40) ? "ABSTIME ": "        "); // Absolute time known (SUDCC/PDCC)?
-  cout << ((a & 0x80) ? "TOTALTIME ": "          "); // Total time known on PDCC? FP issues PREREC TAPE TIME
-
-  cout << endl;
+  x = screen.Str(y + 1, 0, (a & 0x01) ? "LYRICS ": "       "); // Lyrics (issue Get DCC Long Text)
+  x = screen.Str(y + 1, x, (a & 0x02) ? "MARKER ": "       "); // Marker change (issue Get Marker)
+  x = screen.Str(y + 1, x, (a & 0x04) ? "(B4) ": "     "); // unknown
+  x = screen.Str(y + 1, x, (a & 0x08) ? "(B8) ": "     "); // unknown
+  x = screen.Str(y + 1, x, (a & 0x10) ? "(B10) ": "      "); // unknown
+  x = screen.Str(y + 1, x, (a & 0x20) ? "TRACK ": "      "); // Track info available? Seen when playing past track marker
+  x = screen.Str(y + 1, x, (a & 0x40) ? "ABSTIME ": "        "); // Absolute time known (SUDCC/PDCC)?
+  x = screen.Str(y + 1, x, (a & 0x80) ? "TOTALTIME ": "          "); // Total time known on PDCC? FP issues PREREC TAPE TIME
+  screen.ClearEol(y + 1, x);
+
   a = rsp[3];
-  cout << ((a & 0x80) ? "DECKTIME ": "         "); // No absolute tape time, using deck time?
-  cout << ((a & 0x40) ? "TAPETIME ": "         "); // Using tape time code
-  
-  cout << "Sector=" << (a & 3);
+  x = screen.Str(y + 2, 0, (a & 0x80) ? "DECKTIME ": "         "); // No absolute tape time, using deck time?
+  x = screen.Str(y + 2, x, (a & 0x40) ? "TAPETIME ": "         "); // Using tape time code
+  x = screen.Printf(y + 2, x, "Sector=%u", a & 3);
+  screen.ClearEol(y + 2, x);
 }
 
 
 //---------------------------------------------------------------------------
 // Command 0x46: Get drawer status
-void ShowDrawerStatus(
-  uint8_t *rsp)
+void ScreenSink::ShowDrawerStatus(
+  const FrontPanelOpcode *op,           // Descriptor
+  uint8_t status)                       // Drawer status
 {
-  cout << PRE_DRAWERSTATUS << "Drawer ";
+  const char *name = FrontPanel_ValueName(op, status);
 
-  switch (rsp[1])
-  {
-  case 1: printf("Closed ");        return;
-  case 2: printf("Open   ");        return;
-  case 3: printf("Closing");        return;
-  case 4: printf("Opening");        return;
-  case 5: printf("Blocked");        return;
-  default:
-          printf("Unknown");        return;
-  }
+  unsigned x = screen.Printf(ROW_DRAWERSTATUS, 0, "Drawer %-7s", name ? name : "Unknown");
+
+  screen.ClearEol(ROW_DRAWERSTATUS, x);
 }
 
 
 //---------------------------------------------------------------------------
 // Command 0x51: Show Long Text
-void ShowLongText(
-  uint8_t *cmd,
-  uint8_t *rsp,
-  size_t rsplen)
+//
+// Each kind of text is shown on its own line, in the order of the value
+// names in the descriptor. Unknown kinds share the line after those.
+void ScreenSink::ShowLongText(
+  const FrontPanelOpcode *op,           // Descriptor
+  const DecodeEvent *pev)               // Event
 {
-  switch (cmd[1])
+  const uint8_t *text = (const uint8_t *)pev->text.text;
+  unsigned line = 0;
+  const FrontPanelValue *v;
+  unsigned x;
+
+  for (v = op->values; (v->name) && (v->value != pev->text.kind); v++)
+  {
+    line++;
+  }
+
+  if (v->name)
+  {
+    x = screen.Printf(ROW_LONGTEXT(line), 0, "%-20s -> ", v->name);
+  }
+  else
   {
-  case 0xFA: cout << PRE_LONGTEXT(0) << "Track           -> "; break; // Get track name?
-  case 0xE0: cout << PRE_LONGTEXT(1) << "TOC track name? -> "; break; // Not sure; Used when rewinding sudcc to beginning, but returns error
-  case 0x01: cout << PRE_LONGTEXT(2) << "Lyrics / Album? -> "; break; // Possibly language number for lyrics?
-  case 0x03: cout << PRE_LONGTEXT(3) << "Artist          -> "; break; // Album artist on PDCC
-  default:   cout << PRE_LONGTEXT(4) << cmd[1] << " -> ";
+    x = screen.Printf(ROW_LONGTEXT(line), 0, "%02X%18s -> ", pev->text.kind, "");
   }
 
-  printstring(rsp + 1, rsp + rsplen);
+  x = screen.Escaped(ROW_LONGTEXT(line), x, text, text + pev->text.len);
+  screen.ClearEol(ROW_LONGTEXT(line), x);
 }
 
 
 //---------------------------------------------------------------------------
 // Command 0x52: Get Track Title
-void ShowTrackTitle(
-  uint8_t *cmd,
-  uint8_t *rsp,
-  size_t rsplen)
+void ScreenSink::ShowTrackTitle(
+  const DecodeEvent *pev)               // Event
 {
-  cout << PRE_TRACKTITLE;
-
-  printf("Track %2u -> ", cmd[1]);
-  printstring(rsp + 1, rsp + rsplen);
-}
+  const uint8_t *text = (const uint8_t *)pev->text.text;
 
+  unsigned x = screen.Printf(ROW_TRACKTITLE, 0, "Track %2u -> ", pev->text.kind);
 
-/////////////////////////////////////////////////////////////////////////////
-// PUBLIC FUNCTIONS
-/////////////////////////////////////////////////////////////////////////////
+  x = screen.Escaped(ROW_TRACKTITLE, x, text, text + pev->text.len);
+  screen.ClearEol(ROW_TRACKTITLE, x);
+}
 
 
 //---------------------------------------------------------------------------
-// Parse a buffer
-void ProcessCommandResponse(
-  BYTE *cmd,
-  size_t cmdlen,
-  BYTE *rsp,
-  size_t rsplen)
+// Render thread
+//
+// If the terminal is slow, refreshes are skipped instead of queued up.
+void ScreenSink::RenderLoop()
 {
-  {
-    static bool screencleared = false;
-
-    if (!screencleared)
-    {
-      // 2J=clear screen, H=home, ?25l=cursor off
-      printf("\x1B[2J\x1B[H\x1B[?25l");
-      screencleared = true;
-    }
-  }
+  VScreen display(SCREEN_ROWS, SCREEN_COLS);
+  OutBuf out;
+  ScreenImage image;
+  uint32_t version = 0;
 
-  if (cmd) *cmd &= 0x7F;
-  if (rsp) *rsp &= 0x7F;
-  if (cmdlen) cmdlen--;
-  if (rsplen) rsplen--;
+  const auto period = std::chrono::microseconds(1000000 / refreshrate);
+  auto next = std::chrono::steady_clock::now();
 
-  switch (*cmd)
+  for (;;)
   {
-    // Shortcuts
-// #define P(name) printf("%02X %s", cmd[0], name)
-// #define QCR(name, wantedcmdlen, wantedrsplen) do { P(name); if ((cmdlen != wantedcmdlen) || (rsplen != wantedrsplen) || (rsp[0] != 0)) goto dump; } while(0)
-// #define QC(name, wantedcmdlen) QCR(name, wantedcmdlen, 1) // Command with parameters, no return data
-// #define QR(name, wantedrsplen) QCR(name, 1, wantedrsplen) // Command without parameters, has return data
-// #define Q(name) QCR(name, 1, 1); do { fputs("\r\n", stdout); return; } while(0) // Command with no parameters, no return data
-
-#if 0
-  case 0x02: Q("DECK: STOP");
-  case 0x03: Q("DECK: PLAY");
-  case 0x05: Q("DECK: FFWD");
-  case 0x06: Q("DECK: REWIND");
-  case 0x0B: Q("DECK: CLOSE");
-  case 0x0C: Q("DECK: OPEN");
-
-  case 0x10:
-    // Key or remote command. These are ignored by the dig MCU
-    QC("KEY/RC: ", 2);
-
-    switch (cmd[1])
+    // Check for the stop request first, so that the last snapshot is
+    // always shown before the thread ends
+    bool stop = stoprender.load(std::memory_order_acquire);
+
+    if (snapshot.Version() != version)
     {
-      // Note: These numbers correspond to the numbers shown on the front
-      // panel during the Key Test program of the Service Mode
-    case 0x01: printf("SIDE A/B\r\n");      return;
-    case 0x02: printf("OPEN/CLOSE\r\n");    return;
-    case 0x03: printf("EDIT\r\n");          return;
-    case 0x04: printf("REC/PAUSE\r\n");     return;
-    case 0x05: printf("STOP\r\n");          return;
-    case 0x06: printf("REPEAT\r\n");        return;
-    case 0x07: printf("DOLBY\r\n");         return;
-    case 0x08: printf("SCROLL\r\n");        return;
-    case 0x09: printf("RECLEVEL-\r\n");     return;
-    case 0x0A: printf("APPEND\r\n");        return;
-    case 0x0B: printf("PLAY\r\n");          return;
-    case 0x0C: printf("PRESETS\r\n");       return;
-    case 0x0D: printf("TIME\r\n");          return;
-    case 0x0E: printf("TEXT\r\n");          return;
-    case 0x0F: printf("RECLEVEL+\r\n");     return;
-    case 0x10: printf("RECORD\r\n");        return;
-    case 0x11: printf("NEXT\r\n");          return;
-    case 0x12: printf("PREV\r\n");          return;
-
-      // Remote control
-      // "PAUSE" and "COUNTER RESET" and "WRITE MARK" don't show up
-      //
-      // NOTE: Numbers in comments are the codes shown in the service manual
-      // for the key test program
-    case 0x1C: printf("RC FFWD\r\n");       return; // 052?
-    case 0x1D: printf("RC OPEN/CLOSE\r\n"); return; // 045
-    case 0x1F: printf("RC REWIND\r\n");     return; // 050?
-    case 0x20: printf("RC 0\r\n");          return; // 000
-    case 0x21: printf("RC 1\r\n");          return; // 001
-    case 0x22: printf("RC 2\r\n");          return; // 002
-    case 0x23: printf("RC 3\r\n");          return; // 003
-    case 0x24: printf("RC 4\r\n");          return; // 004
-    case 0x25: printf("RC 5\r\n");          return; // 005
-    case 0x26: printf("RC 6\r\n");          return; // 006
-    case 0x27: printf("RC 7\r\n");          return; // 007
-    case 0x28: printf("RC 8\r\n");          return; // 008
-    case 0x29: printf("RC 9\r\n");          return; // 009
-    case 0x2C: printf("RC STANDBY\r\n");    return; // 012
-      // I couldn't reproduce the following codes from the service manual
-      // with my Logitech Harmony universal remote control. I may verify
-      // these later.
-                                                    // 011 TIME
-                                                    // 047 SIDE A/B
-                                                    // 028 REPEAT
-                                                    // 054 STOP
-                                                    // 053 PLAY
-                                                    // 040 REC SELECT/PAUSE
-                                                    // 117 APPEND
-                                                    // 055 RECORD
-                                                    // 121 EDIT
-                                                    // 103 REC LEVEL -
-                                                    // 102 REC LEVEL +
-                                                    // 015 SCROLL/DEMO
-                                                    // 122 TEXT
-                                                    // 063 DCC
-    default:
-      ; // Nothing
+      version = snapshot.Load(&image);
+      display.Load(image.cells);
+      display.Render(out);
     }
 
-    break;
-
-  case 0x23:
-    // Set repeat mode
-    QC("REPEAT MODE: ", 2);
-
-    switch (cmd[1])
+    if (stop)
     {
-    case 1: printf("None\r\n");    return;
-    case 2: printf("Track\r\n");   return;
-    case 3: printf("All\r\n");     return;
-    default:
-      ; // Nothing
+      break;
     }
 
-    break;
-
-  case 0x29:
-    // Rec/pause?
-    break;
+    next += period;
 
-  case 0x2A:
-    // Sector. This is issued after the 10 01 (SIDE A/B) command.
-    // Presumably the sector can be 1 to 4 inclusive but without 4-sector
-    // tapes, we won't know...
-    QC("SECTOR: ", 2);
-
-    printf("%u\r\n", cmd[1]);
-
-    return;
-
-  case 0x2F:
-    // Go to track (pdcc only?)
-    QC("GO TO TRACK: ", 3);
-
-    printf("To=%u, [2]=%u\r\n", cmd[1], cmd[2]);
-
-    return;
-
-  case 0x35:
-    // 35 18 42 10 seen for REC/PAUSE. Configure inputs perhaps?
-    break;
-
-  case 0x36:
-    // Send text
-    QC("SET TEXT: ", 42);
-
-    switch (cmd[1])
+    auto now = std::chrono::steady_clock::now();
+    if (next < now)
     {
-    case 0xFD: printf("DECKID="); break;  // Sent at initialization time to store deck ID
-    case 0xFA: printf("TITLE=");  break;  // Sent when editing title of current song
-    default:
-      printf("%02X ", cmd[1]);
+      next = now;
     }
 
-    printstring(cmd + 2, cmd + cmdlen);
-    fputs("\r\n", stdout);
-
-    return;
-
-  case 0x37:
-    // Search relative from current track.
-    QC("DECK: SEARCH: ", 3);
-
-    printhex(rsp + 1, rsp + 3);
-    fputs("\r\n", stdout);
-
-    return;
-    /*
-        // What the second parameter byte means is not clear, seems to be always 1
-        if (rsp[1] < 100)
-        {
-          // You can search forwards by 1-99 tracks
-          printf("+%u [%02X]\r\n", rsp[1], rsp[2]);
-          return;
-        }
-        else // if?...
-        {
-          // Searching backwards it uses EE=-0, ED=-1 etc. Weird.
-          printf("-%u [%02X]\r\n", 0xEE - rsp[1], rsp[2]);
-          return;
-        }
-
-        break;
-    */
-
-  case 0x38:
-    // Time mode. This is issued after the TIME command (10 0D)
-    // Note: for [super] user tapes, the display has a VU mode too:
-    // Press TIME enough times and it will only send TIME but no time mode
-    // command.
-    // For ACC's a counter will appear in one of the modes, this also
-    // doesn't issue a time mode command.
-    QC("TIME MODE: ", 2);
-
-    switch (cmd[1])
-    {
-    case 1: printf("TOTAL TIME\r\n");     return; // prerec/dcc/acc
-    case 2: printf("TOT REM TIME\r\n");   return; // prerec
-    case 3: printf("TRACK TIME\r\n");     return; // prerec/sudcc
-
-    case 5: printf("REM TIME\r\n");       return; // non-prerecorded
-    default:
-      ; // Nothing
-    }
+    std::this_thread::sleep_until(next);
+  }
+}
 
-    break;
 
-  case 0x39:
-    // Read DCC. This is issued after inserting a DCC cassette.
-    Q("READ DCC.");
+//---------------------------------------------------------------------------
+// Set up the filter
+void ScreenSink::SetFilter(
+  ChangeFilter *pfilter)                // Filter for repeated messages
+{
+  // Repeated messages wouldn't change anything on the screen
+  pfilter->SetRule(FRONTPANEL_POLL);
+  pfilter->SetRule(FRONTPANEL_VU);
+  pfilter->SetRule(FRONTPANEL_DECK_STATE);
+  pfilter->SetRule(FRONTPANEL_FUNCTION_STATE);
+  pfilter->SetRule(FRONTPANEL_DRAWER_STATUS);
+  pfilter->SetRule(FRONTPANEL_LONG_TEXT);
+  pfilter->SetRule(FRONTPANEL_TRACK_TITLE);
+}
 
-  case 0x3C:
-    // Write DCC. This is issued after setting the text for the current track
-    Q("WRITE DCC.");
 
-#endif
-  case 0x41:
-    // Poll status
-    ShowPollStatus(rsp);
-    break;
+//---------------------------------------------------------------------------
+// Show a batch of decoded events
+//
+// The events only update the virtual screen; at the end of the batch, a
+// copy of it is made available to the render thread.
+void ScreenSink::Batch(
+  const DecodeBatch *pbatch)            // Events to show
+{
+  const DecodeEvent *pev = pbatch->Events();
 
-#if 0
-  case 0x44:
-    QR("GET SYSTEM STATUS -> ", 2);
+  for (size_t n = pbatch->Size(); n; n--, pev++)
+  {
+    const FrontPanelOpcode *op = FrontPanel_Opcode(pev->opcode);
 
-    switch (rsp[1])
+    // Messages that weren't understood aren't shown. Other buses aren't
+    // shown either, and after a slip the screen is simply updated by the
+    // next messages.
+    switch (pev->type)
     {
-    case 0x06: printf("CHECK DIG IN\r\n");  return;
-    case 0x10: printf("CLEAN HEADS\r\n");   return;
-    case 0x1F: printf("POWER FAIL\r\n");    return;
-
-    case 0x0D: // Seen when pushing A/B on remote just after pushing open/close twice in quick succession. No text on screen.
-    case 0x1A: // Seen while playing DCC175 recorded tape in service mode
-    default:
-      printf("%02X\r\n", rsp[1]);           return;
-    }
-
-#endif
-
-  case 0x46:
-    // Get drawer status
-    ShowDrawerStatus(rsp);
-    break;
+    case DECODE_POLL:
+      ShowPollStatus(pev->poll.status);
+      break;
+
+    case DECODE_VU:
+      ShowVU(pev);
+      break;
+
+    case DECODE_DECKSTATE:
+      ShowDeckState(pev);
+      break;
+
+    case DECODE_VALUE:
+      if (pev->opcode == FRONTPANEL_DRAWER_STATUS)
+      {
+        ShowDrawerStatus(op, pev->value);
+      }
+      else if (pev->opcode == FRONTPANEL_FUNCTION_STATE)
+      {
+        ShowDeckFunction(op, pev->value);
+      }
+      break;
+
+    case DECODE_TEXT:
+      if (pev->opcode == FRONTPANEL_LONG_TEXT)
+      {
+        // Get long text (invoked when you push the Text button on the front panel)
+        ShowLongText(op, pev);
+      }
+      else if (pev->opcode == FRONTPANEL_TRACK_TITLE)
+      {
+        ShowTrackTitle(pev);
+      }
+      break;
 
-#if 0
-
-  case 0x49:
-    // Get tape type? This is issued right after the drawer finishes closing
-    QR("TAPE TYPE -> ", 2);
-
-    printf("(%02X) ", rsp[0]);
-
-    switch (rsp[1])
-    {
-      // Meanings of bits:
-      //  0x01: No cassette
-      //  0x02: Chrome
-      //  0x04: DCC
-      //  0x08: Recording Allowed
-      //  0x10: Length Hole "3" (45/75/105/Undefined)
-      //  0x20: Length Hole "4" (45/60/105/120)
-      //  0x40: Length Hole "5" (45/60/75/90)
-      // Length can be ("5"/"4"/"3"):
-      //  45  minutes  (1/1/1)
-      //  60  minutes  (1/1/0)
-      //  75  minutes  (1/0/1)
-      //  90  minutes  (1/0/0)
-      //  105 minutes  (0/1/1)
-      //  120 minutes  (0/1/0)
-      //  Undefined    (0/0/1) Reserved
-      //  Undefined    (0/0/0) Also used for prerecorded DCC
-      // These numbers correspond to the decimal numbers that are shown by
-      // the "Switches Test" program in Service Mode
-    case 0x00: printf("ACC FERRO\r\n");   return; // 000
-    case 0x02: printf("ACC CHROME\r\n");  return; // 002
-    case 0x04: printf("PDCC\r\n");        return; // 004
-    case 0x14: printf("UDCC(PROT)\r\n");  return; // 020
-    case 0x1C: printf("UDCC\r\n");        return; // 028
-    case 0x24: printf("DCC120(PROT)\r\n"); return; // 036
-    case 0x2C: printf("DCC120\r\n");      return; // 044
-    case 0x34: printf("DCC105(PROT)\r\n"); return; // 052
-    case 0x3C: printf("DCC105\r\n");      return; // 060
-    case 0x44: printf("DCC90(PROT)\r\n"); return; // 068
-    case 0x4C: printf("DCC90\r\n");       return; // 076
-    case 0x54: printf("DCC75(PROT)\r\n"); return; // 084
-    case 0x5C: printf("DCC75\r\n");       return; // 092
-    case 0x64: printf("DCC60(PROT)\r\n"); return; // 100
-    case 0x6C: printf("DCC60\r\n");       return; // 108
-    case 0x74: printf("DCC45(PROT)\r\n"); return; // 116
-    case 0x7B: printf("NO CASSETTE\r\n"); return; // 123
-    case 0x7C: printf("DCC45\r\n");       return; // 124
     default:
-      printf("%02X\r\n", rsp[1]);         return;
-    }
-
-    break;
-
-#endif
-
-  case 0x51:
-    // Get long text (invoked when you push the Text button on the front panel)
-    ShowLongText(cmd, rsp, rsplen);
-    return;
-
-  case 0x52:
-    // Get track title
-    ShowTrackTitle(cmd, rsp, rsplen);
-    return;
-
-#if 0
-  case 0x53:
-    // Get short text
-    QCR("GET SHORT TEXT -> ", 2, 13);
-
-    switch (cmd[1])
-    {
-    case 0xFA: printf("Track -> ");                 break; // Get track name
-      // Other codes see 0x51?
-    default:   printf("%02X -> ", cmd[1]);
+      ; // Nothing
     }
+  }
 
-    printstring(rsp + 1, rsp + rsplen);
-    fputs("\r\n", stdout);
-
-    return;
-
-  case 0x54:
-    // Get short track title
-    QCR("GET SHORT TRACK TITLE: ", 2, 13);
-
-    printf("Track %u -> ", cmd[1]);
-    printstring(rsp + 1, rsp + rsplen);
-    fputs("\r\n", stdout);
-
-    return;
-
-  case 0x55:
-    // Get DDU2113 ID. Issued at startup before sending the front panel ID
-    QR("Get DDU ID -> ", 5);
+  memcpy(image.cells, screen.Cells(), sizeof(image.cells));
+  snapshot.Store(image);
+}
 
-    printhex(rsp + 1, rsp + rsplen);
-    fputs("\r\n", stdout);
 
-    return;
+//---------------------------------------------------------------------------
+// Stop processing
+//
+// The render thread shows the last state of the screen before it ends.
+void ScreenSink::Exit()
+{
+  if (renderthread.joinable())
+  {
+    stoprender.store(true, std::memory_order_release);
+    renderthread.join();
+  }
+}
 
-  case 0x57:
-    // Get Marker Type?
-    QR("MARKER TYPE -> ", 2);
 
-    switch (rsp[1])
-    {
-    case 0x02: printf("TRACK\r\n");       return;
-    case 0x03: printf("REVERSE\r\n");     return; // Switch to side B
-    case 0x07: printf("SKIP +1\r\n");     return; // Skip marker? Also seen at beginning of 175-recorded tape
-    case 0x0B: printf("REUSE\r\n");       return; // End of recording, beginning of reusable tape
-    case 0x0D: printf("INTRO SKIP\r\n");  return; // Skip over begin of sector 1
-    case 0x14: printf("BEGIN SEC\r\n");   return; // After reversing
-    case 0x0E:
-    default:
-      printf("%02X\r\n", rsp[1]);
-    }
+/////////////////////////////////////////////////////////////////////////////
+// PUBLIC FUNCTIONS
+/////////////////////////////////////////////////////////////////////////////
 
-    return;
-#endif
-
-  case 0x58:
-    ShowDeckFunction(rsp);
-    return;
-
-#if 0
-  case 0x5B:
-    // Set something (at search time). cmdlen=2 rsplen=4
-    break;
-
-  case 0x5D:
-    // Get Target Track number
-    // This is the positive or negative number that's shown in the track
-    // display during search. It also gets polled when playing past a
-    // marker.
-    QR("GET TARGET TRACK -> ", 2);
-
-    printf("%d\r\n", rsp[1]);           return;
-
-    return;
-#endif
-  case 0x5E:
-    ShowVU(rsp);
-    return;
-
-#if 0
-  case 0x5F:
-    // Service mode playback error reporting.
-    // The command parameter byte indicates the requested track (1-9)
-    // or is set to 0x10 to request a bit pattern of all the (main) heads.
-    // The bit order is: head 1=0x80, head 2=0x40, head 3=0x20 etc.
-    // The first byte of the response is always 0 (so the AUX track is
-    // not part of the result for more 0x10). 
-    // The second response byte is between 0 and 20 decimal for individual
-    // heads. According to the service manual, the individual head error
-    // counts can basically be multiplied by 5 to get the percentage of
-    // errors.
-    QCR("BITS ", 2, 2);
-
-    printf("%02X -> %02X %02X\r\n", cmd[1], rsp[0], rsp[1]);
-
-    return;
-#endif
-  case 0x60:
-    ShowDeckState(rsp);
-    return;
-
-#if 0
-  case 0x61:
-    // Get tape info for prerecorded tape
-    QR("PREREC TAPE INFO -> ", 6);
-
-    printf("[1]=0x%02X Tracks=%02X Total time=%02X:%02X:%02X\r\n",
-      rsp[1], rsp[2], rsp[3], rsp[4], rsp[5]);
-
-    return;
-#endif
-  default:
-    ;// Nothing
-  }
 
-/*
-dump:
-  // If we got here, we don't understand the command. Just dump it.
-  // Note, we don't dump the checksums.
-  fputs("?? ", stdout);
-  hexdumpmessage(cmd, cmdlen, rsp, rsplen);
-*/
+//---------------------------------------------------------------------------
+// Create a sink that shows the state of the recorder on the screen
+ProcSink *Proc_CreateScreen(
+  unsigned refresh)                     // Screen refreshes per second
+{
+  return new ScreenSink(refresh);
 }
 
 
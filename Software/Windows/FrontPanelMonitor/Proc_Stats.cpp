@@ -0,0 +1,181 @@
+/****************************************************************************
+Processing module that counts messages
+(C) 2024 Jac Goudsmit
+Licensed under the MIT license.
+See LICENSE for details.
+****************************************************************************/
+
+
+/////////////////////////////////////////////////////////////////////////////
+// INCLUDES
+/////////////////////////////////////////////////////////////////////////////
+
+
+#include <cstdio>
+#include <cstdint>
+
+#include "../../Common/FrontPanelOpcodes.h"
+
+#include "Proc.h"
+
+
+/////////////////////////////////////////////////////////////////////////////
+// TYPES
+/////////////////////////////////////////////////////////////////////////////
+
+
+class StatsSink : public ProcSink
+{
+protected:
+  const ProcCounts *pcounts;            // Messages counted by the decoder
+  const DeckState *pdeck;               // Model of the deck state
+  uint64_t    channel = 0;              // Data from other receivers
+  uint64_t    slips = 0;                // Realignments
+  uint64_t    cadence = 0;              // Cadence changes
+  uint64_t    sequence = 0;             // Toggle bits out of sequence
+
+public:
+  //-------------------------------------------------------------------------
+  // Constructor
+  StatsSink(
+    const ProcCounts *pcounts,          // Messages counted by the decoder
+    const DeckState *pdeck)             // Model of the deck state
+    : pcounts(pcounts)
+    , pdeck(pdeck)
+  {
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Get the name of the sink, for the statistics
+  const char *Name() override
+  {
+    return "stats";
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Count the events in a batch that aren't messages
+  //
+  // The messages themselves are counted by the decoder, because the
+  // batches don't have the repeats.
+  void Batch(
+    const DecodeBatch *pbatch) override // Events
+  {
+    const DecodeEvent *pev = pbatch->Events();
+
+    for (size_t n = pbatch->Size(); n; n--, pev++)
+    {
+      switch (pev->type)
+      {
+      case DECODE_CHANNEL:
+        channel++;
+        break;
+
+      case DECODE_SLIP:
+        slips++;
+        break;
+
+      case DECODE_CADENCE:
+        cadence++;
+        break;
+
+      case DECODE_SEQUENCE:
+        sequence++;
+        break;
+
+      default:
+        break;
+      }
+    }
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Print the counts
+  void Exit() override
+  {
+    // The decoder is done, so the counts don't change anymore
+    const ProcCounts &c = *pcounts;
+    double seconds = (c.last - c.first) / 1e9;
+
+    fprintf(stderr, "\nMessages by opcode, over %.3f s of bus time:\n", seconds);
+
+    for (unsigned opcode = 0; opcode < 128; opcode++)
+    {
+      uint64_t total = c.messages[opcode];
+
+      if (!total)
+      {
+        continue;
+      }
+
+      int len;
+      const char *name = FrontPanel_OpcodeName((uint8_t)opcode, &len);
+
+      fprintf(stderr, "Opcode %02X %-24.*s %10llu", opcode, len, name,
+        (unsigned long long)total);
+
+      if (seconds > 0)
+      {
+        fprintf(stderr, " (%.1f/s)", total / seconds);
+      }
+
+      if (c.unknown[opcode])
+      {
+        fprintf(stderr, ", %llu not understood", (unsigned long long)c.unknown[opcode]);
+      }
+
+      fprintf(stderr, "\n");
+    }
+
+    if (channel)
+    {
+      fprintf(stderr, "Data from other receivers: %llu\n", (unsigned long long)channel);
+    }
+
+    if (slips)
+    {
+      fprintf(stderr, "Realignments: %llu\n", (unsigned long long)slips);
+    }
+
+    if (cadence)
+    {
+      fprintf(stderr, "Cadence changes: %llu\n", (unsigned long long)cadence);
+    }
+
+    if (sequence)
+    {
+      fprintf(stderr, "Toggle bits out of sequence: %llu\n", (unsigned long long)sequence);
+    }
+
+    // All batches have been seen, so the model is at the same point
+    if (pdeck)
+    {
+      DeckSnapshot s;
+
+      pdeck->Load(&s);
+      DeckState::Print(stderr, s);
+    }
+  }
+};
+
+
+/////////////////////////////////////////////////////////////////////////////
+// PUBLIC FUNCTIONS
+/////////////////////////////////////////////////////////////////////////////
+
+
+//---------------------------------------------------------------------------
+// Create a sink that shows the message counts by opcode
+ProcSink *Proc_CreateStats(
+  const ProcCounts *pcounts,            // Messages counted by the decoder
+  const DeckState *pdeck)               // Model of the deck state
+{
+  return new StatsSink(pcounts, pdeck);
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// END
+/////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,750 @@
+/****************************************************************************
+SPI receiver backend selection
+(C) 2024 Jac Goudsmit
+Licensed under the MIT license.
+See LICENSE file for details.
+****************************************************************************/
+
+
+/////////////////////////////////////////////////////////////////////////////
+// INCLUDES
+/////////////////////////////////////////////////////////////////////////////
+
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+
+#include "CapFile.h"
+#include "Pacer.h"
+#include "SPIrx.h"
+#include "SPSCRing.h"
+
+
+/////////////////////////////////////////////////////////////////////////////
+// TYPES
+/////////////////////////////////////////////////////////////////////////////
+
+
+//---------------------------------------------------------------------------
+// Capture state for one receiver
+//
+// The capture thread is the producer for the rings, the thread that calls
+// SPIrx_ReadSpan and SPIrx_Release is the consumer.
+struct Capture
+{
+  unsigned            index;            // Receiver index
+  SPIrxChannel       *rx;               // Receiver backend
+  SPSCRing<uint8_t>   ring;             // Received data
+  SPSCRing<SPIrxChunk> chunks;          // Time stamps for received data
+  size_t              chunkused;        // Bytes released from first chunk
+  uint64_t            chunktime;        // Producer: time of last chunk
+  uint64_t            headtime;         // Consumer: time of last released chunk
+  uint64_t            bytetime;         // Estimated time per byte, ns
+  std::thread         thread;           // Capture thread
+  std::atomic<bool>   quit;             // Set to stop the capture thread
+  std::atomic<bool>   error;            // Set when receiver failed
+  std::atomic<uint64_t> received;       // Total number of bytes received
+  std::atomic<uint64_t> watermark;      // All data up to this time is in ring
+
+  Capture(unsigned i, SPIrxChannel *p, unsigned bitrate)
+    : index(i)
+    , rx(p)
+    , ring(SPIRX_RING_SIZE, SPIRX_MAX_SPAN)
+    , chunks(SPIRX_CHUNK_RING_SIZE)
+    , chunkused(0)
+    , chunktime(0)
+    , headtime(0)
+    , bytetime(8000000000ULL / bitrate)
+    , quit(false)
+    , error(false)
+    , received(0)
+    , watermark(0)
+  {
+  }
+};
+
+
+/////////////////////////////////////////////////////////////////////////////
+// DATA
+/////////////////////////////////////////////////////////////////////////////
+
+
+static Capture *Cap[SPIRX_MAX_CHANNELS];
+static unsigned numRx;
+static std::chrono::steady_clock::time_point startTime;
+static CapReader *Readers[SPIRX_MAX_CHANNELS]; // Capture files being read
+static unsigned numReaders;
+static CapWriter *Writer;               // Capture file being written
+static Pacer *Pace;                     // Timing of replayed capture files
+
+
+/////////////////////////////////////////////////////////////////////////////
+// LOCAL FUNCTIONS
+/////////////////////////////////////////////////////////////////////////////
+
+
+//---------------------------------------------------------------------------
+// Get the current time
+static uint64_t                         // Returns ns since SPIrx_init
+Now()
+{
+  return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now() - startTime).count();
+}
+
+
+//---------------------------------------------------------------------------
+// Store the time stamp of a chunk
+//
+// The caller must make sure that there's room for at least one chunk.
+static void PutChunk(
+  Capture *pcap,                        // Capture state
+  uint64_t now,                         // Time stamp
+  uint64_t polltime,                    // Time of previous poll
+  uint16_t len)                         // Number of bytes in chunk
+{
+  SPIrxChunk *pchunk;
+  uint64_t dt = now - pcap->chunktime;
+
+  // Split up gaps that don't fit in a chunk, as long as there's room. If
+  // there isn't, the time stamp is late; the next chunk will catch up.
+  while ((dt > UINT32_MAX) && (pcap->chunks.Free() > 1))
+  {
+    pcap->chunks.WriteSpan(&pchunk);
+    pchunk->dt = UINT32_MAX;
+    pchunk->len = 0;
+    pchunk->wait = 0;
+    pcap->chunks.Commit(1);
+
+    pcap->chunktime += UINT32_MAX;
+    dt -= UINT32_MAX;
+  }
+
+  if (dt > UINT32_MAX)
+  {
+    dt = UINT32_MAX;
+  }
+
+  pcap->chunktime += dt;
+
+  // Round the wait down, so the earliest time is never before the poll
+  uint64_t wait = (pcap->chunktime > polltime) ? (pcap->chunktime - polltime) / 1000 : 0;
+
+  pcap->chunks.WriteSpan(&pchunk);
+  pchunk->dt = (uint32_t)dt;
+  pchunk->len = len;
+  pchunk->wait = (uint16_t)((wait > 0xFFFF) ? 0xFFFF : wait);
+  pcap->chunks.Commit(1);
+}
+
+
+//---------------------------------------------------------------------------
+// Capture thread
+//
+// This drains the receiver as fast as possible so that its own (small)
+// buffer never overflows, even when the consumer is slowed down by console
+// output.
+static void CaptureThread(
+  Capture *pcap)                        // Capture state
+{
+  SPIrxChannel *rx = pcap->rx;
+  uint8_t discard[4096];                // Data that doesn't fit in the ring
+  uint64_t polltime = 0;                // Time of previous poll
+
+  while (!pcap->quit.load(std::memory_order_relaxed))
+  {
+    uint8_t *p;
+    size_t size = pcap->ring.WriteSpan(&p);
+    bool dropping = false;
+
+    if (!pcap->chunks.Free())
+    {
+      // No room to store the time stamp
+      size = 0;
+    }
+
+    if (!size)
+    {
+      if (!rx->IsLive())
+      {
+        // Wait for the consumer to catch up
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        continue;
+      }
+
+      // The ring is full. Keep reading from the device so that it keeps
+      // working, but throw the data away.
+      p = discard;
+      size = sizeof(discard);
+      dropping = true;
+    }
+
+    uint16_t len = (uint16_t)((size > 0xFFFF) ? 0xFFFF : size);
+    if (!rx->Receive(p, &len))
+    {
+      pcap->error = true;
+      break;
+    }
+
+    // The time stamp is taken after the data arrived, so data that's
+    // received later always has a later time stamp
+    uint64_t now;
+    if (!rx->RecordedTime(&now, &polltime))
+    {
+      now = Now();
+    }
+
+    if (len)
+    {
+      pcap->received.fetch_add(len, std::memory_order_relaxed);
+
+      // The data is recorded even if it doesn't fit in the ring. This has
+      // to be done before the data is committed, because the consumer may
+      // modify it.
+      if (Writer)
+      {
+        Writer->Write(pcap->index, now, polltime, p, len, !rx->IsLive());
+      }
+
+      if (dropping)
+      {
+        pcap->ring.Overrun(len);
+      }
+      else
+      {
+        // The chunk goes first, so that the consumer never sees data
+        // without a time stamp
+        PutChunk(pcap, now, polltime, len);
+        pcap->ring.Commit(len);
+      }
+    }
+
+    pcap->watermark.store(now, std::memory_order_release);
+    polltime = now;
+
+    if (!len)
+    {
+      if (rx->AtEnd())
+      {
+        break;
+      }
+
+      // Nothing available yet
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+  }
+
+  pcap->watermark.store(SPIRX_TIME_END, std::memory_order_release);
+}
+
+
+//---------------------------------------------------------------------------
+// Parse a tape time in the form h:mm:ss
+static bool                             // Returns false=not a tape time
+ParseTapeTime(
+  const char *s,                        // Text to parse
+  uint32_t *ptapetime)                  // Output seconds
+{
+  char *end;
+  unsigned long hours = strtoul(s, &end, 10);
+
+  if ((end == s) || (*end != ':'))
+  {
+    return false;
+  }
+
+  s = end + 1;
+  unsigned long minutes = strtoul(s, &end, 10);
+
+  if ((end == s) || (*end != ':') || (minutes > 59))
+  {
+    return false;
+  }
+
+  s = end + 1;
+  unsigned long seconds = strtoul(s, &end, 10);
+
+  if ((end == s) || (*end) || (seconds > 59) || (hours > 9))
+  {
+    return false;
+  }
+
+  *ptapetime = (uint32_t)((hours * 60 + minutes) * 60 + seconds);
+  return true;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// PUBLIC FUNCTIONS
+/////////////////////////////////////////////////////////////////////////////
+
+
+//---------------------------------------------------------------------------
+// Initialize SPI receiver
+unsigned                                // Returns number of devices opened
+SPIrx_init(
+  const char **argv)                    // Program arguments
+{
+#ifdef _WIN32
+  SPIrxChannel *(*create)() = SPIrx_CreateFT4222;
+#else
+  SPIrxChannel *(*create)() = nullptr;
+#endif
+  unsigned bitrate = SPIRX_DEFAULT_BITRATE;
+  const char **psName;
+  const char *names[SPIRX_MAX_CHANNELS];
+  unsigned bitrates[SPIRX_MAX_CHANNELS];
+  const char *writename = nullptr;
+  double startseconds = 0;
+  uint32_t starttapetime = CAPFILE_NO_TAPETIME;
+  int startopcode = -1;
+  double speed = 0;
+  bool paused = false;
+
+  startTime = std::chrono::steady_clock::now();
+
+  // The capture file gets the date and time too
+  uint64_t startWallTime = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::system_clock::now().time_since_epoch()).count();
+
+  for (numRx = 0, psName = argv + 1; (*psName) && (numRx < SPIRX_MAX_CHANNELS); psName++)
+  {
+    if (!strcmp(*psName, "-r"))
+    {
+      create = SPIrx_CreateReplay;
+      continue;
+    }
+
+    if ((!strcmp(*psName, "-b")) && (psName[1]))
+    {
+      bitrate = (unsigned)strtoul(*++psName, nullptr, 0);
+      if (!bitrate)
+      {
+        bitrate = SPIRX_DEFAULT_BITRATE;
+      }
+      continue;
+    }
+
+    if ((!strcmp(*psName, "-w")) && (psName[1]))
+    {
+      writename = *++psName;
+      continue;
+    }
+
+    if ((!strcmp(*psName, "-s")) && (psName[1]))
+    {
+      // Seconds since the start of the capture, or a tape time
+      psName++;
+      startseconds = 0;
+      if (ParseTapeTime(*psName, &starttapetime))
+      {
+        continue;
+      }
+
+      if (strchr(*psName, ':'))
+      {
+        printf("Invalid tape time: %s\n", *psName);
+        SPIrx_exit();
+        return 0;
+      }
+
+      starttapetime = CAPFILE_NO_TAPETIME;
+      startseconds = strtod(*psName, nullptr);
+      continue;
+    }
+
+    if ((!strcmp(*psName, "-o")) && (psName[1]))
+    {
+      startopcode = (int)(strtoul(*++psName, nullptr, 16) & 0x7F);
+      continue;
+    }
+
+    if ((!strcmp(*psName, "-x")) && (psName[1]))
+    {
+      speed = strtod(*++psName, nullptr);
+      continue;
+    }
+
+    if (!strcmp(*psName, "-p"))
+    {
+      paused = true;
+      continue;
+    }
+
+    if ((!strcmp(*psName, "-c")) && (psName[1]))
+    {
+      const char *filename = *++psName;
+      CapReader *preader = new CapReader;
+
+      if (!preader->Open(filename))
+      {
+        printf("Error opening capture file: %s\n", filename);
+        delete preader;
+        SPIrx_exit();
+        return 0;
+      }
+
+      Readers[numReaders++] = preader;
+
+      // Use the original start time if the capture is written again
+      const CapFileHeader *ph = preader->Header();
+      startWallTime = ph->starttime;
+
+      // Find where to start
+      size_t startblock = 0;
+
+      if (startseconds > 0)
+      {
+        startblock = preader->FindTime((uint64_t)(startseconds * 1e9));
+      }
+
+      if (starttapetime != CAPFILE_NO_TAPETIME)
+      {
+        startblock = preader->FindTapeTime(starttapetime, startblock);
+      }
+
+      if (startopcode >= 0)
+      {
+        startblock = preader->FindOpcode((uint8_t)startopcode, startblock);
+      }
+
+      if (startblock)
+      {
+        printf("Starting at block %zu of %zu of %s%s\n", startblock, preader->Blocks(), filename,
+          preader->Indexed() ? "" : " (no index)");
+      }
+
+      // All files share the same pacer
+      if (((speed > 0) || (paused)) && (!Pace))
+      {
+        Pace = new Pacer((speed > 0) ? speed : 1.0, paused);
+      }
+
+      for (unsigned i = 0; (i < ph->numchannels) && (numRx < SPIRX_MAX_CHANNELS); i++)
+      {
+        SPIrxChannel *p = SPIrx_CreateCapture(preader, i, startblock, Pace);
+
+        p->Open(ph->channel[i].name);
+
+        printf("Opened receiver %u: %s from %s\n", numRx, ph->channel[i].name, filename);
+        names[numRx] = ph->channel[i].name;
+        bitrates[numRx] = ph->channel[i].bitrate ? ph->channel[i].bitrate : SPIRX_DEFAULT_BITRATE;
+        Cap[numRx] = new Capture(numRx, p, bitrates[numRx]);
+        numRx++;
+      }
+
+      continue;
+    }
+
+    if (!strcmp(*psName, "-d"))
+    {
+#ifdef _WIN32
+      create = SPIrx_CreateFT4222;
+#else
+      printf("Only replaying is supported on this platform\n");
+      create = nullptr;
+#endif
+      continue;
+    }
+
+    if (!create)
+    {
+      break;
+    }
+
+    SPIrxChannel *p = create();
+
+    if (!p->Open(*psName))
+    {
+      printf("Error opening receiver %u: %s\n", numRx, *psName);
+      delete p;
+      SPIrx_exit();
+      return 0;
+    }
+
+    printf("Opened receiver %u: %s\n", numRx, *psName);
+    names[numRx] = *psName;
+    bitrates[numRx] = bitrate;
+    Cap[numRx] = new Capture(numRx, p, bitrate);
+    numRx++;
+  }
+
+  if ((!numRx) || (*psName))
+  {
+    printf("Usage: %s [-w <capture>] [-b <bits/s>] [-d] <location>... | -r <file>... | [-s <seconds>|<h:mm:ss>] [-o <opcode>] [-x <speed>] [-p] -c <capture>\n", argv[0]);
+    printf("Receivers 0 and 1 are the front panel command and response lines.\n");
+    printf("-w writes the data of all receivers to a capture file, -c reads one.\n");
+    printf("-s and -o start reading at a time, and/or at a command (hex opcode).\n");
+    printf("The time is in seconds since the start of the capture, or a tape time.\n");
+    printf("-x replays at a speed (1=original timing) instead of as fast as possible,\n");
+    printf("-p starts that paused. Keys: space=pause, n=step, +/-=speed, 1=original speed.\n");
+#ifdef _WIN32
+    printf("\n");
+    SPIrx_ListFT4222();
+    printf("\nSpecify locations on the command line as hex numbers\n");
+#endif
+    SPIrx_exit();
+    return 0;
+  }
+
+  printf("%u device(s) opened\n", numRx);
+
+  if (writename)
+  {
+    Writer = new CapWriter;
+
+    if (!Writer->Open(writename, numRx, names, bitrates, startWallTime))
+    {
+      printf("Error creating capture file: %s\n", writename);
+      SPIrx_exit();
+      return 0;
+    }
+  }
+
+  // Start capturing only after all devices are open, so that they start
+  // at approximately the same time
+  for (unsigned i = 0; i < numRx; i++)
+  {
+    Cap[i]->thread = std::thread(CaptureThread, Cap[i]);
+  }
+
+  return numRx;
+}
+
+
+//---------------------------------------------------------------------------
+// Shutdown SPI receiver
+void SPIrx_exit()
+{
+  for (unsigned i = 0; i < numRx; i++)
+  {
+    Cap[i]->quit = true;
+  }
+
+  for (unsigned i = 0; i < numRx; i++)
+  {
+    if (Cap[i]->thread.joinable())
+    {
+      Cap[i]->thread.join();
+    }
+  }
+
+  // Write what the capture threads stored
+  delete Writer;
+  Writer = nullptr;
+
+  for (unsigned i = 0; i < numRx; i++)
+  {
+    Cap[i]->rx->Close();
+    delete Cap[i]->rx;
+    delete Cap[i];
+    Cap[i] = nullptr;
+  }
+
+  numRx = 0;
+
+  for (unsigned i = 0; i < numReaders; i++)
+  {
+    delete Readers[i];
+    Readers[i] = nullptr;
+  }
+
+  numReaders = 0;
+
+  delete Pace;
+  Pace = nullptr;
+}
+
+
+//---------------------------------------------------------------------------
+// Get the received data that hasn't been released yet
+bool                                    // Returns true=success
+SPIrx_ReadSpan(
+  int rxindex,                          // Receiver index
+  uint8_t **pp,                         // Output pointer to data
+  size_t *plen)                         // Output number of bytes
+{
+  if ((rxindex < 0) || ((unsigned)rxindex >= numRx))
+  {
+    printf("Index out of range");
+    return false;
+  }
+
+  Capture *pcap = Cap[rxindex];
+
+  *plen = pcap->ring.ReadSpan(pp);
+
+  // Report receiver errors only after all the data before it was read
+  return (*plen != 0) || (!pcap->error);
+}
+
+
+//---------------------------------------------------------------------------
+// Release data that was processed
+void SPIrx_Release(
+  int rxindex,                          // Receiver index
+  size_t len)                           // Number of bytes to release
+{
+  if ((rxindex < 0) || ((unsigned)rxindex >= numRx))
+  {
+    return;
+  }
+
+  Capture *pcap = Cap[rxindex];
+
+  pcap->ring.Release(len);
+
+  // Drop the time stamps of the chunks that were released completely,
+  // including any chunks without data that follow them
+  for (;;)
+  {
+    SPIrxChunk *pchunk = pcap->chunks.Peek(0);
+    if (!pchunk)
+    {
+      break;
+    }
+
+    size_t n = pchunk->len - pcap->chunkused;
+    if (n > len)
+    {
+      pcap->chunkused += len;
+      break;
+    }
+
+    pcap->headtime += pchunk->dt;
+    pcap->chunks.Release(1);
+    pcap->chunkused = 0;
+    len -= n;
+  }
+}
+
+
+//---------------------------------------------------------------------------
+// Get the number of bytes that were received at the same time as the
+// first byte that wasn't released
+size_t                                  // Returns 0=no data
+SPIrx_ChunkLen(
+  int rxindex)                          // Receiver index
+{
+  if ((rxindex < 0) || ((unsigned)rxindex >= numRx))
+  {
+    return 0;
+  }
+
+  Capture *pcap = Cap[rxindex];
+
+  for (size_t i = 0; ; i++)
+  {
+    SPIrxChunk *pchunk = pcap->chunks.Peek(i);
+    if (!pchunk)
+    {
+      return 0;
+    }
+
+    // Only the first chunk can be partially released
+    if (pchunk->len)
+    {
+      return pchunk->len - (i ? 0 : pcap->chunkused);
+    }
+  }
+}
+
+
+//---------------------------------------------------------------------------
+// Get the time at which a byte was received
+uint64_t                                // Returns ns since SPIrx_init
+SPIrx_Time(
+  int rxindex,                          // Receiver index
+  size_t offset)                        // Offset from first unreleased byte
+{
+  if ((rxindex < 0) || ((unsigned)rxindex >= numRx))
+  {
+    return 0;
+  }
+
+  Capture *pcap = Cap[rxindex];
+  uint64_t prevtime = pcap->headtime;
+
+  offset += pcap->chunkused;
+  for (size_t i = 0; ; i++)
+  {
+    SPIrxChunk *pchunk = pcap->chunks.Peek(i);
+    if (!pchunk)
+    {
+      // Beyond the received data; return the last known time
+      return prevtime;
+    }
+
+    uint64_t time = prevtime + pchunk->dt;
+    if (offset < pchunk->len)
+    {
+      // Count back from the last byte of the chunk, but not to before
+      // the previous poll
+      uint64_t back = (pchunk->len - 1 - offset) * pcap->bytetime;
+      uint64_t maxback = pchunk->wait * 1000ULL;
+
+      return time - ((back < maxback) ? back : maxback);
+    }
+
+    offset -= pchunk->len;
+    prevtime = time;
+  }
+}
+
+
+//---------------------------------------------------------------------------
+// Get the time up to which all received data is in the ring
+uint64_t                                // Returns ns since SPIrx_init
+SPIrx_Watermark(
+  int rxindex)                          // Receiver index
+{
+  if ((rxindex < 0) || ((unsigned)rxindex >= numRx))
+  {
+    return SPIRX_TIME_END;
+  }
+
+  return Cap[rxindex]->watermark.load(std::memory_order_acquire);
+}
+
+
+//---------------------------------------------------------------------------
+// Get capture statistics
+bool                                    // Returns true=success
+SPIrx_GetStats(
+  unsigned rxindex,                     // Receiver index
+  SPIrxStats *pstats)                   // Output statistics
+{
+  if (rxindex >= numRx)
+  {
+    return false;
+  }
+
+  Capture *pcap = Cap[rxindex];
+
+  pstats->received = pcap->received;
+  pstats->overruns = pcap->ring.Overruns();
+  pstats->highwater = pcap->ring.HighWater();
+  pstats->ringsize = pcap->ring.Size();
+  pstats->live = pcap->rx->IsLive();
+  pstats->unrecorded = Writer ? Writer->Lost(rxindex) : 0;
+
+  return true;
+}
+
+
+//---------------------------------------------------------------------------
+// Get the pacer of the capture files that are replayed with their timing
+Pacer *                                 // Returns nullptr=none
+SPIrx_GetPacer()
+{
+  return Pace;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// END
+/////////////////////////////////////////////////////////////////////////////
@@ -9,6 +9,147 @@ See LICENSE for details.
 #pragma once
 
 
+/////////////////////////////////////////////////////////////////////////////
+// INCLUDES
+/////////////////////////////////////////////////////////////////////////////
+
+
+#include <cstdint>
+#include <cstddef>
+
+
+/////////////////////////////////////////////////////////////////////////////
+// MACROS
+/////////////////////////////////////////////////////////////////////////////
+
+
+#define SPIRX_MAX_CHANNELS 8            // Max number of receivers
+#define SPIRX_RING_SIZE (1 << 20)       // Capture ring size per receiver
+#define SPIRX_CHUNK_RING_SIZE (1 << 16) // Max chunks in ring per receiver
+#define SPIRX_MAX_SPAN 4096             // Min contiguous bytes in a span
+#define SPIRX_TIME_END UINT64_MAX       // Watermark of receiver that ended
+
+// Bit rate that's used to estimate when each byte arrived, if it's not
+// given on the command line. It only affects the times of the bytes
+// within a chunk; the time of the last byte of each chunk is measured.
+#define SPIRX_DEFAULT_BITRATE 1000000   // bits per second
+
+
+/////////////////////////////////////////////////////////////////////////////
+// TYPES
+/////////////////////////////////////////////////////////////////////////////
+
+
+//---------------------------------------------------------------------------
+// Receiver backend for one channel
+//
+// Each backend implements this interface to deliver the raw bytes that
+// were clocked in on one SPI data line. The bytes are delivered in the
+// order in which they arrived, already converted from LSB-first (as they
+// appear on the bus) to MSB-first.
+class SPIrxChannel
+{
+public:
+  virtual ~SPIrxChannel() {}
+
+public:
+  //-------------------------------------------------------------------------
+  // Open connection
+  //
+  // The meaning of the name depends on the backend: for the FT4222 it's
+  // the location ID as a hex number, for the replay backend it's a file
+  // name (or "-" for standard input).
+  virtual bool                          // Returns true=success
+  Open(
+    const char *name) = 0;              // Backend specific name
+
+public:
+  //-------------------------------------------------------------------------
+  // Close connection
+  virtual void Close() = 0;
+
+public:
+  //-------------------------------------------------------------------------
+  // Receive data
+  virtual bool                          // Returns true=success
+  Receive(
+    uint8_t *buffer,                    // Receive buffer
+    uint16_t *pbufsize) = 0;            // Input buf size, output rcvd bytes
+
+public:
+  //-------------------------------------------------------------------------
+  // Check if the source has run out of data
+  //
+  // Live devices never run out of data; recordings do.
+  virtual bool                          // Returns true=no more data
+  AtEnd()
+  {
+    return false;
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Check if the data is live
+  //
+  // Data from a live source is lost if it isn't read in time, so when the
+  // capture ring is full, the capture thread keeps reading and discards
+  // the data. For other sources, the capture thread waits instead.
+  virtual bool                          // Returns true=live source
+  IsLive()
+  {
+    return true;
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Get the time stamps of the data from the last call to Receive
+  //
+  // Recordings that have the original time stamps return them here, so
+  // the data gets the same times as when it was captured. Other backends
+  // return false, and the capture thread uses the current time.
+  virtual bool                          // Returns true=times available
+  RecordedTime(
+    uint64_t *,                         // Output time of last byte
+    uint64_t *)                         // Output time of previous poll
+  {
+    return false;
+  }
+};
+
+
+//---------------------------------------------------------------------------
+// Chunk of data that was received at one time
+//
+// The capture thread stores one of these for each time it gets data from
+// the receiver, so the time at which each byte arrived can be found.
+//
+// To keep the chunks small, the time is stored as the difference with the
+// previous chunk. Gaps that are too long for that are split up with chunks
+// that have no data.
+//
+// The bytes of a chunk arrived after the previous time the receiver was
+// polled, so that's the earliest possible time for each byte.
+struct SPIrxChunk
+{
+  uint32_t    dt;                       // ns since previous chunk
+  uint16_t    len;                      // Number of bytes; 0=time only
+  uint16_t    wait;                     // us since previous poll
+};
+
+
+//---------------------------------------------------------------------------
+// Capture statistics for one receiver
+struct SPIrxStats
+{
+  uint64_t    received;                 // Total bytes received
+  uint64_t    overruns;                 // Bytes dropped because ring full
+  size_t      highwater;                // Max bytes in ring at once
+  size_t      ringsize;                 // Ring capacity
+  bool        live;                     // True=data lost if not read in time
+  uint64_t    unrecorded;               // Bytes not written to capture file
+};
+
+
 /////////////////////////////////////////////////////////////////////////////
 // PUBLIC FUNCTIONS
 /////////////////////////////////////////////////////////////////////////////
@@ -16,6 +157,28 @@ See LICENSE for details.
 
 //---------------------------------------------------------------------------
 // Initialize SPI receiver
+//
+// The arguments are FT4222 location IDs (Windows only) and/or files to
+// replay: "-d" makes the following arguments locations, "-r" makes them
+// files. The default is locations. "-b <bits/s>" sets the bit rate of
+// the receivers that follow it, which is used to estimate the time of
+// each byte.
+//
+// "-c <file>" adds all the receivers of a capture file, with the time
+// stamps from the file; don't combine this with other receivers. "-w
+// <file>" writes the data of all receivers to a capture file. "-s
+// <seconds>" and "-o <opcode>" make the capture files that follow them
+// start at the block with that time, and/or at the first block after
+// that with a command with that opcode (in hex). "-x <speed>" replays the
+// capture files that follow it with the original timing (1) or faster or
+// slower, instead of as fast as possible; "-p" starts that paused.
+//
+// Receivers 0 and 1 are the front panel command and response lines; any
+// other receivers (e.g. the L3 bus or the deck UART) are shown as raw
+// data.
+//
+// Each receiver gets its own capture thread that continuously drains the
+// device into a ring buffer; SPIrx_ReadSpan reads from that ring.
 unsigned                                // Returns number of devices opened
 SPIrx_init(
   const char **argv);                   // Program arguments
@@ -27,12 +190,83 @@ void SPIrx_exit();
 
 
 //---------------------------------------------------------------------------
-// Receive data
+// Get the received data that hasn't been released yet
+//
+// The data is not copied: the pointer points into the capture ring. When
+// there are at least SPIRX_MAX_SPAN bytes available, the span is at least
+// that long, even if the data wraps around the end of the ring. The data
+// stays valid (and may be modified by the caller) until it's released.
 bool                                    // Returns true=success
-SPIrx_Receive(
+SPIrx_ReadSpan(
+  int index,                            // Receiver index
+  uint8_t **pp,                         // Output pointer to data
+  size_t *plen);                        // Output number of bytes
+
+
+//---------------------------------------------------------------------------
+// Release data that was processed
+void SPIrx_Release(
+  int index,                            // Receiver index
+  size_t len);                          // Number of bytes to release
+
+
+//---------------------------------------------------------------------------
+// Get the number of bytes that were received at the same time as the
+// first byte that wasn't released
+size_t                                  // Returns 0=no data
+SPIrx_ChunkLen(
+  int index);                           // Receiver index
+
+
+//---------------------------------------------------------------------------
+// Get the time at which a byte was received
+//
+// The time stamp of each chunk is taken when the receiver returns it, so
+// that's the time of the last byte. The times of the bytes before it are
+// estimated from the bit rate, but never earlier than the previous chunk.
+uint64_t                                // Returns ns since SPIrx_init
+SPIrx_Time(
   int index,                            // Receiver index
-  BYTE *buffer,                         // Receive buffer
-  WORD *pbufsize);                      // Input buf size, output rcvd bytes
+  size_t offset);                       // Offset from first unreleased byte
+
+
+//---------------------------------------------------------------------------
+// Get the time up to which all received data is in the ring
+//
+// Any data that's added to the ring later, has a later time. Call this
+// before SPIrx_ReadSpan to make sure that no data is missed. When the
+// receiver has stopped, this returns SPIRX_TIME_END.
+uint64_t                                // Returns ns since SPIrx_init
+SPIrx_Watermark(
+  int index);                           // Receiver index
+
+
+//---------------------------------------------------------------------------
+// Get capture statistics
+bool                                    // Returns true=success
+SPIrx_GetStats(
+  unsigned rxindex,                     // Receiver index
+  SPIrxStats *pstats);                  // Output statistics
+
+
+//---------------------------------------------------------------------------
+// Get the pacer of the capture files that are replayed with their timing
+class Pacer *                           // Returns nullptr=none
+SPIrx_GetPacer();
+
+
+//---------------------------------------------------------------------------
+// Backend factories
+#ifdef _WIN32
+SPIrxChannel *SPIrx_CreateFT4222();     // FTDI FT4222 in SPI slave mode
+void SPIrx_ListFT4222();                // Print list of FT4222 devices
+#endif
+SPIrxChannel *SPIrx_CreateReplay();     // Recorded data from file or pipe
+SPIrxChannel *SPIrx_CreateCapture(      // Receiver in a capture file
+  class CapReader *preader,             // Capture file
+  unsigned channel,                     // Receiver index in the file
+  size_t startblock = 0,                // First block to read
+  class Pacer *ppacer = nullptr);       // Replay timing, nullptr=none
 
 
 /////////////////////////////////////////////////////////////////////////////
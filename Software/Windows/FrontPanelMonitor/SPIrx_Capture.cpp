@@ -0,0 +1,304 @@
+/****************************************************************************
+SPI receiver that reads one receiver from a capture file
+(C) 2024 Jac Goudsmit
+Licensed under the MIT license.
+See LICENSE file for details.
+****************************************************************************/
+
+/*
+  A capture file has the data of all receivers of a session, with the
+  times at which they were received. Each receiver in the file gets a
+  receiver of this type; they all read the same mapped file, each with its
+  own cursor.
+
+  The data is delivered as fast as the caller asks for it, with the times
+  from the file, so the events are decoded with the same time stamps as
+  when the data was captured.
+
+  With a pacer (see Pacer.h), each record is delivered at the time it was
+  received, relative to the start of the replay, or faster or slower. The
+  receiver then acts like a live one: if the program can't keep up, data
+  is lost like with a real deck. While it's waiting for the next record,
+  the receiver reports the replay time as the time of its data, so the
+  merge doesn't hold back the data of the other receivers.
+
+  Reading can start at any block of the file, e.g. one that was found with
+  the index of the file. All receivers of a file should start at the same
+  block. The front panel lines may not start at the same byte then, so
+  each of them skips the bytes that were received before the other line
+  starts in the block. The merge realigns what's left of the difference
+  the same way as when a byte was lost.
+*/
+
+
+/////////////////////////////////////////////////////////////////////////////
+// INCLUDES
+/////////////////////////////////////////////////////////////////////////////
+
+
+#include <cstring>
+
+#include "CapFile.h"
+#include "Pacer.h"
+#include "SPIrx.h"
+
+
+/////////////////////////////////////////////////////////////////////////////
+// MACROS
+/////////////////////////////////////////////////////////////////////////////
+
+
+// Max time that Receive waits for the pacer
+#define MAX_WAIT 10000000ULL            // ns
+
+
+/////////////////////////////////////////////////////////////////////////////
+// LOCAL FUNCTIONS
+/////////////////////////////////////////////////////////////////////////////
+
+
+//---------------------------------------------------------------------------
+// Get the time of a byte, from the time of the last byte of its record
+static uint64_t ByteTime(
+  CapReader *preader,                   // Capture file
+  unsigned channel,                     // Receiver index in the file
+  uint64_t time,                        // Time of last byte of the record
+  size_t before)                        // Number of bytes after the byte
+{
+  unsigned bitrate = preader->Header()->channel[channel].bitrate;
+
+  return time - before * (8000000000ULL / (bitrate ? bitrate : SPIRX_DEFAULT_BITRATE));
+}
+
+
+//---------------------------------------------------------------------------
+// Get the time at which both front panel lines have data in a block
+static uint64_t                         // Returns time, 0=no need to skip
+LineStartTime(
+  CapReader *preader,                   // Capture file
+  size_t startblock)                    // First block to read
+{
+  uint64_t result = 0;
+
+  if ((!startblock) || (preader->Header()->numchannels < 2))
+  {
+    return 0;
+  }
+
+  for (unsigned channel = 0; channel < 2; channel++)
+  {
+    CapCursor cursor = {};
+    CapRecord rec;
+
+    preader->Seek(&cursor, startblock);
+
+    if ((preader->Next(&cursor, &rec, 1U << channel)) && (rec.len))
+    {
+      uint64_t first = ByteTime(preader, channel, rec.time, rec.len - 1);
+
+      if (first > result)
+      {
+        result = first;
+      }
+    }
+  }
+
+  return result;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// TYPES
+/////////////////////////////////////////////////////////////////////////////
+
+
+class CaptureReceiver : public SPIrxChannel
+{
+protected:
+  CapReader *preader;                   // Capture file
+  unsigned    channel;                  // Receiver index in the file
+  size_t      startblock;               // First block to read
+  Pacer      *ppacer;                   // Replay timing, nullptr=none
+  uint64_t    bytetime;                 // Time per byte, ns
+  CapCursor   cursor = {};              // Position in the file
+  CapRecord   rec = {};                 // Current record
+  size_t      used = 0;                 // Bytes delivered from rec
+  uint64_t    time = 0;                 // Time of last delivered byte
+  uint64_t    polltime = 0;             // Time of poll before that
+  uint64_t    skiptime = 0;             // Skip bytes before this, 0=none
+  bool        eof = false;              // True=no more records
+
+public:
+  //-------------------------------------------------------------------------
+  // Constructor
+  CaptureReceiver(
+    CapReader *preader,                 // Capture file
+    unsigned channel,                   // Receiver index in the file
+    size_t startblock,                  // First block to read
+    Pacer *ppacer)                      // Replay timing, nullptr=none
+    : preader(preader)
+    , channel(channel)
+    , startblock(startblock)
+    , ppacer(ppacer)
+  {
+    unsigned bitrate = preader->Header()->channel[channel].bitrate;
+
+    bytetime = 8000000000ULL / (bitrate ? bitrate : SPIRX_DEFAULT_BITRATE);
+  }
+
+
+public:
+  //-------------------------------------------------------------------------
+  // Open connection
+  //
+  // The name is only used in messages; the file is already open.
+  bool Open(const char *) override
+  {
+    preader->Seek(&cursor, startblock);
+    rec = {};
+    used = 0;
+    skiptime = (channel < 2) ? LineStartTime(preader, startblock) : 0;
+    eof = false;
+
+    return true;
+  }
+
+
+public:
+  //-------------------------------------------------------------------------
+  // Close connection
+  void Close() override
+  {
+    eof = true;
+  }
+
+
+public:
+  //-------------------------------------------------------------------------
+  // Receive data
+  bool Receive(                         // Returns true=success
+    uint8_t *buffer,                    // Receive buffer
+    uint16_t *pbufsize) override        // Input buf size, output rcvd bytes
+  {
+    if (!buffer || !pbufsize || !*pbufsize)
+    {
+      printf("Need buffer and size\n");
+      return false;
+    }
+
+    while (used == rec.len)
+    {
+      if ((eof) || (!preader->Next(&cursor, &rec, 1U << channel)))
+      {
+        eof = true;
+        *pbufsize = 0;
+        return true;
+      }
+
+      used = 0;
+
+      // Skip the bytes from before the other front panel line started
+      while ((skiptime) && (used < rec.len))
+      {
+        if (ByteTime(preader, channel, rec.time, rec.len - 1 - used) >= skiptime)
+        {
+          skiptime = 0;
+        }
+        else
+        {
+          used++;
+        }
+      }
+    }
+
+    size_t n = rec.len - used;
+    if (n > *pbufsize)
+    {
+      n = *pbufsize;
+    }
+
+    // If the record doesn't fit, the first part gets the time at which
+    // its last byte would have been received, so the bytes get the same
+    // times as if the record was delivered in one piece
+    uint64_t back = (rec.len - used - n) * bytetime;
+    uint64_t maxback = rec.time - rec.polltime;
+    uint64_t parttime = rec.time - ((back < maxback) ? back : maxback);
+
+    if ((ppacer) && (!ppacer->Wait(parttime, MAX_WAIT)))
+    {
+      // Not yet; everything before the replay time has been delivered
+      uint64_t position = ppacer->Position();
+
+      if ((position > time) && (position < parttime))
+      {
+        time = position;
+      }
+
+      *pbufsize = 0;
+      return true;
+    }
+
+    memcpy(buffer, rec.data + used, n);
+    used += n;
+    *pbufsize = (uint16_t)n;
+
+    time = parttime;
+    polltime = rec.polltime;
+
+    return true;
+  }
+
+
+public:
+  //-------------------------------------------------------------------------
+  // Check if the source has run out of data
+  bool AtEnd() override
+  {
+    return eof;
+  }
+
+
+public:
+  //-------------------------------------------------------------------------
+  // Check if the data is live
+  bool IsLive() override
+  {
+    return ppacer != nullptr;
+  }
+
+
+public:
+  //-------------------------------------------------------------------------
+  // Get the time stamps of the data from the last call to Receive
+  bool RecordedTime(
+    uint64_t *ptime,                    // Output time of last byte
+    uint64_t *ppolltime) override       // Output time of previous poll
+  {
+    *ptime = time;
+    *ppolltime = polltime;
+
+    return true;
+  }
+};
+
+
+/////////////////////////////////////////////////////////////////////////////
+// PUBLIC FUNCTIONS
+/////////////////////////////////////////////////////////////////////////////
+
+
+//---------------------------------------------------------------------------
+// Create a receiver that reads from a capture file
+SPIrxChannel *SPIrx_CreateCapture(
+  CapReader *preader,                   // Capture file
+  unsigned channel,                     // Receiver index in the file
+  size_t startblock,                    // First block to read
+  Pacer *ppacer)                        // Replay timing, nullptr=none
+{
+  return new CaptureReceiver(preader, channel, startblock, ppacer);
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// END
+/////////////////////////////////////////////////////////////////////////////
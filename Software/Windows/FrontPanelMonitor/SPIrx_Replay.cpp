@@ -0,0 +1,182 @@
+/****************************************************************************
+SPI receiver that replays recorded data from files or pipes
+(C) 2024 Jac Goudsmit
+Licensed under the MIT license.
+See LICENSE file for details.
+****************************************************************************/
+
+/*
+  This backend doesn't need any hardware: each channel reads the raw bytes
+  that were recorded from one SPI data line, in the same format as they
+  come out of the FT4222 (i.e. LSB-first). Data is delivered as fast as the
+  caller asks for it, so the decoder can be run many times faster than
+  real time, e.g. to measure throughput.
+
+  Named pipes work too, and "-" reads from standard input.
+
+  This file and the other platform independent modules can be built on
+  other operating systems than Windows, e.g. on Linux with:
+
+    gcc -std=c99 -O2 -c ../../Common/FrontPanelFramer.c \
+      ../../Common/FrontPanelOpcodes.c ../../Common/FrontPanelSequence.c
+    g++ -std=c++17 -O2 -pthread -o fpmon Main.cpp SPIrx.cpp SPIrx_Replay.cpp \
+      SPIrx_Capture.cpp CapFile.cpp Compress.cpp Pacer.cpp ByteOps.cpp \
+      Merge.cpp Decode.cpp ChangeFilter.cpp Latency.cpp Cadence.cpp \
+      Infer.cpp DeckState.cpp OutBuf.cpp VScreen.cpp Proc.cpp Proc_Dump.cpp \
+      Proc_Screen.cpp Proc_Stats.cpp Bench.cpp FrontPanelFramer.o \
+      FrontPanelOpcodes.o FrontPanelSequence.o
+
+  The shared files in Common are C, and have to be compiled as C.
+*/
+
+
+/////////////////////////////////////////////////////////////////////////////
+// INCLUDES
+/////////////////////////////////////////////////////////////////////////////
+
+
+#define _CRT_SECURE_NO_WARNINGS         // Allow fopen in MSVC
+
+#include <cstdio>
+#include <cstring>
+
+#include "ByteOps.h"
+#include "SPIrx.h"
+
+
+/////////////////////////////////////////////////////////////////////////////
+// TYPES
+/////////////////////////////////////////////////////////////////////////////
+
+
+class ReplayReceiver : public SPIrxChannel
+{
+protected:
+  FILE *f = nullptr;
+  bool eof = false;
+
+public:
+  //-------------------------------------------------------------------------
+  // Destructor
+  ~ReplayReceiver()
+  {
+    Close();
+  }
+
+
+public:
+  //-------------------------------------------------------------------------
+  // Open connection
+  bool Open(const char *name) override
+  {
+    Close();
+
+    if (!strcmp(name, "-"))
+    {
+      f = stdin;
+    }
+    else
+    {
+      f = fopen(name, "rb");
+      if (!f)
+      {
+        perror(name);
+        return false;
+      }
+    }
+
+    eof = false;
+
+    return true;
+  }
+
+
+public:
+  //-------------------------------------------------------------------------
+  // Close connection
+  void Close() override
+  {
+    if ((f) && (f != stdin))
+    {
+      fclose(f);
+    }
+
+    f = nullptr;
+  }
+
+
+public:
+  //-------------------------------------------------------------------------
+  // Receive data
+  bool Receive(                         // Returns true=success
+    uint8_t *buffer,                    // Receive buffer
+    uint16_t *pbufsize) override        // Input buf size, output rcvd bytes
+  {
+    if (!buffer || !pbufsize || !*pbufsize)
+    {
+      printf("Need buffer and size\n");
+      return false;
+    }
+
+    if ((!f) || (eof))
+    {
+      *pbufsize = 0;
+      return true;
+    }
+
+    size_t len = fread(buffer, 1, *pbufsize, f);
+    if (len < *pbufsize)
+    {
+      if (ferror(f))
+      {
+        printf("Error reading recorded data\n");
+        return false;
+      }
+
+      eof = (feof(f) != 0);
+    }
+
+    *pbufsize = (uint16_t)len;
+
+    ByteOps_ReverseBits(buffer, len);
+
+    return true;
+  }
+
+
+public:
+  //-------------------------------------------------------------------------
+  // Check if the source has run out of data
+  bool AtEnd() override
+  {
+    return eof;
+  }
+
+
+public:
+  //-------------------------------------------------------------------------
+  // Check if the data is live
+  bool IsLive() override
+  {
+    // Recordings don't get lost when we don't read them in time
+    return false;
+  }
+};
+
+
+/////////////////////////////////////////////////////////////////////////////
+// PUBLIC FUNCTIONS
+/////////////////////////////////////////////////////////////////////////////
+
+
+//---------------------------------------------------------------------------
+// Create a replay receiver
+SPIrxChannel *SPIrx_CreateReplay()
+{
+  return new ReplayReceiver;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// END
+/////////////////////////////////////////////////////////////////////////////
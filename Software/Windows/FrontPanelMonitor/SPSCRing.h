@@ -0,0 +1,273 @@
+/****************************************************************************
+Lock-free single-producer single-consumer ring buffer
+(C) 2024 Jac Goudsmit
+Licensed under the MIT license.
+See LICENSE for details.
+****************************************************************************/
+
+/*
+  One thread (the producer) puts items into the ring, another thread (the
+  consumer) takes them out. No locks are needed because each index is only
+  ever written by one side: the producer owns the head, the consumer owns
+  the tail.
+
+  The indexes increase forever (wrapping at the size of size_t) and are
+  masked to find the position in the storage, so the capacity must be a
+  power of two.
+
+  Data is transferred in spans so that the producer can receive directly
+  into the ring and the consumer can process the data where it is, without
+  any copying.
+
+  Optionally, the ring can have a mirror area behind the end of the
+  storage: whenever the producer writes items at the start of the storage,
+  they're also copied to the mirror area. That way, the consumer can
+  always see at least as many items as the mirror size as one contiguous
+  span, even if they wrap around the end of the storage. This is what
+  makes it possible to parse messages right where they are in the ring.
+  The cost is that the producer copies a small part of the data once,
+  instead of the consumer having to compact a linear buffer all the time.
+*/
+
+
+#pragma once
+
+
+/////////////////////////////////////////////////////////////////////////////
+// INCLUDES
+/////////////////////////////////////////////////////////////////////////////
+
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+
+/////////////////////////////////////////////////////////////////////////////
+// TYPES
+/////////////////////////////////////////////////////////////////////////////
+
+
+template <typename T>
+class SPSCRing
+{
+protected:
+  T                  *m_buf;            // Storage
+  size_t              m_size;           // Capacity, power of 2
+  size_t              m_mask;           // Capacity - 1
+  size_t              m_mirror;         // Size of mirror area after storage
+
+  // The indexes are on separate cache lines so the producer and consumer
+  // don't slow each other down
+  alignas(64) std::atomic<size_t> m_head; // Next index to write (producer)
+  alignas(64) std::atomic<size_t> m_tail; // Next index to read (consumer)
+
+  // Statistics, only written by the producer
+  alignas(64) std::atomic<size_t> m_highwater; // Max number of items stored
+  std::atomic<uint64_t> m_overruns;     // Items dropped because ring full
+
+public:
+  //-------------------------------------------------------------------------
+  // Constructor
+  SPSCRing(
+    size_t minsize,                     // Minimum capacity
+    size_t mirror = 0)                  // Min contiguous span for consumer
+  {
+    for (m_size = 1; m_size < minsize; m_size <<= 1)
+    {
+      // Nothing
+    }
+
+    m_mask = m_size - 1;
+    m_mirror = (mirror < m_size) ? mirror : m_size;
+    m_buf = new T[m_size + m_mirror];
+    m_head = 0;
+    m_tail = 0;
+    m_highwater = 0;
+    m_overruns = 0;
+  }
+
+
+public:
+  //-------------------------------------------------------------------------
+  // Destructor
+  ~SPSCRing()
+  {
+    delete[] m_buf;
+  }
+
+
+  SPSCRing(const SPSCRing &) = delete;
+  SPSCRing &operator=(const SPSCRing &) = delete;
+
+
+public:
+  //-------------------------------------------------------------------------
+  // Producer: get contiguous free space at the write position
+  size_t                                // Returns number of free items
+  WriteSpan(
+    T **pp)                             // Output pointer to free space
+  {
+    size_t head = m_head.load(std::memory_order_relaxed);
+    size_t tail = m_tail.load(std::memory_order_acquire);
+    size_t free = m_size - (head - tail);
+    size_t pos = head & m_mask;
+
+    if (free > m_size - pos)
+    {
+      free = m_size - pos;
+    }
+
+    *pp = m_buf + pos;
+
+    return free;
+  }
+
+
+public:
+  //-------------------------------------------------------------------------
+  // Producer: get the total number of free items, contiguous or not
+  size_t Free() const
+  {
+    return m_size - (m_head.load(std::memory_order_relaxed) - m_tail.load(std::memory_order_acquire));
+  }
+
+
+public:
+  //-------------------------------------------------------------------------
+  // Producer: make items available to the consumer
+  //
+  // The items must have been written to the span returned by WriteSpan.
+  void Commit(
+    size_t n)                           // Number of items written
+  {
+    size_t head = m_head.load(std::memory_order_relaxed);
+    size_t pos = head & m_mask;
+
+    // Copy anything that was written to the start of the storage, to the
+    // mirror area. The span never wraps so this is only one copy.
+    if (pos < m_mirror)
+    {
+      size_t end = (pos + n < m_mirror) ? pos + n : m_mirror;
+
+      for (size_t i = pos; i < end; i++)
+      {
+        m_buf[m_size + i] = m_buf[i];
+      }
+    }
+
+    head += n;
+
+    m_head.store(head, std::memory_order_release);
+
+    size_t used = head - m_tail.load(std::memory_order_relaxed);
+    if (used > m_highwater.load(std::memory_order_relaxed))
+    {
+      m_highwater.store(used, std::memory_order_relaxed);
+    }
+  }
+
+
+public:
+  //-------------------------------------------------------------------------
+  // Producer: count items that were dropped because the ring was full
+  void Overrun(
+    size_t n)                           // Number of items dropped
+  {
+    m_overruns.fetch_add(n, std::memory_order_relaxed);
+  }
+
+
+public:
+  //-------------------------------------------------------------------------
+  // Consumer: get number of items available for reading
+  size_t Available() const
+  {
+    return m_head.load(std::memory_order_acquire) - m_tail.load(std::memory_order_relaxed);
+  }
+
+
+public:
+  //-------------------------------------------------------------------------
+  // Consumer: get contiguous data at the read position
+  //
+  // If the ring has a mirror area, the span may extend into it; the
+  // consumer may modify the items in the span before releasing them.
+  size_t                                // Returns number of items
+  ReadSpan(
+    T **pp)                             // Output pointer to data
+  {
+    size_t tail = m_tail.load(std::memory_order_relaxed);
+    size_t avail = m_head.load(std::memory_order_acquire) - tail;
+    size_t pos = tail & m_mask;
+
+    if (avail > m_size + m_mirror - pos)
+    {
+      avail = m_size + m_mirror - pos;
+    }
+
+    *pp = m_buf + pos;
+
+    return avail;
+  }
+
+
+public:
+  //-------------------------------------------------------------------------
+  // Consumer: get an item at a distance from the read position
+  T *                                   // Returns nullptr=not available
+  Peek(
+    size_t index)                       // Number of items to skip
+  {
+    size_t tail = m_tail.load(std::memory_order_relaxed);
+
+    if (index >= m_head.load(std::memory_order_acquire) - tail)
+    {
+      return nullptr;
+    }
+
+    return m_buf + ((tail + index) & m_mask);
+  }
+
+
+public:
+  //-------------------------------------------------------------------------
+  // Consumer: give items back to the producer
+  void Release(
+    size_t n)                           // Number of items consumed
+  {
+    m_tail.store(m_tail.load(std::memory_order_relaxed) + n, std::memory_order_release);
+  }
+
+
+public:
+  //-------------------------------------------------------------------------
+  // Get the capacity
+  size_t Size() const
+  {
+    return m_size;
+  }
+
+
+public:
+  //-------------------------------------------------------------------------
+  // Get the highest number of items that were ever stored at the same time
+  size_t HighWater() const
+  {
+    return m_highwater.load(std::memory_order_relaxed);
+  }
+
+
+public:
+  //-------------------------------------------------------------------------
+  // Get the number of items that were dropped because the ring was full
+  uint64_t Overruns() const
+  {
+    return m_overruns.load(std::memory_order_relaxed);
+  }
+};
+
+
+/////////////////////////////////////////////////////////////////////////////
+// END
+/////////////////////////////////////////////////////////////////////////////
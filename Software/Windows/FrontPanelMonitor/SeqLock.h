@@ -0,0 +1,149 @@
+/****************************************************************************
+Sequence lock for sharing a snapshot between threads
+(C) 2024 Jac Goudsmit
+Licensed under the MIT license.
+See LICENSE for details.
+****************************************************************************/
+
+/*
+  One thread (the writer) stores a value from time to time, other threads
+  (the readers) get a copy of the latest value whenever they want. The
+  writer never waits for the readers: it increments a sequence number
+  before and after it changes the data, so the sequence number is odd
+  while the data is being changed. A reader copies the data and then
+  checks that the sequence number was even and didn't change while it was
+  copying; if it did, the reader simply tries again.
+
+  The sequence number also tells a reader whether there's anything new
+  since the last time it looked, without copying anything.
+
+  The data is stored as an array of atomic words so that the copying by
+  the readers while the writer changes it, is well-defined. The type of
+  the value must be trivially copyable.
+*/
+
+
+#pragma once
+
+
+/////////////////////////////////////////////////////////////////////////////
+// INCLUDES
+/////////////////////////////////////////////////////////////////////////////
+
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+#include <type_traits>
+
+
+/////////////////////////////////////////////////////////////////////////////
+// TYPES
+/////////////////////////////////////////////////////////////////////////////
+
+
+template <typename T>
+class SeqLock
+{
+  static_assert(std::is_trivially_copyable<T>::value, "SeqLock needs a trivially copyable type");
+
+protected:
+  static const size_t words = (sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+  alignas(64) std::atomic<uint32_t> m_seq; // Sequence number, odd=writing
+  std::atomic<uint64_t> m_data[words];  // Value
+
+public:
+  //-------------------------------------------------------------------------
+  // Constructor
+  SeqLock()
+  {
+    m_seq = 0;
+
+    for (size_t i = 0; i < words; i++)
+    {
+      m_data[i] = 0;
+    }
+  }
+
+
+  SeqLock(const SeqLock &) = delete;
+  SeqLock &operator=(const SeqLock &) = delete;
+
+
+public:
+  //-------------------------------------------------------------------------
+  // Writer: store a new value
+  void Store(
+    const T &value)                     // Value to store
+  {
+    uint64_t buf[words] = { 0 };
+    uint32_t seq = m_seq.load(std::memory_order_relaxed);
+
+    memcpy(buf, &value, sizeof(T));
+
+    m_seq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    for (size_t i = 0; i < words; i++)
+    {
+      m_data[i].store(buf[i], std::memory_order_relaxed);
+    }
+
+    m_seq.store(seq + 2, std::memory_order_release);
+  }
+
+
+public:
+  //-------------------------------------------------------------------------
+  // Reader: get the sequence number of the latest value
+  //
+  // The number changes every time a value is stored, so it can be used to
+  // check if there's a new value without copying it.
+  uint32_t Version() const
+  {
+    return m_seq.load(std::memory_order_acquire) & ~1U;
+  }
+
+
+public:
+  //-------------------------------------------------------------------------
+  // Reader: get a copy of the latest value
+  uint32_t                              // Returns sequence number of value
+  Load(
+    T *pvalue) const                    // Output value
+  {
+    uint64_t buf[words];
+
+    for (;;)
+    {
+      uint32_t seq = m_seq.load(std::memory_order_acquire);
+
+      if (seq & 1)
+      {
+        // The writer is busy; it won't take long
+        std::this_thread::yield();
+        continue;
+      }
+
+      for (size_t i = 0; i < words; i++)
+      {
+        buf[i] = m_data[i].load(std::memory_order_relaxed);
+      }
+
+      std::atomic_thread_fence(std::memory_order_acquire);
+
+      if (m_seq.load(std::memory_order_relaxed) == seq)
+      {
+        memcpy(pvalue, buf, sizeof(T));
+        return seq;
+      }
+    }
+  }
+};
+
+
+/////////////////////////////////////////////////////////////////////////////
+// END
+/////////////////////////////////////////////////////////////////////////////
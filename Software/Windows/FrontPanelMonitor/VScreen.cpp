@@ -0,0 +1,199 @@
+/****************************************************************************
+Virtual screen
+(C) 2024 Jac Goudsmit
+Licensed under the MIT license.
+See LICENSE for details.
+****************************************************************************/
+
+
+/////////////////////////////////////////////////////////////////////////////
+// INCLUDES
+/////////////////////////////////////////////////////////////////////////////
+
+
+#include <cstdarg>
+#include <cstdio>
+
+#include "VScreen.h"
+
+
+/////////////////////////////////////////////////////////////////////////////
+// PUBLIC FUNCTIONS
+/////////////////////////////////////////////////////////////////////////////
+
+
+//---------------------------------------------------------------------------
+// Constructor
+VScreen::VScreen(
+  unsigned rows,                        // Number of lines
+  unsigned cols)                        // Number of characters per line
+  : rows(rows)
+  , cols(cols)
+  , cells((size_t)rows * cols, ' ')
+  , shown((size_t)rows * cols, ' ')
+{
+}
+
+
+//---------------------------------------------------------------------------
+// Store characters
+unsigned                                // Returns column after the text
+VScreen::Put(
+  unsigned y,                           // Line
+  unsigned x,                           // Column
+  const char *s,                        // Characters
+  size_t n)                             // Number of characters
+{
+  if ((y < rows) && (x < cols))
+  {
+    size_t fit = (n < cols - x) ? n : cols - x;
+
+    memcpy(&cells[(size_t)y * cols + x], s, fit);
+  }
+
+  return x + (unsigned)n;
+}
+
+
+//---------------------------------------------------------------------------
+// Store text with printf formatting
+unsigned                                // Returns column after the text
+VScreen::Printf(
+  unsigned y,                           // Line
+  unsigned x,                           // Column
+  const char *fmt,                      // Format
+  ...)                                  // Arguments
+{
+  char s[256];
+  va_list ap;
+
+  va_start(ap, fmt);
+  int n = vsnprintf(s, sizeof(s), fmt, ap);
+  va_end(ap);
+
+  if (n < 0)
+  {
+    return x;
+  }
+
+  if ((size_t)n >= sizeof(s))
+  {
+    n = sizeof(s) - 1;
+  }
+
+  return Put(y, x, s, n);
+}
+
+
+//---------------------------------------------------------------------------
+// Store a string in quotes, with unprintable characters in hex
+unsigned                                // Returns column after the text
+VScreen::Escaped(
+  unsigned y,                           // Line
+  unsigned x,                           // Column
+  const uint8_t *begin,                 // First character
+  const uint8_t *end)                   // End of string
+{
+  x = Put(y, x, "\"", 1);
+
+  for (const uint8_t *s = begin; s != end; s++)
+  {
+    if ((*s < 32) || (*s >= 0x7E))
+    {
+      x = Printf(y, x, "\\x%02X", *s);
+    }
+    else
+    {
+      x = Put(y, x, (const char *)s, 1);
+    }
+  }
+
+  return Put(y, x, "\"", 1);
+}
+
+
+//---------------------------------------------------------------------------
+// Clear the rest of a line
+void VScreen::ClearEol(
+  unsigned y,                           // Line
+  unsigned x)                           // First column to clear
+{
+  if ((y < rows) && (x < cols))
+  {
+    memset(&cells[(size_t)y * cols + x], ' ', cols - x);
+  }
+}
+
+
+//---------------------------------------------------------------------------
+// Send the changes to the terminal
+bool                                    // Returns true=something was sent
+VScreen::Render(
+  OutBuf &out)                          // Output
+{
+  if (!cleared)
+  {
+    // 2J=clear screen, H=home, ?25l=cursor off
+    out.Str("\x1B[2J\x1B[H\x1B[?25l");
+    cleared = true;
+  }
+  else if (cells == shown)
+  {
+    return false;
+  }
+
+  // Begin synchronized update
+  out.Str("\x1B[?2026h");
+
+  for (unsigned y = 0; y < rows; y++)
+  {
+    char *want = &cells[(size_t)y * cols];
+    char *have = &shown[(size_t)y * cols];
+    unsigned x = 0;
+
+    while (x < cols)
+    {
+      if (want[x] == have[x])
+      {
+        x++;
+        continue;
+      }
+
+      // Find the end of the run, including short gaps of unchanged
+      // characters
+      unsigned begin = x;
+      unsigned end = x + 1;
+
+      for (x = end; (x < cols) && (x - end <= VSCREEN_MAX_GAP); x++)
+      {
+        if (want[x] != have[x])
+        {
+          end = x + 1;
+        }
+      }
+
+      // ESC [ <y> ; <x> H is cursor position
+      out.Str("\x1B[");
+      out.Dec(y + 1);
+      out.Char(';');
+      out.Dec(begin + 1);
+      out.Char('H');
+      out.Write(want + begin, end - begin);
+
+      memcpy(have + begin, want + begin, end - begin);
+
+      x = end;
+    }
+  }
+
+  // End synchronized update
+  out.Str("\x1B[?2026l");
+  out.Flush();
+
+  return true;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// END
+/////////////////////////////////////////////////////////////////////////////
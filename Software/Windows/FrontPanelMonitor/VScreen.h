@@ -0,0 +1,156 @@
+/****************************************************************************
+Virtual screen
+(C) 2024 Jac Goudsmit
+Licensed under the MIT license.
+See LICENSE for details.
+****************************************************************************/
+
+/*
+  The screen view shows a handful of lines that are updated many times per
+  second (VU meters, time, poll status), mostly with the same text as
+  before. Instead of sending every update to the terminal, the text is
+  written into an array of character cells here. When the screen is
+  rendered, the cells are compared with what the terminal is known to
+  show, and only the runs of characters that are different are sent, each
+  preceded by a cursor position sequence.
+
+  All changes of one render are sent in a single write, between the begin
+  and end sequences of the "synchronized output" mode, so terminals that
+  support it update the display all at once without flickering. Terminals
+  that don't support it ignore those sequences.
+
+  Rows and columns are counted from 0 here; the terminal counts from 1.
+  Text that doesn't fit is cut off at the edge, so it never wraps around
+  into the next line.
+*/
+
+
+#pragma once
+
+
+/////////////////////////////////////////////////////////////////////////////
+// INCLUDES
+/////////////////////////////////////////////////////////////////////////////
+
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "OutBuf.h"
+
+
+/////////////////////////////////////////////////////////////////////////////
+// MACROS
+/////////////////////////////////////////////////////////////////////////////
+
+
+// Unchanged characters between two changed runs on the same line are sent
+// again if there are no more than this many of them, because a cursor
+// position sequence would take about as many bytes
+#define VSCREEN_MAX_GAP 6
+
+
+/////////////////////////////////////////////////////////////////////////////
+// TYPES
+/////////////////////////////////////////////////////////////////////////////
+
+
+class VScreen
+{
+protected:
+  unsigned    rows;                     // Number of lines
+  unsigned    cols;                     // Number of characters per line
+  std::vector<char> cells;              // Text that should be shown
+  std::vector<char> shown;              // Text that the terminal shows
+  bool        cleared = false;          // True=terminal was initialized
+
+public:
+  //-------------------------------------------------------------------------
+  // Constructor
+  VScreen(
+    unsigned rows,                      // Number of lines
+    unsigned cols);                     // Number of characters per line
+
+public:
+  //-------------------------------------------------------------------------
+  // Store characters
+  unsigned                              // Returns column after the text
+  Put(
+    unsigned y,                         // Line
+    unsigned x,                         // Column
+    const char *s,                      // Characters
+    size_t n);                          // Number of characters
+
+public:
+  //-------------------------------------------------------------------------
+  // Store a string
+  unsigned                              // Returns column after the text
+  Str(
+    unsigned y,                         // Line
+    unsigned x,                         // Column
+    const char *s)                      // Nul-terminated string
+  {
+    return Put(y, x, s, strlen(s));
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Store text with printf formatting
+  unsigned                              // Returns column after the text
+  Printf(
+    unsigned y,                         // Line
+    unsigned x,                         // Column
+    const char *fmt,                    // Format
+    ...);                               // Arguments
+
+public:
+  //-------------------------------------------------------------------------
+  // Store a string in quotes, with unprintable characters in hex
+  unsigned                              // Returns column after the text
+  Escaped(
+    unsigned y,                         // Line
+    unsigned x,                         // Column
+    const uint8_t *begin,               // First character
+    const uint8_t *end);                // End of string
+
+public:
+  //-------------------------------------------------------------------------
+  // Clear the rest of a line
+  void ClearEol(
+    unsigned y,                         // Line
+    unsigned x);                        // First column to clear
+
+public:
+  //-------------------------------------------------------------------------
+  // Get the text that should be shown, one line after another
+  const char *Cells() const
+  {
+    return cells.data();
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Replace all the text that should be shown, e.g. by a copy of another
+  // virtual screen of the same size
+  void Load(
+    const char *src)                    // Rows * cols characters
+  {
+    memcpy(cells.data(), src, cells.size());
+  }
+
+public:
+  //-------------------------------------------------------------------------
+  // Send the changes to the terminal
+  //
+  // The first time, the terminal is cleared and the cursor is turned off.
+  bool                                  // Returns true=something was sent
+  Render(
+    OutBuf &out);                       // Output
+};
+
+
+/////////////////////////////////////////////////////////////////////////////
+// END
+/////////////////////////////////////////////////////////////////////////////